@@ -64,6 +64,7 @@ static bool disable_shutdown_check = false;
 static bool multi = false;
 static bool log_verbose = false;
 static bool unfiltered_log = false;
+static bool profiler_trace = false;
 bool opt_start_streaming = false;
 bool opt_start_recording = false;
 bool opt_studio_mode = false;
@@ -471,8 +472,20 @@ static void SaveProfilerData(const ProfilerSnapshot &snap)
 	BPtr<char> path = GetAppConfigPathPtr(dst.str().c_str());
 	if (!profiler_snapshot_dump_csv_gz(snap.get(), path))
 		blog(LOG_WARNING, "Could not save profiler data to '%s'", static_cast<const char *>(path));
+
+	if (!profiler_trace)
+		return;
+
+	string trace_name = "obs-studio/profiler_data/" + currentLogFile.substr(0, pos) + ".trace.json";
+	BPtr<char> trace_path = GetAppConfigPathPtr(trace_name.c_str());
+	if (!profiler_trace_dump_json(trace_path))
+		blog(LOG_WARNING, "Could not save profiler trace to '%s'", static_cast<const char *>(trace_path));
 }
 
+/* the trace keeps the latest 4M scope events (up to 128 MB), older ones are
+ * overwritten */
+#define PROFILER_TRACE_MAX_EVENTS (4 * 1024 * 1024)
+
 static auto ProfilerFree = [](void *) {
 	profiler_stop();
 
@@ -503,7 +516,10 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 
 	std::unique_ptr<void, decltype(ProfilerFree)> prof_release(static_cast<void *>(&ProfilerFree), ProfilerFree);
 
-	profiler_start();
+	if (profiler_trace)
+		profiler_start_event_mode(PROFILER_TRACE_MAX_EVENTS);
+	else
+		profiler_start();
 	profile_register_root(run_program_init, 0);
 
 	ScopeProfiler prof{run_program_init};
@@ -991,6 +1007,9 @@ int main(int argc, char *argv[])
 		} else if (arg_is(argv[i], "--unfiltered_log", nullptr)) {
 			unfiltered_log = true;
 
+		} else if (arg_is(argv[i], "--profiler-trace", nullptr)) {
+			profiler_trace = true;
+
 		} else if (arg_is(argv[i], "--startstreaming", nullptr)) {
 			opt_start_streaming = true;
 
@@ -1055,7 +1074,8 @@ int main(int argc, char *argv[])
 				"--disable-shutdown-check: Disable unclean shutdown detection.\n"
 				"--verbose: Make log more verbose.\n"
 				"--always-on-top: Start in 'always on top' mode.\n\n"
-				"--unfiltered_log: Make log unfiltered.\n\n"
+				"--unfiltered_log: Make log unfiltered.\n"
+				"--profiler-trace: Use the low-overhead profiler and save a Chrome trace alongside the profiler data.\n\n"
 				"--disable-updater: Disable built-in updater (Windows/Mac only)\n\n"
 				"--disable-missing-files-check: Disable the missing files dialog which can appear on startup.\n\n";
 
@@ -1111,6 +1131,7 @@ int main(int argc, char *argv[])
 
 	delete_safe_mode_sentinel();
 	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	bmem_log_leaks();
 	base_set_log_handler(nullptr, nullptr);
 
 	if (restart || restart_safe) {
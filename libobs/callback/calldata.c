@@ -18,6 +18,7 @@
 
 #include "../util/bmem.h"
 #include "../util/base.h"
+#include "../util/threading.h"
 
 #include "calldata.h"
 
@@ -236,3 +237,52 @@ bool calldata_get_string(const calldata_t *data, const char *name, const char **
 	*str = cd_serialize_string(&pos);
 	return true;
 }
+
+/* ------------------------------------------------------------------------- */
+/* pooled calldata */
+
+#define CALLDATA_POOL_MAX 32
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static calldata_t *pool[CALLDATA_POOL_MAX];
+static size_t pool_num = 0;
+
+calldata_t *calldata_acquire(void)
+{
+	calldata_t *data = NULL;
+
+	pthread_mutex_lock(&pool_mutex);
+	if (pool_num)
+		data = pool[--pool_num];
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (!data)
+		data = calldata_create();
+	return data;
+}
+
+void calldata_release(calldata_t *data)
+{
+	if (!data)
+		return;
+
+	calldata_clear(data);
+
+	pthread_mutex_lock(&pool_mutex);
+	if (pool_num < CALLDATA_POOL_MAX && !data->fixed) {
+		pool[pool_num++] = data;
+		data = NULL;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (data)
+		calldata_destroy(data);
+}
+
+void calldata_pool_free(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+	while (pool_num)
+		calldata_destroy(pool[--pool_num]);
+	pthread_mutex_unlock(&pool_mutex);
+}
@@ -96,6 +96,16 @@ static inline void calldata_destroy(calldata_t *cd)
 	bfree(cd);
 }
 
+/*
+ *   Pooled calldata objects keep their stack allocation between uses, so
+ * frequently emitted signals that don't fit a fixed stack can avoid
+ * reallocating it every time.  Released objects are cleared and recycled.
+ */
+
+EXPORT calldata_t *calldata_acquire(void);
+EXPORT void calldata_release(calldata_t *data);
+EXPORT void calldata_pool_free(void);
+
 /* ------------------------------------------------------------------------- */
 /* NOTE: 'get' functions return true only if parameter exists, and is the
  *       same type.  They return false otherwise. */
@@ -16,6 +16,7 @@
 
 #include "../util/darray.h"
 #include "../util/threading.h"
+#include "../util/uthash.h"
 
 #include "decl.h"
 #include "signal.h"
@@ -33,14 +34,15 @@ struct signal_info {
 	pthread_mutex_t mutex;
 	bool signalling;
 
-	struct signal_info *next;
+	signal_handler_t *handler;
+	UT_hash_handle hh;
 };
 
-static inline struct signal_info *signal_info_create(struct decl_info *info)
+static inline struct signal_info *signal_info_create(signal_handler_t *handler, struct decl_info *info)
 {
-	struct signal_info *si = bmalloc(sizeof(struct signal_info));
+	struct signal_info *si = bzalloc(sizeof(struct signal_info));
 	si->func = *info;
-	si->next = NULL;
+	si->handler = handler;
 	si->signalling = false;
 	da_init(si->callbacks);
 
@@ -85,7 +87,7 @@ struct global_callback_info {
 };
 
 struct signal_handler {
-	struct signal_info *first;
+	struct signal_info *signals;
 	pthread_mutex_t mutex;
 	volatile long refs;
 
@@ -93,21 +95,11 @@ struct signal_handler {
 	pthread_mutex_t global_callbacks_mutex;
 };
 
-static struct signal_info *getsignal(signal_handler_t *handler, const char *name, struct signal_info **p_last)
+static inline struct signal_info *getsignal(signal_handler_t *handler, const char *name)
 {
-	struct signal_info *signal, *last = NULL;
+	struct signal_info *signal;
 
-	signal = handler->first;
-	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
-			break;
-
-		last = signal;
-		signal = signal->next;
-	}
-
-	if (p_last)
-		*p_last = last;
+	HASH_FIND_STR(handler->signals, name, signal);
 	return signal;
 }
 
@@ -116,7 +108,7 @@ static struct signal_info *getsignal(signal_handler_t *handler, const char *name
 signal_handler_t *signal_handler_create(void)
 {
 	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
-	handler->first = NULL;
+	handler->signals = NULL;
 	handler->refs = 1;
 
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
@@ -137,11 +129,11 @@ signal_handler_t *signal_handler_create(void)
 
 static void signal_handler_actually_destroy(signal_handler_t *handler)
 {
-	struct signal_info *sig = handler->first;
-	while (sig != NULL) {
-		struct signal_info *next = sig->next;
+	struct signal_info *sig, *tmp;
+
+	HASH_ITER (hh, handler->signals, sig, tmp) {
+		HASH_DELETE(hh, handler->signals, sig);
 		signal_info_destroy(sig);
-		sig = next;
 	}
 
 	da_free(handler->global_callbacks);
@@ -160,7 +152,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -170,17 +162,17 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, func.name);
 	if (sig) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
-		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
+		sig = signal_info_create(handler, &func);
+		if (sig)
+			HASH_ADD_KEYPTR(hh, handler->signals, sig->func.name, strlen(sig->func.name), sig);
 		else
-			last->next = sig;
+			success = false;
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -191,7 +183,7 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 static void signal_handler_connect_internal(signal_handler_t *handler, const char *signal, signal_callback_t callback,
 					    void *data, bool keep_ref)
 {
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	struct signal_callback cb_data = {callback, data, false, keep_ref};
 	size_t idx;
 
@@ -199,7 +191,7 @@ static void signal_handler_connect_internal(signal_handler_t *handler, const cha
 		return;
 
 	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
+	sig = getsignal(handler, signal);
 	pthread_mutex_unlock(&handler->mutex);
 
 	if (!sig) {
@@ -242,7 +234,7 @@ static inline struct signal_info *getsignal_locked(signal_handler_t *handler, co
 		return NULL;
 
 	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
+	sig = getsignal(handler, name);
 	pthread_mutex_unlock(&handler->mutex);
 
 	return sig;
@@ -287,14 +279,21 @@ void signal_handler_remove_current(void)
 		current_global_cb->remove = true;
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal, calldata_t *params)
+signal_handle_t *signal_handler_get_handle(signal_handler_t *handler, const char *signal)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	return getsignal_locked(handler, signal);
+}
+
+void signal_handle_emit(signal_handle_t *sig, calldata_t *params)
+{
+	signal_handler_t *handler;
 	long remove_refs = 0;
 
 	if (!sig)
 		return;
 
+	handler = sig->handler;
+
 	pthread_mutex_lock(&sig->mutex);
 	sig->signalling = true;
 
@@ -329,7 +328,7 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal, callda
 			if (!cb->remove) {
 				cb->signaling++;
 				current_global_cb = cb;
-				cb->callback(cb->data, signal, params);
+				cb->callback(cb->data, sig->func.name, params);
 				current_global_cb = NULL;
 				cb->signaling--;
 			}
@@ -350,6 +349,11 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal, callda
 	}
 }
 
+void signal_handler_signal(signal_handler_t *handler, const char *signal, calldata_t *params)
+{
+	signal_handle_emit(getsignal_locked(handler, signal), params);
+}
+
 void signal_handler_connect_global(signal_handler_t *handler, global_signal_callback_t callback, void *data)
 {
 	struct global_callback_info cb_data = {callback, data, 0, false};
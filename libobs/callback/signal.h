@@ -32,7 +32,9 @@ extern "C" {
  */
 
 struct signal_handler;
+struct signal_info;
 typedef struct signal_handler signal_handler_t;
+typedef struct signal_info signal_handle_t;
 typedef void (*global_signal_callback_t)(void *, const char *, calldata_t *);
 typedef void (*signal_callback_t)(void *, calldata_t *);
 
@@ -68,6 +70,15 @@ EXPORT void signal_handler_remove_current(void);
 
 EXPORT void signal_handler_signal(signal_handler_t *handler, const char *signal, calldata_t *params);
 
+/*
+ *   Signal handles are resolved once by name and stay valid for the lifetime
+ * of the signal handler, allowing frequently emitted signals to skip the name
+ * lookup entirely.
+ */
+
+EXPORT signal_handle_t *signal_handler_get_handle(signal_handler_t *handler, const char *signal);
+EXPORT void signal_handle_emit(signal_handle_t *handle, calldata_t *params);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,9 +15,28 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <string.h>
+
 #include "format-conversion.h"
 
+/* x86 builds use the native intrinsics so the AVX2 ones can be used next to
+ * SSE2, everything else gets SSE2 through simde */
+#if (defined(_M_X64) && !defined(_M_ARM64EC)) || defined(_M_IX86) || defined(__x86_64__) || \
+	(defined(__i386__) && defined(__SSE2__))
+#define FORMAT_CONVERSION_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_FUNC __attribute__((target("avx2")))
+#else
+#define AVX2_FUNC
+#endif
+#else
 #include "../util/sse-intrin.h"
+#endif
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
@@ -25,14 +44,25 @@
 #define get_m128_32_0(val) (*((uint32_t *)&val))
 #define get_m128_32_1(val) (*(((uint32_t *)&val) + 1))
 
+/* planes and linesizes don't have to be aligned */
+static FORCE_INLINE void store_u32(uint8_t *dst, uint32_t val)
+{
+	memcpy(dst, &val, sizeof(val));
+}
+
+static FORCE_INLINE void store_u16(uint8_t *dst, uint16_t val)
+{
+	memcpy(dst, &val, sizeof(val));
+}
+
 #define pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, mask, sh)                           \
 	do {                                                                                        \
 		__m128i pack_val = _mm_packs_epi32(_mm_srli_si128(_mm_and_si128(line1, mask), sh),  \
 						   _mm_srli_si128(_mm_and_si128(line2, mask), sh)); \
 		pack_val = _mm_packus_epi16(pack_val, pack_val);                                    \
                                                                                                     \
-		*(uint32_t *)(lum_plane + lum_pos0) = get_m128_32_0(pack_val);                      \
-		*(uint32_t *)(lum_plane + lum_pos1) = get_m128_32_1(pack_val);                      \
+		store_u32(lum_plane + lum_pos0, get_m128_32_0(pack_val));                           \
+		store_u32(lum_plane + lum_pos1, get_m128_32_1(pack_val));                           \
 	} while (false)
 
 #define pack_val(lum_plane, lum_pos0, lum_pos1, line1, line2, mask)                                         \
@@ -40,8 +70,8 @@
 		__m128i pack_val = _mm_packs_epi32(_mm_and_si128(line1, mask), _mm_and_si128(line2, mask)); \
 		pack_val = _mm_packus_epi16(pack_val, pack_val);                                            \
                                                                                                             \
-		*(uint32_t *)(lum_plane + lum_pos0) = get_m128_32_0(pack_val);                              \
-		*(uint32_t *)(lum_plane + lum_pos1) = get_m128_32_1(pack_val);                              \
+		store_u32(lum_plane + lum_pos0, get_m128_32_0(pack_val));                                   \
+		store_u32(lum_plane + lum_pos1, get_m128_32_1(pack_val));                                   \
 	} while (false)
 
 #define pack_ch_1plane(uv_plane, chroma_pos, line1, line2, uv_mask)                                            \
@@ -52,7 +82,7 @@
 		avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));                                 \
 		avg_val = _mm_packus_epi16(avg_val, avg_val);                                                  \
                                                                                                                \
-		*(uint32_t *)(uv_plane + chroma_pos) = get_m128_32_0(avg_val);                                 \
+		store_u32(uv_plane + chroma_pos, get_m128_32_0(avg_val));                                      \
 	} while (false)
 
 #define pack_ch_2plane(u_plane, v_plane, chroma_pos, line1, line2, uv_mask)                                    \
@@ -68,8 +98,8 @@
                                                                                                                \
 		packed_vals = get_m128_32_0(avg_val);                                                          \
                                                                                                                \
-		*(uint16_t *)(u_plane + chroma_pos) = (uint16_t)(packed_vals);                                 \
-		*(uint16_t *)(v_plane + chroma_pos) = (uint16_t)(packed_vals >> 16);                           \
+		store_u16(u_plane + chroma_pos, (uint16_t)(packed_vals));                                      \
+		store_u16(v_plane + chroma_pos, (uint16_t)(packed_vals >> 16));                                \
 	} while (false)
 
 static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
@@ -77,35 +107,273 @@ static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
 	return a < b ? a : b;
 }
 
+/* ------------------------------------------------------------------------- */
+/* AVX2 variants, picked at runtime.  Each one handles as many 8 pixel groups
+ * of a row (pair) as it can and returns how far it got; the SSE2 loops and
+ * the scalar tails finish the rest, and all of them produce identical
+ * output. */
+
+#ifdef FORMAT_CONVERSION_AVX2
+static bool cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+/* 0 = not checked yet, 1 = use AVX2, 2 = don't */
+static int avx2_state = 0;
+
+static inline bool use_avx2(void)
+{
+	int state = avx2_state;
+
+	/* racing initializations all store the same value */
+	if (!state)
+		avx2_state = state = cpu_has_avx2() ? 1 : 2;
+	return state == 1;
+}
+
+/* stores the low byte of each 32 bit element of a to dst0 and of b to dst1 */
+AVX2_FUNC static inline void store_low_bytes_avx2(uint8_t *dst0, uint8_t *dst1, __m256i a, __m256i b)
+{
+	/* packs work per 128 bit lane: [a0-3 b0-3 | a4-7 b4-7] */
+	__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_setzero_si256());
+	packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+
+	__m128i vals = _mm_shuffle_epi32(_mm256_castsi256_si128(packed), _MM_SHUFFLE(3, 1, 2, 0));
+	_mm_storel_epi64((__m128i *)dst0, vals);
+	_mm_storel_epi64((__m128i *)dst1, _mm_srli_si128(vals, 8));
+}
+
+/* sums the U and V samples of each 2x2 block into the even 32 bit elements
+ * of each lane and divides by 4, as U in the low and V in the high word */
+AVX2_FUNC static inline __m256i average_uv_avx2(__m256i line1, __m256i line2)
+{
+	const __m256i uv_mask = _mm256_set1_epi16(0x00FF);
+
+	__m256i sum = _mm256_add_epi16(_mm256_and_si256(line1, uv_mask), _mm256_and_si256(line2, uv_mask));
+	sum = _mm256_add_epi16(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm256_srli_epi16(sum, 2);
+	return _mm256_shuffle_epi32(sum, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+AVX2_FUNC static uint32_t compress_uyvx_to_i420_avx2(const uint8_t *img, uint32_t in_linesize, uint8_t *lum0,
+						     uint8_t *lum1, uint8_t *u, uint8_t *v, uint32_t width)
+{
+	const __m256i lum_mask = _mm256_set1_epi32(0x0000FF00);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i line1 = _mm256_loadu_si256((const __m256i *)(img + x * 4));
+		__m256i line2 = _mm256_loadu_si256((const __m256i *)(img + x * 4 + in_linesize));
+
+		store_low_bytes_avx2(lum0 + x, lum1 + x, _mm256_srli_epi32(_mm256_and_si256(line1, lum_mask), 8),
+				     _mm256_srli_epi32(_mm256_and_si256(line2, lum_mask), 8));
+
+		__m256i uv = _mm256_shufflelo_epi16(average_uv_avx2(line1, line2), _MM_SHUFFLE(3, 1, 2, 0));
+		uv = _mm256_packus_epi16(uv, uv);
+
+		uint32_t uv0 = (uint32_t)_mm256_extract_epi32(uv, 0);
+		uint32_t uv1 = (uint32_t)_mm256_extract_epi32(uv, 4);
+		store_u32(u + x / 2, (uv0 & 0xFFFF) | (uv1 << 16));
+		store_u32(v + x / 2, (uv0 >> 16) | (uv1 & 0xFFFF0000));
+	}
+
+	return x;
+}
+
+AVX2_FUNC static uint32_t compress_uyvx_to_nv12_avx2(const uint8_t *img, uint32_t in_linesize, uint8_t *lum0,
+						     uint8_t *lum1, uint8_t *uv_plane, uint32_t width)
+{
+	const __m256i lum_mask = _mm256_set1_epi32(0x0000FF00);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i line1 = _mm256_loadu_si256((const __m256i *)(img + x * 4));
+		__m256i line2 = _mm256_loadu_si256((const __m256i *)(img + x * 4 + in_linesize));
+
+		store_low_bytes_avx2(lum0 + x, lum1 + x, _mm256_srli_epi32(_mm256_and_si256(line1, lum_mask), 8),
+				     _mm256_srli_epi32(_mm256_and_si256(line2, lum_mask), 8));
+
+		__m256i uv = average_uv_avx2(line1, line2);
+		uv = _mm256_packus_epi16(uv, uv);
+
+		store_u32(uv_plane + x, (uint32_t)_mm256_extract_epi32(uv, 0));
+		store_u32(uv_plane + x + 4, (uint32_t)_mm256_extract_epi32(uv, 4));
+	}
+
+	return x;
+}
+
+AVX2_FUNC static uint32_t convert_uyvx_to_i444_avx2(const uint8_t *img, uint32_t in_linesize, uint8_t *lum0,
+						    uint8_t *lum1, uint8_t *u0, uint8_t *u1, uint8_t *v0, uint8_t *v1,
+						    uint32_t width)
+{
+	const __m256i lum_mask = _mm256_set1_epi32(0x0000FF00);
+	const __m256i u_mask = _mm256_set1_epi32(0x000000FF);
+	const __m256i v_mask = _mm256_set1_epi32(0x00FF0000);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		__m256i line1 = _mm256_loadu_si256((const __m256i *)(img + x * 4));
+		__m256i line2 = _mm256_loadu_si256((const __m256i *)(img + x * 4 + in_linesize));
+
+		store_low_bytes_avx2(lum0 + x, lum1 + x, _mm256_srli_epi32(_mm256_and_si256(line1, lum_mask), 8),
+				     _mm256_srli_epi32(_mm256_and_si256(line2, lum_mask), 8));
+		store_low_bytes_avx2(u0 + x, u1 + x, _mm256_and_si256(line1, u_mask), _mm256_and_si256(line2, u_mask));
+		store_low_bytes_avx2(v0 + x, v1 + x, _mm256_srli_epi32(_mm256_and_si256(line1, v_mask), 16),
+				     _mm256_srli_epi32(_mm256_and_si256(line2, v_mask), 16));
+	}
+
+	return x;
+}
+
+/* width_d2 is in chroma samples, so each iteration does 4 of them */
+AVX2_FUNC static uint32_t decompress_420_avx2(const uint8_t *lum0, const uint8_t *lum1, const uint8_t *chroma0,
+					      const uint8_t *chroma1, uint32_t *output0, uint32_t *output1,
+					      uint32_t width_d2)
+{
+	uint32_t x;
+
+	for (x = 0; x + 4 <= width_d2; x += 4) {
+		int u_vals, v_vals;
+		memcpy(&u_vals, chroma0 + x, sizeof(u_vals));
+		memcpy(&v_vals, chroma1 + x, sizeof(v_vals));
+
+		__m128i u = _mm_cvtsi32_si128(u_vals);
+		__m128i v = _mm_cvtsi32_si128(v_vals);
+		__m256i out = _mm256_or_si256(_mm256_slli_epi32(_mm256_cvtepu8_epi32(_mm_unpacklo_epi8(u, u)), 8),
+					      _mm256_cvtepu8_epi32(_mm_unpacklo_epi8(v, v)));
+
+		__m256i y0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(lum0 + x * 2)));
+		__m256i y1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(lum1 + x * 2)));
+
+		_mm256_storeu_si256((__m256i *)(output0 + x * 2), _mm256_or_si256(_mm256_slli_epi32(y0, 16), out));
+		_mm256_storeu_si256((__m256i *)(output1 + x * 2), _mm256_or_si256(_mm256_slli_epi32(y1, 16), out));
+	}
+
+	return x;
+}
+
+AVX2_FUNC static uint32_t decompress_nv12_avx2(const uint8_t *lum0, const uint8_t *lum1, const uint8_t *chroma,
+					       uint32_t *output0, uint32_t *output1, uint32_t width_d2)
+{
+	uint32_t x;
+
+	for (x = 0; x + 4 <= width_d2; x += 4) {
+		__m128i uv = _mm_loadl_epi64((const __m128i *)(chroma + x * 2));
+		__m256i out = _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_unpacklo_epi16(uv, uv)), 8);
+
+		__m256i y0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(lum0 + x * 2)));
+		__m256i y1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(lum1 + x * 2)));
+
+		_mm256_storeu_si256((__m256i *)(output0 + x * 2), _mm256_or_si256(y0, out));
+		_mm256_storeu_si256((__m256i *)(output1 + x * 2), _mm256_or_si256(y1, out));
+	}
+
+	return x;
+}
+
+/* expands 4 packed 4:2:2 pixel pairs per iteration; the shuffle copies the
+ * second luma sample over the first one of each output pair */
+AVX2_FUNC static uint32_t decompress_422_avx2(const uint32_t *input32, uint32_t *output32, uint32_t width_d2,
+					      bool leading_lum)
+{
+	const __m256i shuffle = leading_lum ? _mm256_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7, 8, 9,
+							       10, 11, 10, 9, 10, 11, 12, 13, 14, 15, 14, 13, 14, 15)
+					    : _mm256_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7, 8, 9,
+							       10, 11, 8, 11, 10, 11, 12, 13, 14, 15, 12, 15, 14, 15);
+	uint32_t x;
+
+	for (x = 0; x + 4 <= width_d2; x += 4) {
+		__m256i in = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(input32 + x)));
+
+		_mm256_storeu_si256((__m256i *)(output32 + x * 2), _mm256_shuffle_epi8(in, shuffle));
+	}
+
+	return x;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static FORCE_INLINE void compress_uyvx_tail(const uint8_t *img, uint32_t in_linesize, uint8_t *lum0, uint8_t *lum1,
+					    uint32_t x, uint32_t width, uint8_t *u, uint8_t *v)
+{
+	const uint8_t *px0 = img + x * 4;
+	const uint8_t *px1 = px0 + in_linesize;
+
+	lum0[x] = px0[1];
+	lum1[x] = px1[1];
+
+	/* an odd last column averages its single column pair */
+	if (x + 1 < width) {
+		lum0[x + 1] = px0[5];
+		lum1[x + 1] = px1[5];
+		*u = (uint8_t)((px0[0] + px0[4] + px1[0] + px1[4]) >> 2);
+		*v = (uint8_t)((px0[2] + px0[6] + px1[2] + px1[6]) >> 2);
+	} else {
+		*u = (uint8_t)((px0[0] + px1[0]) >> 1);
+		*v = (uint8_t)((px0[2] + px1[2]) >> 1);
+	}
+}
+
 void compress_uyvx_to_i420(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
 			   uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane = output[0];
-	uint8_t *u_plane = output[1];
-	uint8_t *v_plane = output[2];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t width = min_uint32(in_linesize / 4, out_linesize[0]);
 	uint32_t y;
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
 
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
-
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
-			pack_ch_2plane(u_plane, v_plane, chroma_y_pos + (x >> 1), line1, line2, uv_mask);
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *img_row = input + y * in_linesize;
+		uint8_t *lum_row = output[0] + y * out_linesize[0];
+		uint8_t *u_row = output[1] + (y >> 1) * out_linesize[1];
+		uint8_t *v_row = output[2] + (y >> 1) * out_linesize[2];
+		uint32_t x = 0;
+
+#ifdef FORMAT_CONVERSION_AVX2
+		if (avx2)
+			x = compress_uyvx_to_i420_avx2(img_row, in_linesize, lum_row, lum_row + out_linesize[0], u_row,
+						       v_row, width);
+#endif
+
+		for (; x + 4 <= width; x += 4) {
+			const uint8_t *img = img_row + x * 4;
+
+			__m128i line1 = _mm_loadu_si128((const __m128i *)img);
+			__m128i line2 = _mm_loadu_si128((const __m128i *)(img + in_linesize));
+
+			pack_shift(lum_row, x, x + out_linesize[0], line1, line2, lum_mask, 1);
+			pack_ch_2plane(u_row, v_row, (x >> 1), line1, line2, uv_mask);
 		}
+
+		for (; x < width; x += 2)
+			compress_uyvx_tail(img_row, in_linesize, lum_row, lum_row + out_linesize[0], x, width,
+					   u_row + (x >> 1), v_row + (x >> 1));
 	}
 }
 
@@ -114,61 +382,98 @@ void compress_uyvx_to_nv12(const uint8_t *input, uint32_t in_linesize, uint32_t
 {
 	uint8_t *lum_plane = output[0];
 	uint8_t *chroma_plane = output[1];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t width = min_uint32(in_linesize / 4, out_linesize[0]);
 	uint32_t y;
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i uv_mask = _mm_set1_epi16(0x00FF);
 
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
+
 	for (y = start_y; y < end_y; y += 2) {
 		uint32_t y_pos = y * in_linesize;
 		uint32_t chroma_y_pos = (y >> 1) * out_linesize[1];
 		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
+		uint32_t x = 0;
 
-		for (x = 0; x < width; x += 4) {
+#ifdef FORMAT_CONVERSION_AVX2
+		if (avx2)
+			x = compress_uyvx_to_nv12_avx2(input + y_pos, in_linesize, lum_plane + lum_y_pos,
+						       lum_plane + lum_y_pos + out_linesize[0],
+						       chroma_plane + chroma_y_pos, width);
+#endif
+
+		for (; x + 4 <= width; x += 4) {
 			const uint8_t *img = input + y_pos + x * 4;
 			uint32_t lum_pos0 = lum_y_pos + x;
 			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+			__m128i line1 = _mm_loadu_si128((const __m128i *)img);
+			__m128i line2 = _mm_loadu_si128((const __m128i *)(img + in_linesize));
 
 			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
 			pack_ch_1plane(chroma_plane, chroma_y_pos + x, line1, line2, uv_mask);
 		}
+
+		for (; x < width; x += 2) {
+			uint8_t *uv = chroma_plane + chroma_y_pos + x;
+
+			compress_uyvx_tail(input + y_pos, in_linesize, lum_plane + lum_y_pos,
+					   lum_plane + lum_y_pos + out_linesize[0], x, width, uv, uv + 1);
+		}
 	}
 }
 
 void convert_uyvx_to_i444(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
 			  uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane = output[0];
-	uint8_t *u_plane = output[1];
-	uint8_t *v_plane = output[2];
-	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
+	uint32_t width = min_uint32(in_linesize / 4, out_linesize[0]);
 	uint32_t y;
 
 	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
 	__m128i u_mask = _mm_set1_epi32(0x000000FF);
 	__m128i v_mask = _mm_set1_epi32(0x00FF0000);
 
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos = y * in_linesize;
-		uint32_t lum_y_pos = y * out_linesize[0];
-		uint32_t x;
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
 
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x * 4;
-			uint32_t lum_pos0 = lum_y_pos + x;
-			uint32_t lum_pos1 = lum_pos0 + out_linesize[0];
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *img_row = input + y * in_linesize;
+		uint8_t *lum_row = output[0] + y * out_linesize[0];
+		uint8_t *u_row = output[1] + y * out_linesize[1];
+		uint8_t *v_row = output[2] + y * out_linesize[2];
+		uint32_t x = 0;
+
+#ifdef FORMAT_CONVERSION_AVX2
+		if (avx2)
+			x = convert_uyvx_to_i444_avx2(img_row, in_linesize, lum_row, lum_row + out_linesize[0], u_row,
+						      u_row + out_linesize[1], v_row, v_row + out_linesize[2], width);
+#endif
+
+		for (; x + 4 <= width; x += 4) {
+			const uint8_t *img = img_row + x * 4;
+
+			__m128i line1 = _mm_loadu_si128((const __m128i *)img);
+			__m128i line2 = _mm_loadu_si128((const __m128i *)(img + in_linesize));
+
+			pack_shift(lum_row, x, x + out_linesize[0], line1, line2, lum_mask, 1);
+			pack_val(u_row, x, x + out_linesize[1], line1, line2, u_mask);
+			pack_shift(v_row, x, x + out_linesize[2], line1, line2, v_mask, 2);
+		}
 
-			__m128i line1 = _mm_load_si128((const __m128i *)img);
-			__m128i line2 = _mm_load_si128((const __m128i *)(img + in_linesize));
+		for (; x < width; x++) {
+			const uint8_t *px0 = img_row + x * 4;
+			const uint8_t *px1 = px0 + in_linesize;
 
-			pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, lum_mask, 1);
-			pack_val(u_plane, lum_pos0, lum_pos1, line1, line2, u_mask);
-			pack_shift(v_plane, lum_pos0, lum_pos1, line1, line2, v_mask, 2);
+			lum_row[x] = px0[1];
+			lum_row[x + out_linesize[0]] = px1[1];
+			u_row[x] = px0[0];
+			u_row[x + out_linesize[1]] = px1[0];
+			v_row[x] = px0[2];
+			v_row[x + out_linesize[2]] = px1[2];
 		}
 	}
 }
@@ -181,19 +486,35 @@ void decompress_420(const uint8_t *const input[], const uint32_t in_linesize[],
 	uint32_t height_d2 = end_y / 2;
 	uint32_t y;
 
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
+
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
 		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		lum0 = input[0] + y * 2 * in_linesize[0];
 		lum1 = lum0 + in_linesize[0];
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+#ifdef FORMAT_CONVERSION_AVX2
+		if (avx2) {
+			x = decompress_420_avx2(lum0, lum1, chroma0, chroma1, output0, output1, width_d2);
+			chroma0 += x;
+			chroma1 += x;
+			lum0 += x * 2;
+			lum1 += x * 2;
+			output0 += x * 2;
+			output1 += x * 2;
+		}
+#endif
+
+		for (; x < width_d2; x++) {
 			uint32_t out;
 			out = (*(chroma0++) << 8) | *(chroma1++);
 
@@ -214,11 +535,15 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 	uint32_t height_d2 = end_y / 2;
 	uint32_t y;
 
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
+
 	for (y = start_y_d2; y < height_d2; y++) {
 		const uint16_t *chroma;
 		register const uint8_t *lum0, *lum1;
 		register uint32_t *output0, *output1;
-		uint32_t x;
+		uint32_t x = 0;
 
 		chroma = (const uint16_t *)(input[1] + y * in_linesize[1]);
 		lum0 = input[0] + y * 2 * in_linesize[0];
@@ -226,7 +551,18 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 		output0 = (uint32_t *)(output + y * 2 * out_linesize);
 		output1 = (uint32_t *)((uint8_t *)output0 + out_linesize);
 
-		for (x = 0; x < width_d2; x++) {
+#ifdef FORMAT_CONVERSION_AVX2
+		if (avx2) {
+			x = decompress_nv12_avx2(lum0, lum1, (const uint8_t *)chroma, output0, output1, width_d2);
+			chroma += x;
+			lum0 += x * 2;
+			lum1 += x * 2;
+			output0 += x * 2;
+			output1 += x * 2;
+		}
+#endif
+
+		for (; x < width_d2; x++) {
 			uint32_t out = *(chroma++) << 8;
 
 			*(output0++) = *(lum0++) | out;
@@ -241,19 +577,32 @@ void decompress_nv12(const uint8_t *const input[], const uint32_t in_linesize[],
 void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y, uint8_t *output,
 		    uint32_t out_linesize, bool leading_lum)
 {
-	uint32_t width_d2 = min_uint32(in_linesize, out_linesize) / 2;
+	/* pixel pairs: 4 bytes in, 8 bytes out */
+	uint32_t width_d2 = min_uint32(in_linesize / 4, out_linesize / 8);
 	uint32_t y;
 
 	register const uint32_t *input32;
 	register const uint32_t *input32_end;
 	register uint32_t *output32;
 
+#ifdef FORMAT_CONVERSION_AVX2
+	bool avx2 = use_avx2();
+#endif
+
 	if (leading_lum) {
 		for (y = start_y; y < end_y; y++) {
 			input32 = (const uint32_t *)(input + y * in_linesize);
 			input32_end = input32 + width_d2;
 			output32 = (uint32_t *)(output + y * out_linesize);
 
+#ifdef FORMAT_CONVERSION_AVX2
+			if (avx2) {
+				uint32_t done = decompress_422_avx2(input32, output32, width_d2, true);
+				input32 += done;
+				output32 += done * 2;
+			}
+#endif
+
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
@@ -272,6 +621,14 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y
 			input32_end = input32 + width_d2;
 			output32 = (uint32_t *)(output + y * out_linesize);
 
+#ifdef FORMAT_CONVERSION_AVX2
+			if (avx2) {
+				uint32_t done = decompress_422_avx2(input32, output32, width_d2, false);
+				input32 += done;
+				output32 += done * 2;
+			}
+#endif
+
 			while (input32 < input32_end) {
 				register uint32_t dw = *input32;
 
@@ -286,3 +643,63 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+
+void format_conversion_set_avx2(bool enable)
+{
+#ifdef FORMAT_CONVERSION_AVX2
+	avx2_state = enable && cpu_has_avx2() ? 1 : 2;
+#else
+	UNUSED_PARAMETER(enable);
+#endif
+}
+
+/* bands much smaller than this cost more to hand out than to convert */
+#define MIN_BAND_ROWS 32
+
+struct conversion_bands {
+	format_conversion_band_t convert;
+	void *param;
+	uint32_t start_y;
+	uint32_t end_y;
+	uint32_t band_rows;
+};
+
+static void convert_band(void *param, size_t idx)
+{
+	struct conversion_bands *bands = param;
+	uint32_t start_y = bands->start_y + (uint32_t)idx * bands->band_rows;
+	uint32_t end_y = min_uint32(start_y + bands->band_rows, bands->end_y);
+
+	bands->convert(bands->param, start_y, end_y);
+}
+
+void format_conversion_run_bands(os_task_pool_t *pool, format_conversion_band_t convert, void *param,
+				 uint32_t start_y, uint32_t end_y)
+{
+	struct conversion_bands bands = {convert, param, start_y, end_y, 0};
+	uint32_t rows = end_y > start_y ? end_y - start_y : 0;
+	uint32_t count;
+
+	if (!pool || rows <= MIN_BAND_ROWS) {
+		if (rows)
+			convert(param, start_y, end_y);
+		return;
+	}
+
+	/* two bands per thread (the caller included) so threads that finish
+	 * early can pick up the slack; even heights keep 4:2:0 row pairs in
+	 * the same band */
+	count = (uint32_t)(os_task_pool_threads(pool) + 1) * 2;
+	bands.band_rows = (rows + count - 1) / count;
+	if (bands.band_rows < MIN_BAND_ROWS)
+		bands.band_rows = MIN_BAND_ROWS;
+	bands.band_rows = (bands.band_rows + 1) & ~1U;
+	count = (rows + bands.band_rows - 1) / bands.band_rows;
+
+	/* the pool is shared, and while another thread is using it converting
+	 * on this one is quicker than queueing up behind it */
+	if (!os_task_pool_try_run(pool, convert_band, &bands, count))
+		convert(param, start_y, end_y);
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/c99defs.h"
+#include "../util/task.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +46,28 @@ EXPORT void decompress_420(const uint8_t *const input[], const uint32_t in_lines
 EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize, uint32_t start_y, uint32_t end_y,
 			   uint8_t *output, uint32_t out_linesize, bool leading_lum);
 
+/*
+ * The conversions above pick AVX2 code paths at runtime when the CPU supports
+ * them, and produce the same output either way.  Disabling them is meant for
+ * comparing and benchmarking against the SSE2 paths.
+ */
+
+EXPORT void format_conversion_set_avx2(bool enable);
+
+/*
+ * Splits a conversion of rows [start_y, end_y) into bands of an even number of
+ * rows and runs them on the threads of a task pool and the calling thread.
+ * convert is called once per band with its row range, so any of the functions
+ * above can be wrapped.  Without a pool, for small heights, or while the pool
+ * is busy with another thread's bands, convert is called once for the whole
+ * range on the calling thread.
+ */
+
+typedef void (*format_conversion_band_t)(void *param, uint32_t start_y, uint32_t end_y);
+
+EXPORT void format_conversion_run_bands(os_task_pool_t *pool, format_conversion_band_t convert, void *param,
+					uint32_t start_y, uint32_t end_y);
+
 #ifdef __cplusplus
 }
 #endif
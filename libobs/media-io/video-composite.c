@@ -0,0 +1,760 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "video-composite.h"
+#include "format-conversion.h"
+#include "../util/bmem.h"
+#include "../util/sse-intrin.h"
+
+static bool use_simd = true;
+
+void video_composite_set_simd(bool enable)
+{
+	use_simd = enable;
+}
+
+/* x / 255, rounded, for x up to 255 * 255 */
+static inline uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sampling                                                                   */
+
+/* bilinear weights have 7 bits so two weighted pixels still fit in 16 bits */
+#define WEIGHT_BITS 7
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+struct sample {
+	/* the pixel left of (or above) the sample position */
+	int32_t index;
+	/* WEIGHT_ONE - f in the low 16 bits, f in the high 16 bits, where f is
+	 * the weight of the pixel after index */
+	uint32_t weights;
+};
+
+/* Maps a position in source pixels (pixel centres at +0.5) to a sample.
+ * Positions are clamped to the pixels [first, last] like the clamp address
+ * mode of the renderer clamps them to the texture. */
+static inline struct sample get_sample(double pos, int32_t first, int32_t last, bool bilinear)
+{
+	struct sample sample = {0, WEIGHT_ONE};
+	int32_t index;
+
+	if (!bilinear) {
+		index = (int32_t)floor(pos);
+		sample.index = index < first ? first : (index > last ? last : index);
+		return sample;
+	}
+
+	pos -= 0.5;
+	if (pos <= (double)first) {
+		sample.index = first;
+		return sample;
+	}
+	if (pos >= (double)last) {
+		sample.index = last;
+		return sample;
+	}
+
+	index = (int32_t)floor(pos);
+	uint32_t f = (uint32_t)lround((pos - (double)index) * WEIGHT_ONE);
+	if (f == WEIGHT_ONE) {
+		index++;
+		f = 0;
+	}
+
+	sample.index = index;
+	sample.weights = (WEIGHT_ONE - f) | (f << 16);
+	return sample;
+}
+
+static inline uint32_t next_weight(uint32_t weights)
+{
+	return weights >> 16;
+}
+
+static inline int32_t clamp_coord(double value, int32_t min, int32_t max)
+{
+	if (!(value > (double)min))
+		return min;
+	if (value > (double)max)
+		return max;
+	return (int32_t)value;
+}
+
+/* ------------------------------------------------------------------------- */
+/* row kernels                                                                */
+
+/* dst = a + (b - a) * weight, over bytes */
+static void lerp_row(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size, uint32_t weight)
+{
+	size_t i = 0;
+
+	if (use_simd) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i wa = _mm_set1_epi16((short)(WEIGHT_ONE - weight));
+		const __m128i wb = _mm_set1_epi16((short)weight);
+		const __m128i round = _mm_set1_epi16(WEIGHT_ONE / 2);
+
+		for (; i + 16 <= size; i += 16) {
+			__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+						   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+						   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, round), WEIGHT_BITS);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, round), WEIGHT_BITS);
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+		}
+	}
+
+	for (; i < size; i++)
+		dst[i] = (uint8_t)((a[i] * (WEIGHT_ONE - weight) + b[i] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS);
+}
+
+/* the weighted sum of the pixels at index and index + 1 in the low four
+ * 16-bit lanes */
+static inline __m128i sample_pixel_sse2(const uint8_t *span, const struct sample *sample)
+{
+	__m128i pixels = _mm_loadl_epi64((const __m128i *)(span + (size_t)sample->index * 4));
+	__m128i weights = _mm_cvtsi32_si128((int)sample->weights);
+
+	pixels = _mm_unpacklo_epi8(pixels, _mm_setzero_si128());
+	weights = _mm_unpacklo_epi16(weights, weights);
+	weights = _mm_unpacklo_epi32(weights, weights);
+
+	__m128i products = _mm_mullo_epi16(pixels, weights);
+	return _mm_add_epi16(products, _mm_srli_si128(products, 8));
+}
+
+/* horizontal filtering of a span of source pixels into one pixel per column */
+static void sample_row(uint8_t *dst, const uint8_t *span, const struct sample *columns, uint32_t count, bool bilinear)
+{
+	uint32_t x = 0;
+
+	if (!bilinear) {
+		for (; x < count; x++)
+			memcpy(dst + (size_t)x * 4, span + (size_t)columns[x].index * 4, 4);
+		return;
+	}
+
+	if (use_simd) {
+		const __m128i round = _mm_set1_epi16(WEIGHT_ONE / 2);
+
+		for (; x + 4 <= count; x += 4) {
+			__m128i lo = _mm_unpacklo_epi64(sample_pixel_sse2(span, &columns[x]),
+							sample_pixel_sse2(span, &columns[x + 1]));
+			__m128i hi = _mm_unpacklo_epi64(sample_pixel_sse2(span, &columns[x + 2]),
+							sample_pixel_sse2(span, &columns[x + 3]));
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, round), WEIGHT_BITS);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, round), WEIGHT_BITS);
+			_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4), _mm_packus_epi16(lo, hi));
+		}
+	}
+
+	for (; x < count; x++) {
+		const uint8_t *p = span + (size_t)columns[x].index * 4;
+		const uint32_t w0 = columns[x].weights & 0xFFFF;
+		const uint32_t w1 = next_weight(columns[x].weights);
+		uint8_t *out = dst + (size_t)x * 4;
+
+		for (int c = 0; c < 4; c++)
+			out[c] = (uint8_t)((p[c] * w0 + p[c + 4] * w1 + WEIGHT_ONE / 2) >> WEIGHT_BITS);
+	}
+}
+
+/* blends two pixels in 16-bit lanes, src has its alpha lanes set to 255 */
+static inline __m128i blend_pixels_sse2(__m128i src, __m128i dst, __m128i alpha)
+{
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i c255 = _mm_set1_epi16(255);
+
+	alpha = _mm_shufflelo_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(src, alpha), _mm_mullo_epi16(dst, _mm_sub_epi16(c255, alpha)));
+	sum = _mm_add_epi16(sum, c128);
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 8)), 8);
+}
+
+static void blend_row(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+	uint32_t x = 0;
+
+	if (use_simd) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+
+		for (; x + 4 <= count; x += 4) {
+			__m128i s = _mm_loadu_si128((const __m128i *)(src + (size_t)x * 4));
+			__m128i alpha = _mm_and_si128(s, alpha_mask);
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, alpha_mask)) == 0xFFFF) {
+				_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4), s);
+				continue;
+			}
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, zero)) == 0xFFFF)
+				continue;
+
+			__m128i d = _mm_loadu_si128((const __m128i *)(dst + (size_t)x * 4));
+			__m128i s1 = _mm_or_si128(s, alpha_mask);
+			__m128i lo = blend_pixels_sse2(_mm_unpacklo_epi8(s1, zero), _mm_unpacklo_epi8(d, zero),
+						       _mm_unpacklo_epi8(s, zero));
+			__m128i hi = blend_pixels_sse2(_mm_unpackhi_epi8(s1, zero), _mm_unpackhi_epi8(d, zero),
+						       _mm_unpackhi_epi8(s, zero));
+			_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4), _mm_packus_epi16(lo, hi));
+		}
+	}
+
+	for (; x < count; x++) {
+		const uint8_t *s = src + (size_t)x * 4;
+		uint8_t *d = dst + (size_t)x * 4;
+		const uint32_t a = s[3];
+		const uint32_t ia = 255 - a;
+
+		d[0] = (uint8_t)div255(s[0] * a + d[0] * ia);
+		d[1] = (uint8_t)div255(s[1] * a + d[1] * ia);
+		d[2] = (uint8_t)div255(s[2] * a + d[2] * ia);
+		d[3] = (uint8_t)div255(255 * a + d[3] * ia);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* compositing                                                                */
+
+struct layer_plan {
+	const struct video_composite_layer *layer;
+	bool bilinear;
+
+	/* the canvas area the layer covers */
+	int32_t x0, x1;
+	int32_t y0, y1;
+
+	/* the source pixels the layer reads */
+	int32_t sx1;
+	int32_t sy0, sy1;
+	double scale_y;
+
+	/* one sample per covered column, relative to span_start.  the span
+	 * has one more pixel than the columns need so the pixel after every
+	 * sample can be read */
+	struct sample *columns;
+	int32_t span_start;
+	int32_t span_width;
+
+	/* the columns map to consecutive source pixels without filtering */
+	bool direct;
+};
+
+struct composite_data {
+	uint8_t *canvas;
+	uint32_t linesize;
+	uint32_t width;
+
+	struct layer_plan *plans;
+	size_t count;
+
+	size_t max_span;
+	size_t max_columns;
+};
+
+static bool plan_layer(struct layer_plan *plan, const struct video_composite_layer *layer, uint32_t width,
+		       uint32_t height)
+{
+	if (!layer->data || !layer->width || !layer->height)
+		return false;
+	if (!(layer->src_cx > 0.0f) || !(layer->src_cy > 0.0f) || layer->dst_cx == 0.0f || layer->dst_cy == 0.0f)
+		return false;
+
+	const double src_x = layer->src_x;
+	const double src_y = layer->src_y;
+	const double dst_x = layer->dst_x;
+	const double dst_y = layer->dst_y;
+	const double scale_x = (double)layer->src_cx / (double)layer->dst_cx;
+
+	const int32_t sx0 = clamp_coord(floor(src_x), 0, (int32_t)layer->width);
+	const int32_t sx1 = clamp_coord(ceil(src_x + layer->src_cx), 0, (int32_t)layer->width);
+	const int32_t sy0 = clamp_coord(floor(src_y), 0, (int32_t)layer->height);
+	const int32_t sy1 = clamp_coord(ceil(src_y + layer->src_cy), 0, (int32_t)layer->height);
+	if (sx1 <= sx0 || sy1 <= sy0)
+		return false;
+
+	/* a pixel is covered when its centre is inside the destination */
+	const double left = fmin(dst_x, dst_x + layer->dst_cx);
+	const double right = fmax(dst_x, dst_x + layer->dst_cx);
+	const double top = fmin(dst_y, dst_y + layer->dst_cy);
+	const double bottom = fmax(dst_y, dst_y + layer->dst_cy);
+	int32_t x0 = clamp_coord(ceil(left - 0.5), 0, (int32_t)width);
+	int32_t x1 = clamp_coord(ceil(right - 0.5), 0, (int32_t)width);
+	int32_t y0 = clamp_coord(ceil(top - 0.5), 0, (int32_t)height);
+	int32_t y1 = clamp_coord(ceil(bottom - 0.5), 0, (int32_t)height);
+
+	if (layer->clip) {
+		const int64_t clip_x1 = (int64_t)layer->clip_x + layer->clip_cx;
+		const int64_t clip_y1 = (int64_t)layer->clip_y + layer->clip_cy;
+
+		if (x0 < layer->clip_x)
+			x0 = layer->clip_x;
+		if (y0 < layer->clip_y)
+			y0 = layer->clip_y;
+		if (x1 > clip_x1)
+			x1 = (int32_t)clip_x1;
+		if (y1 > clip_y1)
+			y1 = (int32_t)clip_y1;
+	}
+
+	if (x1 <= x0 || y1 <= y0)
+		return false;
+
+	plan->layer = layer;
+	plan->bilinear = layer->filter == VIDEO_COMPOSITE_BILINEAR;
+	plan->x0 = x0;
+	plan->x1 = x1;
+	plan->y0 = y0;
+	plan->y1 = y1;
+	plan->sx1 = sx1;
+	plan->sy0 = sy0;
+	plan->sy1 = sy1;
+	plan->scale_y = (double)layer->src_cy / (double)layer->dst_cy;
+	plan->columns = bmalloc(sizeof(struct sample) * (size_t)(x1 - x0));
+	plan->direct = true;
+
+	int32_t min_index = INT32_MAX;
+	int32_t max_index = INT32_MIN;
+	int32_t first_index = 0;
+
+	for (int32_t x = x0; x < x1; x++) {
+		const double pos = src_x + ((double)x + 0.5 - dst_x) * scale_x;
+		struct sample sample = get_sample(pos, sx0, sx1 - 1, plan->bilinear);
+
+		if (x == x0)
+			first_index = sample.index;
+		if (sample.index < min_index)
+			min_index = sample.index;
+		if (sample.index > max_index)
+			max_index = sample.index;
+		if (next_weight(sample.weights) || sample.index != first_index + (x - x0))
+			plan->direct = false;
+
+		plan->columns[x - x0] = sample;
+	}
+
+	for (int32_t x = x0; x < x1; x++)
+		plan->columns[x - x0].index -= min_index;
+
+	plan->span_start = min_index;
+	plan->span_width = max_index - min_index + 2;
+	return true;
+}
+
+static void draw_layer_row(const struct layer_plan *plan, uint8_t *canvas_row, int32_t y, uint8_t *span,
+			   uint8_t *samples)
+{
+	const struct video_composite_layer *layer = plan->layer;
+
+	if (y < plan->y0 || y >= plan->y1)
+		return;
+
+	const double pos = layer->src_y + ((double)y + 0.5 - layer->dst_y) * plan->scale_y;
+	const struct sample row = get_sample(pos, plan->sy0, plan->sy1 - 1, plan->bilinear);
+	const uint32_t weight = next_weight(row.weights);
+	const uint32_t count = (uint32_t)(plan->x1 - plan->x0);
+
+	const uint8_t *top = layer->data + (size_t)row.index * layer->linesize + (size_t)plan->span_start * 4;
+	const uint8_t *src;
+
+	if (plan->direct && !weight) {
+		src = top;
+	} else {
+		const int32_t available = plan->sx1 - plan->span_start;
+		const int32_t pixels = plan->span_width < available ? plan->span_width : available;
+
+		if (weight)
+			lerp_row(span, top, top + layer->linesize, (size_t)pixels * 4, weight);
+		else
+			memcpy(span, top, (size_t)pixels * 4);
+
+		/* repeats the last pixel of the layer for the samples at its
+		 * right edge */
+		if (pixels < plan->span_width)
+			memcpy(span + (size_t)pixels * 4, span + (size_t)(pixels - 1) * 4, 4);
+
+		if (plan->direct) {
+			src = span;
+		} else {
+			sample_row(samples, span, plan->columns, count, plan->bilinear);
+			src = samples;
+		}
+	}
+
+	uint8_t *dst = canvas_row + (size_t)plan->x0 * 4;
+	if (layer->opaque)
+		memcpy(dst, src, (size_t)count * 4);
+	else
+		blend_row(dst, src, count);
+}
+
+static void composite_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	const struct composite_data *data = param;
+	uint8_t *span = bmalloc(data->max_span * 4 + 16);
+	uint8_t *samples = bmalloc(data->max_columns * 4 + 16);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		uint8_t *row = data->canvas + (size_t)y * data->linesize;
+
+		memset(row, 0, (size_t)data->width * 4);
+
+		for (size_t i = 0; i < data->count; i++)
+			draw_layer_row(&data->plans[i], row, (int32_t)y, span, samples);
+	}
+
+	bfree(span);
+	bfree(samples);
+}
+
+void video_composite(uint8_t *canvas, uint32_t linesize, uint32_t width, uint32_t height,
+		     const struct video_composite_layer *layers, size_t count, os_task_pool_t *pool)
+{
+	struct composite_data data = {
+		.canvas = canvas,
+		.linesize = linesize,
+		.width = width,
+	};
+
+	if (count)
+		data.plans = bmalloc(sizeof(struct layer_plan) * count);
+
+	for (size_t i = 0; i < count; i++) {
+		struct layer_plan *plan = &data.plans[data.count];
+
+		if (!plan_layer(plan, &layers[i], width, height))
+			continue;
+
+		if ((size_t)plan->span_width > data.max_span)
+			data.max_span = (size_t)plan->span_width;
+		if ((size_t)(plan->x1 - plan->x0) > data.max_columns)
+			data.max_columns = (size_t)(plan->x1 - plan->x0);
+		data.count++;
+	}
+
+	format_conversion_run_bands(pool, composite_band, &data, 0, height);
+
+	for (size_t i = 0; i < data.count; i++)
+		bfree(data.plans[i].columns);
+	bfree(data.plans);
+}
+
+/* ------------------------------------------------------------------------- */
+/* frame conversion                                                           */
+
+#define COEFF_BITS 13
+
+struct yuv_coefficients {
+	/* R, G and B from Y, U and V */
+	int32_t c[3][3];
+	/* includes the rounding */
+	int32_t offset[3];
+};
+
+struct convert_data {
+	uint8_t *dst;
+	uint32_t dst_linesize;
+	const uint8_t *const *data;
+	const uint32_t *linesize;
+	enum video_format format;
+	uint32_t width;
+	struct yuv_coefficients coeffs;
+};
+
+bool video_composite_format_supported(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_Y800:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_BGR3:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void get_yuv_coefficients(struct yuv_coefficients *coeffs, const float matrix[16])
+{
+	/* the matrix works on values from 0 to 1, the coefficients on 8-bit
+	 * values, so only the offsets are scaled */
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			long c = lrintf(matrix[i * 4 + j] * (float)(1 << COEFF_BITS));
+			coeffs->c[i][j] = c < INT16_MIN ? INT16_MIN : (c > INT16_MAX ? INT16_MAX : (int32_t)c);
+		}
+
+		coeffs->offset[i] = (int32_t)lrintf(matrix[i * 4 + 3] * 255.0f * (float)(1 << COEFF_BITS)) +
+				    (1 << (COEFF_BITS - 1));
+	}
+}
+
+static inline uint8_t clamp_u8(int32_t value)
+{
+	return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline __m128i yuv_channel_sse2(__m128i yu_lo, __m128i yu_hi, __m128i v_lo, __m128i v_hi,
+				       const struct yuv_coefficients *coeffs, int channel)
+{
+	const int32_t *c = coeffs->c[channel];
+	const __m128i c_yu = _mm_set1_epi32((int)((uint32_t)(uint16_t)c[0] | ((uint32_t)(uint16_t)c[1] << 16)));
+	const __m128i c_v = _mm_set1_epi32((int)(uint32_t)(uint16_t)c[2]);
+	const __m128i offset = _mm_set1_epi32(coeffs->offset[channel]);
+
+	__m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yu_lo, c_yu), _mm_madd_epi16(v_lo, c_v)), offset);
+	__m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yu_hi, c_yu), _mm_madd_epi16(v_hi, c_v)), offset);
+	lo = _mm_srai_epi32(lo, COEFF_BITS);
+	hi = _mm_srai_epi32(hi, COEFF_BITS);
+
+	__m128i value = _mm_packs_epi32(lo, hi);
+	return _mm_packus_epi16(value, value);
+}
+
+static void yuv_to_rgba_row(uint8_t *dst, const uint8_t *y_row, const uint8_t *u_row, const uint8_t *v_row,
+			    uint32_t width, const struct yuv_coefficients *coeffs)
+{
+	uint32_t x = 0;
+
+	if (use_simd) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alpha = _mm_set1_epi8((char)0xFF);
+
+		for (; x + 8 <= width; x += 8) {
+			__m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y_row + x)), zero);
+			__m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u_row + x)), zero);
+			__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v_row + x)), zero);
+			__m128i yu_lo = _mm_unpacklo_epi16(y, u);
+			__m128i yu_hi = _mm_unpackhi_epi16(y, u);
+			__m128i v_lo = _mm_unpacklo_epi16(v, zero);
+			__m128i v_hi = _mm_unpackhi_epi16(v, zero);
+
+			__m128i r = yuv_channel_sse2(yu_lo, yu_hi, v_lo, v_hi, coeffs, 0);
+			__m128i g = yuv_channel_sse2(yu_lo, yu_hi, v_lo, v_hi, coeffs, 1);
+			__m128i b = yuv_channel_sse2(yu_lo, yu_hi, v_lo, v_hi, coeffs, 2);
+			__m128i rg = _mm_unpacklo_epi8(r, g);
+			__m128i ba = _mm_unpacklo_epi8(b, alpha);
+
+			_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4), _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+		}
+	}
+
+	for (; x < width; x++) {
+		const int32_t y = y_row[x];
+		const int32_t u = u_row[x];
+		const int32_t v = v_row[x];
+		uint8_t *out = dst + (size_t)x * 4;
+
+		for (int c = 0; c < 3; c++) {
+			const int32_t *m = coeffs->c[c];
+			out[c] = clamp_u8((m[0] * y + m[1] * u + m[2] * v + coeffs->offset[c]) >> COEFF_BITS);
+		}
+		out[3] = 255;
+	}
+}
+
+static void swap_rb_row(uint8_t *dst, const uint8_t *src, uint32_t width, bool opaque)
+{
+	uint32_t x = 0;
+
+	if (use_simd) {
+		const __m128i ag_mask = _mm_set1_epi32((int)0xFF00FF00);
+		const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+		const __m128i alpha = _mm_set1_epi32(opaque ? (int)0xFF000000 : 0);
+
+		for (; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + (size_t)x * 4));
+			__m128i rb = _mm_and_si128(v, rb_mask);
+
+			rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+			v = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, ag_mask), rb), alpha);
+			_mm_storeu_si128((__m128i *)(dst + (size_t)x * 4), v);
+		}
+	}
+
+	for (; x < width; x++) {
+		const uint8_t *in = src + (size_t)x * 4;
+		uint8_t *out = dst + (size_t)x * 4;
+
+		out[0] = in[2];
+		out[1] = in[1];
+		out[2] = in[0];
+		out[3] = opaque ? 255 : in[3];
+	}
+}
+
+static inline void upsample_chroma(uint8_t *dst, const uint8_t *src, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++)
+		dst[x] = src[x >> 1];
+}
+
+/* splits a row into full resolution Y, U and V rows */
+static void unpack_yuv_row(const struct convert_data *cd, uint32_t y, uint8_t *y_out, uint8_t *u_out, uint8_t *v_out)
+{
+	const uint8_t *const *data = cd->data;
+	const uint32_t *linesize = cd->linesize;
+	const uint32_t width = cd->width;
+	const uint8_t *row = data[0] + (size_t)y * linesize[0];
+	uint32_t y_offset = 0, u_offset = 1, v_offset = 3;
+
+	/* interleaved chroma of odd widths only covers the even part of the
+	 * row, like the width / 2 textures of the renderer */
+	const uint32_t last_pair = width > 1 ? width / 2 - 1 : 0;
+
+	switch (cd->format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I422: {
+		const uint32_t chroma_y = cd->format == VIDEO_FORMAT_I420 ? y / 2 : y;
+
+		memcpy(y_out, row, width);
+		upsample_chroma(u_out, data[1] + (size_t)chroma_y * linesize[1], width);
+		upsample_chroma(v_out, data[2] + (size_t)chroma_y * linesize[2], width);
+		return;
+	}
+	case VIDEO_FORMAT_I444:
+		memcpy(y_out, row, width);
+		memcpy(u_out, data[1] + (size_t)y * linesize[1], width);
+		memcpy(v_out, data[2] + (size_t)y * linesize[2], width);
+		return;
+	case VIDEO_FORMAT_NV12: {
+		const uint8_t *uv = data[1] + (size_t)(y / 2) * linesize[1];
+
+		memcpy(y_out, row, width);
+		for (uint32_t x = 0; x < width; x++) {
+			const uint32_t pair = x / 2 < last_pair ? x / 2 : last_pair;
+			u_out[x] = uv[pair * 2];
+			v_out[x] = uv[pair * 2 + 1];
+		}
+		return;
+	}
+	case VIDEO_FORMAT_YVYU:
+		u_offset = 3;
+		v_offset = 1;
+		break;
+	case VIDEO_FORMAT_UYVY:
+		y_offset = 1;
+		u_offset = 0;
+		v_offset = 2;
+		break;
+	default:
+		break;
+	}
+
+	/* packed 4:2:2 */
+	for (uint32_t x = 0; x < width; x++) {
+		const uint32_t pair = x / 2 < last_pair ? x / 2 : last_pair;
+		const uint8_t *macropixel = row + (size_t)pair * 4;
+
+		y_out[x] = row[(size_t)(x / 2) * 4 + y_offset + (x & 1) * 2];
+		u_out[x] = macropixel[u_offset];
+		v_out[x] = macropixel[v_offset];
+	}
+}
+
+static void convert_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	const struct convert_data *cd = param;
+	const uint32_t width = cd->width;
+	const bool yuv = format_is_yuv(cd->format);
+	uint8_t *planes = yuv ? bmalloc(((size_t)width + 16) * 3) : NULL;
+	uint8_t *y_row = planes;
+	uint8_t *u_row = planes + width + 16;
+	uint8_t *v_row = u_row + width + 16;
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *in = cd->data[0] + (size_t)y * cd->linesize[0];
+		uint8_t *out = cd->dst + (size_t)y * cd->dst_linesize;
+
+		switch (cd->format) {
+		case VIDEO_FORMAT_RGBA:
+			memcpy(out, in, (size_t)width * 4);
+			break;
+		case VIDEO_FORMAT_BGRA:
+		case VIDEO_FORMAT_BGRX:
+			swap_rb_row(out, in, width, cd->format == VIDEO_FORMAT_BGRX);
+			break;
+		case VIDEO_FORMAT_BGR3:
+			for (uint32_t x = 0; x < width; x++) {
+				out[x * 4] = in[x * 3 + 2];
+				out[x * 4 + 1] = in[x * 3 + 1];
+				out[x * 4 + 2] = in[x * 3];
+				out[x * 4 + 3] = 255;
+			}
+			break;
+		case VIDEO_FORMAT_Y800:
+			for (uint32_t x = 0; x < width; x++) {
+				out[x * 4] = in[x];
+				out[x * 4 + 1] = in[x];
+				out[x * 4 + 2] = in[x];
+				out[x * 4 + 3] = 255;
+			}
+			break;
+		default:
+			unpack_yuv_row(cd, y, y_row, u_row, v_row);
+			yuv_to_rgba_row(out, y_row, u_row, v_row, width, &cd->coeffs);
+			break;
+		}
+	}
+
+	bfree(planes);
+}
+
+void video_composite_convert(uint8_t *dst, uint32_t dst_linesize, const uint8_t *const data[MAX_AV_PLANES],
+			     const uint32_t linesize[MAX_AV_PLANES], enum video_format format, uint32_t width,
+			     uint32_t height, const float color_matrix[16], os_task_pool_t *pool)
+{
+	struct convert_data cd = {
+		.dst = dst,
+		.dst_linesize = dst_linesize,
+		.data = data,
+		.linesize = linesize,
+		.format = format,
+		.width = width,
+	};
+
+	if (!video_composite_format_supported(format))
+		return;
+
+	if (format_is_yuv(format))
+		get_yuv_coefficients(&cd.coeffs, color_matrix);
+
+	format_conversion_run_bands(pool, convert_band, &cd, 0, height);
+}
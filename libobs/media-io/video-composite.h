@@ -0,0 +1,95 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/task.h"
+#include "video-io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CPU compositing of 8-bit RGBA images, used to render video without a
+ * graphics module.  Images hold straight (non-premultiplied) alpha and are
+ * blended like the default blend state of the renderer:
+ *
+ *   color = src * src_alpha + dst * (1 - src_alpha)
+ *   alpha = src_alpha + dst_alpha * (1 - src_alpha)
+ */
+
+enum video_composite_filter {
+	VIDEO_COMPOSITE_POINT,
+	VIDEO_COMPOSITE_BILINEAR,
+};
+
+struct video_composite_layer {
+	/* RGBA image */
+	const uint8_t *data;
+	uint32_t linesize;
+	uint32_t width;
+	uint32_t height;
+
+	/* the part of the image that is drawn, in pixels */
+	float src_x;
+	float src_y;
+	float src_cx;
+	float src_cy;
+
+	/* where it is drawn on the canvas, negative sizes flip the image */
+	float dst_x;
+	float dst_y;
+	float dst_cx;
+	float dst_cy;
+
+	/* when set, nothing is drawn outside of the clip rectangle */
+	bool clip;
+	int32_t clip_x;
+	int32_t clip_y;
+	int32_t clip_cx;
+	int32_t clip_cy;
+
+	enum video_composite_filter filter;
+
+	/* every pixel of the image has an alpha of 255, which lets the layer
+	 * be copied instead of blended */
+	bool opaque;
+};
+
+/* Clears an RGBA canvas to transparent black and draws the layers over it in
+ * order.  Rows are split across the threads of the pool, which may be NULL. */
+EXPORT void video_composite(uint8_t *canvas, uint32_t linesize, uint32_t width, uint32_t height,
+			    const struct video_composite_layer *layers, size_t count, os_task_pool_t *pool);
+
+EXPORT bool video_composite_format_supported(enum video_format format);
+
+/* Converts an 8-bit frame to an RGBA image.  YUV formats are converted with
+ * color_matrix, the same matrix as the one of async source frames, formats
+ * without alpha get an alpha of 255. */
+EXPORT void video_composite_convert(uint8_t *dst, uint32_t dst_linesize, const uint8_t *const data[MAX_AV_PLANES],
+				    const uint32_t linesize[MAX_AV_PLANES], enum video_format format, uint32_t width,
+				    uint32_t height, const float color_matrix[16], os_task_pool_t *pool);
+
+/* The kernels use SSE2 (or its NEON translation) when available, with the
+ * same output either way.  Disabling it is meant for comparing and
+ * benchmarking against the C paths. */
+EXPORT void video_composite_set_simd(bool enable);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,466 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "video-deinterlace.h"
+#include "format-conversion.h"
+#include "../util/sse-intrin.h"
+
+static bool use_simd = true;
+
+struct deinterlace_plane {
+	/* in bytes */
+	uint32_t width;
+	uint32_t height;
+	/* distance in bytes to the same component of the next pixel */
+	uint32_t step;
+};
+
+static size_t get_planes(const struct video_deinterlace_info *info, struct deinterlace_plane planes[MAX_AV_PLANES])
+{
+	const uint32_t width = info->width;
+	const uint32_t height = info->height;
+	const uint32_t half_width = (width + 1) / 2;
+	const uint32_t half_height = (height + 1) / 2;
+
+	switch (info->format) {
+	case VIDEO_FORMAT_I420:
+		planes[0] = (struct deinterlace_plane){width, height, 1};
+		planes[1] = (struct deinterlace_plane){half_width, half_height, 1};
+		planes[2] = planes[1];
+		return 3;
+	case VIDEO_FORMAT_NV12:
+		planes[0] = (struct deinterlace_plane){width, height, 1};
+		planes[1] = (struct deinterlace_plane){half_width * 2, half_height, 2};
+		return 2;
+	case VIDEO_FORMAT_I422:
+		planes[0] = (struct deinterlace_plane){width, height, 1};
+		planes[1] = (struct deinterlace_plane){half_width, height, 1};
+		planes[2] = planes[1];
+		return 3;
+	case VIDEO_FORMAT_I444:
+		planes[0] = (struct deinterlace_plane){width, height, 1};
+		planes[1] = planes[0];
+		planes[2] = planes[0];
+		return 3;
+	case VIDEO_FORMAT_Y800:
+		planes[0] = (struct deinterlace_plane){width, height, 1};
+		return 1;
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+		/* steps over whole macropixels so luma is only compared with
+		 * luma and chroma with chroma */
+		planes[0] = (struct deinterlace_plane){half_width * 4, height, 4};
+		return 1;
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		planes[0] = (struct deinterlace_plane){width * 4, height, 4};
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+bool video_deinterlace_format_supported(enum video_format format)
+{
+	struct video_deinterlace_info info = {.format = format, .width = 2, .height = 2};
+	struct deinterlace_plane planes[MAX_AV_PLANES];
+
+	return get_planes(&info, planes) != 0;
+}
+
+void video_deinterlace_set_simd(bool enable)
+{
+	use_simd = enable;
+}
+
+#define ROW(frame, plane, y) ((frame)->data[plane] + (size_t)(y) * (frame)->linesize[plane])
+
+/* ------------------------------------------------------------------------- */
+
+static void average_row(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t width)
+{
+	uint32_t x = 0;
+
+	if (use_simd) {
+		for (; x + 16 <= width; x += 16) {
+			__m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+			__m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+			_mm_storeu_si128((__m128i *)(dst + x), _mm_avg_epu8(va, vb));
+		}
+	}
+
+	for (; x < width; x++)
+		dst[x] = (uint8_t)((a[x] + b[x] + 1) >> 1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* yadif, as in FFmpeg's vf_yadif with mode 0 (spatial check enabled)        */
+
+struct yadif_rows {
+	/* the rows above and below the missing one */
+	const uint8_t *cur_above;
+	const uint8_t *cur_below;
+	const uint8_t *prev_above;
+	const uint8_t *prev_below;
+	const uint8_t *next_above;
+	const uint8_t *next_below;
+
+	/* the missing row in the frames around the field */
+	const uint8_t *prev2;
+	const uint8_t *next2;
+
+	/* two rows further out, only set when the spatial interlacing check
+	 * is done for the row */
+	const uint8_t *prev2_above2;
+	const uint8_t *next2_above2;
+	const uint8_t *prev2_below2;
+	const uint8_t *next2_below2;
+};
+
+static inline int max3(int a, int b, int c)
+{
+	int m = a > b ? a : b;
+	return m > c ? m : c;
+}
+
+static inline int min3(int a, int b, int c)
+{
+	int m = a < b ? a : b;
+	return m < c ? m : c;
+}
+
+/* how well the edge direction j matches, lower is better */
+static inline int yadif_score(const uint8_t *a, const uint8_t *b, ptrdiff_t x, ptrdiff_t s, ptrdiff_t j)
+{
+	return abs(a[x + (j - 1) * s] - b[x - (j + 1) * s]) + abs(a[x + j * s] - b[x - j * s]) +
+	       abs(a[x + (j + 1) * s] - b[x - (j - 1) * s]);
+}
+
+static void yadif_row_c(uint8_t *dst, const struct yadif_rows *r, ptrdiff_t start, ptrdiff_t end, ptrdiff_t s,
+			bool edge)
+{
+	const uint8_t *a = r->cur_above;
+	const uint8_t *b = r->cur_below;
+
+	for (ptrdiff_t x = start; x < end; x++) {
+		int c = a[x];
+		int e = b[x];
+		int d = (r->prev2[x] + r->next2[x]) >> 1;
+		int temporal_diff0 = abs(r->prev2[x] - r->next2[x]);
+		int temporal_diff1 = (abs(r->prev_above[x] - c) + abs(r->prev_below[x] - e)) >> 1;
+		int temporal_diff2 = (abs(r->next_above[x] - c) + abs(r->next_below[x] - e)) >> 1;
+		int diff = max3(temporal_diff0 >> 1, temporal_diff1, temporal_diff2);
+		int spatial_pred = (c + e) >> 1;
+
+		if (!edge) {
+			int spatial_score = abs(a[x - s] - b[x - s]) + abs(c - e) + abs(a[x + s] - b[x + s]) - 1;
+			int score;
+
+			/* the second step in a direction is only tried
+			 * when the first one was an improvement */
+			score = yadif_score(a, b, x, s, -1);
+			if (score < spatial_score) {
+				spatial_score = score;
+				spatial_pred = (a[x - s] + b[x + s]) >> 1;
+
+				score = yadif_score(a, b, x, s, -2);
+				if (score < spatial_score) {
+					spatial_score = score;
+					spatial_pred = (a[x - 2 * s] + b[x + 2 * s]) >> 1;
+				}
+			}
+
+			score = yadif_score(a, b, x, s, 1);
+			if (score < spatial_score) {
+				spatial_score = score;
+				spatial_pred = (a[x + s] + b[x - s]) >> 1;
+
+				score = yadif_score(a, b, x, s, 2);
+				if (score < spatial_score)
+					spatial_pred = (a[x + 2 * s] + b[x - 2 * s]) >> 1;
+			}
+		}
+
+		if (r->prev2_above2) {
+			int b2 = (r->prev2_above2[x] + r->next2_above2[x]) >> 1;
+			int f2 = (r->prev2_below2[x] + r->next2_below2[x]) >> 1;
+			int max = max3(d - e, d - c, b2 - c < f2 - e ? b2 - c : f2 - e);
+			int min = min3(d - e, d - c, b2 - c > f2 - e ? b2 - c : f2 - e);
+
+			diff = max3(diff, min, -max);
+		}
+
+		if (spatial_pred > d + diff)
+			spatial_pred = d + diff;
+		else if (spatial_pred < d - diff)
+			spatial_pred = d - diff;
+
+		dst[x] = (uint8_t)spatial_pred;
+	}
+}
+
+static inline __m128i load_epi16(const uint8_t *p)
+{
+	return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+}
+
+static inline __m128i absdiff_epi16(__m128i a, __m128i b)
+{
+	__m128i d = _mm_sub_epi16(a, b);
+	return _mm_max_epi16(d, _mm_sub_epi16(_mm_setzero_si128(), d));
+}
+
+static inline __m128i select_epi16(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i yadif_score_sse2(const uint8_t *a, const uint8_t *b, ptrdiff_t x, ptrdiff_t s, ptrdiff_t j)
+{
+	__m128i s0 = absdiff_epi16(load_epi16(a + x + (j - 1) * s), load_epi16(b + x - (j + 1) * s));
+	__m128i s1 = absdiff_epi16(load_epi16(a + x + j * s), load_epi16(b + x - j * s));
+	__m128i s2 = absdiff_epi16(load_epi16(a + x + (j + 1) * s), load_epi16(b + x - (j - 1) * s));
+	return _mm_add_epi16(_mm_add_epi16(s0, s1), s2);
+}
+
+static inline __m128i yadif_pred_sse2(const uint8_t *a, const uint8_t *b, ptrdiff_t x, ptrdiff_t s, ptrdiff_t j)
+{
+	return _mm_srli_epi16(_mm_add_epi16(load_epi16(a + x + j * s), load_epi16(b + x - j * s)), 1);
+}
+
+/* eight pixels at a time in 16-bit lanes, the same arithmetic as the C
+ * version; returns where it stopped */
+static ptrdiff_t yadif_row_sse2(uint8_t *dst, const struct yadif_rows *r, ptrdiff_t start, ptrdiff_t end, ptrdiff_t s)
+{
+	const uint8_t *a = r->cur_above;
+	const uint8_t *b = r->cur_below;
+	const __m128i one = _mm_set1_epi16(1);
+	ptrdiff_t x = start;
+
+	for (; x + 8 <= end; x += 8) {
+		__m128i c = load_epi16(a + x);
+		__m128i e = load_epi16(b + x);
+		__m128i p2 = load_epi16(r->prev2 + x);
+		__m128i n2 = load_epi16(r->next2 + x);
+		__m128i d = _mm_srli_epi16(_mm_add_epi16(p2, n2), 1);
+
+		__m128i temporal_diff0 = _mm_srli_epi16(absdiff_epi16(p2, n2), 1);
+		__m128i temporal_diff1 = _mm_srli_epi16(_mm_add_epi16(absdiff_epi16(load_epi16(r->prev_above + x), c),
+								      absdiff_epi16(load_epi16(r->prev_below + x), e)),
+							1);
+		__m128i temporal_diff2 = _mm_srli_epi16(_mm_add_epi16(absdiff_epi16(load_epi16(r->next_above + x), c),
+								      absdiff_epi16(load_epi16(r->next_below + x), e)),
+							1);
+		__m128i diff = _mm_max_epi16(temporal_diff0, _mm_max_epi16(temporal_diff1, temporal_diff2));
+
+		__m128i spatial_pred = _mm_srli_epi16(_mm_add_epi16(c, e), 1);
+		__m128i spatial_score = absdiff_epi16(load_epi16(a + x - s), load_epi16(b + x - s));
+		spatial_score = _mm_add_epi16(spatial_score, absdiff_epi16(c, e));
+		spatial_score = _mm_add_epi16(spatial_score, absdiff_epi16(load_epi16(a + x + s), load_epi16(b + x + s)));
+		spatial_score = _mm_sub_epi16(spatial_score, one);
+
+		for (ptrdiff_t dir = -1; dir <= 1; dir += 2) {
+			__m128i score = yadif_score_sse2(a, b, x, s, dir);
+			__m128i better = _mm_cmplt_epi16(score, spatial_score);
+			spatial_score = select_epi16(better, score, spatial_score);
+			spatial_pred = select_epi16(better, yadif_pred_sse2(a, b, x, s, dir), spatial_pred);
+
+			score = yadif_score_sse2(a, b, x, s, dir * 2);
+			better = _mm_and_si128(better, _mm_cmplt_epi16(score, spatial_score));
+			spatial_score = select_epi16(better, score, spatial_score);
+			spatial_pred = select_epi16(better, yadif_pred_sse2(a, b, x, s, dir * 2), spatial_pred);
+		}
+
+		if (r->prev2_above2) {
+			__m128i b2 = _mm_srli_epi16(
+				_mm_add_epi16(load_epi16(r->prev2_above2 + x), load_epi16(r->next2_above2 + x)), 1);
+			__m128i f2 = _mm_srli_epi16(
+				_mm_add_epi16(load_epi16(r->prev2_below2 + x), load_epi16(r->next2_below2 + x)), 1);
+			__m128i de = _mm_sub_epi16(d, e);
+			__m128i dc = _mm_sub_epi16(d, c);
+			__m128i bc = _mm_sub_epi16(b2, c);
+			__m128i fe = _mm_sub_epi16(f2, e);
+			__m128i max = _mm_max_epi16(de, _mm_max_epi16(dc, _mm_min_epi16(bc, fe)));
+			__m128i min = _mm_min_epi16(de, _mm_min_epi16(dc, _mm_max_epi16(bc, fe)));
+
+			diff = _mm_max_epi16(diff, _mm_max_epi16(min, _mm_sub_epi16(_mm_setzero_si128(), max)));
+		}
+
+		/* diff is never negative, so clamping to the upper bound
+		 * first gives the same result as the C version */
+		spatial_pred = _mm_min_epi16(spatial_pred, _mm_add_epi16(d, diff));
+		spatial_pred = _mm_max_epi16(spatial_pred, _mm_sub_epi16(d, diff));
+
+		_mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(spatial_pred, spatial_pred));
+	}
+
+	return x;
+}
+
+static void yadif_row(uint8_t *dst, const struct yadif_rows *r, uint32_t width, uint32_t step)
+{
+	const ptrdiff_t s = (ptrdiff_t)step;
+	const ptrdiff_t w = (ptrdiff_t)width;
+	const ptrdiff_t edge = 3 * s;
+	ptrdiff_t x;
+
+	/* the spatial check looks three pixels to each side */
+	if (w < edge * 2) {
+		yadif_row_c(dst, r, 0, w, s, true);
+		return;
+	}
+
+	yadif_row_c(dst, r, 0, edge, s, true);
+	x = use_simd ? yadif_row_sse2(dst, r, edge, w - edge, s) : edge;
+	yadif_row_c(dst, r, x, w - edge, s, false);
+	yadif_row_c(dst, r, w - edge, w, s, true);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct deinterlace_job {
+	struct video_frame *dst;
+	const struct video_frame *prev;
+	const struct video_frame *cur;
+	const struct video_frame *next;
+	const struct video_deinterlace_info *info;
+	struct deinterlace_plane planes[MAX_AV_PLANES];
+	size_t num_planes;
+
+	/* rows where (y ^ parity) & 1 is set are reconstructed */
+	int parity;
+};
+
+static void deinterlace_yadif_row(struct deinterlace_job *job, size_t p, int y)
+{
+	const struct deinterlace_plane *plane = &job->planes[p];
+	const int h = (int)plane->height;
+	const int above = y ? y - 1 : y + 1;
+	const int below = y + 1 < h ? y + 1 : y - 1;
+	const bool prev_pair = job->parity ^ job->info->top_field_first;
+	const struct video_frame *prev2 = prev_pair ? job->prev : job->cur;
+	const struct video_frame *next2 = prev_pair ? job->cur : job->next;
+	struct yadif_rows r = {
+		.cur_above = ROW(job->cur, p, above),
+		.cur_below = ROW(job->cur, p, below),
+		.prev_above = ROW(job->prev, p, above),
+		.prev_below = ROW(job->prev, p, below),
+		.next_above = ROW(job->next, p, above),
+		.next_below = ROW(job->next, p, below),
+		.prev2 = ROW(prev2, p, y),
+		.next2 = ROW(next2, p, y),
+	};
+
+	/* no spatial interlacing check next to the first and last rows */
+	if (y != 1 && y + 2 != h) {
+		const int above2 = y + 2 * (above - y);
+		const int below2 = y + 2 * (below - y);
+
+		r.prev2_above2 = ROW(prev2, p, above2);
+		r.next2_above2 = ROW(next2, p, above2);
+		r.prev2_below2 = ROW(prev2, p, below2);
+		r.next2_below2 = ROW(next2, p, below2);
+	}
+
+	yadif_row(ROW(job->dst, p, y), &r, plane->width, plane->step);
+}
+
+static void deinterlace_row(struct deinterlace_job *job, size_t p, int y)
+{
+	const struct deinterlace_plane *plane = &job->planes[p];
+	const int h = (int)plane->height;
+	uint8_t *dst = ROW(job->dst, p, y);
+
+	if (job->info->filter == VIDEO_DEINTERLACE_BLEND) {
+		/* the kept field comes from this frame, the other one from
+		 * the frame the field is paired with */
+		const struct video_frame *other = job->info->second_field ? job->cur : job->prev;
+		const int top = y & ~1;
+		const int bottom = top + 1 < h ? top + 1 : top;
+		const struct video_frame *top_src = job->parity ? other : job->cur;
+		const struct video_frame *bottom_src = job->parity ? job->cur : other;
+
+		average_row(dst, ROW(top_src, p, top), ROW(bottom_src, p, bottom), plane->width);
+		return;
+	}
+
+	if (!((y ^ job->parity) & 1) || h < 2) {
+		memcpy(dst, ROW(job->cur, p, y), plane->width);
+		return;
+	}
+
+	switch (job->info->filter) {
+	case VIDEO_DEINTERLACE_DISCARD:
+		memcpy(dst, ROW(job->cur, p, (y ^ 1) < h ? y ^ 1 : y - 1), plane->width);
+		break;
+	case VIDEO_DEINTERLACE_LINEAR:
+		average_row(dst, ROW(job->cur, p, y ? y - 1 : y + 1), ROW(job->cur, p, y + 1 < h ? y + 1 : y - 1),
+			    plane->width);
+		break;
+	case VIDEO_DEINTERLACE_YADIF:
+		deinterlace_yadif_row(job, p, y);
+		break;
+	case VIDEO_DEINTERLACE_BLEND:
+		break;
+	}
+}
+
+static void deinterlace_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct deinterlace_job *job = param;
+	const uint32_t height = job->info->height;
+
+	for (size_t p = 0; p < job->num_planes; p++) {
+		const uint32_t plane_height = job->planes[p].height;
+		uint32_t start = start_y;
+		uint32_t end = end_y;
+
+		/* bands have an even number of rows, so the rows of half
+		 * height planes split evenly */
+		if (plane_height != height) {
+			start = start_y / 2;
+			end = end_y == height ? plane_height : end_y / 2;
+		}
+
+		for (uint32_t y = start; y < end; y++)
+			deinterlace_row(job, p, (int)y);
+	}
+}
+
+void video_deinterlace(struct video_frame *dst, const struct video_frame *prev, const struct video_frame *cur,
+		       const struct video_frame *next, const struct video_deinterlace_info *info, os_task_pool_t *pool)
+{
+	struct deinterlace_job job = {
+		.dst = dst,
+		.prev = prev ? prev : cur,
+		.cur = cur,
+		.next = next ? next : cur,
+		.info = info,
+		.parity = info->top_field_first ^ !info->second_field,
+	};
+
+	job.num_planes = get_planes(info, job.planes);
+	if (!job.num_planes)
+		return;
+
+	format_conversion_run_bands(pool, deinterlace_band, &job, 0, info->height);
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/task.h"
+#include "video-frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CPU deinterlacing of 8-bit frames, the counterpart of the deinterlace
+ * effects for sources that deinterlace before their frames are queued.
+ */
+
+enum video_deinterlace_filter {
+	/* line doubling of the kept field */
+	VIDEO_DEINTERLACE_DISCARD,
+	/* the missing lines are averaged from the lines above and below */
+	VIDEO_DEINTERLACE_LINEAR,
+	/* each pair of lines is the average of both fields */
+	VIDEO_DEINTERLACE_BLEND,
+	/* yadif: spatial prediction clamped by the temporal neighbours */
+	VIDEO_DEINTERLACE_YADIF,
+};
+
+struct video_deinterlace_info {
+	enum video_format format;
+	uint32_t width;
+	uint32_t height;
+	enum video_deinterlace_filter filter;
+	bool top_field_first;
+
+	/* reconstructs the second field of the frame instead of the first.
+	 * the first field is kept from the current frame and paired with the
+	 * previous frame, the second one with the next frame */
+	bool second_field;
+};
+
+EXPORT bool video_deinterlace_format_supported(enum video_format format);
+
+/* Writes one deinterlaced field of cur to dst.  prev and next are the
+ * neighbouring frames used by the blend and yadif filters, pass cur for
+ * either when it isn't available.  All frames have the format and size of
+ * info.  Rows are split across the threads of the pool, which may be NULL. */
+EXPORT void video_deinterlace(struct video_frame *dst, const struct video_frame *prev, const struct video_frame *cur,
+			      const struct video_frame *next, const struct video_deinterlace_info *info,
+			      os_task_pool_t *pool);
+
+/* The filters use SSE2 (or its NEON translation) when available, with the
+ * same output either way.  Disabling it is meant for comparing and
+ * benchmarking against the C paths. */
+EXPORT void video_deinterlace_set_simd(bool enable);
+
+#ifdef __cplusplus
+}
+#endif
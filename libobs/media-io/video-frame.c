@@ -16,6 +16,7 @@
 ******************************************************************************/
 #include <assert.h>
 #include "video-frame.h"
+#include "../util/sse-intrin.h"
 
 #define HALF(size) ((size + 1) / 2)
 #define ALIGN(size, alignment) *size = (*size + alignment - 1) & (~(alignment - 1));
@@ -261,3 +262,146 @@ void video_frame_copy(struct video_frame *dst, const struct video_frame *src, en
 		}
 	}
 }
+
+/* frames smaller than this are copied on the calling thread, handing out
+ * bands would cost more than it saves */
+#define PARALLEL_COPY_MIN_SIZE (4 * 1024 * 1024)
+
+/* frames larger than a typical last level cache would only push everything
+ * else out of it, so they're written with non-temporal stores instead */
+#define STREAMING_COPY_MIN_SIZE (32 * 1024 * 1024)
+
+#define MAX_BANDS_PER_PLANE 8
+
+struct copy_band {
+	uint32_t plane;
+	uint32_t start_y;
+	uint32_t end_y;
+};
+
+struct frame_copy {
+	struct video_frame *dst;
+	const struct video_frame *src;
+	bool streaming;
+	size_t num_bands;
+	struct copy_band bands[MAX_AV_PLANES * MAX_BANDS_PER_PLANE];
+};
+
+static void copy_streaming(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+
+	if (head > size)
+		head = size;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	for (; size >= 64; size -= 64, dst += 64, src += 64) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)src);
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i v3 = _mm_loadu_si128((const __m128i *)(src + 48));
+
+		_mm_stream_si128((__m128i *)dst, v0);
+		_mm_stream_si128((__m128i *)(dst + 16), v1);
+		_mm_stream_si128((__m128i *)(dst + 32), v2);
+		_mm_stream_si128((__m128i *)(dst + 48), v3);
+	}
+
+	memcpy(dst, src, size);
+}
+
+static inline void copy_bytes(uint8_t *dst, const uint8_t *src, size_t size, bool streaming)
+{
+	if (streaming)
+		copy_streaming(dst, src, size);
+	else
+		memcpy(dst, src, size);
+}
+
+static void copy_plane_rows(struct video_frame *dst, const struct video_frame *src, uint32_t plane, uint32_t start_y,
+			    uint32_t end_y, bool streaming)
+{
+	size_t src_linesize = src->linesize[plane];
+	size_t dst_linesize = dst->linesize[plane];
+	const uint8_t *src_pos = src->data[plane] + src_linesize * start_y;
+	uint8_t *dst_pos = dst->data[plane] + dst_linesize * start_y;
+
+	if (src_linesize == dst_linesize) {
+		copy_bytes(dst_pos, src_pos, src_linesize * (end_y - start_y), streaming);
+	} else {
+		size_t linesize = src_linesize < dst_linesize ? src_linesize : dst_linesize;
+
+		for (uint32_t y = start_y; y < end_y; y++) {
+			copy_bytes(dst_pos, src_pos, linesize, streaming);
+			src_pos += src_linesize;
+			dst_pos += dst_linesize;
+		}
+	}
+}
+
+static void copy_band(void *param, size_t idx)
+{
+	struct frame_copy *copy = param;
+	const struct copy_band *band = &copy->bands[idx];
+
+	copy_plane_rows(copy->dst, copy->src, band->plane, band->start_y, band->end_y, copy->streaming);
+
+	/* non-temporal stores have to be visible before the frame is used */
+	if (copy->streaming)
+		_mm_sfence();
+}
+
+void video_frame_copy_parallel(struct video_frame *dst, const struct video_frame *src, enum video_format format,
+			       uint32_t cy, os_task_pool_t *pool)
+{
+	struct frame_copy copy = {0};
+	uint32_t heights[MAX_AV_PLANES] = {0};
+	size_t size = 0;
+
+	video_frame_get_plane_heights(heights, format, cy);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++)
+		size += (size_t)dst->linesize[i] * heights[i];
+
+	if (size < PARALLEL_COPY_MIN_SIZE) {
+		video_frame_copy(dst, src, format, cy);
+		return;
+	}
+
+	copy.dst = dst;
+	copy.src = src;
+	copy.streaming = size >= STREAMING_COPY_MIN_SIZE;
+
+	/* two bands per thread (the caller included) so threads that finish
+	 * early can pick up the slack */
+	size_t threads = pool ? os_task_pool_threads(pool) + 1 : 1;
+	size_t band_size = size / (threads * 2);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++) {
+		uint32_t band_rows;
+
+		if (!heights[i] || !dst->linesize[i])
+			continue;
+
+		band_rows = (uint32_t)(band_size / dst->linesize[i]);
+		if (band_rows < (heights[i] + MAX_BANDS_PER_PLANE - 1) / MAX_BANDS_PER_PLANE)
+			band_rows = (heights[i] + MAX_BANDS_PER_PLANE - 1) / MAX_BANDS_PER_PLANE;
+
+		for (uint32_t y = 0; y < heights[i]; y += band_rows) {
+			struct copy_band *band = &copy.bands[copy.num_bands++];
+
+			band->plane = i;
+			band->start_y = y;
+			band->end_y = y + band_rows < heights[i] ? y + band_rows : heights[i];
+		}
+	}
+
+	/* a pool is shared by the frames of every source, when another one is
+	 * being copied on it copying on this thread beats waiting in line */
+	if (!os_task_pool_try_run(pool, copy_band, &copy, copy.num_bands))
+		os_task_pool_run(NULL, copy_band, &copy, copy.num_bands);
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/bmem.h"
+#include "../util/task.h"
 #include "video-io.h"
 
 #ifdef __cplusplus
@@ -59,6 +60,14 @@ static inline void video_frame_destroy(struct video_frame *frame)
 EXPORT void video_frame_copy(struct video_frame *dst, const struct video_frame *src, enum video_format format,
 			     uint32_t height);
 
+/* Same as video_frame_copy, but large frames are split into bands of rows that
+ * are copied on the threads of a task pool and the calling thread, and frames
+ * too large to stay in the cache are written with non-temporal stores.  The
+ * pool may be NULL, and while it's busy with another frame the bands are
+ * copied on the calling thread alone. */
+EXPORT void video_frame_copy_parallel(struct video_frame *dst, const struct video_frame *src,
+				      enum video_format format, uint32_t height, os_task_pool_t *pool);
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,12 +34,21 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
 
+/* frames a threaded input can hold, including the one being processed */
+#define MAX_QUEUED_FRAMES 3
+#define QUEUE_RING_SIZE 4
+
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* held by threaded inputs */
+	volatile long refs;
 };
 
+struct video_input_thread;
+
 struct video_input {
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
@@ -58,6 +67,34 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	struct video_input_thread *thread;
+};
+
+struct queued_frame {
+	struct video_data frame;
+	struct cached_frame_info *cache_slot;
+};
+
+/* Threaded inputs get frames on their own thread through a single-producer
+ * single-consumer queue of cache slot references, so a slow input only drops
+ * its own frames instead of stalling the video thread for every input.  The
+ * thread's copy of the input owns the scaler, which also runs on that thread. */
+struct video_input_thread {
+	struct video_output *video;
+	struct video_input input;
+
+	pthread_t thread;
+	os_sem_t *queued;
+	volatile bool stop;
+	bool detached;
+
+	struct queued_frame queue[QUEUE_RING_SIZE];
+	volatile long write_idx;
+	volatile long read_idx;
+
+	volatile long total_frames;
+	volatile long late_frames;
 };
 
 static inline void video_input_free(struct video_input *input)
@@ -87,6 +124,11 @@ struct video_output {
 	size_t last_added;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
+	/* frames already output but still referenced by threaded inputs,
+	 * starting at first_held and ending before first_added */
+	size_t first_held;
+	size_t held_frames;
+
 	struct video_output *parent;
 
 	volatile bool raw_active;
@@ -123,6 +165,108 @@ static inline bool scale_video_output(struct video_input *input, struct video_da
 	return success;
 }
 
+/* call with data_mutex held */
+static void release_held_frames(struct video_output *video)
+{
+	while (video->held_frames && !os_atomic_load_long(&video->cache[video->first_held].refs)) {
+		if (++video->first_held == video->info.cache_size)
+			video->first_held = 0;
+		video->held_frames--;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_added;
+	}
+}
+
+static void release_cache_slot(struct video_output *video, struct cached_frame_info *cache_slot)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	os_atomic_dec_long(&cache_slot->refs);
+	release_held_frames(video);
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static void queue_input_frame(struct video_input_thread *thread, struct cached_frame_info *cache_slot,
+			      const struct video_data *frame)
+{
+	long write_idx = thread->write_idx;
+	long read_idx = os_atomic_load_long(&thread->read_idx);
+	struct queued_frame *queued;
+
+	os_atomic_inc_long(&thread->total_frames);
+
+	if ((unsigned long)write_idx - (unsigned long)read_idx >= MAX_QUEUED_FRAMES) {
+		os_atomic_inc_long(&thread->late_frames);
+		return;
+	}
+
+	queued = &thread->queue[(unsigned long)write_idx & (QUEUE_RING_SIZE - 1)];
+	queued->frame = *frame;
+	queued->cache_slot = cache_slot;
+	os_atomic_inc_long(&cache_slot->refs);
+
+	os_atomic_set_long(&thread->write_idx, (long)((unsigned long)write_idx + 1));
+	os_sem_post(thread->queued);
+}
+
+static void input_thread_free(struct video_input_thread *thread)
+{
+	unsigned long write_idx = (unsigned long)os_atomic_load_long(&thread->write_idx);
+	unsigned long read_idx = (unsigned long)os_atomic_load_long(&thread->read_idx);
+
+	for (; read_idx != write_idx; read_idx++) {
+		struct queued_frame *queued = &thread->queue[read_idx & (QUEUE_RING_SIZE - 1)];
+		release_cache_slot(thread->video, queued->cache_slot);
+	}
+
+	video_input_free(&thread->input);
+	os_sem_destroy(thread->queued);
+	bfree(thread);
+}
+
+static void *input_thread(void *param)
+{
+	struct video_input_thread *thread = param;
+	struct video_input *input = &thread->input;
+
+	os_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(thread->queued) == 0) {
+		if (os_atomic_load_bool(&thread->stop))
+			break;
+
+		long read_idx = thread->read_idx;
+		struct queued_frame *queued = &thread->queue[(unsigned long)read_idx & (QUEUE_RING_SIZE - 1)];
+		struct video_data frame = queued->frame;
+
+		if (scale_video_output(input, &frame))
+			input->callback(input->param, &frame);
+
+		release_cache_slot(thread->video, queued->cache_slot);
+		os_atomic_set_long(&thread->read_idx, (long)((unsigned long)read_idx + 1));
+	}
+
+	if (thread->detached)
+		input_thread_free(thread);
+	return NULL;
+}
+
+static void input_thread_stop(struct video_input_thread *thread)
+{
+	os_atomic_set_bool(&thread->stop, true);
+	os_sem_post(thread->queued);
+
+	if (pthread_equal(pthread_self(), thread->thread)) {
+		/* disconnected from within its own callback (e.g. an encoder
+		 * stopping itself on error), so it frees itself on exit */
+		thread->detached = true;
+		pthread_detach(thread->thread);
+	} else {
+		pthread_join(thread->thread, NULL);
+		input_thread_free(thread);
+	}
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
@@ -155,7 +299,9 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (skip)
 			continue;
 
-		if (scale_video_output(input, &frame))
+		if (input->thread)
+			queue_input_frame(input->thread, frame_info, &frame);
+		else if (scale_video_output(input, &frame))
 			input->callback(input->param, &frame);
 	}
 
@@ -173,8 +319,8 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		video->held_frames++;
+		release_held_frames(video);
 	} else if (skipped) {
 		--frame_info->skipped;
 		os_atomic_inc_long(&video->skipped_frames);
@@ -282,6 +428,23 @@ void video_output_close(video_t *video)
 
 	video_output_stop(video);
 
+	/* input threads are stopped outside of the lock, as they may try to
+	 * disconnect themselves */
+	pthread_mutex_lock(&video->input_mutex);
+	DARRAY(struct video_input_thread *) threads;
+	da_init(threads);
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = &video->inputs.array[i];
+		if (input->thread)
+			da_push_back(threads, &input->thread);
+		input->thread = NULL;
+	}
+	pthread_mutex_unlock(&video->input_mutex);
+
+	for (size_t i = 0; i < threads.num; i++)
+		input_thread_stop(threads.array[i]);
+	da_free(threads);
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
@@ -395,8 +558,36 @@ bool video_output_connect(video_t *video, const struct video_scale_info *convers
 	return video_output_connect2(video, conversion, 1, callback, param);
 }
 
-bool video_output_connect2(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
-			   void (*callback)(void *param, struct video_data *frame), void *param)
+static bool input_thread_init(struct video_input *input, struct video_output *video)
+{
+	struct video_input_thread *thread = bzalloc(sizeof(struct video_input_thread));
+
+	thread->video = video;
+	thread->input = *input;
+
+	if (os_sem_init(&thread->queued, 0) != 0)
+		goto fail;
+	if (pthread_create(&thread->thread, NULL, input_thread, thread) != 0) {
+		os_sem_destroy(thread->queued);
+		goto fail;
+	}
+
+	/* the thread's copy owns the scaler and conversion frames */
+	input->scaler = NULL;
+	memset(input->frame, 0, sizeof(input->frame));
+	input->thread = thread;
+	return true;
+
+fail:
+	blog(LOG_ERROR, "video_input_init: Failed to create input thread");
+	bfree(thread);
+	return false;
+}
+
+static bool video_output_connect_internal(video_t *video, const struct video_scale_info *conversion,
+					  uint32_t frame_rate_divisor,
+					  void (*callback)(void *param, struct video_data *frame), void *param,
+					  bool threaded)
 {
 	bool success = false;
 
@@ -432,6 +623,11 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
+		if (success && threaded) {
+			success = input_thread_init(&input, video);
+			if (!success)
+				video_input_free(&input);
+		}
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -448,6 +644,47 @@ bool video_output_connect2(video_t *video, const struct video_scale_info *conver
 	return success;
 }
 
+bool video_output_connect2(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
+			   void (*callback)(void *param, struct video_data *frame), void *param)
+{
+	return video_output_connect_internal(video, conversion, frame_rate_divisor, callback, param, false);
+}
+
+bool video_output_connect_threaded(video_t *video, const struct video_scale_info *conversion,
+				   uint32_t frame_rate_divisor, void (*callback)(void *param, struct video_data *frame),
+				   void *param)
+{
+	return video_output_connect_internal(video, conversion, frame_rate_divisor, callback, param, true);
+}
+
+bool video_output_get_input_frames(video_t *video, void (*callback)(void *param, struct video_data *frame),
+				   void *param, uint32_t *total_frames, uint32_t *late_frames)
+{
+	bool found = false;
+
+	if (!video || !callback)
+		return false;
+
+	video = get_root(video);
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input_thread *thread = video->inputs.array[idx].thread;
+
+		if (thread) {
+			*total_frames = (uint32_t)os_atomic_load_long(&thread->total_frames);
+			*late_frames = (uint32_t)os_atomic_load_long(&thread->late_frames);
+			found = true;
+		}
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return found;
+}
+
 static void log_skipped(video_t *video)
 {
 	long skipped = os_atomic_load_long(&video->skipped_frames);
@@ -474,10 +711,13 @@ bool video_output_disconnect2(video_t *video, void (*callback)(void *param, stru
 
 	video = get_root(video);
 
+	struct video_input_thread *thread = NULL;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
+		thread = video->inputs.array[idx].thread;
 		video_input_free(video->inputs.array + idx);
 		da_erase(video->inputs, idx);
 
@@ -491,6 +731,11 @@ bool video_output_disconnect2(video_t *video, void (*callback)(void *param, stru
 
 	pthread_mutex_unlock(&video->input_mutex);
 
+	/* stopped outside of the lock, the thread may be disconnecting
+	 * itself from within its callback */
+	if (thread)
+		input_thread_stop(thread);
+
 	return idx != DARRAY_INVALID;
 }
 
@@ -518,7 +763,14 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame, int coun
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	if (video->available_frames == 0) {
+	if (video->available_frames == 0 && video->held_frames == video->info.cache_size) {
+		/* every frame has been output and is still held by threaded
+		 * inputs, so there's no queued frame left to repeat */
+		for (int i = 0; i < count; i++)
+			os_atomic_inc_long(&video->skipped_frames);
+		locked = false;
+
+	} else if (video->available_frames == 0) {
 		video->cache[video->last_added].count += count;
 		video->cache[video->last_added].skipped += count;
 		locked = false;
@@ -308,6 +308,16 @@ EXPORT void video_output_disconnect(video_t *video, void (*callback)(void *param
 EXPORT bool video_output_disconnect2(video_t *video, void (*callback)(void *param, struct video_data *frame),
 				     void *param);
 
+/* Like video_output_connect2, but the callback (and any conversion) runs on a
+ * dedicated thread with a small frame queue.  If the queue is full when a new
+ * frame is output, that frame is dropped for this input only and counted as
+ * late. */
+EXPORT bool video_output_connect_threaded(video_t *video, const struct video_scale_info *conversion,
+					  uint32_t frame_rate_divisor,
+					  void (*callback)(void *param, struct video_data *frame), void *param);
+EXPORT bool video_output_get_input_frames(video_t *video, void (*callback)(void *param, struct video_data *frame),
+					  void *param, uint32_t *total_frames, uint32_t *late_frames);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *video_output_get_info(const video_t *video);
@@ -17,7 +17,7 @@
 
 #include "obs-avc.h"
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-nal.h"
 #include "util/array-serializer.h"
 #include "util/bitstream.h"
@@ -65,42 +65,9 @@ static int compute_avc_keyframe_priority(const uint8_t *nal_start, bool *is_keyf
 	return priority;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data, size_t size, bool *is_keyframe, int *priority)
-{
-	const uint8_t *const end = data + size;
-	const uint8_t *nal_start = obs_nal_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++))
-			;
-
-		if (nal_start == end)
-			break;
-
-		*priority = compute_avc_keyframe_priority(nal_start, is_keyframe, *priority);
-
-		const uint8_t *const nal_end = obs_nal_find_startcode(nal_start, end);
-		const size_t nal_size = nal_end - nal_start;
-		s_wb32(s, (uint32_t)nal_size);
-		s_write(s, nal_start, nal_size);
-		nal_start = nal_end;
-	}
-}
-
 void obs_parse_avc_packet(struct encoder_packet *avc_packet, const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
-	long ref = 1;
-
-	array_output_serializer_init(&s, &output);
-	*avc_packet = *src;
-
-	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe, &avc_packet->priority);
-
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
-	avc_packet->drop_priority = avc_packet->priority;
+	obs_nal_parse_packet(avc_packet, src, compute_avc_keyframe_priority);
 }
 
 int obs_parse_avc_packet_priority(const struct encoder_packet *packet)
@@ -273,7 +273,7 @@ static struct obs_data_item *obs_data_item_create(const char *name, const void *
 	name_size = get_name_align_size(name);
 	total_size = name_size + sizeof(struct obs_data_item) + size;
 
-	item = bzalloc(total_size);
+	item = bzalloc_tagged(total_size, BMEM_TAG_DATA);
 
 	item->capacity = total_size;
 	item->type = type;
@@ -442,6 +442,19 @@ static inline void obs_data_item_set_autoselect_data(struct obs_data_item **p_it
 
 static void obs_data_add_json_item(obs_data_t *data, const char *key, json_t *json);
 
+/* json objects are always parsed with JSON_REJECT_DUPLICATES, so keys are
+ * known to be unique and the lookup done by set_item can be skipped */
+static inline void obs_data_add_json_data(obs_data_t *data, const char *key, const void *ptr, size_t size,
+					  enum obs_data_type type)
+{
+	struct obs_data_item *item = obs_data_item_create(key, ptr, size, type, false, false);
+	if (!item)
+		return;
+
+	item->parent = data;
+	HASH_ADD_STR(data->items, name, item);
+}
+
 static inline void obs_data_add_json_object_data(obs_data_t *data, json_t *jobj)
 {
 	const char *item_key;
@@ -457,8 +470,12 @@ static inline void obs_data_add_json_object(obs_data_t *data, const char *key, j
 	obs_data_t *sub_obj = obs_data_create();
 
 	obs_data_add_json_object_data(sub_obj, jobj);
-	obs_data_set_obj(data, key, sub_obj);
+	obs_data_add_json_data(data, key, &sub_obj, sizeof(obs_data_t *), OBS_DATA_OBJECT);
 	obs_data_release(sub_obj);
+
+	/* free the converted subtree right away so the json tree and the
+	 * obs_data tree don't both have to be held in full at the same time */
+	json_object_clear(jobj);
 }
 
 static void obs_data_add_json_array(obs_data_t *data, const char *key, json_t *jarray)
@@ -467,6 +484,8 @@ static void obs_data_add_json_array(obs_data_t *data, const char *key, json_t *j
 	size_t idx;
 	json_t *jitem;
 
+	da_reserve(array->objects, json_array_size(jarray));
+
 	json_array_foreach (jarray, idx, jitem) {
 		obs_data_t *item;
 
@@ -475,30 +494,44 @@ static void obs_data_add_json_array(obs_data_t *data, const char *key, json_t *j
 
 		item = obs_data_create();
 		obs_data_add_json_object_data(item, jitem);
-		obs_data_array_push_back(array, item);
-		obs_data_release(item);
+		da_push_back(array->objects, &item);
+		json_object_clear(jitem);
 	}
 
-	obs_data_set_array(data, key, array);
+	obs_data_add_json_data(data, key, &array, sizeof(obs_data_array_t *), OBS_DATA_ARRAY);
 	obs_data_array_release(array);
+	json_array_clear(jarray);
 }
 
 static void obs_data_add_json_item(obs_data_t *data, const char *key, json_t *json)
 {
-	if (json_is_object(json))
+	struct obs_data_number num;
+	bool val;
+
+	if (json_is_object(json)) {
 		obs_data_add_json_object(data, key, json);
-	else if (json_is_array(json))
+
+	} else if (json_is_array(json)) {
 		obs_data_add_json_array(data, key, json);
-	else if (json_is_string(json))
-		obs_data_set_string(data, key, json_string_value(json));
-	else if (json_is_integer(json))
-		obs_data_set_int(data, key, json_integer_value(json));
-	else if (json_is_real(json))
-		obs_data_set_double(data, key, json_real_value(json));
-	else if (json_is_true(json))
-		obs_data_set_bool(data, key, true);
-	else if (json_is_false(json))
-		obs_data_set_bool(data, key, false);
+
+	} else if (json_is_string(json)) {
+		const char *str = json_string_value(json);
+		obs_data_add_json_data(data, key, str, strlen(str) + 1, OBS_DATA_STRING);
+
+	} else if (json_is_integer(json)) {
+		num.type = OBS_DATA_NUM_INT;
+		num.int_val = json_integer_value(json);
+		obs_data_add_json_data(data, key, &num, sizeof(num), OBS_DATA_NUMBER);
+
+	} else if (json_is_real(json)) {
+		num.type = OBS_DATA_NUM_DOUBLE;
+		num.double_val = json_real_value(json);
+		obs_data_add_json_data(data, key, &num, sizeof(num), OBS_DATA_NUMBER);
+
+	} else if (json_is_true(json) || json_is_false(json)) {
+		val = json_is_true(json);
+		obs_data_add_json_data(data, key, &val, sizeof(bool), OBS_DATA_BOOLEAN);
+	}
 }
 
 /* ------------------------------------------------------------------------- */
@@ -587,45 +620,71 @@ static json_t *obs_data_to_json(obs_data_t *data, bool with_defaults)
 
 obs_data_t *obs_data_create()
 {
-	struct obs_data *data = bzalloc(sizeof(struct obs_data));
+	struct obs_data *data = bzalloc_tagged(sizeof(struct obs_data), BMEM_TAG_DATA);
 	data->ref = 1;
 
 	return data;
 }
 
-obs_data_t *obs_data_create_from_json(const char *json_string)
+static obs_data_t *obs_data_create_from_json_root(json_t *root)
 {
 	obs_data_t *data = obs_data_create();
+	obs_data_add_json_object_data(data, root);
+	json_decref(root);
+	return data;
+}
 
+obs_data_t *obs_data_create_from_json(const char *json_string)
+{
 	json_error_t error;
 	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
 
-	if (root) {
-		obs_data_add_json_object_data(data, root);
-		json_decref(root);
-	} else {
+	if (!root) {
 		blog(LOG_ERROR,
 		     "obs-data.c: [obs_data_create_from_json] "
 		     "Failed reading json string (%d): %s",
 		     error.line, error.text);
-		obs_data_release(data);
-		data = NULL;
+		return NULL;
 	}
 
-	return data;
+	return obs_data_create_from_json_root(root);
+}
+
+static size_t read_json_file_cb(void *buffer, size_t buflen, void *param)
+{
+	FILE *file = param;
+	size_t size = fread(buffer, 1, buflen, file);
+	return (size == 0 && ferror(file)) ? (size_t)-1 : size;
 }
 
 obs_data_t *obs_data_create_from_json_file(const char *json_file)
 {
-	char *file_data = os_quick_read_utf8_file(json_file);
-	obs_data_t *data = NULL;
+	FILE *file = os_fopen(json_file, "rb");
+	json_error_t error;
+	json_t *root;
+	char bom[3];
+
+	if (!file)
+		return NULL;
+
+	/* remove the ghastly BOM if present */
+	if (fread(bom, 1, 3, file) != 3 || memcmp(bom, "\xEF\xBB\xBF", 3) != 0)
+		fseek(file, 0, SEEK_SET);
 
-	if (file_data) {
-		data = obs_data_create_from_json(file_data);
-		bfree(file_data);
+	/* parse straight from the file rather than reading the entire file
+	 * into memory first, large scene collections can be several MB */
+	root = json_load_callback(read_json_file_cb, file, JSON_REJECT_DUPLICATES, &error);
+	fclose(file);
+
+	if (!root) {
+		blog(LOG_ERROR,
+		     "obs-data.c: [obs_data_create_from_json_file] "
+		     "Failed reading json file '%s' (%d): %s",
+		     json_file, error.line, error.text);
+		return NULL;
 	}
 
-	return data;
+	return obs_data_create_from_json_root(root);
 }
 
 obs_data_t *obs_data_create_from_json_file_safe(const char *json_file, const char *backup_ext)
@@ -1284,7 +1343,7 @@ obs_data_array_t *obs_data_get_autoselect_array(obs_data_t *data, const char *na
 
 obs_data_array_t *obs_data_array_create()
 {
-	struct obs_data_array *array = bzalloc(sizeof(struct obs_data_array));
+	struct obs_data_array *array = bzalloc_tagged(sizeof(struct obs_data_array), BMEM_TAG_DATA);
 	array->ref = 1;
 
 	return array;
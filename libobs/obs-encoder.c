@@ -80,11 +80,13 @@ static struct obs_encoder *create_encoder(const char *id, enum obs_encoder_type
 {
 	struct obs_encoder *encoder;
 	struct obs_encoder_info *ei = find_encoder(id);
+	enum bmem_tag prev_tag;
 	bool success;
 
 	if (ei && ei->type != type)
 		return NULL;
 
+	prev_tag = bmem_set_thread_tag(BMEM_TAG_ENCODER);
 	encoder = bzalloc(sizeof(struct obs_encoder));
 	encoder->mixer_idx = mixer_idx;
 
@@ -104,6 +106,7 @@ static struct obs_encoder *create_encoder(const char *id, enum obs_encoder_type
 	if (!success) {
 		blog(LOG_ERROR, "creating encoder '%s' (%s) failed", name, id);
 		obs_encoder_destroy(encoder);
+		bmem_set_thread_tag(prev_tag);
 		return NULL;
 	}
 
@@ -120,6 +123,7 @@ static struct obs_encoder *create_encoder(const char *id, enum obs_encoder_type
 		blog(LOG_WARNING, "Encoder ID '%s' is deprecated and may be removed in a future version.", id);
 	}
 
+	bmem_set_thread_tag(prev_tag);
 	return encoder;
 }
 
@@ -322,7 +326,9 @@ static void add_connection(struct obs_encoder *encoder)
 		if (gpu_encode_available(encoder)) {
 			start_gpu_encode(encoder);
 		} else {
-			start_raw_video(encoder->media, &info, encoder->frame_rate_divisor, receive_video, encoder);
+			os_atomic_set_long(&encoder->late_frames, 0);
+			start_raw_video(encoder->media, &info, encoder->frame_rate_divisor, receive_video, encoder,
+					encoder->dedicated_thread);
 		}
 	}
 
@@ -338,6 +344,23 @@ static void add_connection(struct obs_encoder *encoder)
 	set_encoder_active(encoder, true);
 }
 
+static void log_late_frames(struct obs_encoder *encoder)
+{
+	uint32_t total = 0;
+	uint32_t late = 0;
+
+	if (!encoder->dedicated_thread)
+		return;
+	if (!video_output_get_input_frames(encoder->media, receive_video, encoder, &total, &late))
+		return;
+
+	os_atomic_set_long(&encoder->late_frames, (long)late);
+
+	if (late)
+		blog(LOG_INFO, "encoder '%s': %" PRIu32 "/%" PRIu32 " frames dropped due to encoding lag (%0.1f%%)",
+		     encoder->context.name, late, total, (double)late / (double)total * 100.0);
+}
+
 void obs_encoder_group_actually_destroy(obs_encoder_group_t *group);
 static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 {
@@ -347,6 +370,7 @@ static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 		if (gpu_encode_available(encoder)) {
 			stop_gpu_encode(encoder);
 		} else {
+			log_late_frames(encoder);
 			stop_raw_video(encoder->media, receive_video, encoder);
 		}
 	}
@@ -729,6 +753,7 @@ static inline void obs_encoder_start_internal(obs_encoder_t *encoder, encoded_ca
 		pause_reset(&encoder->pause);
 
 		encoder->cur_pts = 0;
+		encoder->last_video_ts = 0;
 		add_connection(encoder);
 	}
 }
@@ -1016,6 +1041,46 @@ enum obs_scale_type obs_encoder_get_scale_type(obs_encoder_t *encoder)
 	return encoder->gpu_scale_type;
 }
 
+bool obs_encoder_set_dedicated_thread(obs_encoder_t *encoder, bool dedicated_thread)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_dedicated_thread"))
+		return false;
+
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING,
+		     "obs_encoder_set_dedicated_thread: "
+		     "encoder '%s' is not a video encoder",
+		     obs_encoder_get_name(encoder));
+		return false;
+	}
+
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING,
+		     "encoder '%s': Cannot change encode thread "
+		     "while the encoder is active",
+		     obs_encoder_get_name(encoder));
+		return false;
+	}
+
+	encoder->dedicated_thread = dedicated_thread;
+	return true;
+}
+
+uint32_t obs_encoder_get_late_frames(const obs_encoder_t *encoder)
+{
+	uint32_t total = 0;
+	uint32_t late;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_late_frames"))
+		return 0;
+
+	late = (uint32_t)os_atomic_load_long(&encoder->late_frames);
+	if (encoder->dedicated_thread && encoder_active(encoder))
+		video_output_get_input_frames(encoder->media, receive_video, (void *)encoder, &total, &late);
+
+	return late;
+}
+
 uint32_t obs_encoder_get_frame_rate_divisor(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_set_frame_rate_divisor"))
@@ -1291,8 +1356,17 @@ void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+/* data of the packet currently being sent to the encoder callbacks on this
+ * thread, which is already reference counted */
+static THREAD_LOCAL const uint8_t *sending_packet_data = NULL;
+
 void send_off_encoder_packet(obs_encoder_t *encoder, bool success, bool received, struct encoder_packet *pkt)
 {
+	bool refcounted = (encoder->info.caps & OBS_ENCODER_CAP_REFCOUNTED_PACKETS) != 0;
+
+	if (refcounted && (!success || !received))
+		obs_encoder_packet_release(pkt);
+
 	if (!success) {
 		blog(LOG_ERROR, "Error encoding with encoder '%s'", encoder->context.name);
 		full_stop(encoder);
@@ -1338,10 +1412,26 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success, bool received
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
+		/* copy the packet data at most once, outputs and the delay
+		 * buffer then add references to it instead of copying it */
+		struct encoder_packet shared = *pkt;
+		bool share = refcounted || encoder->callbacks.num;
+		const uint8_t *prev_sending = sending_packet_data;
+
+		if (!refcounted && share)
+			obs_encoder_packet_create_instance(&shared, pkt);
+		if (share)
+			sending_packet_data = shared.data;
+
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt, found_ept ? &ept_local : NULL);
+			send_packet(encoder, cb, &shared, found_ept ? &ept_local : NULL);
+		}
+
+		if (share) {
+			sending_packet_data = prev_sending;
+			obs_encoder_packet_release(&shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -1436,6 +1526,20 @@ bool video_pause_check(struct pause_data *pause, uint64_t timestamp)
 	return ignore_frame;
 }
 
+/* frames dropped by the input thread of a dedicated encode thread never reach
+ * the encoder, but still take up their place in the timeline */
+static inline int64_t dropped_video_frames(struct obs_encoder *encoder, uint64_t ts)
+{
+	uint64_t interval = video_output_get_frame_time(encoder->media) * encoder->frame_rate_divisor;
+	uint64_t frames;
+
+	if (!interval || ts <= encoder->last_video_ts)
+		return 0;
+
+	frames = (ts - encoder->last_video_ts + interval / 2) / interval;
+	return frames > 1 ? (int64_t)(frames - 1) : 0;
+}
+
 static const char *receive_video_name = "receive_video";
 static void receive_video(void *param, struct video_data *frame)
 {
@@ -1469,8 +1573,10 @@ static void receive_video(void *param, struct video_data *frame)
 		}
 	}
 
-	if (video_pause_check(&encoder->pause, frame->timestamp))
+	if (video_pause_check(&encoder->pause, frame->timestamp)) {
+		encoder->last_video_ts = frame->timestamp;
 		goto wait_for_audio;
+	}
 
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
@@ -1482,6 +1588,11 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
+	if (encoder->dedicated_thread && encoder->last_video_ts)
+		encoder->cur_pts += dropped_video_frames(encoder, frame->timestamp) * encoder->timebase_num *
+				    encoder->frame_rate_divisor;
+	encoder->last_video_ts = frame->timestamp;
+
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
 
@@ -1737,14 +1848,26 @@ void obs_encoder_remove_output(struct obs_encoder *encoder, struct obs_output *o
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
-void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src)
+uint8_t *obs_encoder_packet_alloc_data(struct encoder_packet *packet, size_t size)
 {
-	long *p_refs;
+	long *p_refs = bmalloc_tagged(size + sizeof(long), BMEM_TAG_ENCODER);
 
-	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
 	*p_refs = 1;
+	packet->data = (uint8_t *)(p_refs + 1);
+	packet->size = size;
+	return packet->data;
+}
+
+void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src)
+{
+	*dst = *src;
+
+	if (src->data && src->data == sending_packet_data) {
+		os_atomic_inc_long(((long *)src->data) - 1);
+		return;
+	}
+
+	obs_encoder_packet_alloc_data(dst, src->size);
 	memcpy(dst->data, src->data, src->size);
 }
 
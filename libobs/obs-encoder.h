@@ -38,6 +38,9 @@ typedef struct obs_encoder obs_encoder_t;
 #define OBS_ENCODER_CAP_INTERNAL (1 << 3)
 #define OBS_ENCODER_CAP_ROI (1 << 4)
 #define OBS_ENCODER_CAP_SCALING (1 << 5)
+/* packet data is allocated with obs_encoder_packet_alloc_data(), and libobs
+ * takes ownership of it */
+#define OBS_ENCODER_CAP_REFCOUNTED_PACKETS (1 << 6)
 
 /** Specifies the encoder type */
 enum obs_encoder_type {
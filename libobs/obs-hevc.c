@@ -17,9 +17,8 @@
 
 #include "obs-hevc.h"
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-nal.h"
-#include "util/array-serializer.h"
 
 bool obs_hevc_keyframe(const uint8_t *data, size_t size)
 {
@@ -66,43 +65,9 @@ static int compute_hevc_keyframe_priority(const uint8_t *nal_start, bool *is_key
 	return priority;
 }
 
-static void serialize_hevc_data(struct serializer *s, const uint8_t *data, size_t size, bool *is_keyframe,
-				int *priority)
-{
-	const uint8_t *const end = data + size;
-	const uint8_t *nal_start = obs_nal_find_startcode(data, end);
-	while (true) {
-		while (nal_start < end && !*(nal_start++))
-			;
-
-		if (nal_start == end)
-			break;
-
-		*priority = compute_hevc_keyframe_priority(nal_start, is_keyframe, *priority);
-
-		const uint8_t *const nal_end = obs_nal_find_startcode(nal_start, end);
-		const size_t nal_size = nal_end - nal_start;
-		s_wb32(s, (uint32_t)nal_size);
-		s_write(s, nal_start, nal_size);
-		nal_start = nal_end;
-	}
-}
-
 void obs_parse_hevc_packet(struct encoder_packet *hevc_packet, const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
-	long ref = 1;
-
-	array_output_serializer_init(&s, &output);
-	*hevc_packet = *src;
-
-	serialize(&s, &ref, sizeof(ref));
-	serialize_hevc_data(&s, src->data, src->size, &hevc_packet->keyframe, &hevc_packet->priority);
-
-	hevc_packet->data = output.bytes.array + sizeof(ref);
-	hevc_packet->size = output.bytes.num - sizeof(ref);
-	hevc_packet->drop_priority = hevc_packet->priority;
+	obs_nal_parse_packet(hevc_packet, src, compute_hevc_keyframe_priority);
 }
 
 int obs_parse_hevc_packet_priority(const struct encoder_packet *packet)
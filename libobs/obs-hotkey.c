@@ -136,13 +136,12 @@ void obs_hotkey_pair_set_descriptions(obs_hotkey_pair_id id, const char *desc0,
 
 static void hotkey_signal(const char *signal, obs_hotkey_t *hotkey)
 {
-	calldata_t data;
-	calldata_init(&data);
-	calldata_set_ptr(&data, "key", hotkey);
+	calldata_t *data = calldata_acquire();
+	calldata_set_ptr(data, "key", hotkey);
 
-	signal_handler_signal(obs->hotkeys.signals, signal, &data);
+	signal_handler_signal(obs->hotkeys.signals, signal, data);
 
-	calldata_free(&data);
+	calldata_release(data);
 }
 
 static inline void load_bindings(obs_hotkey_t *hotkey, obs_data_array_t *data);
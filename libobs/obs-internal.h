@@ -35,6 +35,8 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/video-composite.h"
+#include "media-io/video-scaler.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
@@ -313,11 +315,22 @@ struct obs_core_video_mix {
 
 	bool encoder_only_mix;
 	long encoder_refs;
+
+	/* CPU compositing: the base resolution RGBA canvas, the layers drawn
+	 * on it and the sources they belong to, which are referenced until
+	 * the frame is composited */
+	uint8_t *cpu_canvas;
+	DARRAY(struct video_composite_layer) cpu_layers;
+	DARRAY(obs_source_t *) cpu_sources;
+	video_scaler_t *cpu_scaler;
 };
 
 extern struct obs_core_video_mix *obs_create_video_mix(struct obs_video_info *ovi);
 extern void obs_free_video_mix(struct obs_core_video_mix *video);
 
+extern void obs_cpu_output_frames(void);
+extern void obs_cpu_free_video_mix(struct obs_core_video_mix *video);
+
 struct obs_core_video {
 	graphics_t *graphics;
 	gs_effect_t *default_effect;
@@ -366,6 +379,15 @@ struct obs_core_video {
 	pthread_mutex_t mixes_mutex;
 	DARRAY(struct obs_core_video_mix *) mixes;
 	struct obs_core_video_mix *main_mix;
+
+	/* runs video_tick of OBS_SOURCE_PARALLEL_TICK sources */
+	os_task_pool_t *tick_pool;
+
+	/* video is composited on the CPU without a graphics subsystem, see
+	 * OBS_GRAPHICS_MODULE_CPU.  cpu_frame counts the composited frames so
+	 * sources used by several items or mixes are rendered once */
+	bool cpu_compositing;
+	uint64_t cpu_frame;
 };
 
 extern void add_ready_encoder_group(obs_encoder_t *encoder);
@@ -394,6 +416,12 @@ struct obs_core_audio {
 	struct deque tasks;
 };
 
+struct parallel_tick {
+	obs_source_t *source;
+	uint64_t tick_time;
+	size_t worker;
+};
+
 /* user sources, output channels, and displays */
 struct obs_core_data {
 	/* Hash tables (uthash) */
@@ -428,6 +456,15 @@ struct obs_core_data {
 
 	DARRAY(char *) protocols;
 	DARRAY(obs_source_t *) sources_to_tick;
+	DARRAY(struct parallel_tick) parallel_ticks;
+
+	/* sources that currently need obs_source_video_tick, maintained
+	 * incrementally so idle sources cost nothing per frame */
+	pthread_mutex_t tick_set_mutex;
+	DARRAY(obs_source_t *) tick_set;
+
+	/* loaded input sources are only created once they're first used */
+	bool defer_source_create;
 };
 
 /* user hotkeys */
@@ -497,6 +534,11 @@ struct obs_core {
 
 	os_task_queue_t *destruction_task_thread;
 
+	/* copies and deinterlaces async video frames in bands of rows, lives
+	 * as long as the core since sources can output frames across video
+	 * resets */
+	os_task_pool_t *async_frame_pool;
+
 	obs_task_handler_t ui_task_handler;
 };
 
@@ -526,7 +568,7 @@ extern bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in
 extern struct obs_core_video_mix *get_mix_for_video(video_t *video);
 
 extern void start_raw_video(video_t *video, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
-			    void (*callback)(void *param, struct video_data *frame), void *param);
+			    void (*callback)(void *param, struct video_data *frame), void *param, bool threaded);
 extern void stop_raw_video(video_t *video, void (*callback)(void *param, struct video_data *frame), void *param);
 
 /* ------------------------------------------------------------------------- */
@@ -638,9 +680,60 @@ static inline bool obs_weak_ref_expired(struct obs_weak_ref *ref)
 struct async_frame {
 	struct obs_source_frame *frame;
 	long unused_count;
-	bool used;
 };
 
+/* Single-producer/single-consumer ring of async frames.  The producer side
+ * is serialized by async_output_mutex and the consumer side by async_mutex,
+ * so the thread outputting frames never waits on the graphics thread. */
+#define ASYNC_FRAME_RING_SIZE 32
+
+struct async_frame_ring {
+	struct obs_source_frame *frames[ASYNC_FRAME_RING_SIZE];
+	volatile long head;
+	volatile long tail;
+};
+
+static inline size_t async_frame_ring_count(const struct async_frame_ring *ring)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&ring->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	return (size_t)(tail - head);
+}
+
+/* producer side */
+static inline bool async_frame_ring_push(struct async_frame_ring *ring, struct obs_source_frame *frame)
+{
+	unsigned long tail = (unsigned long)ring->tail;
+
+	if (async_frame_ring_count(ring) == ASYNC_FRAME_RING_SIZE)
+		return false;
+
+	ring->frames[tail % ASYNC_FRAME_RING_SIZE] = frame;
+	os_atomic_set_long(&ring->tail, (long)(tail + 1));
+	return true;
+}
+
+/* consumer side, idx must be less than the frame count */
+static inline struct obs_source_frame *async_frame_ring_peek(const struct async_frame_ring *ring, size_t idx)
+{
+	unsigned long head = (unsigned long)ring->head;
+	return ring->frames[(head + idx) % ASYNC_FRAME_RING_SIZE];
+}
+
+/* consumer side */
+static inline struct obs_source_frame *async_frame_ring_pop(struct async_frame_ring *ring)
+{
+	unsigned long head = (unsigned long)ring->head;
+	struct obs_source_frame *frame;
+
+	if (!async_frame_ring_count(ring))
+		return NULL;
+
+	frame = ring->frames[head % ASYNC_FRAME_RING_SIZE];
+	os_atomic_set_long(&ring->head, (long)(head + 1));
+	return frame;
+}
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -711,6 +804,16 @@ struct obs_source {
 	/* ensures activate/deactivate are only called once */
 	volatile long activate_refs;
 
+	/* source is in obs->data.tick_set */
+	volatile bool in_tick_set;
+
+	/* enum deferred_create_state, creation of the source's plugin data is
+	 * postponed until the source is first shown or activated */
+	volatile long deferred_create;
+
+	/* rendered since the last video tick */
+	volatile bool tick_rendered;
+
 	/* source is in the process of being destroyed */
 	volatile long destroying;
 
@@ -768,6 +871,7 @@ struct obs_source {
 	uint32_t audio_mixers;
 	float user_volume;
 	float volume;
+	signal_handle_t *volume_signal;
 	int64_t sync_offset;
 	int64_t last_sync_offset;
 	float balance;
@@ -793,13 +897,26 @@ struct obs_source {
 	bool async_unbuffered;
 	bool async_decoupled;
 	struct obs_source_frame *async_preload_frame;
-	DARRAY(struct async_frame) async_cache;
-	DARRAY(struct obs_source_frame *) async_frames;
 	pthread_mutex_t async_mutex;
 	uint32_t async_width;
 	uint32_t async_height;
+
+	/* frames queued for the graphics thread */
+	struct async_frame_ring async_frames;
+	/* frames given back by the graphics thread for reuse */
+	struct async_frame_ring async_free_frames;
+	/* frames taken from the queue and not given back yet, only accessed
+	 * with async_mutex held */
+	DARRAY(struct async_frame) async_cache;
+	/* idle frames of the outputting thread, only accessed with
+	 * async_output_mutex held */
+	DARRAY(struct async_frame) async_spare_frames;
+	pthread_mutex_t async_output_mutex;
 	uint32_t async_cache_width;
 	uint32_t async_cache_height;
+	volatile bool async_flush;
+	volatile long async_dropped_frames;
+	volatile long async_late_frames;
 	uint32_t async_convert_width[MAX_AV_PLANES];
 	uint32_t async_convert_height[MAX_AV_PLANES];
 	uint64_t async_last_rendered_ts;
@@ -819,6 +936,12 @@ struct obs_source {
 	bool deinterlace_top_first;
 	bool deinterlace_rendered;
 
+	/* CPU deinterlacing of frames as they are output: the previous,
+	 * current and next frame, only accessed with async_output_mutex
+	 * held */
+	struct obs_source_frame *deinterlace_cpu_frames[3];
+	bool deinterlace_cpu;
+
 	/* filters */
 	struct obs_source *filter_parent;
 	struct obs_source *filter_target;
@@ -872,6 +995,16 @@ struct obs_source {
 	/* color space */
 	gs_texrender_t *color_space_texrender;
 
+	/* CPU compositing: the image of the source for cpu_image_frame, the
+	 * two images its filters draw to in turn, and which of them is drawn
+	 * (NULL if none) */
+	struct obs_cpu_image cpu_image;
+	struct obs_cpu_image cpu_filter_images[2];
+	const struct obs_cpu_image *cpu_output;
+	uint64_t cpu_image_frame;
+	bool cpu_image_opaque;
+	bool cpu_unsupported_logged;
+
 	/* audio monitoring */
 	struct audio_monitor *monitor;
 	enum obs_monitoring_type monitoring_type;
@@ -893,6 +1026,7 @@ extern bool obs_transition_init(obs_source_t *transition);
 extern void obs_transition_free(obs_source_t *transition);
 extern void obs_transition_tick(obs_source_t *transition, float t);
 extern void obs_transition_enum_sources(obs_source_t *transition, obs_source_enum_proc_t enum_callback, void *param);
+extern obs_source_t *obs_transition_get_cpu_source(obs_source_t *transition, struct matrix4 *matrix);
 extern void obs_transition_save(obs_source_t *source, obs_data_t *data);
 extern void obs_transition_load(obs_source_t *source, obs_data_t *data);
 
@@ -900,9 +1034,15 @@ struct audio_monitor *audio_monitor_create(obs_source_t *source);
 void audio_monitor_reset(struct audio_monitor *monitor);
 extern void audio_monitor_destroy(struct audio_monitor *monitor);
 
+enum deferred_create_state {
+	DEFERRED_CREATE_NONE,
+	DEFERRED_CREATE_PENDING,
+	DEFERRED_CREATE_QUEUED,
+};
+
 extern obs_source_t *obs_source_create_set_last_ver(const char *id, const char *name, const char *uuid,
 						    obs_data_t *settings, obs_data_t *hotkey_data,
-						    uint32_t last_obs_ver, bool is_private);
+						    uint32_t last_obs_ver, bool is_private, bool defer_create);
 extern void obs_source_destroy(struct obs_source *source);
 extern void obs_source_addref(obs_source_t *source);
 
@@ -989,6 +1129,10 @@ extern void obs_source_set_texcoords_centered(obs_source_t *source, bool centere
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern bool obs_source_video_tick_begin(obs_source_t *source, float seconds);
+extern void obs_source_video_tick_callback(obs_source_t *source, float seconds);
+extern void obs_source_tick_set_add(obs_source_t *source);
+extern void obs_source_tick_set_prune(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source, obs_source_t *target);
 extern uint64_t obs_source_get_last_async_ts(const obs_source_t *source);
 
@@ -1004,12 +1148,20 @@ extern bool update_async_textures(struct obs_source *source, const struct obs_so
 				  gs_texture_t *tex[MAX_AV_PLANES], gs_texrender_t *texrender);
 extern bool set_async_texture_size(struct obs_source *source, const struct obs_source_frame *frame);
 extern void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame);
+extern struct obs_source_frame *pop_async_frame(obs_source_t *source);
+extern void skip_async_frame(obs_source_t *source);
 
 extern void set_deinterlace_texture_size(obs_source_t *source);
 extern void deinterlace_process_last_frame(obs_source_t *source, uint64_t sys_time);
 extern void deinterlace_update_async_video(obs_source_t *source);
 extern void deinterlace_render(obs_source_t *s);
 
+extern bool deinterlace_cpu_active(const obs_source_t *source, enum video_format format);
+extern bool deinterlace_cpu_push_frame(obs_source_t *source, const struct obs_source_frame *frame);
+extern size_t deinterlace_cpu_field_count(const obs_source_t *source);
+extern void deinterlace_cpu_output_field(obs_source_t *source, struct obs_source_frame *dst, bool second_field);
+extern void deinterlace_cpu_flush(obs_source_t *source);
+
 /* ------------------------------------------------------------------------- */
 /* outputs  */
 
@@ -1190,6 +1342,13 @@ extern void obs_output_remove_encoder(struct obs_output *output, struct obs_enco
 extern void obs_encoder_packet_create_instance(struct encoder_packet *dst, const struct encoder_packet *src);
 void obs_output_destroy(obs_output_t *output);
 
+typedef int (*obs_nal_priority_func)(const uint8_t *nal_start, bool *is_keyframe, int priority);
+
+/* converts an Annex-B packet to 4-byte length-prefixed NAL units in a new
+ * refcounted buffer, updating keyframe/priority in the same pass */
+extern void obs_nal_parse_packet(struct encoder_packet *dst, const struct encoder_packet *src,
+				 obs_nal_priority_func get_priority);
+
 /* ------------------------------------------------------------------------- */
 /* encoders  */
 
@@ -1266,6 +1425,13 @@ struct obs_encoder {
 	// Number of frames successfully encoded
 	uint32_t encoded_frames;
 
+	/* raw video encoders can receive frames on their own thread, in which
+	 * case frames they can't keep up with are dropped and counted as late,
+	 * and their pts are skipped based on the gap from last_video_ts */
+	bool dedicated_thread;
+	volatile long late_frames;
+	uint64_t last_video_ts;
+
 	/* Regions of interest to prioritize during encoding */
 	pthread_mutex_t roi_mutex;
 	DARRAY(struct obs_encoder_roi) roi;
@@ -1378,6 +1544,8 @@ extern void source_profiler_async_frame_received(obs_source_t *source);
 extern uint64_t source_profiler_source_tick_start(void);
 /* Submit start timestamp for source */
 extern void source_profiler_source_tick_end(obs_source_t *source, uint64_t start);
+/* Adds time of a tick callback that ran on tick pool worker 'worker' */
+extern void source_profiler_source_tick_add(obs_source_t *source, uint64_t time, size_t worker);
 
 /* Obtain GPU timer and start timestamp for render start of a source. */
 extern uint64_t source_profiler_source_render_begin(gs_timer_t **timer);
@@ -17,50 +17,127 @@
 
 #include "obs-nal.h"
 
-/* NOTE: I noticed that FFmpeg does some unusual special handling of certain
- * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
- * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
-static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p, const uint8_t *end)
-{
-	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+#include "obs-internal.h"
+#include "util/sse-intrin.h"
 
-	for (end -= 3; p < a && p < end; p++) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
+/* Returns the first {0, 0, 1} sequence followed by at least one byte of
+ * data, or end.  This matches the FFmpeg-derived word-at-a-time search that
+ * used to be here, but compares 16 positions at a time. */
+static const uint8_t *find_startcode_internal(const uint8_t *p, const uint8_t *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
 
-	for (end -= 3; p < end; p += 4) {
-		uint32_t x = *(const uint32_t *)p;
+	while (end - p >= 19) {
+		__m128i b0 = _mm_loadu_si128((const __m128i *)p);
+		__m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
 
-		if ((x - 0x01010101) & (~x) & 0x80808080) {
-			if (p[1] == 0) {
-				if (p[0] == 0 && p[2] == 1)
-					return p;
-				if (p[2] == 0 && p[3] == 1)
-					return p + 1;
-			}
+		__m128i match = _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero));
+		match = _mm_and_si128(match, _mm_cmpeq_epi8(b2, one));
 
-			if (p[3] == 0) {
-				if (p[2] == 0 && p[4] == 1)
-					return p + 2;
-				if (p[4] == 0 && p[5] == 1)
-					return p + 3;
+		int mask = _mm_movemask_epi8(match);
+		if (mask) {
+			while (!(mask & 1)) {
+				mask >>= 1;
+				p++;
 			}
+			return p;
 		}
+
+		p += 16;
 	}
 
-	for (end += 3; p < end; p++) {
+	for (; end - p >= 4; p++) {
 		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
 			return p;
 	}
 
-	return end + 3;
+	return end;
 }
 
 const uint8_t *obs_nal_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-	const uint8_t *out = ff_avc_find_startcode_internal(p, end);
+	const uint8_t *out = find_startcode_internal(p, end);
 	if (p < out && out < end && !out[-1])
 		out--;
 	return out;
 }
+
+/* ------------------------------------------------------------------------- */
+
+#define MAX_CACHED_NALS 64
+
+struct nal_span {
+	const uint8_t *start;
+	size_t size;
+};
+
+static inline const uint8_t *next_nal(const uint8_t *nal_start, const uint8_t *end, struct nal_span *span)
+{
+	while (nal_start < end && !*(nal_start++))
+		;
+
+	if (nal_start == end)
+		return NULL;
+
+	span->start = nal_start;
+	span->size = obs_nal_find_startcode(nal_start, end) - nal_start;
+	return nal_start + span->size;
+}
+
+static inline uint8_t *write_nal(uint8_t *out, const struct nal_span *span)
+{
+	out[0] = (uint8_t)(span->size >> 24);
+	out[1] = (uint8_t)(span->size >> 16);
+	out[2] = (uint8_t)(span->size >> 8);
+	out[3] = (uint8_t)span->size;
+	memcpy(out + 4, span->start, span->size);
+	return out + 4 + span->size;
+}
+
+void obs_nal_parse_packet(struct encoder_packet *dst, const struct encoder_packet *src,
+			  obs_nal_priority_func get_priority)
+{
+	struct nal_span spans[MAX_CACHED_NALS];
+	struct nal_span span;
+	const uint8_t *const end = src->data + src->size;
+	const uint8_t *nal_start;
+	size_t num_nals = 0;
+	size_t out_size = 0;
+	uint8_t *out;
+	long *p_refs;
+
+	*dst = *src;
+
+	/* first pass: find the NAL units, classify them and size the output,
+	 * which grows by one byte for every 3-byte start code */
+	nal_start = obs_nal_find_startcode(src->data, end);
+	while ((nal_start = next_nal(nal_start, end, &span)) != NULL) {
+		dst->priority = get_priority(span.start, &dst->keyframe, dst->priority);
+
+		if (num_nals < MAX_CACHED_NALS)
+			spans[num_nals] = span;
+		num_nals++;
+		out_size += 4 + span.size;
+	}
+
+	/* second pass: write length-prefixed NAL units into a single
+	 * refcounted buffer */
+	p_refs = bmalloc(sizeof(long) + out_size);
+	*p_refs = 1;
+	out = (uint8_t *)(p_refs + 1);
+
+	dst->data = out;
+	dst->size = out_size;
+	dst->drop_priority = dst->priority;
+
+	for (size_t i = 0; i < num_nals && i < MAX_CACHED_NALS; i++)
+		out = write_nal(out, &spans[i]);
+
+	if (num_nals > MAX_CACHED_NALS) {
+		nal_start = spans[MAX_CACHED_NALS - 1].start + spans[MAX_CACHED_NALS - 1].size;
+		while ((nal_start = next_nal(nal_start, end, &span)) != NULL)
+			out = write_nal(out, &span);
+	}
+}
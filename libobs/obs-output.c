@@ -162,6 +162,7 @@ static bool init_output_handlers(struct obs_output *output, const char *name, ob
 obs_output_t *obs_output_create(const char *id, const char *name, obs_data_t *settings, obs_data_t *hotkey_data)
 {
 	const struct obs_output_info *info = find_output(id);
+	enum bmem_tag prev_tag = bmem_set_thread_tag(BMEM_TAG_OUTPUT);
 	struct obs_output *output;
 	int ret;
 
@@ -219,10 +220,12 @@ obs_output_t *obs_output_create(const char *id, const char *name, obs_data_t *se
 		blog(LOG_ERROR, "Failed to create output '%s'!", name);
 
 	blog(LOG_DEBUG, "output '%s' (%s) created", name, id);
+	bmem_set_thread_tag(prev_tag);
 	return output;
 
 fail:
 	obs_output_destroy(output);
+	bmem_set_thread_tag(prev_tag);
 	return NULL;
 }
 
@@ -2444,7 +2447,7 @@ static void hook_data_capture(struct obs_output *output)
 	} else {
 		if (has_video)
 			start_raw_video(output->video, obs_output_get_video_conversion(output), 1,
-					default_raw_video_callback, output);
+					default_raw_video_callback, output, false);
 		if (has_audio)
 			start_raw_audio(output);
 	}
@@ -2473,16 +2476,15 @@ static inline void signal_reconnect_success(struct obs_output *output)
 
 static inline void signal_stop(struct obs_output *output)
 {
-	struct calldata params;
+	calldata_t *params = calldata_acquire();
 
-	calldata_init(&params);
-	calldata_set_string(&params, "last_error", obs_output_get_last_error(output));
-	calldata_set_int(&params, "code", output->stop_code);
-	calldata_set_ptr(&params, "output", output);
+	calldata_set_string(params, "last_error", obs_output_get_last_error(output));
+	calldata_set_int(params, "code", output->stop_code);
+	calldata_set_ptr(params, "output", output);
 
-	signal_handler_signal(output->context.signals, "stop", &params);
+	signal_handler_signal(output->context.signals, "stop", params);
 
-	calldata_free(&params);
+	calldata_release(params);
 }
 
 bool obs_output_can_begin_data_capture(const obs_output_t *output, uint32_t flags)
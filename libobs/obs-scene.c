@@ -153,6 +153,8 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 {
 	struct obs_scene *scene = bzalloc(sizeof(struct obs_scene));
 	scene->source = source;
+	scene->index_gen = -1;
+	scene->render_items_gen = -1;
 
 	if (strcmp(source->info.id, group_info.id) == 0) {
 		scene->is_group = true;
@@ -162,6 +164,7 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 	}
 
 	signal_handler_add_array(obs_source_get_signal_handler(source), obs_scene_signals);
+	scene->item_transform_signal = signal_handler_get_handle(obs_source_get_signal_handler(source), "item_transform");
 
 	if (pthread_mutex_init_recursive(&scene->audio_mutex) != 0) {
 		blog(LOG_ERROR, "scene_create: Couldn't initialize audio "
@@ -203,6 +206,16 @@ static inline void full_unlock(struct obs_scene *scene)
 
 static void obs_sceneitem_remove_internal(obs_sceneitem_t *item);
 
+/* the hash tables live in the items themselves, so this has to happen while
+ * every indexed item is still alive and still belongs to this scene */
+static inline void clear_items_index(struct obs_scene *scene)
+{
+	HASH_CLEAR(hh_id, scene->items_by_id);
+	HASH_CLEAR(hh_source, scene->items_by_source);
+	HASH_CLEAR(hh_name, scene->items_by_name);
+	da_resize(scene->index_groups, 0);
+}
+
 static void remove_all_items(struct obs_scene *scene)
 {
 	struct obs_scene_item *item;
@@ -238,6 +251,12 @@ static void scene_destroy(void *data)
 	pthread_mutex_destroy(&scene->video_mutex);
 	pthread_mutex_destroy(&scene->audio_mutex);
 	da_free(scene->mix_sources);
+	da_free(scene->mix_order);
+	da_free(scene->audio_plan);
+	da_free(scene->audio_plan_scenes);
+	da_free(scene->audio_plan_sources);
+	da_free(scene->render_items);
+	da_free(scene->index_groups);
 	bfree(scene);
 }
 
@@ -292,8 +311,20 @@ static void scene_enum_all_sources(void *data, obs_source_enum_proc_t enum_callb
 	scene_enum_sources(data, enum_callback, param, false);
 }
 
+/* call with the scene locked whenever its items are added, removed or
+ * reordered, before the item list is touched.  the lookup indexes are dropped
+ * right away rather than on the next lookup, since a removed item may be freed
+ * or moved to a group before then. */
+static inline void scene_items_changed(struct obs_scene *scene)
+{
+	scene->items_gen++;
+	clear_items_index(scene);
+}
+
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
+	scene_items_changed(item->parent);
+
 	if (item->prev)
 		item->prev->next = item->next;
 	else
@@ -307,6 +338,8 @@ static inline void detach_sceneitem(struct obs_scene_item *item)
 
 static inline void attach_sceneitem(struct obs_scene *parent, struct obs_scene_item *item, struct obs_scene_item *prev)
 {
+	scene_items_changed(parent);
+
 	item->prev = prev;
 	item->parent = parent;
 
@@ -693,7 +726,8 @@ static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 
 	calldata_init_fixed(&params, stack, sizeof(stack));
 	calldata_set_ptr(&params, "item", item);
-	signal_parent(item->parent, "item_transform", &params);
+	calldata_set_ptr(&params, "scene", item->parent);
+	signal_handle_emit(item->parent->item_transform_signal, &params);
 
 	if (!update_tex)
 		return;
@@ -983,17 +1017,32 @@ cleanup:
 	GS_DEBUG_MARKER_END();
 }
 
+/* assumes video lock */
+static void update_render_items(struct obs_scene *scene)
+{
+	struct obs_scene_item *item;
+
+	if (scene->render_items_gen == scene->items_gen)
+		return;
+
+	da_resize(scene->render_items, 0);
+	for (item = scene->first_item; item; item = item->next)
+		da_push_back(scene->render_items, &item);
+
+	scene->render_items_gen = scene->items_gen;
+}
+
 static void scene_video_tick(void *data, float seconds)
 {
 	struct obs_scene *scene = data;
-	struct obs_scene_item *item;
 
 	video_lock(scene);
-	item = scene->first_item;
-	while (item) {
+	update_render_items(scene);
+
+	for (size_t i = 0; i < scene->render_items.num; i++) {
+		struct obs_scene_item *item = scene->render_items.array[i];
 		if (item->item_render)
 			gs_texrender_reset(item->item_render);
-		item = item->next;
 	}
 	video_unlock(scene);
 
@@ -1004,16 +1053,18 @@ static void scene_video_tick(void *data, float seconds)
 static void update_transforms_and_prune_sources(obs_scene_t *scene, obs_scene_item_ptr_array_t *remove_items,
 						obs_sceneitem_t *group_sceneitem, bool scene_size_changed)
 {
-	struct obs_scene_item *item = scene->first_item;
 	bool rebuild_group = group_sceneitem && os_atomic_load_bool(&group_sceneitem->update_group_resize);
 
-	while (item) {
-		if (obs_source_removed(item->source)) {
-			struct obs_scene_item *del_item = item;
-			item = item->next;
+	update_render_items(scene);
+
+	/* removing items changes items_gen but not the array being walked,
+	 * which is rebuilt on the next call */
+	for (size_t i = 0; i < scene->render_items.num; i++) {
+		struct obs_scene_item *item = scene->render_items.array[i];
 
-			obs_sceneitem_remove_internal(del_item);
-			da_push_back(*remove_items, &del_item);
+		if (obs_source_removed(item->source)) {
+			obs_sceneitem_remove_internal(item);
+			da_push_back(*remove_items, &item);
 			rebuild_group = true;
 			continue;
 		}
@@ -1031,8 +1082,6 @@ static void update_transforms_and_prune_sources(obs_scene_t *scene, obs_scene_it
 			update_item_transform(item, true);
 			rebuild_group = true;
 		}
-
-		item = item->next;
 	}
 
 	if (rebuild_group && group_sceneitem)
@@ -1056,7 +1105,6 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	obs_scene_item_ptr_array_t remove_items;
 	struct obs_scene *scene = data;
-	struct obs_scene_item *item;
 
 	da_init(remove_items);
 
@@ -1067,15 +1115,16 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 		update_transforms_and_prune_sources(scene, &remove_items, NULL, size_changed);
 	}
 
+	update_render_items(scene);
+
 	gs_blend_state_push();
 	gs_reset_blend_state();
 
-	item = scene->first_item;
-	while (item) {
+	for (size_t i = 0; i < scene->render_items.num; i++) {
+		struct obs_scene_item *item = scene->render_items.array[i];
+
 		if (item->user_visible || transition_active(item->hide_transition))
 			render_item(item);
-
-		item = item->next;
 	}
 
 	gs_blend_state_pop();
@@ -1089,6 +1138,36 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+void obs_scene_enum_render_items(struct obs_scene *scene, obs_scene_render_item_cb callback, void *param)
+{
+	obs_scene_item_ptr_array_t remove_items;
+
+	da_init(remove_items);
+
+	video_lock(scene);
+
+	if (!scene->is_group) {
+		bool size_changed = scene_size_changed(scene);
+		update_transforms_and_prune_sources(scene, &remove_items, NULL, size_changed);
+	}
+
+	update_render_items(scene);
+
+	/* show and hide transitions aren't rendered, items switch at once */
+	for (size_t i = 0; i < scene->render_items.num; i++) {
+		struct obs_scene_item *item = scene->render_items.array[i];
+
+		if (item->user_visible)
+			callback(param, item);
+	}
+
+	video_unlock(scene);
+
+	for (size_t i = 0; i < remove_items.num; i++)
+		obs_sceneitem_release(remove_items.array[i]);
+	da_free(remove_items);
+}
+
 static void set_visibility(struct obs_scene_item *item, bool vis)
 {
 	pthread_mutex_lock(&item->actions_mutex);
@@ -1576,38 +1655,104 @@ static inline void mix_audio(float *p_out, float *p_in, size_t pos, size_t count
 		*(out++) += *(in++);
 }
 
-static inline struct scene_source_mix *get_source_mix(struct obs_scene *scene, struct obs_source *source)
+static void audio_plan_add_scene(struct obs_scene *root, struct obs_scene *scene)
 {
-	for (size_t i = 0; i < scene->mix_sources.num; i++) {
-		struct scene_source_mix *mix = &scene->mix_sources.array[i];
-		if (mix->source == source)
-			return mix;
+	struct scene_audio_plan_scene *plan_scene = da_push_back_new(root->audio_plan_scenes);
+	plan_scene->scene = scene;
+	plan_scene->items_gen = scene->items_gen;
+
+	for (struct obs_scene_item *item = scene->first_item; item; item = item->next) {
+		size_t idx = root->audio_plan.num;
+		struct scene_audio_plan_entry *entry = da_push_back_new(root->audio_plan);
+		struct obs_source *source = item->source;
+
+		entry->item = item;
+		entry->mix_idx = da_find(root->audio_plan_sources, &source, 0);
+		if (entry->mix_idx == DARRAY_INVALID) {
+			entry->mix_idx = root->audio_plan_sources.num;
+			da_push_back(root->audio_plan_sources, &source);
+		}
+
+		if (obs_source_is_group(source) || obs_source_is_scene(source)) {
+			struct obs_scene *nested = source->context.data;
+
+			audio_lock(nested);
+			audio_plan_add_scene(root, nested);
+			audio_unlock(nested);
+		}
+
+		root->audio_plan.array[idx].end = root->audio_plan.num;
 	}
+}
 
-	return NULL;
+/* call with the scene audio locked */
+static void rebuild_audio_plan(struct obs_scene *scene)
+{
+	da_resize(scene->audio_plan, 0);
+	da_resize(scene->audio_plan_scenes, 0);
+	da_resize(scene->audio_plan_sources, 0);
+
+	audio_plan_add_scene(scene, scene);
+
+	da_resize(scene->mix_sources, scene->audio_plan_sources.num);
+	for (size_t i = 0; i < scene->mix_sources.num; i++)
+		scene->mix_sources.array[i].source = NULL;
+	da_reserve(scene->mix_order, scene->mix_sources.num);
+}
+
+static void audio_plan_unlock(struct obs_scene *scene, size_t count)
+{
+	for (size_t i = count; i > 1; i--)
+		audio_unlock(scene->audio_plan_scenes.array[i - 1].scene);
+}
+
+/* Locks the nested scenes of the audio plan (the scene itself is already
+ * locked).  Scenes are stored in render order, so every nested scene is only
+ * accessed after the scene containing it has been verified to be unchanged.
+ * Returns false if the plan is out of date. */
+static bool audio_plan_lock(struct obs_scene *scene)
+{
+	if (!scene->audio_plan_scenes.num)
+		return false;
+
+	for (size_t i = 0; i < scene->audio_plan_scenes.num; i++) {
+		struct scene_audio_plan_scene *plan_scene = &scene->audio_plan_scenes.array[i];
+
+		if (i)
+			audio_lock(plan_scene->scene);
+
+		if (plan_scene->scene->items_gen != plan_scene->items_gen) {
+			audio_plan_unlock(scene, i + 1);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static inline struct obs_source *get_item_audio_source(struct obs_scene_item *item)
+{
+	if (item->visible && transition_active(item->show_transition))
+		return item->show_transition;
+	else if (!item->visible && transition_active(item->hide_transition))
+		return item->hide_transition;
+	return item->source;
 }
 
-static bool scene_audio_render_internal(struct obs_scene *scene, struct obs_scene *parent, uint64_t *ts_out,
+/* Renders the plan entries from begin to end, which are the items of a single
+ * (possibly nested) scene */
+static bool scene_audio_render_internal(struct obs_scene *scene, size_t begin, size_t end, uint64_t *ts_out,
 					struct obs_source_audio_mix *audio_output, uint32_t mixers, size_t channels,
 					size_t sample_rate, float *parent_buf)
 {
 	uint64_t timestamp = 0;
 	float buf[AUDIO_OUTPUT_FRAMES];
 	struct obs_source_audio_mix child_audio;
-	struct obs_scene_item *item;
-	struct obs_scene *mix_scene = parent ? parent : scene;
-
-	audio_lock(scene);
+	struct scene_audio_plan_entry *plan = scene->audio_plan.array;
 
-	item = scene->first_item;
-	while (item) {
-		struct obs_source *source;
-		if (item->visible && transition_active(item->show_transition))
-			source = item->show_transition;
-		else if (!item->visible && transition_active(item->hide_transition))
-			source = item->hide_transition;
-		else
-			source = item->source;
+	for (size_t i = begin; i < end; i = plan[i].end) {
+		struct obs_scene_item *item = plan[i].item;
+		struct obs_source *source = get_item_audio_source(item);
 
 		if (!obs_source_audio_pending(source) && (item->visible || transition_active(item->hide_transition))) {
 			uint64_t source_ts = obs_source_get_audio_timestamp(source);
@@ -1615,73 +1760,52 @@ static bool scene_audio_render_internal(struct obs_scene *scene, struct obs_scen
 			if (source_ts && (!timestamp || source_ts < timestamp))
 				timestamp = source_ts;
 		}
-
-		item = item->next;
 	}
 
 	if (!timestamp) {
 		/* just process all pending audio actions if no audio playing,
 		 * otherwise audio actions will just never be processed */
-		item = scene->first_item;
-		while (item) {
-			process_all_audio_actions(item, sample_rate);
-			item = item->next;
-		}
+		for (size_t i = begin; i < end; i = plan[i].end)
+			process_all_audio_actions(plan[i].item, sample_rate);
 
-		audio_unlock(scene);
 		return false;
 	}
 
-	item = scene->first_item;
-	while (item) {
+	for (size_t i = begin; i < end; i = plan[i].end) {
+		struct obs_scene_item *item = plan[i].item;
 		uint64_t source_ts;
 		size_t pos;
 		bool apply_buf;
-		struct obs_source *source;
+		struct obs_source *source = get_item_audio_source(item);
 		struct scene_source_mix *source_mix;
 
-		if (item->visible && transition_active(item->show_transition))
-			source = item->show_transition;
-		else if (!item->visible && transition_active(item->hide_transition))
-			source = item->hide_transition;
-		else
-			source = item->source;
-
 		apply_buf = apply_scene_item_volume(item, buf, timestamp, sample_rate);
 
-		if (obs_source_audio_pending(source)) {
-			item = item->next;
+		if (obs_source_audio_pending(source))
 			continue;
-		}
 
 		source_ts = obs_source_get_audio_timestamp(source);
-		if (!source_ts) {
-			item = item->next;
+		if (!source_ts)
 			continue;
-		}
 
 		pos = (size_t)ns_to_audio_frames(sample_rate, source_ts - timestamp);
 
-		if (pos >= AUDIO_OUTPUT_FRAMES) {
-			item = item->next;
+		if (pos >= AUDIO_OUTPUT_FRAMES)
 			continue;
-		}
 
-		if (!apply_buf && !item->visible && !transition_active(item->hide_transition)) {
-			item = item->next;
+		if (!apply_buf && !item->visible && !transition_active(item->hide_transition))
 			continue;
-		}
 
 		size_t count = AUDIO_OUTPUT_FRAMES - pos;
 
 		/* Update buf so that parent mute state applies to all current
 		 * scene items as well */
 		if (parent_buf && (!apply_buf || memcmp(buf, parent_buf, sizeof(float) * count) != 0)) {
-			for (size_t i = 0; i < count; i++) {
+			for (size_t j = 0; j < count; j++) {
 				if (!apply_buf) {
-					buf[i] = parent_buf[i];
+					buf[j] = parent_buf[j];
 				} else {
-					buf[i] = buf[i] < parent_buf[i] ? buf[i] : parent_buf[i];
+					buf[j] = buf[j] < parent_buf[j] ? buf[j] : parent_buf[j];
 				}
 			}
 
@@ -1691,16 +1815,15 @@ static bool scene_audio_render_internal(struct obs_scene *scene, struct obs_scen
 		/* If "source" is a group/scene and has no transition,
 		 * add their items to the current list */
 		if (source == item->source && (obs_source_is_group(source) || obs_source_is_scene(source))) {
-			scene_audio_render_internal(source->context.data, mix_scene, NULL, NULL, 0, 0, sample_rate,
+			scene_audio_render_internal(scene, i + 1, plan[i].end, NULL, NULL, 0, 0, sample_rate,
 						    apply_buf ? buf : NULL);
-			item = item->next;
 			continue;
 		}
 
-		source_mix = get_source_mix(mix_scene, item->source);
+		source_mix = &scene->mix_sources.array[plan[i].mix_idx];
 
-		if (!source_mix) {
-			source_mix = da_push_back_new(mix_scene->mix_sources);
+		if (!source_mix->source) {
+			da_push_back(scene->mix_order, &plan[i].mix_idx);
 			source_mix->source = item->source;
 			source_mix->transition = source != item->source ? source : NULL;
 			source_mix->apply_buf = apply_buf;
@@ -1721,23 +1844,19 @@ static bool scene_audio_render_internal(struct obs_scene *scene, struct obs_scen
 			 * items is used. */
 			if (source_mix->apply_buf &&
 			    memcmp(source_mix->buf, buf, source_mix->count * sizeof(float)) != 0) {
-				for (size_t i = 0; i < source_mix->count; i++) {
-					if (buf[i] > source_mix->buf[i])
-						source_mix->buf[i] = buf[i];
+				for (size_t j = 0; j < source_mix->count; j++) {
+					if (buf[j] > source_mix->buf[j])
+						source_mix->buf[j] = buf[j];
 				}
 			}
 		}
-
-		item = item->next;
 	}
 
-	if (!audio_output) {
-		audio_unlock(scene);
+	if (!audio_output)
 		return true;
-	}
 
-	for (size_t i = 0; i < scene->mix_sources.num; i++) {
-		struct scene_source_mix *source_mix = &scene->mix_sources.array[i];
+	for (size_t i = 0; i < scene->mix_order.num; i++) {
+		struct scene_source_mix *source_mix = &scene->mix_sources.array[scene->mix_order.array[i]];
 		obs_source_get_audio_mix(source_mix->transition ? source_mix->transition : source_mix->source,
 					 &child_audio);
 
@@ -1756,13 +1875,13 @@ static bool scene_audio_render_internal(struct obs_scene *scene, struct obs_scen
 					mix_audio(out, in, source_mix->pos, source_mix->count);
 			}
 		}
+
+		source_mix->source = NULL;
 	}
 
-	da_clear(scene->mix_sources);
+	da_resize(scene->mix_order, 0);
 
 	*ts_out = timestamp;
-	audio_unlock(scene);
-
 	return true;
 }
 
@@ -1770,7 +1889,20 @@ static bool scene_audio_render(void *data, uint64_t *ts_out, struct obs_source_a
 			       size_t channels, size_t sample_rate)
 {
 	struct obs_scene *scene = data;
-	return scene_audio_render_internal(scene, NULL, ts_out, audio_output, mixers, channels, sample_rate, NULL);
+	bool success;
+
+	audio_lock(scene);
+
+	while (!audio_plan_lock(scene))
+		rebuild_audio_plan(scene);
+
+	success = scene_audio_render_internal(scene, 0, scene->audio_plan.num, ts_out, audio_output, mixers, channels,
+					      sample_rate, NULL);
+
+	audio_plan_unlock(scene, scene->audio_plan_scenes.num);
+	audio_unlock(scene);
+
+	return success;
 }
 
 enum gs_color_space scene_video_get_color_space(void *data, size_t count, const enum gs_color_space *preferred_spaces)
@@ -2068,23 +2200,78 @@ obs_scene_t *obs_group_from_source(const obs_source_t *source)
 	return source->context.data;
 }
 
-obs_sceneitem_t *obs_scene_find_source(obs_scene_t *scene, const char *name)
+/* call with the scene locked */
+static void update_items_index(struct obs_scene *scene)
 {
+	bool names_dirty = os_atomic_set_bool(&scene->index_names_dirty, false);
 	struct obs_scene_item *item;
+	struct obs_scene_item *found;
+	size_t pos = 0;
 
-	if (!scene)
-		return NULL;
+	if (scene->index_gen == scene->items_gen && !names_dirty)
+		return;
 
-	full_lock(scene);
+	clear_items_index(scene);
 
-	item = scene->first_item;
-	while (item) {
-		if (strcmp(item->source->context.name, name) == 0)
-			break;
+	for (item = scene->first_item; item; item = item->next) {
+		const char *name = item->source->context.name;
 
-		item = item->next;
+		if (!name || !item->index_name || strcmp(item->index_name, name) != 0) {
+			bfree(item->index_name);
+			item->index_name = bstrdup(name);
+		}
+
+		item->index_pos = pos++;
+
+		HASH_FIND(hh_id, scene->items_by_id, &item->id, sizeof(item->id), found);
+		if (!found)
+			HASH_ADD(hh_id, scene->items_by_id, id, sizeof(item->id), item);
+
+		HASH_FIND(hh_source, scene->items_by_source, &item->source, sizeof(item->source), found);
+		if (!found)
+			HASH_ADD(hh_source, scene->items_by_source, source, sizeof(item->source), item);
+
+		if (item->index_name) {
+			name = item->index_name;
+			HASH_FIND(hh_name, scene->items_by_name, name, strlen(name), found);
+			if (!found)
+				HASH_ADD_KEYPTR(hh_name, scene->items_by_name, name, strlen(name), item);
+		}
+
+		if (item->is_group)
+			da_push_back(scene->index_groups, &item);
 	}
 
+	scene->index_gen = scene->items_gen;
+}
+
+static inline struct obs_scene_item *find_item_by_name(struct obs_scene *scene, const char *name)
+{
+	struct obs_scene_item *item;
+
+	update_items_index(scene);
+	HASH_FIND(hh_name, scene->items_by_name, name, strlen(name), item);
+	return item;
+}
+
+static inline struct obs_scene_item *find_item_by_source(struct obs_scene *scene, const obs_source_t *source)
+{
+	struct obs_scene_item *item;
+
+	update_items_index(scene);
+	HASH_FIND(hh_source, scene->items_by_source, &source, sizeof(source), item);
+	return item;
+}
+
+obs_sceneitem_t *obs_scene_find_source(obs_scene_t *scene, const char *name)
+{
+	struct obs_scene_item *item;
+
+	if (!scene || !name)
+		return NULL;
+
+	full_lock(scene);
+	item = find_item_by_name(scene, name);
 	full_unlock(scene);
 
 	return item;
@@ -2094,26 +2281,27 @@ obs_sceneitem_t *obs_scene_find_source_recursive(obs_scene_t *scene, const char
 {
 	struct obs_scene_item *item;
 
-	if (!scene)
+	if (!scene || !name)
 		return NULL;
 
 	full_lock(scene);
 
-	item = scene->first_item;
-	while (item) {
-		if (strcmp(item->source->context.name, name) == 0)
+	item = find_item_by_name(scene, name);
+
+	/* a match inside a group only wins if the group comes before the
+	 * first match in the scene itself */
+	for (size_t i = 0; i < scene->index_groups.num; i++) {
+		struct obs_scene_item *group_item = scene->index_groups.array[i];
+		obs_sceneitem_t *child;
+
+		if (item && group_item->index_pos >= item->index_pos)
 			break;
 
-		if (item->is_group) {
-			obs_scene_t *group = item->source->context.data;
-			obs_sceneitem_t *child = obs_scene_find_source(group, name);
-			if (child) {
-				item = child;
-				break;
-			}
+		child = obs_scene_find_source(group_item->source->context.data, name);
+		if (child) {
+			item = child;
+			break;
 		}
-
-		item = item->next;
 	}
 
 	full_unlock(scene);
@@ -2141,9 +2329,18 @@ bool check_sceneitem_exists(obs_scene_t *scene, obs_sceneitem_t *item, void *vp_
 
 obs_sceneitem_t *obs_scene_sceneitem_from_source(obs_scene_t *scene, obs_source_t *source)
 {
-	struct sceneitem_check check = {source, NULL};
-	obs_scene_enum_items(scene, check_sceneitem_exists, (void *)&check);
-	return check.item_out;
+	struct obs_scene_item *item;
+
+	if (!scene)
+		return NULL;
+
+	full_lock(scene);
+	item = find_item_by_source(scene, source);
+	if (item)
+		obs_sceneitem_addref(item);
+	full_unlock(scene);
+
+	return item;
 }
 
 obs_sceneitem_t *obs_scene_find_sceneitem_by_id(obs_scene_t *scene, int64_t id)
@@ -2154,14 +2351,8 @@ obs_sceneitem_t *obs_scene_find_sceneitem_by_id(obs_scene_t *scene, int64_t id)
 		return NULL;
 
 	full_lock(scene);
-
-	item = scene->first_item;
-	while (item) {
-		if (item->id == id)
-			break;
-
-		item = item->next;
-	}
+	update_items_index(scene);
+	HASH_FIND(hh_id, scene->items_by_id, &id, sizeof(id), item);
 
 	full_unlock(scene);
 
@@ -2303,8 +2494,11 @@ static void sceneitem_rename_hotkey(const obs_sceneitem_t *scene_item, const cha
 static void sceneitem_renamed(void *param, calldata_t *data)
 {
 	obs_sceneitem_t *scene_item = param;
+	struct obs_scene *scene = scene_item->parent;
 	const char *name = calldata_string(data, "new_name");
 
+	if (scene)
+		os_atomic_store_bool(&scene->index_names_dirty, true);
 	sceneitem_rename_hotkey(scene_item, name);
 }
 
@@ -2381,6 +2575,8 @@ static obs_sceneitem_t *obs_scene_add_internal(obs_scene_t *scene, obs_source_t
 
 	full_lock(scene);
 
+	scene_items_changed(scene);
+
 	if (insert_after) {
 		obs_sceneitem_t *next = insert_after->next;
 		if (next)
@@ -2451,6 +2647,7 @@ static void obs_sceneitem_destroy(obs_sceneitem_t *item)
 		if (item->source)
 			obs_source_release(item->source);
 		da_free(item->audio_actions);
+		bfree(item->index_name);
 		bfree(item);
 	}
 }
@@ -3210,6 +3407,7 @@ bool obs_scene_reorder_items(obs_scene_t *scene, obs_sceneitem_t *const *item_or
 		return false;
 	}
 
+	scene_items_changed(scene);
 	scene->first_item = item_order[0];
 
 	obs_sceneitem_t *prev = NULL;
@@ -3371,7 +3569,17 @@ int64_t obs_sceneitem_get_id(const obs_sceneitem_t *item)
 
 void obs_sceneitem_set_id(obs_sceneitem_t *item, int64_t id)
 {
+	obs_scene_t *scene = item->parent;
+
+	if (!scene) {
+		item->id = id;
+		return;
+	}
+
+	full_lock(scene);
+	scene_items_changed(scene);
 	item->id = id;
+	full_unlock(scene);
 }
 
 obs_data_t *obs_sceneitem_get_private_settings(obs_sceneitem_t *item)
@@ -3636,6 +3844,7 @@ obs_sceneitem_t *obs_scene_insert_group(obs_scene_t *scene, const char *name, ob
 
 	full_lock(scene);
 	full_lock(sub_scene);
+	scene_items_changed(sub_scene);
 	sub_scene->first_item = items[0];
 
 	for (size_t i = count; i > 0; i--) {
@@ -3900,17 +4109,11 @@ static bool sceneitems_match2(obs_scene_t *scene, struct obs_sceneitem_order_inf
 
 static obs_sceneitem_t *get_sceneitem_parent_group(obs_scene_t *scene, obs_sceneitem_t *group_subitem)
 {
-	if (group_subitem->is_group)
+	if (group_subitem->is_group || !group_subitem->parent)
 		return NULL;
 
-	obs_sceneitem_t *item = scene->first_item;
-	while (item) {
-		if (item->is_group && item->source->context.data == group_subitem->parent)
-			return item;
-		item = item->next;
-	}
-
-	return NULL;
+	obs_sceneitem_t *item = find_item_by_source(scene, group_subitem->parent->source);
+	return item && item->is_group ? item : NULL;
 }
 
 static void obs_sceneitem_move_hotkeys(obs_scene_t *parent, obs_sceneitem_t *item)
@@ -3953,6 +4156,7 @@ bool obs_scene_reorder_items2(obs_scene_t *scene, struct obs_sceneitem_order_inf
 		}
 	}
 
+	scene_items_changed(scene);
 	scene->first_item = item_order[0].item;
 
 	obs_sceneitem_t *prev = NULL;
@@ -3968,6 +4172,7 @@ bool obs_scene_reorder_items2(obs_scene_t *scene, struct obs_sceneitem_order_inf
 
 			obs_scene_addref(sub_scene);
 			full_lock(sub_scene);
+			scene_items_changed(sub_scene);
 
 			for (i++; i < item_order_size; i++) {
 				struct obs_sceneitem_order_info *sub_info = &item_order[i];
@@ -19,6 +19,7 @@
 
 #include "obs.h"
 #include "graphics/matrix4.h"
+#include "util/uthash.h"
 
 /* how obs scene! */
 
@@ -94,6 +95,16 @@ struct obs_scene_item {
 	/* would do **prev_next, but not really great for reordering */
 	struct obs_scene_item *prev;
 	struct obs_scene_item *next;
+
+	/* lookup indexes of the parent scene, only the first item in list
+	 * order is indexed for a given id, source or name.  The name index is
+	 * keyed on index_name, a copy of the source name, since the source
+	 * frees its old name before the rename signal arrives */
+	size_t index_pos;
+	char *index_name;
+	UT_hash_handle hh_id;
+	UT_hash_handle hh_source;
+	UT_hash_handle hh_name;
 };
 
 struct scene_source_mix {
@@ -105,6 +116,22 @@ struct scene_source_mix {
 	float buf[AUDIO_OUTPUT_FRAMES];
 };
 
+/* The audio render plan of a scene is its item tree flattened in render order,
+ * with the items of nested scenes and groups following the item that contains
+ * them.  It's rebuilt when the items of any scene in it change. */
+struct scene_audio_plan_entry {
+	struct obs_scene_item *item;
+	/* index after the last entry nested in this item */
+	size_t end;
+	/* index of the item's source in the mix sources of the scene */
+	size_t mix_idx;
+};
+
+struct scene_audio_plan_scene {
+	struct obs_scene *scene;
+	long items_gen;
+};
+
 struct obs_scene {
 	struct obs_source *source;
 
@@ -123,5 +150,37 @@ struct obs_scene {
 	pthread_mutex_t audio_mutex;
 	struct obs_scene_item *first_item;
 
+	/* incremented with the scene locked whenever items are added, removed
+	 * or reordered */
+	long items_gen;
+
 	DARRAY(struct scene_source_mix) mix_sources;
+	DARRAY(size_t) mix_order;
+
+	DARRAY(struct scene_audio_plan_entry) audio_plan;
+	DARRAY(struct scene_audio_plan_scene) audio_plan_scenes;
+	DARRAY(obs_source_t *) audio_plan_sources;
+
+	/* the items in render order, rebuilt with the video lock held when
+	 * items_gen changes so the graphics thread walks a contiguous array
+	 * instead of the item list */
+	long render_items_gen;
+	DARRAY(struct obs_scene_item *) render_items;
+
+	/* item lookup indexes, dropped whenever items_gen changes and rebuilt
+	 * on the next lookup, or after the source of an item is renamed */
+	long index_gen;
+	volatile bool index_names_dirty;
+	struct obs_scene_item *items_by_id;
+	struct obs_scene_item *items_by_source;
+	struct obs_scene_item *items_by_name;
+	DARRAY(struct obs_scene_item *) index_groups;
+
+	signal_handle_t *item_transform_signal;
 };
+
+/* Calls callback for the visible items of a scene in drawing order, after
+ * updating their transforms the way rendering the scene does.  Used by the
+ * CPU compositor, which doesn't go through the scene's video_render. */
+typedef void (*obs_scene_render_item_cb)(void *param, struct obs_scene_item *item);
+extern void obs_scene_enum_render_items(struct obs_scene *scene, obs_scene_render_item_cb callback, void *param);
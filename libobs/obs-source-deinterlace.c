@@ -16,10 +16,11 @@
 ******************************************************************************/
 
 #include "obs-internal.h"
+#include "media-io/video-deinterlace.h"
 
 static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_ring_peek(&source->async_frames, 0);
 	struct obs_source_frame *prev_frame = NULL;
 	struct obs_source_frame *frame = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
@@ -28,17 +29,16 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 	size_t idx = 1;
 
 	if (source->async_unbuffered) {
-		while (source->async_frames.num > 2) {
-			da_erase(source->async_frames, 0);
-			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+		while (async_frame_ring_count(&source->async_frames) > 2) {
+			skip_async_frame(source);
+			next_frame = async_frame_ring_peek(&source->async_frames, 0);
 		}
 
-		if (source->async_frames.num == 2) {
+		if (async_frame_ring_count(&source->async_frames) == 2) {
 			bool prev_frame = true;
 			if (source->async_unbuffered && source->deinterlace_offset) {
-				const uint64_t timestamp = source->async_frames.array[0]->timestamp;
-				const uint64_t after_timestamp = source->async_frames.array[1]->timestamp;
+				const uint64_t timestamp = async_frame_ring_peek(&source->async_frames, 0)->timestamp;
+				const uint64_t after_timestamp = async_frame_ring_peek(&source->async_frames, 1)->timestamp;
 				const uint64_t duration = after_timestamp - timestamp;
 				const uint64_t frame_end = timestamp + source->deinterlace_offset + duration;
 				if (sys_time < frame_end) {
@@ -47,7 +47,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 					source->deinterlace_frame_ts = timestamp - duration;
 				}
 			}
-			source->async_frames.array[0]->prev_frame = prev_frame;
+			async_frame_ring_peek(&source->async_frames, 0)->prev_frame = prev_frame;
 		}
 		source->deinterlace_offset = 0;
 		source->last_frame_ts = next_frame->timestamp;
@@ -73,18 +73,16 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 		if ((source->last_frame_ts - next_frame->timestamp) < 2000000)
 			break;
 
-		if (prev_frame) {
-			da_erase(source->async_frames, 0);
-			remove_async_frame(source, prev_frame);
-		}
+		if (prev_frame)
+			skip_async_frame(source);
 
-		if (source->async_frames.num <= 2) {
+		if (async_frame_ring_count(&source->async_frames) <= 2) {
 			bool exit = true;
 
 			if (prev_frame) {
 				prev_frame->prev_frame = true;
 
-			} else if (!frame && source->async_frames.num == 2) {
+			} else if (!frame && async_frame_ring_count(&source->async_frames) == 2) {
 				exit = false;
 			}
 
@@ -101,7 +99,7 @@ static bool ready_deinterlace_frames(obs_source_t *source, uint64_t sys_time)
 
 		prev_frame = frame;
 		frame = next_frame;
-		next_frame = source->async_frames.array[idx];
+		next_frame = async_frame_ring_peek(&source->async_frames, idx);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -124,8 +122,8 @@ static inline bool first_frame(obs_source_t *s)
 	if (s->last_frame_ts)
 		return false;
 
-	if (s->async_frames.num >= 2)
-		s->async_frames.array[0]->prev_frame = true;
+	if (async_frame_ring_count(&s->async_frames) >= 2)
+		async_frame_ring_peek(&s->async_frames, 0)->prev_frame = true;
 	return true;
 }
 
@@ -154,7 +152,7 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s, uint64_t sys_
 		}
 	}
 
-	if (!s->async_frames.num)
+	if (!async_frame_ring_count(&s->async_frames))
 		return;
 
 	half_interval = obs->video.video_half_frame_interval_ns;
@@ -163,15 +161,11 @@ static inline void deinterlace_get_closest_frames(obs_source_t *s, uint64_t sys_
 		uint64_t offset;
 
 		s->prev_async_frame = NULL;
-		s->cur_async_frame = s->async_frames.array[0];
-
-		da_erase(s->async_frames, 0);
+		s->cur_async_frame = pop_async_frame(s);
 
-		if ((s->async_frames.num > 0) && s->cur_async_frame->prev_frame) {
+		if (async_frame_ring_count(&s->async_frames) && s->cur_async_frame->prev_frame) {
 			s->prev_async_frame = s->cur_async_frame;
-			s->cur_async_frame = s->async_frames.array[0];
-
-			da_erase(s->async_frames, 0);
+			s->cur_async_frame = pop_async_frame(s);
 
 			s->deinterlace_half_duration =
 				(uint32_t)((s->cur_async_frame->timestamp - s->prev_async_frame->timestamp) / 2);
@@ -403,6 +397,127 @@ void deinterlace_render(obs_source_t *s)
 	gs_enable_framebuffer_srgb(previous);
 }
 
+/* ------------------------------------------------------------------------- */
+/* CPU deinterlacing                                                          */
+
+/* frames further apart are a timestamp jump, not a frame interval */
+#define MAX_FIELD_INTERVAL 100000000ULL
+
+static enum video_deinterlace_filter get_cpu_filter(enum obs_deinterlace_mode mode)
+{
+	switch (mode) {
+	case OBS_DEINTERLACE_MODE_DISABLE:
+	case OBS_DEINTERLACE_MODE_DISCARD:
+	case OBS_DEINTERLACE_MODE_RETRO:
+		return VIDEO_DEINTERLACE_DISCARD;
+	case OBS_DEINTERLACE_MODE_BLEND:
+	case OBS_DEINTERLACE_MODE_BLEND_2X:
+		return VIDEO_DEINTERLACE_BLEND;
+	case OBS_DEINTERLACE_MODE_LINEAR:
+	case OBS_DEINTERLACE_MODE_LINEAR_2X:
+		return VIDEO_DEINTERLACE_LINEAR;
+	case OBS_DEINTERLACE_MODE_YADIF:
+	case OBS_DEINTERLACE_MODE_YADIF_2X:
+		return VIDEO_DEINTERLACE_YADIF;
+	}
+
+	return VIDEO_DEINTERLACE_DISCARD;
+}
+
+static inline void get_video_frame(struct video_frame *dst, const struct obs_source_frame *src)
+{
+	memcpy(dst->data, src->data, sizeof(dst->data));
+	memcpy(dst->linesize, src->linesize, sizeof(dst->linesize));
+}
+
+bool deinterlace_cpu_active(const obs_source_t *source, enum video_format format)
+{
+	/* the CPU compositor has no deinterlacing effects */
+	return (source->deinterlace_cpu || obs->video.cpu_compositing) &&
+	       source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE &&
+	       video_deinterlace_format_supported(format);
+}
+
+/* keeps a copy of the frame as the next one, returns true once there is a
+ * current frame to output */
+bool deinterlace_cpu_push_frame(obs_source_t *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame **frames = source->deinterlace_cpu_frames;
+	struct obs_source_frame *next = frames[0];
+
+	if (frames[2] && (frames[2]->format != frame->format || frames[2]->width != frame->width ||
+			  frames[2]->height != frame->height)) {
+		deinterlace_cpu_flush(source);
+		next = NULL;
+	}
+
+	if (!next)
+		next = obs_source_frame_create(frame->format, frame->width, frame->height);
+	obs_source_frame_copy(next, frame);
+
+	frames[0] = frames[1];
+	frames[1] = frames[2];
+	frames[2] = next;
+
+	return frames[1] != NULL;
+}
+
+size_t deinterlace_cpu_field_count(const obs_source_t *source)
+{
+	switch (source->deinterlace_mode) {
+	case OBS_DEINTERLACE_MODE_RETRO:
+	case OBS_DEINTERLACE_MODE_BLEND_2X:
+	case OBS_DEINTERLACE_MODE_LINEAR_2X:
+	case OBS_DEINTERLACE_MODE_YADIF_2X:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/* writes a field of the current frame to dst, which already has its
+ * metadata */
+void deinterlace_cpu_output_field(obs_source_t *source, struct obs_source_frame *dst, bool second_field)
+{
+	struct obs_source_frame *const *frames = source->deinterlace_cpu_frames;
+	const struct obs_source_frame *cur = frames[1];
+	const struct obs_source_frame *next = frames[2];
+	struct video_frame out, prev_frame, cur_frame, next_frame;
+	struct video_deinterlace_info info = {
+		.format = cur->format,
+		.width = cur->width,
+		.height = cur->height,
+		.filter = get_cpu_filter(source->deinterlace_mode),
+		.top_field_first = source->deinterlace_top_first,
+		.second_field = second_field,
+	};
+
+	/* at single rate the fields of the same frame are blended */
+	if (info.filter == VIDEO_DEINTERLACE_BLEND && deinterlace_cpu_field_count(source) == 1)
+		info.second_field = true;
+
+	get_video_frame(&out, dst);
+	get_video_frame(&prev_frame, frames[0] ? frames[0] : cur);
+	get_video_frame(&cur_frame, cur);
+	get_video_frame(&next_frame, next);
+
+	video_deinterlace(&out, &prev_frame, &cur_frame, &next_frame, &info, obs->async_frame_pool);
+
+	/* the second field is shown halfway to the next frame */
+	if (second_field && next->timestamp > cur->timestamp && next->timestamp - cur->timestamp < MAX_FIELD_INTERVAL)
+		dst->timestamp = cur->timestamp + (next->timestamp - cur->timestamp) / 2;
+}
+
+void deinterlace_cpu_flush(obs_source_t *source)
+{
+	for (size_t i = 0; i < 3; i++) {
+		obs_source_frame_destroy(source->deinterlace_cpu_frames[i]);
+		source->deinterlace_cpu_frames[i] = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void enable_deinterlacing(obs_source_t *source, enum obs_deinterlace_mode mode)
 {
 	obs_enter_graphics();
@@ -478,3 +593,19 @@ enum obs_deinterlace_field_order obs_source_get_deinterlace_field_order(const ob
 
 	return source->deinterlace_top_first ? OBS_DEINTERLACE_FIELD_ORDER_TOP : OBS_DEINTERLACE_FIELD_ORDER_BOTTOM;
 }
+
+void obs_source_set_deinterlace_cpu(obs_source_t *source, bool enable)
+{
+	if (!obs_source_valid(source, "obs_source_set_deinterlace_cpu"))
+		return;
+
+	pthread_mutex_lock(&source->async_output_mutex);
+	source->deinterlace_cpu = enable;
+	deinterlace_cpu_flush(source);
+	pthread_mutex_unlock(&source->async_output_mutex);
+}
+
+bool obs_source_get_deinterlace_cpu(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_deinterlace_cpu") ? source->deinterlace_cpu : false;
+}
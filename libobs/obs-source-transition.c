@@ -742,6 +742,46 @@ void obs_transition_video_render2(obs_source_t *transition, obs_transition_video
 		handle_stop(transition);
 }
 
+/* the CPU compositor has no transition effects and cuts to the destination
+ * at the start of a transition, but still ends it once its time is up */
+obs_source_t *obs_transition_get_cpu_source(obs_source_t *transition, struct matrix4 *matrix)
+{
+	bool stopped = false;
+	bool video_stopped = false;
+	obs_source_t *source;
+	size_t idx;
+
+	if (!transition_valid(transition, "obs_transition_get_cpu_source"))
+		return NULL;
+
+	float t = get_video_time(transition);
+
+	lock_transition(transition);
+
+	if (t >= 1.0f && transition->transitioning_video) {
+		transition->transitioning_video = false;
+		video_stopped = true;
+
+		if (!transition->transitioning_audio) {
+			obs_transition_stop(transition);
+			stopped = true;
+		}
+	}
+
+	idx = transition->transitioning_video ? 1 : 0;
+	source = obs_source_get_ref(transition->transition_sources[idx]);
+	*matrix = transition->transition_matrices[idx];
+
+	unlock_transition(transition);
+
+	if (video_stopped)
+		obs_source_dosignal(transition, "source_transition_video_stop", "transition_video_stop");
+	if (stopped)
+		handle_stop(transition);
+
+	return source;
+}
+
 static enum gs_color_space mix_spaces(enum gs_color_space a, enum gs_color_space b)
 {
 	if ((a == GS_CS_709_EXTENDED) || (a == GS_CS_709_SCRGB) || (b == GS_CS_709_EXTENDED) || (b == GS_CS_709_SCRGB))
@@ -42,7 +42,9 @@ static inline bool data_valid(const struct obs_source *source, const char *f)
 
 static inline bool deinterlacing_enabled(const struct obs_source *source)
 {
-	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE;
+	/* frames deinterlaced on the CPU are rendered as progressive */
+	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE &&
+	       !deinterlace_cpu_active(source, source->async_format);
 }
 
 static inline bool destroying(const struct obs_source *source)
@@ -121,7 +123,11 @@ bool obs_source_init_context(struct obs_source *source, obs_data_t *settings, co
 	if (!obs_context_data_init(&source->context, OBS_OBJ_TYPE_SOURCE, settings, name, uuid, hotkey_data, private))
 		return false;
 
-	return signal_handler_add_array(source->context.signals, source_signals);
+	if (!signal_handler_add_array(source->context.signals, source_signals))
+		return false;
+
+	source->volume_signal = signal_handler_get_handle(source->context.signals, "volume");
+	return true;
 }
 
 const char *obs_source_get_display_name(const char *id)
@@ -176,6 +182,7 @@ static bool obs_source_init(struct obs_source *source)
 	source->audio_active = true;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
+	pthread_mutex_init_value(&source->async_output_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
 	pthread_mutex_init_value(&source->audio_buf_mutex);
 	pthread_mutex_init_value(&source->audio_cb_mutex);
@@ -194,6 +201,8 @@ static bool obs_source_init(struct obs_source *source)
 		return false;
 	if (pthread_mutex_init_recursive(&source->async_mutex) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_output_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&source->caption_cb_mutex, NULL) != 0)
 		return false;
 	if (pthread_mutex_init(&source->media_actions_mutex, NULL) != 0)
@@ -236,6 +245,10 @@ static void obs_source_init_finalize(struct obs_source *source)
 		obs_context_data_insert_name(&source->context, &obs->data.sources_mutex, &obs->data.public_sources);
 	}
 	obs_context_data_insert_uuid(&source->context, &obs->data.sources_mutex, &obs->data.sources);
+
+	/* every source is ticked at least once, it drops out of the tick set
+	 * afterwards if it turns out to be idle */
+	obs_source_tick_set_add(source);
 }
 
 static bool obs_source_hotkey_mute(void *data, obs_hotkey_pair_id id, obs_hotkey_t *key, bool pressed)
@@ -320,8 +333,9 @@ static void obs_source_init_audio_hotkeys(struct obs_source *source)
 
 static obs_source_t *obs_source_create_internal(const char *id, const char *name, const char *uuid,
 						obs_data_t *settings, obs_data_t *hotkey_data, bool private,
-						uint32_t last_obs_ver)
+						uint32_t last_obs_ver, bool defer_create)
 {
+	enum bmem_tag prev_tag = bmem_set_thread_tag(BMEM_TAG_SOURCE);
 	struct obs_source *source = bzalloc(sizeof(struct obs_source));
 
 	const struct obs_source_info *info = get_source_info(id);
@@ -365,14 +379,20 @@ static obs_source_t *obs_source_create_internal(const char *id, const char *name
 	if (!private)
 		obs_source_init_audio_hotkeys(source);
 
+	/* only inputs are deferred, scenes and transitions reference other
+	 * sources and filters are created along with their parent */
+	if (defer_create && info && info->create && info->type == OBS_SOURCE_TYPE_INPUT && !private)
+		source->deferred_create = DEFERRED_CREATE_PENDING;
+
 	/* allow the source to be created even if creation fails so that the
 	 * user's data doesn't become lost */
-	if (info && info->create)
+	if (info && info->create && !source->deferred_create)
 		source->context.data = info->create(source->context.settings, source);
-	if ((!info || info->create) && !source->context.data)
+	if ((!info || info->create) && !source->context.data && !source->deferred_create)
 		blog(LOG_ERROR, "Failed to create source '%s'!", name);
 
-	blog(LOG_DEBUG, "%ssource '%s' (%s) created", private ? "private " : "", name, id);
+	blog(LOG_DEBUG, "%ssource '%s' (%s) %s", private ? "private " : "", name, id,
+	     source->deferred_create ? "loaded, creation deferred" : "created");
 
 	source->flags = source->default_flags;
 	source->enabled = true;
@@ -382,28 +402,32 @@ static obs_source_t *obs_source_create_internal(const char *id, const char *name
 		obs_source_dosignal(source, "source_create", NULL);
 	}
 
+	bmem_set_thread_tag(prev_tag);
 	return source;
 
 fail:
 	blog(LOG_ERROR, "obs_source_create failed");
 	obs_source_destroy(source);
+	bmem_set_thread_tag(prev_tag);
 	return NULL;
 }
 
 obs_source_t *obs_source_create(const char *id, const char *name, obs_data_t *settings, obs_data_t *hotkey_data)
 {
-	return obs_source_create_internal(id, name, NULL, settings, hotkey_data, false, LIBOBS_API_VER);
+	return obs_source_create_internal(id, name, NULL, settings, hotkey_data, false, LIBOBS_API_VER, false);
 }
 
 obs_source_t *obs_source_create_private(const char *id, const char *name, obs_data_t *settings)
 {
-	return obs_source_create_internal(id, name, NULL, settings, NULL, true, LIBOBS_API_VER);
+	return obs_source_create_internal(id, name, NULL, settings, NULL, true, LIBOBS_API_VER, false);
 }
 
 obs_source_t *obs_source_create_set_last_ver(const char *id, const char *name, const char *uuid, obs_data_t *settings,
-					     obs_data_t *hotkey_data, uint32_t last_obs_ver, bool is_private)
+					     obs_data_t *hotkey_data, uint32_t last_obs_ver, bool is_private,
+					     bool defer_create)
 {
-	return obs_source_create_internal(id, name, uuid, settings, hotkey_data, is_private, last_obs_ver);
+	return obs_source_create_internal(id, name, uuid, settings, hotkey_data, is_private, last_obs_ver,
+					  defer_create);
 }
 
 static char *get_new_filter_name(obs_source_t *dst, const char *name)
@@ -570,6 +594,8 @@ static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source, obs_source_t *filter);
+static void free_async_cache(struct obs_source *source);
+static void flush_async_frames(struct obs_source *source);
 static void obs_source_destroy_defer(struct obs_source *source);
 
 void obs_source_destroy(struct obs_source *source)
@@ -616,6 +642,13 @@ void obs_source_destroy(struct obs_source *source)
 	if (!source->context.private)
 		obs_context_data_remove_name(&source->context, &obs->data.public_sources);
 
+	pthread_mutex_lock(&obs->data.tick_set_mutex);
+	if (source->in_tick_set) {
+		da_erase_item(obs->data.tick_set, &source);
+		source->in_tick_set = false;
+	}
+	pthread_mutex_unlock(&obs->data.tick_set_mutex);
+
 	source_profiler_remove_source(source);
 
 	/* defer source destroy */
@@ -645,8 +678,7 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	obs_hotkey_unregister(source->push_to_mute_key);
 	obs_hotkey_pair_unregister(source->mute_unmute_key);
 
-	for (i = 0; i < source->async_cache.num; i++)
-		obs_source_frame_decref(source->async_cache.array[i].frame);
+	free_async_cache(source);
 
 	gs_enter_context(obs->video.graphics);
 	if (source->async_texrender)
@@ -663,6 +695,10 @@ static void obs_source_destroy_defer(struct obs_source *source)
 		gs_texrender_destroy(source->color_space_texrender);
 	gs_leave_context();
 
+	bfree(source->cpu_image.data);
+	bfree(source->cpu_filter_images[0].data);
+	bfree(source->cpu_filter_images[1].data);
+
 	for (i = 0; i < MAX_AV_PLANES; i++)
 		bfree(source->audio_data.data[i]);
 	for (i = 0; i < MAX_AUDIO_CHANNELS; i++)
@@ -680,7 +716,7 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	da_free(source->audio_cb_list);
 	da_free(source->caption_cb_list);
 	da_free(source->async_cache);
-	da_free(source->async_frames);
+	da_free(source->async_spare_frames);
 	da_free(source->filters);
 	da_free(source->media_actions);
 	pthread_mutex_destroy(&source->filter_mutex);
@@ -690,6 +726,7 @@ static void obs_source_destroy_defer(struct obs_source *source)
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->caption_cb_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
+	pthread_mutex_destroy(&source->async_output_mutex);
 	pthread_mutex_destroy(&source->media_actions_mutex);
 	obs_data_release(source->private_settings);
 	obs_context_data_free(&source->context);
@@ -879,7 +916,12 @@ bool obs_source_configurable(const obs_source_t *source)
 
 obs_properties_t *obs_source_properties(const obs_source_t *source)
 {
-	if (!data_valid(source, "obs_source_properties"))
+	if (!obs_source_valid(source, "obs_source_properties"))
+		return NULL;
+
+	/* deferred sources use the same NULL data path as
+	 * obs_get_source_properties until they're created */
+	if (!source->context.data && !os_atomic_load_long(&source->deferred_create))
 		return NULL;
 
 	if (source->info.get_properties2) {
@@ -930,6 +972,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
+		obs_source_tick_set_add(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data, source->context.settings);
 		obs_source_dosignal(source, "source_update", "update");
@@ -1024,6 +1067,46 @@ void obs_source_set_texcoords_centered(obs_source_t *source, bool centered)
 	source->texcoords_centered = centered;
 }
 
+static void create_deferred_source(obs_source_t *source)
+{
+	enum bmem_tag prev_tag = bmem_set_thread_tag(BMEM_TAG_SOURCE);
+
+	if (!source->removed) {
+		source->context.data = source->info.create(source->context.settings, source);
+		if (!source->context.data)
+			blog(LOG_ERROR, "Failed to create source '%s'!", source->context.name);
+		else
+			blog(LOG_DEBUG, "deferred source '%s' (%s) created", source->context.name, source->info.id);
+
+		/* obs_source_load was skipped while the source had no data */
+		obs_source_load(source);
+	}
+
+	os_atomic_set_long(&source->deferred_create, DEFERRED_CREATE_NONE);
+	bmem_set_thread_tag(prev_tag);
+}
+
+static void create_deferred_source_task(void *param)
+{
+	obs_source_t *source = param;
+	create_deferred_source(source);
+	obs_source_release(source);
+}
+
+/* plugins expect to be created on the UI thread, so creation is handed off
+ * there when a frontend is present. show/activate are held back in the video
+ * tick until the source has its data. */
+static void queue_deferred_create(obs_source_t *source)
+{
+	if (!os_atomic_compare_swap_long(&source->deferred_create, DEFERRED_CREATE_PENDING, DEFERRED_CREATE_QUEUED))
+		return;
+
+	if (obs->ui_task_handler)
+		obs_queue_task(OBS_TASK_UI, create_deferred_source_task, obs_source_get_ref(source), false);
+	else
+		create_deferred_source(source);
+}
+
 static void activate_source(obs_source_t *source)
 {
 	if (source->context.data && source->info.activate)
@@ -1055,6 +1138,7 @@ static void hide_source(obs_source_t *source)
 static void activate_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_inc_long(&child->activate_refs);
+	obs_source_tick_set_add(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1071,6 +1155,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child, void *par
 static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_inc_long(&child->show_refs);
+	obs_source_tick_set_add(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1090,6 +1175,7 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 		return;
 
 	os_atomic_inc_long(&source->show_refs);
+	obs_source_tick_set_add(source);
 	obs_source_enum_active_tree(source, show_tree, NULL);
 
 	if (type == MAIN_VIEW) {
@@ -1187,9 +1273,16 @@ static void async_tick(obs_source_t *source)
 
 	pthread_mutex_lock(&source->async_mutex);
 
+	if (os_atomic_set_bool(&source->async_flush, false))
+		flush_async_frames(source);
+
 	if (deinterlacing_enabled(source)) {
 		deinterlace_process_last_frame(source, sys_time);
 	} else {
+		if (source->prev_async_frame) {
+			remove_async_frame(source, source->prev_async_frame);
+			source->prev_async_frame = NULL;
+		}
 		if (source->cur_async_frame) {
 			remove_async_frame(source, source->cur_async_frame);
 			source->cur_async_frame = NULL;
@@ -1210,12 +1303,37 @@ static void async_tick(obs_source_t *source)
 	pthread_mutex_unlock(&source->async_mutex);
 }
 
+static inline bool tick_in_parallel(const obs_source_t *source)
+{
+	return (source->info.output_flags & OBS_SOURCE_PARALLEL_TICK) != 0 && source->context.data &&
+	       source->info.video_tick && obs->video.tick_pool;
+}
+
 void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (obs_source_video_tick_begin(source, seconds))
+		obs_source_video_tick_callback(source, seconds);
+}
+
+void obs_source_video_tick_callback(obs_source_t *source, float seconds)
+{
+	source->info.video_tick(source->context.data, seconds);
+}
+
+/* Runs the graphics thread part of the tick, returns true if the video_tick
+ * callback was left for the tick pool. */
+bool obs_source_video_tick_begin(obs_source_t *source, float seconds)
 {
 	bool now_showing, now_active;
+	bool parallel = false;
+	bool deferred;
 
 	if (!obs_source_valid(source, "obs_source_video_tick"))
-		return;
+		return false;
+
+	deferred = os_atomic_load_long(&source->deferred_create) != DEFERRED_CREATE_NONE;
+	if (deferred && (source->show_refs || source->activate_refs))
+		queue_deferred_create(source);
 
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_tick(source, seconds);
@@ -1235,7 +1353,7 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 	/* call show/hide if the reference changed */
 	now_showing = !!source->show_refs;
-	if (now_showing != source->showing) {
+	if (now_showing != source->showing && !deferred) {
 		if (now_showing) {
 			show_source(source);
 		} else {
@@ -1258,7 +1376,7 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 	/* call activate/deactivate if the reference changed */
 	now_active = !!source->activate_refs;
-	if (now_active != source->active) {
+	if (now_active != source->active && !deferred) {
 		if (now_active) {
 			activate_source(source);
 		} else {
@@ -1279,11 +1397,79 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		source->active = now_active;
 	}
 
-	if (source->context.data && source->info.video_tick)
+	if (tick_in_parallel(source))
+		parallel = true;
+	else if (source->context.data && source->info.video_tick)
 		source->info.video_tick(source->context.data, seconds);
 
 	source->async_rendered = false;
 	source->deinterlace_rendered = false;
+	os_atomic_store_bool(&source->tick_rendered, false);
+	return parallel;
+}
+
+/* Sources with per-frame work of their own, they stay in the tick set for
+ * their whole lifetime. */
+static inline bool source_always_ticks(const obs_source_t *source)
+{
+	return source->info.video_tick || source->info.type == OBS_SOURCE_TYPE_TRANSITION ||
+	       (source->info.output_flags & OBS_SOURCE_ASYNC) != 0;
+}
+
+static inline bool source_needs_tick(obs_source_t *source)
+{
+	if (source_always_ticks(source))
+		return true;
+
+	/* pending show/hide or activate/deactivate transitions are only
+	 * resolved by the tick */
+	if (os_atomic_load_long(&source->show_refs) || source->showing)
+		return true;
+	if (os_atomic_load_long(&source->activate_refs) || source->active)
+		return true;
+
+	if (os_atomic_load_long(&source->defer_update_count) > 0)
+		return true;
+	if (source->media_actions.num)
+		return true;
+
+	/* rendered without being shown (e.g. by a plugin), the render state
+	 * still has to be reset every frame */
+	return os_atomic_load_bool(&source->tick_rendered);
+}
+
+/* Call after changing any of the state checked in source_needs_tick.  The
+ * state change has to happen before the in_tick_set check, pairing with the
+ * store/re-check order in obs_source_tick_set_prune. */
+void obs_source_tick_set_add(obs_source_t *source)
+{
+	if (os_atomic_load_bool(&source->in_tick_set))
+		return;
+
+	pthread_mutex_lock(&obs->data.tick_set_mutex);
+	if (!source->in_tick_set && !os_atomic_load_long(&source->destroying)) {
+		da_push_back(obs->data.tick_set, &source);
+		os_atomic_store_bool(&source->in_tick_set, true);
+	}
+	pthread_mutex_unlock(&obs->data.tick_set_mutex);
+}
+
+/* Removes the source from the tick set after its tick if it went idle. */
+void obs_source_tick_set_prune(obs_source_t *source)
+{
+	if (source_needs_tick(source))
+		return;
+
+	pthread_mutex_lock(&obs->data.tick_set_mutex);
+	if (source->in_tick_set) {
+		os_atomic_store_bool(&source->in_tick_set, false);
+
+		if (source_needs_tick(source))
+			os_atomic_store_bool(&source->in_tick_set, true);
+		else
+			da_erase_item(obs->data.tick_set, &source);
+	}
+	pthread_mutex_unlock(&obs->data.tick_set_mutex);
 }
 
 /* unless the value is 3+ hours worth of frames, this won't overflow */
@@ -1974,6 +2160,10 @@ bool set_async_texture_size(struct obs_source *source, const struct obs_source_f
 	source->async_full_range = frame->full_range;
 	source->async_trc = frame->trc;
 
+	/* frames are converted when they are composited */
+	if (obs->video.cpu_compositing)
+		return true;
+
 	gs_enter_context(obs->video.graphics);
 
 	for (size_t c = 0; c < MAX_AV_PLANES; c++) {
@@ -2761,6 +2951,11 @@ static const char *get_type_format(enum obs_source_type type)
 
 static inline void render_video(obs_source_t *source)
 {
+	if (!os_atomic_load_bool(&source->tick_rendered)) {
+		os_atomic_store_bool(&source->tick_rendered, true);
+		obs_source_tick_set_add(source);
+	}
+
 	if (source->info.type != OBS_SOURCE_TYPE_FILTER && (source->info.output_flags & OBS_SOURCE_VIDEO) == 0) {
 		if (source->filter_parent)
 			obs_source_skip_video_filter(source);
@@ -2964,6 +3159,8 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_tick_set_add(filter);
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -3208,28 +3405,7 @@ struct obs_source_frame *filter_async_video(obs_source_t *source, struct obs_sou
 	return in;
 }
 
-static inline void copy_frame_data_line(struct obs_source_frame *dst, const struct obs_source_frame *src,
-					uint32_t plane, uint32_t y)
-{
-	uint32_t pos_src = y * src->linesize[plane];
-	uint32_t pos_dst = y * dst->linesize[plane];
-	uint32_t bytes = dst->linesize[plane] < src->linesize[plane] ? dst->linesize[plane] : src->linesize[plane];
-
-	memcpy(dst->data[plane] + pos_dst, src->data[plane] + pos_src, bytes);
-}
-
-static inline void copy_frame_data_plane(struct obs_source_frame *dst, const struct obs_source_frame *src,
-					 uint32_t plane, uint32_t lines)
-{
-	if (dst->linesize[plane] != src->linesize[plane]) {
-		for (uint32_t y = 0; y < lines; y++)
-			copy_frame_data_line(dst, src, plane, y);
-	} else {
-		memcpy(dst->data[plane], src->data[plane], (size_t)dst->linesize[plane] * (size_t)lines);
-	}
-}
-
-static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+static void copy_frame_metadata(struct obs_source_frame *dst, const struct obs_source_frame *src)
 {
 	dst->flip = src->flip;
 	dst->flags = src->flags;
@@ -3243,75 +3419,23 @@ static void copy_frame_data(struct obs_source_frame *dst, const struct obs_sourc
 		memcpy(dst->color_range_min, src->color_range_min, size);
 		memcpy(dst->color_range_max, src->color_range_max, size);
 	}
+}
 
-	switch (src->format) {
-	case VIDEO_FORMAT_I420:
-	case VIDEO_FORMAT_I010: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
-		copy_frame_data_plane(dst, src, 2, half_height);
-		break;
-	}
-
-	case VIDEO_FORMAT_NV12:
-	case VIDEO_FORMAT_P010: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
-		break;
-	}
-
-	case VIDEO_FORMAT_I444:
-	case VIDEO_FORMAT_I422:
-	case VIDEO_FORMAT_I210:
-	case VIDEO_FORMAT_I412:
-		copy_frame_data_plane(dst, src, 0, dst->height);
-		copy_frame_data_plane(dst, src, 1, dst->height);
-		copy_frame_data_plane(dst, src, 2, dst->height);
-		break;
-
-	case VIDEO_FORMAT_YVYU:
-	case VIDEO_FORMAT_YUY2:
-	case VIDEO_FORMAT_UYVY:
-	case VIDEO_FORMAT_NONE:
-	case VIDEO_FORMAT_RGBA:
-	case VIDEO_FORMAT_BGRA:
-	case VIDEO_FORMAT_BGRX:
-	case VIDEO_FORMAT_Y800:
-	case VIDEO_FORMAT_BGR3:
-	case VIDEO_FORMAT_AYUV:
-	case VIDEO_FORMAT_V210:
-	case VIDEO_FORMAT_R10L:
-		copy_frame_data_plane(dst, src, 0, dst->height);
-		break;
+static void copy_frame_data(struct obs_source_frame *dst, const struct obs_source_frame *src)
+{
+	struct video_frame dst_frame;
+	struct video_frame src_frame;
 
-	case VIDEO_FORMAT_I40A: {
-		const uint32_t height = dst->height;
-		const uint32_t half_height = (height + 1) / 2;
-		copy_frame_data_plane(dst, src, 0, height);
-		copy_frame_data_plane(dst, src, 1, half_height);
-		copy_frame_data_plane(dst, src, 2, half_height);
-		copy_frame_data_plane(dst, src, 3, height);
-		break;
-	}
+	copy_frame_metadata(dst, src);
 
-	case VIDEO_FORMAT_I42A:
-	case VIDEO_FORMAT_YUVA:
-	case VIDEO_FORMAT_YA2L:
-		copy_frame_data_plane(dst, src, 0, dst->height);
-		copy_frame_data_plane(dst, src, 1, dst->height);
-		copy_frame_data_plane(dst, src, 2, dst->height);
-		copy_frame_data_plane(dst, src, 3, dst->height);
-		break;
+	memcpy(dst_frame.data, dst->data, sizeof(dst_frame.data));
+	memcpy(dst_frame.linesize, dst->linesize, sizeof(dst_frame.linesize));
+	memcpy(src_frame.data, src->data, sizeof(src_frame.data));
+	memcpy(src_frame.linesize, src->linesize, sizeof(src_frame.linesize));
 
-	case VIDEO_FORMAT_P216:
-	case VIDEO_FORMAT_P416:
-		/* Unimplemented */
-		break;
-	}
+	/* large frames (4K P010, 4:4:4, ...) are split across the async frame
+	 * workers so the outputting thread isn't stuck copying them alone */
+	video_frame_copy_parallel(&dst_frame, &src_frame, src->format, dst->height, obs->async_frame_pool);
 }
 
 void obs_source_frame_copy(struct obs_source_frame *dst, const struct obs_source_frame *src)
@@ -3328,15 +3452,56 @@ static inline bool async_texture_changed(struct obs_source *source, const struct
 	return source->async_cache_width != frame->width || source->async_cache_height != frame->height || prev != cur;
 }
 
-static inline void free_async_cache(struct obs_source *source)
+/* gives a frame taken from the queue back to the outputting thread, call with
+ * async_mutex held */
+static inline void recycle_async_frame(struct obs_source *source, struct obs_source_frame *frame)
+{
+	if (!async_frame_ring_push(&source->async_free_frames, frame))
+		obs_source_frame_decref(frame);
+}
+
+/* drops all queued frames but the newest one after the queue overflowed, call
+ * with async_mutex held */
+static void flush_async_frames(struct obs_source *source)
+{
+	while (async_frame_ring_count(&source->async_frames) > 1) {
+		recycle_async_frame(source, async_frame_ring_pop(&source->async_frames));
+		os_atomic_inc_long(&source->async_dropped_frames);
+	}
+
+	source->last_frame_ts = 0;
+}
+
+/* call with both async_output_mutex and async_mutex held */
+static void free_async_cache(struct obs_source *source)
 {
+	struct obs_source_frame *frame;
+
 	for (size_t i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
+	for (size_t i = 0; i < source->async_spare_frames.num; i++)
+		obs_source_frame_decref(source->async_spare_frames.array[i].frame);
+
+	while ((frame = async_frame_ring_pop(&source->async_frames)) != NULL)
+		obs_source_frame_decref(frame);
+	while ((frame = async_frame_ring_pop(&source->async_free_frames)) != NULL)
+		obs_source_frame_decref(frame);
 
 	da_resize(source->async_cache, 0);
-	da_resize(source->async_frames, 0);
+	da_resize(source->async_spare_frames, 0);
 	source->cur_async_frame = NULL;
 	source->prev_async_frame = NULL;
+
+	deinterlace_cpu_flush(source);
+}
+
+/* call with async_output_mutex held */
+static void free_spare_frames(struct obs_source *source)
+{
+	for (size_t i = 0; i < source->async_spare_frames.num; i++)
+		obs_source_frame_decref(source->async_spare_frames.array[i].frame);
+
+	da_resize(source->async_spare_frames, 0);
 }
 
 #define MAX_UNUSED_FRAME_DURATION 5
@@ -3345,34 +3510,27 @@ static inline void free_async_cache(struct obs_source *source)
  * of time */
 static void clean_cache(obs_source_t *source)
 {
-	for (size_t i = source->async_cache.num; i > 0; i--) {
-		struct async_frame *af = &source->async_cache.array[i - 1];
-		if (!af->used) {
-			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
-				da_erase(source->async_cache, i - 1);
-			}
+	for (size_t i = source->async_spare_frames.num; i > 0; i--) {
+		struct async_frame *af = &source->async_spare_frames.array[i - 1];
+		if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
+			obs_source_frame_decref(af->frame);
+			da_erase(source->async_spare_frames, i - 1);
 		}
 	}
 }
 
+/* must stay below ASYNC_FRAME_RING_SIZE */
 #define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+
+/* returns an unused frame with the format and size of frame, call with
+ * async_output_mutex held */
+static struct obs_source_frame *get_cache_frame(struct obs_source *source, const struct obs_source_frame *frame)
 {
 	struct obs_source_frame *new_frame = NULL;
-
-	pthread_mutex_lock(&source->async_mutex);
-
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
-		free_async_cache(source);
-		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
-	}
+	struct obs_source_frame *free_frame;
 
 	if (async_texture_changed(source, frame)) {
-		free_async_cache(source);
+		free_spare_frames(source);
 		source->async_cache_width = frame->width;
 		source->async_cache_height = frame->height;
 	}
@@ -3382,70 +3540,106 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source, co
 	source->async_cache_full_range = frame->full_range;
 	source->async_cache_trc = frame->trc;
 
-	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *af = &source->async_cache.array[i];
-		if (!af->used) {
-			new_frame = af->frame;
-			new_frame->format = format;
-			af->used = true;
-			af->unused_count = 0;
-			break;
+	/* frames given back after the format changed can't be reused */
+	while ((free_frame = async_frame_ring_pop(&source->async_free_frames)) != NULL) {
+		if (async_texture_changed(source, free_frame)) {
+			obs_source_frame_decref(free_frame);
+		} else {
+			struct async_frame af = {free_frame, 0};
+			da_push_back(source->async_spare_frames, &af);
 		}
 	}
 
+	if (source->async_spare_frames.num) {
+		new_frame = source->async_spare_frames.array[source->async_spare_frames.num - 1].frame;
+		new_frame->format = format;
+		da_pop_back(source->async_spare_frames);
+	}
+
 	clean_cache(source);
 
 	if (!new_frame) {
-		struct async_frame new_af;
-
 		new_frame = obs_source_frame_create(format, frame->width, frame->height);
-		new_af.frame = new_frame;
-		new_af.used = true;
-		new_af.unused_count = 0;
 		new_frame->refs = 1;
-
-		da_push_back(source->async_cache, &new_af);
 	}
 
-	os_atomic_inc_long(&new_frame->refs);
+	return new_frame;
+}
 
-	pthread_mutex_unlock(&source->async_mutex);
+/* call with async_output_mutex held */
+static inline struct obs_source_frame *cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame = get_cache_frame(source, frame);
 
 	copy_frame_data(new_frame, frame);
 
 	return new_frame;
 }
 
+/* queues the fields of the frame before the one given once it has arrived,
+ * call with async_output_mutex held */
+static void output_deinterlaced_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	if (!deinterlace_cpu_push_frame(source, frame))
+		return;
+
+	const struct obs_source_frame *cur = source->deinterlace_cpu_frames[1];
+	const size_t fields = deinterlace_cpu_field_count(source);
+
+	for (size_t i = 0; i < fields; i++) {
+		if (async_frame_ring_count(&source->async_frames) >= MAX_ASYNC_FRAMES) {
+			os_atomic_inc_long(&source->async_dropped_frames);
+			os_atomic_set_bool(&source->async_flush, true);
+			break;
+		}
+
+		struct obs_source_frame *output = get_cache_frame(source, cur);
+		copy_frame_metadata(output, cur);
+		deinterlace_cpu_output_field(source, output, i == 1);
+		async_frame_ring_push(&source->async_frames, output);
+	}
+
+	source->async_active = true;
+}
+
 static void obs_source_output_video_internal(obs_source_t *source, const struct obs_source_frame *frame)
 {
 	if (!obs_source_valid(source, "obs_source_output_video"))
 		return;
 
+	pthread_mutex_lock(&source->async_output_mutex);
+
 	if (!frame) {
 		pthread_mutex_lock(&source->async_mutex);
 		source->async_active = false;
 		source->last_frame_ts = 0;
 		free_async_cache(source);
 		pthread_mutex_unlock(&source->async_mutex);
+		pthread_mutex_unlock(&source->async_output_mutex);
 		return;
 	}
 
 	source_profiler_async_frame_received(source);
 
-	struct obs_source_frame *output = cache_video(source, frame);
+	if (async_frame_ring_count(&source->async_frames) >= MAX_ASYNC_FRAMES) {
+		/* the graphics thread isn't keeping up, drop the frame and
+		 * have the queue flushed on the next tick */
+		os_atomic_inc_long(&source->async_dropped_frames);
+		os_atomic_set_bool(&source->async_flush, true);
+	} else if (deinterlace_cpu_active(source, frame->format)) {
+		output_deinterlaced_video(source, frame);
+	} else {
+		/* frames held back for CPU deinterlacing are stale once it's
+		 * turned off or the format can't be deinterlaced */
+		if (source->deinterlace_cpu_frames[2])
+			deinterlace_cpu_flush(source);
 
-	/* ------------------------------------------- */
-	pthread_mutex_lock(&source->async_mutex);
-	if (output) {
-		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
-			output = NULL;
-		} else {
-			da_push_back(source->async_frames, &output);
-			source->async_active = true;
-		}
+		struct obs_source_frame *output = cache_video(source, frame);
+		async_frame_ring_push(&source->async_frames, output);
+		source->async_active = true;
 	}
-	pthread_mutex_unlock(&source->async_mutex);
+
+	pthread_mutex_unlock(&source->async_output_mutex);
 }
 
 void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame)
@@ -3923,36 +4117,54 @@ void obs_source_output_audio(obs_source_t *source, const struct obs_source_audio
 	pthread_mutex_unlock(&source->filter_mutex);
 }
 
+/* the consumer side of the async frame queue, call these with async_mutex
+ * held */
+struct obs_source_frame *pop_async_frame(obs_source_t *source)
+{
+	struct obs_source_frame *frame = async_frame_ring_pop(&source->async_frames);
+
+	if (frame) {
+		struct async_frame af = {frame, 0};
+		da_push_back(source->async_cache, &af);
+	}
+
+	return frame;
+}
+
 void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 {
 	if (frame)
 		frame->prev_frame = false;
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
-		struct async_frame *f = &source->async_cache.array[i];
-
-		if (f->frame == frame) {
-			f->used = false;
+		if (source->async_cache.array[i].frame == frame) {
+			da_erase(source->async_cache, i);
+			recycle_async_frame(source, frame);
 			break;
 		}
 	}
 }
 
+void skip_async_frame(obs_source_t *source)
+{
+	remove_async_frame(source, pop_async_frame(source));
+	os_atomic_inc_long(&source->async_late_frames);
+}
+
 /* #define DEBUG_ASYNC_FRAMES 1 */
 
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 {
-	struct obs_source_frame *next_frame = source->async_frames.array[0];
+	struct obs_source_frame *next_frame = async_frame_ring_peek(&source->async_frames, 0);
 	struct obs_source_frame *frame = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
 	uint64_t frame_time = next_frame->timestamp;
 	uint64_t frame_offset = 0;
 
 	if (source->async_unbuffered) {
-		while (source->async_frames.num > 1) {
-			da_erase(source->async_frames, 0);
-			remove_async_frame(source, next_frame);
-			next_frame = source->async_frames.array[0];
+		while (async_frame_ring_count(&source->async_frames) > 1) {
+			skip_async_frame(source);
+			next_frame = async_frame_ring_peek(&source->async_frames, 0);
 		}
 
 		source->last_frame_ts = next_frame->timestamp;
@@ -3965,7 +4177,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 	     "sys_offset: %llu, frame_offset: %llu, "
 	     "number of frames: %lu",
 	     source->last_frame_ts, frame_time, sys_offset, frame_time - source->last_frame_ts,
-	     (unsigned long)source->async_frames.num);
+	     (unsigned long)async_frame_ring_count(&source->async_frames));
 #endif
 
 	/* account for timestamp invalidation */
@@ -3990,7 +4202,7 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 			break;
 
 		if (frame)
-			da_erase(source->async_frames, 0);
+			skip_async_frame(source);
 
 #if DEBUG_ASYNC_FRAMES
 		blog(LOG_DEBUG,
@@ -4000,13 +4212,11 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 		     source->last_frame_ts, next_frame->timestamp);
 #endif
 
-		remove_async_frame(source, frame);
-
-		if (source->async_frames.num == 1)
+		if (async_frame_ring_count(&source->async_frames) == 1)
 			return true;
 
 		frame = next_frame;
-		next_frame = source->async_frames.array[1];
+		next_frame = async_frame_ring_peek(&source->async_frames, 1);
 
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TS_VAR) {
@@ -4030,12 +4240,11 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source, uint64_t sys_time)
 {
-	if (!source->async_frames.num)
+	if (!async_frame_ring_count(&source->async_frames))
 		return NULL;
 
 	if (!source->last_frame_ts || ready_async_frame(source, sys_time)) {
-		struct obs_source_frame *frame = source->async_frames.array[0];
-		da_erase(source->async_frames, 0);
+		struct obs_source_frame *frame = pop_async_frame(source);
 
 		if (!source->last_frame_ts)
 			source->last_frame_ts = frame->timestamp;
@@ -4108,7 +4317,7 @@ void obs_source_set_name(obs_source_t *source, const char *name)
 		return;
 
 	if (!name || !*name || !source->context.name || strcmp(name, source->context.name) != 0) {
-		struct calldata data;
+		calldata_t *data;
 		char *prev_name = bstrdup(source->context.name);
 
 		if (!source->context.private) {
@@ -4117,14 +4326,14 @@ void obs_source_set_name(obs_source_t *source, const char *name)
 			obs_context_data_setname(&source->context, name);
 		}
 
-		calldata_init(&data);
-		calldata_set_ptr(&data, "source", source);
-		calldata_set_string(&data, "new_name", source->context.name);
-		calldata_set_string(&data, "prev_name", prev_name);
+		data = calldata_acquire();
+		calldata_set_ptr(data, "source", source);
+		calldata_set_string(data, "new_name", source->context.name);
+		calldata_set_string(data, "prev_name", prev_name);
 		if (!source->context.private)
-			signal_handler_signal(obs->signals, "source_rename", &data);
-		signal_handler_signal(source->context.signals, "rename", &data);
-		calldata_free(&data);
+			signal_handler_signal(obs->signals, "source_rename", data);
+		signal_handler_signal(source->context.signals, "rename", data);
+		calldata_release(data);
 		bfree(prev_name);
 	}
 }
@@ -4376,7 +4585,7 @@ void obs_source_set_volume(obs_source_t *source, float volume)
 		calldata_set_ptr(&data, "source", source);
 		calldata_set_float(&data, "volume", volume);
 
-		signal_handler_signal(source->context.signals, "volume", &data);
+		signal_handle_emit(source->volume_signal, &data);
 		if (!source->context.private)
 			signal_handler_signal(obs->signals, "source_volume", &data);
 
@@ -4608,7 +4817,9 @@ void obs_source_load(obs_source_t *source)
 
 void obs_source_load2(obs_source_t *source)
 {
-	if (!data_valid(source, "obs_source_load2"))
+	if (!obs_source_valid(source, "obs_source_load2"))
+		return;
+	if (!source->context.data && !os_atomic_load_long(&source->deferred_create))
 		return;
 
 	obs_source_load(source);
@@ -5457,6 +5668,22 @@ bool obs_source_async_unbuffered(const obs_source_t *source)
 	return obs_source_valid(source, "obs_source_async_unbuffered") ? source->async_unbuffered : false;
 }
 
+uint32_t obs_source_get_dropped_async_frames(const obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_get_dropped_async_frames"))
+		return 0;
+
+	return (uint32_t)os_atomic_load_long(&source->async_dropped_frames);
+}
+
+uint32_t obs_source_get_late_async_frames(const obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_get_late_async_frames"))
+		return 0;
+
+	return (uint32_t)os_atomic_load_long(&source->async_late_frames);
+}
+
 obs_data_t *obs_source_get_private_settings(obs_source_t *source)
 {
 	if (!obs_ptr_valid(source, "obs_source_get_private_settings"))
@@ -5575,6 +5802,8 @@ void obs_source_media_play_pause(obs_source_t *source, bool pause)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 void obs_source_media_restart(obs_source_t *source)
@@ -5594,6 +5823,8 @@ void obs_source_media_restart(obs_source_t *source)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 void obs_source_media_stop(obs_source_t *source)
@@ -5613,6 +5844,8 @@ void obs_source_media_stop(obs_source_t *source)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 void obs_source_media_next(obs_source_t *source)
@@ -5632,6 +5865,8 @@ void obs_source_media_next(obs_source_t *source)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 void obs_source_media_previous(obs_source_t *source)
@@ -5651,6 +5886,8 @@ void obs_source_media_previous(obs_source_t *source)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 int64_t obs_source_media_get_duration(obs_source_t *source)
@@ -5696,6 +5933,8 @@ void obs_source_media_set_time(obs_source_t *source, int64_t ms)
 	pthread_mutex_lock(&source->media_actions_mutex);
 	da_push_back(source->media_actions, &action);
 	pthread_mutex_unlock(&source->media_actions_mutex);
+
+	obs_source_tick_set_add(source);
 }
 
 enum obs_media_state obs_source_media_get_state(obs_source_t *source)
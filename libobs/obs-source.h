@@ -203,6 +203,14 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_CAP_DONT_SHOW_PROPERTIES (1 << 16)
 
+/**
+ * Source's video_tick is thread-safe, does not use the graphics subsystem
+ * and does not query other sources (such as the size of a filter target), so
+ * it may be called on a worker thread in parallel with the ticks of other
+ * sources
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1 << 17)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent, obs_source_t *child, void *param);
@@ -211,6 +219,17 @@ struct obs_source_audio_mix {
 	struct audio_output_data output[MAX_AUDIO_MIXES];
 };
 
+/**
+ * Image drawn by video_render_cpu and filter_video_cpu, 8-bit RGBA with
+ * straight alpha
+ */
+struct obs_cpu_image {
+	uint8_t *data;
+	uint32_t linesize;
+	uint32_t width;
+	uint32_t height;
+};
+
 /**
  * Source definition structure
  */
@@ -546,6 +565,31 @@ struct obs_source_info {
 	 * @param  source  Source that the filter is being added to
 	 */
 	void (*filter_add)(void *data, obs_source_t *source);
+
+	/**
+	 * Renders the source without the graphics subsystem, when video is
+	 * composited on the CPU (see OBS_GRAPHICS_MODULE_CPU).  Sources draw
+	 * over a transparent image of their size.  Called from the graphics
+	 * thread.
+	 *
+	 * @param  data   Source data
+	 * @param  image  Image to draw to
+	 */
+	void (*video_render_cpu)(void *data, struct obs_cpu_image *image);
+
+	/**
+	 * Filters the image of the target without the graphics subsystem, the
+	 * counterpart of video_render for filters when video is composited on
+	 * the CPU.  The output image is sized by get_width/get_height, or to
+	 * the input if the filter has neither, and isn't cleared beforehand:
+	 * every pixel of it has to be written.  Called from the graphics
+	 * thread.
+	 *
+	 * @param  data    Filter data
+	 * @param  input   Image of the target, or of the previous filter
+	 * @param  output  Image to draw to
+	 */
+	void (*filter_video_cpu)(void *data, const struct obs_cpu_image *input, struct obs_cpu_image *output);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info, size_t size);
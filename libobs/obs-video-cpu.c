@@ -0,0 +1,443 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+
+#include "obs.h"
+#include "obs-internal.h"
+#include "obs-scene.h"
+#include "obs-video-cpu.h"
+#include "media-io/video-frame.h"
+
+/*
+ * Video rendering for OBS_GRAPHICS_MODULE_CPU.  Every frame, the sources of a
+ * view are flattened into a list of layers: scenes, groups and transitions are
+ * walked and their transforms combined, and everything else is drawn as an
+ * RGBA image, converted from async frames or rendered by the video_render_cpu
+ * callback and passed through the filter_video_cpu callbacks of its filters.
+ * The layers are then composited into the base resolution canvas of the mix
+ * and scaled and converted to the output format.
+ */
+
+#define MAX_CPU_DEPTH 16
+
+static void cpu_draw_source(const struct cpu_draw *draw, obs_source_t *source);
+
+static void cpu_log_unsupported(obs_source_t *source, const char *reason)
+{
+	if (source->cpu_unsupported_logged)
+		return;
+
+	source->cpu_unsupported_logged = true;
+	blog(LOG_WARNING, "CPU compositing: '%s' (%s) can't be drawn as it would be by a graphics module: %s",
+	     obs_source_get_name(source), source->info.id, reason);
+}
+
+/* ------------------------------------------------------------------------- */
+/* source images                                                             */
+
+static void cpu_image_resize(struct obs_cpu_image *image, uint32_t width, uint32_t height)
+{
+	if (image->data && image->width == width && image->height == height)
+		return;
+
+	bfree(image->data);
+	image->width = width;
+	image->height = height;
+	image->linesize = width * 4;
+	image->data = bmalloc((size_t)image->linesize * height);
+}
+
+static struct obs_cpu_image *cpu_update_async(obs_source_t *source)
+{
+	if (!source->async_rendered) {
+		struct obs_source_frame *frame = obs_source_get_frame(source);
+
+		source->async_rendered = true;
+
+		if (frame) {
+			if (!source->async_decoupled || !source->async_unbuffered) {
+				source->timing_adjust = obs->video.video_time - frame->timestamp;
+				source->timing_set = true;
+			}
+
+			if (video_composite_format_supported(frame->format)) {
+				cpu_image_resize(&source->cpu_image, frame->width, frame->height);
+				video_composite_convert(source->cpu_image.data, source->cpu_image.linesize,
+							(const uint8_t *const *)frame->data, frame->linesize,
+							frame->format, frame->width, frame->height, frame->color_matrix,
+							obs->video.tick_pool);
+				source->cpu_image_opaque = frame->format != VIDEO_FORMAT_RGBA &&
+							   frame->format != VIDEO_FORMAT_BGRA;
+			} else {
+				cpu_log_unsupported(source, get_video_format_name(frame->format));
+			}
+
+			source->async_last_rendered_ts = frame->timestamp;
+			obs_source_release_frame(source, frame);
+		}
+	}
+
+	if (!source->async_active || !source->cpu_image.data)
+		return NULL;
+
+	if (source->async_rotation)
+		cpu_log_unsupported(source, "frame rotation");
+
+	return &source->cpu_image;
+}
+
+static struct obs_cpu_image *cpu_render_sync(obs_source_t *source)
+{
+	struct obs_cpu_image *image = &source->cpu_image;
+	uint32_t width = obs_source_get_base_width(source);
+	uint32_t height = obs_source_get_base_height(source);
+
+	if (!width || !height)
+		return NULL;
+
+	cpu_image_resize(image, width, height);
+	memset(image->data, 0, (size_t)image->linesize * height);
+
+	source->info.video_render_cpu(source->context.data, image);
+	source->cpu_image_opaque = false;
+	return image;
+}
+
+/* filters are applied from the last one to the first, the same order they
+ * render in, each one drawing to the filter image the one before it didn't */
+static const struct obs_cpu_image *cpu_apply_filters(obs_source_t *source, const struct obs_cpu_image *image)
+{
+	DARRAY(obs_source_t *) filters;
+	size_t next = 0;
+
+	da_init(filters);
+
+	pthread_mutex_lock(&source->filter_mutex);
+	for (size_t i = source->filters.num; i > 0; i--) {
+		obs_source_t *filter = source->filters.array[i - 1];
+
+		if (!filter->enabled || !filter->context.data)
+			continue;
+
+		if (filter->info.filter_video_cpu) {
+			filter = obs_source_get_ref(filter);
+			if (filter)
+				da_push_back(filters, &filter);
+		} else if (filter->info.video_render) {
+			cpu_log_unsupported(filter, "filter without filter_video_cpu");
+		}
+	}
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	for (size_t i = 0; i < filters.num; i++) {
+		obs_source_t *filter = filters.array[i];
+		void *data = filter->context.data;
+
+		if (image) {
+			struct obs_cpu_image *output = &source->cpu_filter_images[next];
+			uint32_t width = filter->info.get_width ? filter->info.get_width(data) : image->width;
+			uint32_t height = filter->info.get_height ? filter->info.get_height(data) : image->height;
+
+			if (width && height) {
+				cpu_image_resize(output, width, height);
+				filter->info.filter_video_cpu(data, image, output);
+				image = output;
+				next ^= 1;
+			} else {
+				image = NULL;
+			}
+		}
+
+		obs_source_release(filter);
+	}
+
+	da_free(filters);
+	return image;
+}
+
+/* renders the image of a source once per frame, however many times it's
+ * drawn */
+static const struct obs_cpu_image *cpu_render_source(obs_source_t *source)
+{
+	const struct obs_cpu_image *image = NULL;
+
+	if (source->cpu_image_frame == obs->video.cpu_frame)
+		return source->cpu_output;
+
+	source->cpu_image_frame = obs->video.cpu_frame;
+	source->cpu_output = NULL;
+
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0) {
+		image = cpu_update_async(source);
+	} else if (source->info.video_render_cpu) {
+		image = cpu_render_sync(source);
+	} else {
+		cpu_log_unsupported(source, "no video_render_cpu callback");
+	}
+
+	if (image)
+		source->cpu_output = cpu_apply_filters(source, image);
+
+	return source->cpu_output;
+}
+
+/* ------------------------------------------------------------------------- */
+/* flattening                                                                */
+
+static void cpu_draw_image(const struct cpu_draw *draw, obs_source_t *source)
+{
+	struct obs_core_video_mix *mix = draw->mix;
+	const struct obs_cpu_image *image = cpu_render_source(source);
+	struct video_composite_layer layer;
+	bool flip;
+
+	if (!image)
+		return;
+
+	flip = (source->info.output_flags & OBS_SOURCE_ASYNC) != 0 && source->async_flip;
+	if (!cpu_make_layer(draw, image, flip, &layer))
+		return;
+
+	layer.opaque = image == &source->cpu_image && source->cpu_image_opaque;
+	da_push_back(mix->cpu_layers, &layer);
+
+	/* the image stays valid while the source is referenced */
+	source = obs_source_get_ref(source);
+	if (source)
+		da_push_back(mix->cpu_sources, &source);
+}
+
+static void cpu_draw_item(void *param, struct obs_scene_item *item)
+{
+	const struct cpu_draw *parent = param;
+	const struct matrix4 *m = &item->draw_transform;
+	obs_source_t *source = item->source;
+	struct cpu_draw draw = *parent;
+
+	if (m->x.y != 0.0f || m->y.x != 0.0f) {
+		cpu_log_unsupported(source, "rotated scene items");
+		return;
+	}
+	if (item->blend_type != OBS_BLEND_NORMAL)
+		cpu_log_unsupported(source, "blending modes other than normal");
+
+	uint32_t width = obs_source_get_width(source);
+	uint32_t height = obs_source_get_height(source);
+	if (!width || !height)
+		return;
+
+	cpu_enter_item(&draw, m, &item->crop, &item->bounds_crop, width, height);
+	draw.filter = item->scale_filter == OBS_SCALE_POINT ? VIDEO_COMPOSITE_POINT : VIDEO_COMPOSITE_BILINEAR;
+
+	if (!cpu_clip_empty(&draw))
+		cpu_draw_source(&draw, source);
+}
+
+static void cpu_draw_transition(const struct cpu_draw *parent, obs_source_t *transition)
+{
+	struct cpu_draw draw = *parent;
+	struct matrix4 m;
+	obs_source_t *source = obs_transition_get_cpu_source(transition, &m);
+
+	if (!source)
+		return;
+
+	cpu_clip(&draw, 0.0f, 0.0f, (float)obs_source_get_width(transition),
+		 (float)obs_source_get_height(transition));
+	cpu_transform(&draw, m.x.x, m.y.y, m.t.x, m.t.y);
+	memset(&draw.crop, 0, sizeof(draw.crop));
+	draw.depth++;
+
+	if (!cpu_clip_empty(&draw))
+		cpu_draw_source(&draw, source);
+
+	obs_source_release(source);
+}
+
+static void cpu_draw_source(const struct cpu_draw *draw, obs_source_t *source)
+{
+	if (!source || source->removed || !source->context.data)
+		return;
+	if ((source->info.output_flags & OBS_SOURCE_VIDEO) == 0)
+		return;
+	if (draw->depth > MAX_CPU_DEPTH)
+		return;
+
+	if (source->info.type == OBS_SOURCE_TYPE_SCENE) {
+		if (source->filters.num)
+			cpu_log_unsupported(source, "filters on scenes");
+
+		/* nested scenes are drawn over their own area only */
+		struct cpu_draw scene_draw = *draw;
+		memset(&scene_draw.crop, 0, sizeof(scene_draw.crop));
+		obs_scene_enum_render_items(source->context.data, cpu_draw_item, &scene_draw);
+
+	} else if (source->info.type == OBS_SOURCE_TYPE_TRANSITION) {
+		cpu_draw_transition(draw, source);
+
+	} else {
+		cpu_draw_image(draw, source);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* output                                                                    */
+
+static void cpu_composite(struct obs_core_video_mix *mix)
+{
+	const uint32_t width = mix->ovi.base_width;
+	const uint32_t height = mix->ovi.base_height;
+	struct obs_view *view = mix->view;
+	struct cpu_draw draw = {
+		.mix = mix,
+		.transform = {1.0f, 1.0f, 0.0f, 0.0f},
+		.clip_right = (int32_t)width,
+		.clip_bottom = (int32_t)height,
+		.filter = VIDEO_COMPOSITE_BILINEAR,
+	};
+
+	if (!mix->cpu_canvas)
+		mix->cpu_canvas = bmalloc((size_t)width * height * 4);
+
+	pthread_mutex_lock(&view->channels_mutex);
+
+	for (size_t i = 0; i < MAX_CHANNELS; i++) {
+		struct obs_source *source = view->channels[i];
+
+		if (source) {
+			if (source->removed) {
+				obs_source_release(source);
+				view->channels[i] = NULL;
+			} else {
+				cpu_draw_source(&draw, source);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&view->channels_mutex);
+
+	video_composite(mix->cpu_canvas, width * 4, width, height, mix->cpu_layers.array, mix->cpu_layers.num,
+			obs->video.tick_pool);
+
+	for (size_t i = 0; i < mix->cpu_sources.num; i++)
+		obs_source_release(mix->cpu_sources.array[i]);
+
+	da_resize(mix->cpu_layers, 0);
+	da_resize(mix->cpu_sources, 0);
+}
+
+static enum video_scale_type cpu_scale_type(enum obs_scale_type type)
+{
+	switch (type) {
+	case OBS_SCALE_POINT:
+		return VIDEO_SCALE_POINT;
+	case OBS_SCALE_BILINEAR:
+		return VIDEO_SCALE_BILINEAR;
+	case OBS_SCALE_BICUBIC:
+	case OBS_SCALE_LANCZOS:
+		return VIDEO_SCALE_BICUBIC;
+	default:
+		return VIDEO_SCALE_DEFAULT;
+	}
+}
+
+static bool cpu_create_scaler(struct obs_core_video_mix *mix)
+{
+	const struct video_output_info *info = video_output_get_info(mix->video);
+	struct video_scale_info src = {
+		.format = VIDEO_FORMAT_RGBA,
+		.width = mix->ovi.base_width,
+		.height = mix->ovi.base_height,
+		.range = VIDEO_RANGE_FULL,
+		.colorspace = VIDEO_CS_SRGB,
+	};
+	struct video_scale_info dst = {
+		.format = info->format,
+		.width = info->width,
+		.height = info->height,
+		.range = info->range,
+		.colorspace = info->colorspace,
+	};
+
+	int ret = video_scaler_create(&mix->cpu_scaler, &dst, &src, cpu_scale_type(mix->ovi.scale_type));
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		blog(LOG_ERROR, "CPU compositing: Failed to create the output scaler (%d)", ret);
+		return false;
+	}
+
+	return true;
+}
+
+static void cpu_output_frame(struct obs_core_video_mix *mix)
+{
+	const uint8_t *input[MAX_AV_PLANES] = {mix->cpu_canvas};
+	const uint32_t input_linesize[MAX_AV_PLANES] = {mix->ovi.base_width * 4};
+	struct obs_vframe_info vframe_info;
+	struct video_frame output_frame;
+
+	cpu_composite(mix);
+
+	if (!mix->raw_was_active || !mix->vframe_info_buffer.size)
+		return;
+
+	deque_pop_front(&mix->vframe_info_buffer, &vframe_info, sizeof(vframe_info));
+
+	if (!mix->cpu_scaler && !cpu_create_scaler(mix))
+		return;
+
+	if (video_output_lock_frame(mix->video, &output_frame, vframe_info.count, vframe_info.timestamp)) {
+		video_scaler_scale(mix->cpu_scaler, output_frame.data, output_frame.linesize, input, input_linesize);
+		video_output_unlock_frame(mix->video);
+	}
+}
+
+void obs_cpu_output_frames(void)
+{
+	obs->video.cpu_frame++;
+
+	pthread_mutex_lock(&obs->video.mixes_mutex);
+	for (size_t i = 0, num = obs->video.mixes.num; i < num; i++) {
+		struct obs_core_video_mix *mix = obs->video.mixes.array[i];
+		if (mix->view) {
+			cpu_output_frame(mix);
+		} else {
+			obs->video.mixes.array[i] = NULL;
+			obs_free_video_mix(mix);
+			da_erase(obs->video.mixes, i);
+			i--;
+			num--;
+		}
+	}
+	pthread_mutex_unlock(&obs->video.mixes_mutex);
+}
+
+void obs_cpu_free_video_mix(struct obs_core_video_mix *video)
+{
+	for (size_t i = 0; i < video->cpu_sources.num; i++)
+		obs_source_release(video->cpu_sources.array[i]);
+
+	da_free(video->cpu_sources);
+	da_free(video->cpu_layers);
+	bfree(video->cpu_canvas);
+	video->cpu_canvas = NULL;
+
+	if (video->cpu_scaler) {
+		video_scaler_destroy(video->cpu_scaler);
+		video->cpu_scaler = NULL;
+	}
+}
@@ -0,0 +1,173 @@
+/******************************************************************************
+    Copyright (C) 2023 by Lain Bailey <lain@obsproject.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <math.h>
+
+#include "obs.h"
+#include "graphics/matrix4.h"
+#include "media-io/video-composite.h"
+
+/*
+ * Flattening math of the CPU compositor: how the transforms and crops of
+ * nested scene items combine into the layers of video_composite.  Kept apart
+ * from the walk over the sources so that it can be tested on its own.
+ */
+
+#define MAX_CPU_EDGE 1048576.0f
+
+struct obs_core_video_mix;
+
+/* maps source pixels to canvas pixels, items can be moved, scaled and flipped
+ * but not rotated */
+struct cpu_transform {
+	float scale_x;
+	float scale_y;
+	float x;
+	float y;
+};
+
+struct cpu_draw {
+	struct obs_core_video_mix *mix;
+	struct cpu_transform transform;
+
+	/* canvas area the source is drawn in, the edges of the pixels */
+	int32_t clip_left;
+	int32_t clip_top;
+	int32_t clip_right;
+	int32_t clip_bottom;
+
+	/* crop of the scene item of the source, if it's drawn as an image */
+	struct obs_sceneitem_crop crop;
+
+	enum video_composite_filter filter;
+	int depth;
+};
+
+static inline int32_t cpu_pixel_edge(float pos)
+{
+	/* a pixel is drawn when its center is covered */
+	if (pos < -MAX_CPU_EDGE)
+		pos = -MAX_CPU_EDGE;
+	else if (pos > MAX_CPU_EDGE)
+		pos = MAX_CPU_EDGE;
+	return (int32_t)ceilf(pos - 0.5f);
+}
+
+/* limits drawing to a rectangle of the source, in source pixels */
+static inline void cpu_clip(struct cpu_draw *draw, float left, float top, float right, float bottom)
+{
+	const struct cpu_transform *tf = &draw->transform;
+	float x0 = tf->x + tf->scale_x * left;
+	float x1 = tf->x + tf->scale_x * right;
+	float y0 = tf->y + tf->scale_y * top;
+	float y1 = tf->y + tf->scale_y * bottom;
+
+	int32_t clip_left = cpu_pixel_edge(fminf(x0, x1));
+	int32_t clip_right = cpu_pixel_edge(fmaxf(x0, x1));
+	int32_t clip_top = cpu_pixel_edge(fminf(y0, y1));
+	int32_t clip_bottom = cpu_pixel_edge(fmaxf(y0, y1));
+
+	if (clip_left > draw->clip_left)
+		draw->clip_left = clip_left;
+	if (clip_top > draw->clip_top)
+		draw->clip_top = clip_top;
+	if (clip_right < draw->clip_right)
+		draw->clip_right = clip_right;
+	if (clip_bottom < draw->clip_bottom)
+		draw->clip_bottom = clip_bottom;
+}
+
+/* applies a child transform, child pixels to parent pixels */
+static inline void cpu_transform(struct cpu_draw *draw, float scale_x, float scale_y, float x, float y)
+{
+	struct cpu_transform *tf = &draw->transform;
+
+	tf->x += tf->scale_x * x;
+	tf->y += tf->scale_y * y;
+	tf->scale_x *= scale_x;
+	tf->scale_y *= scale_y;
+}
+
+static inline bool cpu_clip_empty(const struct cpu_draw *draw)
+{
+	return draw->clip_left >= draw->clip_right || draw->clip_top >= draw->clip_bottom;
+}
+
+/* moves into a scene item of a width x height source, drawn with the (not
+ * rotated) draw transform of the item */
+static inline void cpu_enter_item(struct cpu_draw *draw, const struct matrix4 *m, const struct obs_sceneitem_crop *crop,
+				  const struct obs_sceneitem_crop *bounds_crop, uint32_t width, uint32_t height)
+{
+	draw->crop.left = crop->left + bounds_crop->left;
+	draw->crop.top = crop->top + bounds_crop->top;
+	draw->crop.right = crop->right + bounds_crop->right;
+	draw->crop.bottom = crop->bottom + bounds_crop->bottom;
+
+	/* draw_transform maps the cropped source, move it back to the origin
+	 * of the whole source */
+	cpu_transform(draw, m->x.x, m->y.y, m->t.x - m->x.x * (float)draw->crop.left,
+		      m->t.y - m->y.y * (float)draw->crop.top);
+	cpu_clip(draw, (float)draw->crop.left, (float)draw->crop.top, (float)width - (float)draw->crop.right,
+		 (float)height - (float)draw->crop.bottom);
+	draw->depth++;
+}
+
+/* the layer of an image drawn at the current transform and crop, returns
+ * false if it's cropped away entirely */
+static inline bool cpu_make_layer(const struct cpu_draw *draw, const struct obs_cpu_image *image, bool flip,
+				  struct video_composite_layer *layer)
+{
+	const struct cpu_transform *tf = &draw->transform;
+	const struct obs_sceneitem_crop *crop = &draw->crop;
+	int64_t src_cx = (int64_t)image->width - crop->left - crop->right;
+	int64_t src_cy = (int64_t)image->height - crop->top - crop->bottom;
+
+	if (src_cx <= 0 || src_cy <= 0)
+		return false;
+
+	memset(layer, 0, sizeof(*layer));
+	layer->data = image->data;
+	layer->linesize = image->linesize;
+	layer->width = image->width;
+	layer->height = image->height;
+	layer->src_x = (float)crop->left;
+	layer->src_y = (float)crop->top;
+	layer->src_cx = (float)src_cx;
+	layer->src_cy = (float)src_cy;
+	layer->dst_x = tf->x + tf->scale_x * (float)crop->left;
+	layer->dst_y = tf->y + tf->scale_y * (float)crop->top;
+	layer->dst_cx = tf->scale_x * (float)src_cx;
+	layer->dst_cy = tf->scale_y * (float)src_cy;
+	layer->clip = true;
+	layer->clip_x = draw->clip_left;
+	layer->clip_y = draw->clip_top;
+	layer->clip_cx = draw->clip_right - draw->clip_left;
+	layer->clip_cy = draw->clip_bottom - draw->clip_top;
+	layer->filter = draw->filter;
+
+	/* a flipped image is cropped as it's shown, its bottom rows are the
+	 * top rows of the data */
+	if (flip) {
+		layer->src_y = (float)crop->bottom;
+		layer->dst_y += layer->dst_cy;
+		layer->dst_cy = -layer->dst_cy;
+	}
+
+	return true;
+}
@@ -29,10 +29,27 @@
 #include <windows.h>
 #endif
 
+struct parallel_tick_data {
+	struct parallel_tick *ticks;
+	float seconds;
+};
+
+static void parallel_tick(void *param, size_t idx)
+{
+	struct parallel_tick_data *data = param;
+	struct parallel_tick *tick = &data->ticks[idx];
+
+	const uint64_t start = os_gettime_ns();
+	obs_source_video_tick_callback(tick->source, data->seconds);
+	tick->tick_time = os_gettime_ns() - start;
+	tick->worker = os_task_pool_worker_index();
+}
+
+static const char *parallel_ticks_name = "parallel_ticks";
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
-	struct obs_source *source;
 	uint64_t delta_time;
 	float seconds;
 
@@ -56,33 +73,60 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	pthread_mutex_unlock(&data->draw_callbacks_mutex);
 
 	/* ------------------------------------- */
-	/* get an array of all sources to tick   */
+	/* get an array of the sources to tick   */
 
 	da_clear(data->sources_to_tick);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	pthread_mutex_lock(&data->tick_set_mutex);
 
-	source = data->sources;
-	while (source) {
-		obs_source_t *s = obs_source_get_ref(source);
+	da_reserve(data->sources_to_tick, data->tick_set.num);
+	for (size_t i = 0; i < data->tick_set.num; i++) {
+		obs_source_t *s = obs_source_get_ref(data->tick_set.array[i]);
 		if (s)
 			da_push_back(data->sources_to_tick, &s);
-		source = (struct obs_source *)source->context.hh_uuid.next;
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->tick_set_mutex);
 
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
+	da_clear(data->parallel_ticks);
+
 	for (size_t i = 0; i < data->sources_to_tick.num; i++) {
 		obs_source_t *s = data->sources_to_tick.array[i];
 		const uint64_t start = source_profiler_source_tick_start();
-		obs_source_video_tick(s, seconds);
+		bool parallel = obs_source_video_tick_begin(s, seconds);
 		source_profiler_source_tick_end(s, start);
+
+		if (parallel) {
+			struct parallel_tick *tick = da_push_back_new(data->parallel_ticks);
+			tick->source = s;
+			continue;
+		}
+
+		obs_source_tick_set_prune(s);
 		obs_source_release(s);
 	}
 
+	/* ------------------------------------- */
+	/* fan out thread-safe tick callbacks    */
+
+	if (data->parallel_ticks.num) {
+		struct parallel_tick_data tick_data = {data->parallel_ticks.array, seconds};
+
+		profile_start(parallel_ticks_name);
+		os_task_pool_run(obs->video.tick_pool, parallel_tick, &tick_data, data->parallel_ticks.num);
+		profile_end(parallel_ticks_name);
+
+		for (size_t i = 0; i < data->parallel_ticks.num; i++) {
+			struct parallel_tick *tick = &data->parallel_ticks.array[i];
+			source_profiler_source_tick_add(tick->source, tick->tick_time, tick->worker);
+			obs_source_tick_set_prune(tick->source);
+			obs_source_release(tick->source);
+		}
+	}
+
 	return cur_time;
 }
 
@@ -1104,9 +1148,11 @@ bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 	profile_start(context->video_thread_name);
 	source_profiler_frame_begin();
 
-	gs_enter_context(obs->video.graphics);
-	gs_begin_frame();
-	gs_leave_context();
+	if (!obs->video.cpu_compositing) {
+		gs_enter_context(obs->video.graphics);
+		gs_begin_frame();
+		gs_leave_context();
+	}
 
 	profile_start(tick_sources_name);
 	context->last_time = tick_sources(obs->video.video_time, context->last_time);
@@ -1122,12 +1168,19 @@ bool obs_graphics_thread_loop(struct obs_graphics_context *context)
 
 	source_profiler_render_begin();
 	profile_start(output_frame_name);
-	output_frames();
+	if (obs->video.cpu_compositing) {
+		obs_cpu_output_frames();
+	} else {
+		output_frames();
+	}
 	profile_end(output_frame_name);
 
-	profile_start(render_displays_name);
-	render_displays();
-	profile_end(render_displays_name);
+	/* displays need a graphics module */
+	if (!obs->video.cpu_compositing) {
+		profile_start(render_displays_name);
+		render_displays();
+		profile_end(render_displays_name);
+	}
 	source_profiler_render_end();
 
 	execute_graphics_tasks();
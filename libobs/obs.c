@@ -622,7 +622,8 @@ static int obs_init_video_mix(struct obs_video_info *ovi, struct obs_core_video_
 	}
 	pthread_mutex_unlock(&obs->video.mixes_mutex);
 
-	video->gpu_conversion = ovi->gpu_conversion;
+	/* the CPU compositor converts the canvas with the video scaler */
+	video->gpu_conversion = ovi->gpu_conversion && !obs->video.cpu_compositing;
 	video->gpu_was_active = false;
 	video->raw_was_active = false;
 	video->was_active = false;
@@ -643,6 +644,9 @@ static int obs_init_video_mix(struct obs_video_info *ovi, struct obs_core_video_
 	if (pthread_mutex_init(&video->gpu_encoder_mutex, NULL) < 0)
 		return OBS_VIDEO_FAIL;
 
+	if (obs->video.cpu_compositing)
+		return OBS_VIDEO_SUCCESS;
+
 	gs_enter_context(obs->video.graphics);
 
 	if (video->gpu_conversion && !obs_init_gpu_conversion(video))
@@ -681,6 +685,11 @@ static int obs_init_video(struct obs_video_info *ovi)
 	if (!obs_view_add2(&obs->data.main_view, ovi))
 		return OBS_VIDEO_FAIL;
 
+	/* the graphics thread runs its share of the parallel ticks itself */
+	int cores = os_get_logical_cores();
+	if (cores > 2)
+		video->tick_pool = os_task_pool_create("libobs: tick worker", cores - 2 < 7 ? cores - 2 : 7);
+
 	int errorcode;
 #ifdef __APPLE__
 	pthread_attr_t attr;
@@ -772,6 +781,7 @@ void obs_free_video_mix(struct obs_core_video_mix *video)
 		video->video = NULL;
 
 		obs_free_render_textures(video);
+		obs_cpu_free_video_mix(video);
 
 		deque_free(&video->vframe_info_buffer);
 		deque_free(&video->vframe_info_buffer_gpu);
@@ -820,6 +830,9 @@ static void obs_free_video(void)
 	pthread_mutex_destroy(&obs->video.task_mutex);
 	pthread_mutex_init_value(&obs->video.task_mutex);
 	deque_free(&obs->video.tasks);
+
+	os_task_pool_destroy(obs->video.tick_pool);
+	obs->video.tick_pool = NULL;
 }
 
 static void obs_free_graphics(void)
@@ -921,6 +934,7 @@ static bool obs_init_data(void)
 
 	pthread_mutex_init_value(&obs->data.displays_mutex);
 	pthread_mutex_init_value(&obs->data.draw_callbacks_mutex);
+	pthread_mutex_init_value(&obs->data.tick_set_mutex);
 
 	if (pthread_mutex_init_recursive(&data->sources_mutex) != 0)
 		goto fail;
@@ -936,6 +950,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init_recursive(&obs->data.draw_callbacks_mutex) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->tick_set_mutex, NULL) != 0)
+		goto fail;
 
 	if (!obs_view_init(&data->main_view))
 		goto fail;
@@ -1012,6 +1028,7 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
 	pthread_mutex_destroy(&data->draw_callbacks_mutex);
+	pthread_mutex_destroy(&data->tick_set_mutex);
 	da_free(data->draw_callbacks);
 	da_free(data->rendered_callbacks);
 	da_free(data->tick_callbacks);
@@ -1021,6 +1038,8 @@ static void obs_free_data(void)
 		bfree(data->protocols.array[i]);
 	da_free(data->protocols);
 	da_free(data->sources_to_tick);
+	da_free(data->parallel_ticks);
+	da_free(data->tick_set);
 }
 
 static const char *obs_signals[] = {
@@ -1188,6 +1207,11 @@ static bool obs_init(const char *locale, const char *module_config_path, profile
 	if (!obs->destruction_task_thread)
 		return false;
 
+	/* copying saturates memory bandwidth after a few threads */
+	int cores = os_get_logical_cores();
+	if (cores > 2)
+		obs->async_frame_pool = os_task_pool_create("libobs: async frame worker", cores / 2 < 3 ? cores / 2 : 3);
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -1360,12 +1384,14 @@ void obs_shutdown(void)
 	obs_free_audio();
 	obs_free_video();
 	os_task_queue_destroy(obs->destruction_task_thread);
+	os_task_pool_destroy(obs->async_frame_pool);
 	obs_free_hotkeys();
 	obs_free_graphics();
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
 	obs->signals = NULL;
+	calldata_pool_free();
 
 	for (size_t i = 0; i < obs->module_paths.num; i++)
 		free_module_path(obs->module_paths.array + i);
@@ -1447,6 +1473,12 @@ int obs_reset_video(struct obs_video_info *ovi)
 	if (!size_valid(ovi->output_width, ovi->output_height) || !size_valid(ovi->base_width, ovi->base_height))
 		return OBS_VIDEO_INVALID_PARAM;
 
+	const bool cpu_compositing = ovi->graphics_module && strcmp(ovi->graphics_module, OBS_GRAPHICS_MODULE_CPU) == 0;
+	if (cpu_compositing ? obs->video.graphics != NULL : obs->video.cpu_compositing) {
+		blog(LOG_ERROR, "obs_reset_video: Cannot switch between the CPU compositor and a graphics module");
+		return OBS_VIDEO_NOT_SUPPORTED;
+	}
+
 	stop_video();
 	obs_free_video();
 
@@ -1454,7 +1486,9 @@ int obs_reset_video(struct obs_video_info *ovi)
 	ovi->output_width &= 0xFFFFFFFC;
 	ovi->output_height &= 0xFFFFFFFE;
 
-	if (!obs->video.graphics) {
+	if (cpu_compositing) {
+		obs->video.cpu_compositing = true;
+	} else if (!obs->video.graphics) {
 		int errorcode = obs_init_graphics(ovi);
 		if (errorcode != OBS_VIDEO_SUCCESS) {
 			obs_free_graphics();
@@ -1496,10 +1530,11 @@ int obs_reset_video(struct obs_video_info *ovi)
 	     "\tdownscale filter:  %s\n"
 	     "\tfps:               %d/%d\n"
 	     "\tformat:            %s\n"
-	     "\tYUV mode:          %s%s%s",
+	     "\tYUV mode:          %s%s%s\n"
+	     "\tcompositing:       %s",
 	     ovi->base_width, ovi->base_height, ovi->output_width, ovi->output_height, scale_type_name, ovi->fps_num,
 	     ovi->fps_den, get_video_format_name(ovi->output_format), yuv ? yuv_format : "None", yuv ? "/" : "",
-	     yuv ? yuv_range : "");
+	     yuv ? yuv_range : "", cpu_compositing ? "CPU" : "GPU");
 
 	source_profiler_reset_video(ovi);
 
@@ -1566,7 +1601,7 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 
 bool obs_get_video_info(struct obs_video_info *ovi)
 {
-	if (!obs->video.graphics || !obs->video.main_mix)
+	if ((!obs->video.graphics && !obs->video.cpu_compositing) || !obs->video.main_mix)
 		return false;
 
 	*ovi = obs->video.main_mix->ovi;
@@ -2148,7 +2183,8 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data, bool is_priva
 	if (!*v_id)
 		v_id = id;
 
-	source = obs_source_create_set_last_ver(v_id, name, uuid, settings, hotkeys, prev_ver, is_private);
+	source = obs_source_create_set_last_ver(v_id, name, uuid, settings, hotkeys, prev_ver, is_private,
+						obs->data.defer_source_create);
 
 	if (source->owns_info_id) {
 		bfree((void *)source->info.unversioned_id);
@@ -2202,6 +2238,8 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data, bool is_priva
 	di_order = (int)obs_data_get_int(source_data, "deinterlace_field_order");
 	obs_source_set_deinterlace_field_order(source, (enum obs_deinterlace_field_order)di_order);
 
+	obs_source_set_deinterlace_cpu(source, obs_data_get_bool(source_data, "deinterlace_cpu"));
+
 	monitoring_type = (int)obs_data_get_int(source_data, "monitoring_type");
 	if (prev_ver < MAKE_SEMANTIC_VERSION(23, 2, 2)) {
 		if ((caps & OBS_SOURCE_MONITOR_BY_DEFAULT) != 0) {
@@ -2292,6 +2330,11 @@ void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb, void *priv
 	da_free(sources);
 }
 
+void obs_set_defer_source_creation(bool defer)
+{
+	obs->data.defer_source_create = defer;
+}
+
 obs_data_t *obs_save_source(obs_source_t *source)
 {
 	obs_data_array_t *filters = obs_data_array_create();
@@ -2317,6 +2360,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	int m_type = (int)obs_source_get_monitoring_type(source);
 	int di_mode = (int)obs_source_get_deinterlace_mode(source);
 	int di_order = (int)obs_source_get_deinterlace_field_order(source);
+	bool di_cpu = obs_source_get_deinterlace_cpu(source);
 	DARRAY(obs_source_t *) filters_copy;
 
 	obs_source_save(source);
@@ -2349,6 +2393,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	obs_data_set_obj(source_data, "hotkeys", hotkey_data);
 	obs_data_set_int(source_data, "deinterlace_mode", di_mode);
 	obs_data_set_int(source_data, "deinterlace_field_order", di_order);
+	obs_data_set_bool(source_data, "deinterlace_cpu", di_cpu);
 	obs_data_set_int(source_data, "monitoring_type", m_type);
 
 	obs_data_set_obj(source_data, "private_settings", source->private_settings);
@@ -2938,12 +2983,19 @@ struct obs_core_video_mix *get_mix_for_video(video_t *v)
 }
 
 void start_raw_video(video_t *v, const struct video_scale_info *conversion, uint32_t frame_rate_divisor,
-		     void (*callback)(void *param, struct video_data *frame), void *param)
+		     void (*callback)(void *param, struct video_data *frame), void *param, bool threaded)
 {
 	struct obs_core_video_mix *video = get_mix_for_video(v);
+	bool success;
+
 	if (!video)
 		return;
-	if (video_output_connect2(v, conversion, frame_rate_divisor, callback, param))
+
+	if (threaded)
+		success = video_output_connect_threaded(v, conversion, frame_rate_divisor, callback, param);
+	else
+		success = video_output_connect2(v, conversion, frame_rate_divisor, callback, param);
+	if (success)
 		os_atomic_inc_long(&video->raw_active);
 }
 
@@ -2966,7 +3018,7 @@ void obs_add_raw_video_callback2(const struct video_scale_info *conversion, uint
 				 void (*callback)(void *param, struct video_data *frame), void *param)
 {
 	struct obs_core_video_mix *video = obs->video.main_mix;
-	start_raw_video(video->video, conversion, frame_rate_divisor, callback, param);
+	start_raw_video(video->video, conversion, frame_rate_divisor, callback, param, false);
 }
 
 void obs_remove_raw_video_callback(void (*callback)(void *param, struct video_data *frame), void *param)
@@ -3086,6 +3138,11 @@ bool obs_video_active(void)
 	return result;
 }
 
+bool obs_cpu_compositing_active(void)
+{
+	return obs && obs->video.cpu_compositing;
+}
+
 bool obs_nv12_tex_active(void)
 {
 	struct obs_core_video_mix *video = obs->video.main_mix;
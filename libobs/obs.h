@@ -167,13 +167,22 @@ struct obs_transform_info {
 	bool crop_to_bounds;
 };
 
+/**
+ * Graphics module name that runs video without a graphics subsystem.  Scenes,
+ * async sources, the sources that implement video_render_cpu and the filters
+ * that implement filter_video_cpu are composited on the CPU, for machines
+ * without a GPU.
+ */
+#define OBS_GRAPHICS_MODULE_CPU "cpu"
+
 /**
  * Video initialization structure
  */
 struct obs_video_info {
 #ifndef SWIG
 	/**
-	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11")
+	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11",
+	 * or OBS_GRAPHICS_MODULE_CPU)
 	 */
 	const char *graphics_module;
 #endif
@@ -653,6 +662,9 @@ EXPORT video_t *obs_get_video(void);
 /** Returns true if video is active, false otherwise */
 EXPORT bool obs_video_active(void);
 
+/** Returns true if video is composited on the CPU (OBS_GRAPHICS_MODULE_CPU) */
+EXPORT bool obs_cpu_compositing_active(void);
+
 /** Sets the primary output source for a channel. */
 EXPORT void obs_set_output_source(uint32_t channel, obs_source_t *source);
 
@@ -774,6 +786,12 @@ typedef void (*obs_load_source_cb)(void *private_data, obs_source_t *source);
 /** Loads sources from a data array */
 EXPORT void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb, void *private_data);
 
+/**
+ * Defers creating input sources loaded with obs_load_source/obs_load_sources
+ * until they are first shown or activated.
+ */
+EXPORT void obs_set_defer_source_creation(bool defer);
+
 /** Saves sources to a data array */
 EXPORT obs_data_array_t *obs_save_sources(void);
 
@@ -1271,6 +1289,14 @@ EXPORT enum obs_deinterlace_mode obs_source_get_deinterlace_mode(const obs_sourc
 EXPORT void obs_source_set_deinterlace_field_order(obs_source_t *source, enum obs_deinterlace_field_order field_order);
 EXPORT enum obs_deinterlace_field_order obs_source_get_deinterlace_field_order(const obs_source_t *source);
 
+/**
+ * Deinterlaces the frames of an async source on the CPU as they are output
+ * instead of on the GPU when they are rendered, for the 8-bit formats that
+ * support it.  The mode and field order still apply.  Adds a frame of latency.
+ */
+EXPORT void obs_source_set_deinterlace_cpu(obs_source_t *source, bool enable);
+EXPORT bool obs_source_get_deinterlace_cpu(const obs_source_t *source);
+
 enum obs_monitoring_type {
 	OBS_MONITORING_TYPE_NONE,
 	OBS_MONITORING_TYPE_MONITOR_ONLY,
@@ -1458,6 +1484,11 @@ EXPORT void obs_source_get_audio_mix(const obs_source_t *source, struct obs_sour
 EXPORT void obs_source_set_async_unbuffered(obs_source_t *source, bool unbuffered);
 EXPORT bool obs_source_async_unbuffered(const obs_source_t *source);
 
+/** Number of async video frames dropped because the graphics thread wasn't
+ * keeping up, and of queued frames skipped without being rendered */
+EXPORT uint32_t obs_source_get_dropped_async_frames(const obs_source_t *source);
+EXPORT uint32_t obs_source_get_late_async_frames(const obs_source_t *source);
+
 /** Used to decouple audio from video so that audio doesn't attempt to sync up
  * with video.  I.E. Audio acts independently.  Only works when in unbuffered
  * mode. */
@@ -2233,6 +2264,19 @@ EXPORT enum obs_scale_type obs_encoder_get_scale_type(obs_encoder_t *encoder);
 /** For video encoders, returns the frame rate divisor (default is 1) */
 EXPORT uint32_t obs_encoder_get_frame_rate_divisor(const obs_encoder_t *encoder);
 
+/**
+ * Makes a raw (non-GPU) video encoder receive and encode frames on its own
+ * thread, so that it can't delay other encoders.  Frames it can't keep up
+ * with are dropped for this encoder only and counted as late.
+ *
+ * Can only be called on stopped encoders
+ */
+EXPORT bool obs_encoder_set_dedicated_thread(obs_encoder_t *encoder, bool dedicated_thread);
+
+/** For video encoders on a dedicated thread, returns the number of frames
+ * dropped because the encoder fell behind */
+EXPORT uint32_t obs_encoder_get_late_frames(const obs_encoder_t *encoder);
+
 /** For video encoders, returns the number of frames encoded */
 EXPORT uint32_t obs_encoder_get_encoded_frames(const obs_encoder_t *encoder);
 
@@ -2341,6 +2385,10 @@ EXPORT uint32_t obs_encoder_get_caps(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst, struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/** For encoders with OBS_ENCODER_CAP_REFCOUNTED_PACKETS, allocates reference
+ * counted packet data of the given size and sets it on the packet */
+EXPORT uint8_t *obs_encoder_packet_alloc_data(struct encoder_packet *packet, size_t size);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder, const char *reroute_id);
 
 /** Returns whether encoder is paused */
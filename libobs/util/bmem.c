@@ -96,37 +96,471 @@ static void a_free(void *ptr)
 #endif
 }
 
+/* ------------------------------------------------------------------------- */
+/* allocation tags */
+
+static THREAD_LOCAL enum bmem_tag thread_tag = BMEM_TAG_NONE;
+
+static const char *tag_names[BMEM_TAG_COUNT] = {"none", "source", "encoder", "output", "data"};
+
+enum bmem_tag bmem_set_thread_tag(enum bmem_tag tag)
+{
+	enum bmem_tag prev = thread_tag;
+	thread_tag = tag;
+	return prev;
+}
+
+const char *bmem_tag_name(enum bmem_tag tag)
+{
+	return ((unsigned)tag < BMEM_TAG_COUNT) ? tag_names[tag] : NULL;
+}
+
+#ifdef BMEM_ARENA
+
+/*
+ * Size-class arena
+ *
+ *   Every block starts with a header padded to ALIGNMENT which records the
+ * requested size, the size class and the tag.  Blocks up to 8 KiB (including
+ * the header) are carved out of slabs and recycled through per-thread free
+ * lists, which exchange batches with a global depot.  Larger blocks go
+ * straight to the system allocator.
+ *
+ *   Per-tag counters are accumulated per thread and folded into the global
+ * totals once a thread has moved FLUSH_BYTES or when it exits, so the hot
+ * path never touches shared state.  Queries add the counters of every live
+ * thread to the totals.
+ */
+
+#define HEADER_SIZE ALIGNMENT
+#define MIN_CLASS_SHIFT 6
+#define NUM_CLASSES 8
+#define LARGE_CLASS 0xFF
+#define CACHE_MAX 64
+#define CACHE_BATCH 32
+#define SLAB_SIZE (64 * 1024)
+#define MIN_SLAB_BLOCKS 8
+#define FLUSH_BYTES (64 * 1024)
+
+struct bmem_header {
+	size_t size;
+	uint8_t size_class;
+	uint8_t tag;
+};
+
+struct free_block {
+	struct free_block *next;
+};
+
+/* only written by the owning thread, read by queries from any thread; stay
+ * below 2 * FLUSH_BYTES as larger changes are published right away */
+struct tag_counters {
+	volatile long bytes;
+	volatile long allocs;
+};
+
+struct thread_cache {
+	struct free_block *free[NUM_CLASSES];
+	size_t num_free[NUM_CLASSES];
+
+	struct tag_counters pending[BMEM_TAG_COUNT];
+	uint64_t pending_bytes;
+
+	struct thread_cache *next;
+	struct thread_cache **prev_next;
+};
+
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct free_block *depot[NUM_CLASSES];
+static size_t depot_num[NUM_CLASSES];
+static struct bmem_tag_stats totals[BMEM_TAG_COUNT];
+static struct thread_cache *caches = NULL;
+
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static THREAD_LOCAL struct thread_cache *thread_cache = NULL;
+static THREAD_LOCAL bool thread_cache_destroyed = false;
+
+static inline size_t class_size(uint8_t size_class)
+{
+	return (size_t)1 << (size_class + MIN_CLASS_SHIFT);
+}
+
+static inline uint8_t get_size_class(size_t total)
+{
+	for (uint8_t c = 0; c < NUM_CLASSES; c++) {
+		if (total <= class_size(c))
+			return c;
+	}
+
+	return LARGE_CLASS;
+}
+
+static inline void add_to_totals_locked(uint8_t tag, int64_t bytes, int64_t allocs)
+{
+	struct bmem_tag_stats *total = &totals[tag];
+
+	total->live_bytes += bytes;
+	total->live_allocs += allocs;
+	if (total->live_bytes > total->peak_bytes)
+		total->peak_bytes = total->live_bytes;
+}
+
+/* call with arena_mutex held, from the thread that owns the counters */
+static void flush_counters_locked(struct tag_counters *pending)
+{
+	for (uint8_t i = 0; i < BMEM_TAG_COUNT; i++) {
+		add_to_totals_locked(i, pending[i].bytes, pending[i].allocs);
+		os_atomic_store_long(&pending[i].bytes, 0);
+		os_atomic_store_long(&pending[i].allocs, 0);
+	}
+}
+
+/* call with arena_mutex held */
+static void get_stats_locked(enum bmem_tag tag, struct bmem_tag_stats *stats)
+{
+	*stats = totals[tag];
+
+	for (struct thread_cache *cache = caches; cache; cache = cache->next) {
+		stats->live_bytes += os_atomic_load_long(&cache->pending[tag].bytes);
+		stats->live_allocs += os_atomic_load_long(&cache->pending[tag].allocs);
+	}
+
+	if (stats->live_bytes > stats->peak_bytes)
+		stats->peak_bytes = stats->live_bytes;
+}
+
+static void flush_counters(struct thread_cache *cache)
+{
+	pthread_mutex_lock(&arena_mutex);
+	flush_counters_locked(cache->pending);
+	pthread_mutex_unlock(&arena_mutex);
+	cache->pending_bytes = 0;
+}
+
+static void account(struct thread_cache *cache, uint8_t tag, int64_t bytes, int64_t allocs)
+{
+	uint64_t moved = (uint64_t)(bytes < 0 ? -bytes : bytes);
+
+	if (!cache || moved >= FLUSH_BYTES) {
+		pthread_mutex_lock(&arena_mutex);
+		add_to_totals_locked(tag, bytes, allocs);
+		pthread_mutex_unlock(&arena_mutex);
+		return;
+	}
+
+	os_atomic_store_long(&cache->pending[tag].bytes, cache->pending[tag].bytes + (long)bytes);
+	os_atomic_store_long(&cache->pending[tag].allocs, cache->pending[tag].allocs + (long)allocs);
+	cache->pending_bytes += moved;
+
+	if (cache->pending_bytes >= FLUSH_BYTES)
+		flush_counters(cache);
+}
+
+static void thread_cache_destroy(void *data)
+{
+	struct thread_cache *cache = data;
+
+	pthread_mutex_lock(&arena_mutex);
+
+	for (size_t c = 0; c < NUM_CLASSES; c++) {
+		while (cache->free[c]) {
+			struct free_block *block = cache->free[c];
+			cache->free[c] = block->next;
+
+			block->next = depot[c];
+			depot[c] = block;
+			depot_num[c]++;
+		}
+	}
+
+	flush_counters_locked(cache->pending);
+
+	*cache->prev_next = cache->next;
+	if (cache->next)
+		cache->next->prev_next = cache->prev_next;
+
+	pthread_mutex_unlock(&arena_mutex);
+
+	/* other thread exit destructors may still free memory, which then
+	 * goes straight to the depot */
+	thread_cache = NULL;
+	thread_cache_destroyed = true;
+	free(cache);
+}
+
+static void cache_key_init(void)
+{
+	pthread_key_create(&cache_key, thread_cache_destroy);
+}
+
+static struct thread_cache *get_thread_cache(void)
+{
+	struct thread_cache *cache = thread_cache;
+	if (cache || thread_cache_destroyed)
+		return cache;
+
+	pthread_once(&cache_key_once, cache_key_init);
+
+	cache = calloc(1, sizeof(struct thread_cache));
+	if (cache) {
+		pthread_mutex_lock(&arena_mutex);
+		cache->prev_next = &caches;
+		cache->next = caches;
+		if (caches)
+			caches->prev_next = &cache->next;
+		caches = cache;
+		pthread_mutex_unlock(&arena_mutex);
+
+		pthread_setspecific(cache_key, cache);
+		thread_cache = cache;
+	}
+
+	return cache;
+}
+
+/* call with arena_mutex held */
+static void carve_slab_locked(uint8_t size_class)
+{
+	size_t size = class_size(size_class);
+	size_t count = SLAB_SIZE / size;
+	uint8_t *slab;
+
+	if (count < MIN_SLAB_BLOCKS)
+		count = MIN_SLAB_BLOCKS;
+
+	/* slabs are never returned to the system; their blocks are recycled
+	 * through the depot for the lifetime of the process */
+	slab = a_malloc(size * count);
+	if (!slab)
+		return;
+
+	for (size_t i = count; i > 0; i--) {
+		struct free_block *block = (struct free_block *)(slab + size * (i - 1));
+		block->next = depot[size_class];
+		depot[size_class] = block;
+	}
+
+	depot_num[size_class] += count;
+}
+
+static void *alloc_block(struct thread_cache *cache, uint8_t size_class)
+{
+	struct free_block *block;
+
+	if (!cache) {
+		pthread_mutex_lock(&arena_mutex);
+		if (!depot[size_class])
+			carve_slab_locked(size_class);
+		block = depot[size_class];
+		if (block) {
+			depot[size_class] = block->next;
+			depot_num[size_class]--;
+		}
+		pthread_mutex_unlock(&arena_mutex);
+		return block;
+	}
+
+	if (!cache->free[size_class]) {
+		pthread_mutex_lock(&arena_mutex);
+
+		if (!depot[size_class])
+			carve_slab_locked(size_class);
+
+		for (size_t i = 0; i < CACHE_BATCH && depot[size_class]; i++) {
+			block = depot[size_class];
+			depot[size_class] = block->next;
+			depot_num[size_class]--;
+
+			block->next = cache->free[size_class];
+			cache->free[size_class] = block;
+			cache->num_free[size_class]++;
+		}
+
+		pthread_mutex_unlock(&arena_mutex);
+	}
+
+	block = cache->free[size_class];
+	if (block) {
+		cache->free[size_class] = block->next;
+		cache->num_free[size_class]--;
+	}
+
+	return block;
+}
+
+static void free_block(struct thread_cache *cache, uint8_t size_class, void *ptr)
+{
+	struct free_block *block = ptr;
+
+	if (!cache) {
+		pthread_mutex_lock(&arena_mutex);
+		block->next = depot[size_class];
+		depot[size_class] = block;
+		depot_num[size_class]++;
+		pthread_mutex_unlock(&arena_mutex);
+		return;
+	}
+
+	block->next = cache->free[size_class];
+	cache->free[size_class] = block;
+
+	if (++cache->num_free[size_class] <= CACHE_MAX)
+		return;
+
+	pthread_mutex_lock(&arena_mutex);
+
+	for (size_t i = 0; i < CACHE_BATCH; i++) {
+		block = cache->free[size_class];
+		cache->free[size_class] = block->next;
+		cache->num_free[size_class]--;
+
+		block->next = depot[size_class];
+		depot[size_class] = block;
+		depot_num[size_class]++;
+	}
+
+	pthread_mutex_unlock(&arena_mutex);
+}
+
+static void *arena_malloc(size_t size, enum bmem_tag tag)
+{
+	struct thread_cache *cache = get_thread_cache();
+	struct bmem_header *header;
+	size_t total = size + HEADER_SIZE;
+	uint8_t size_class;
+
+	if (total < size)
+		return NULL;
+	if ((unsigned)tag >= BMEM_TAG_COUNT)
+		tag = BMEM_TAG_NONE;
+
+	size_class = get_size_class(total);
+	header = size_class == LARGE_CLASS ? a_malloc(total) : alloc_block(cache, size_class);
+	if (!header)
+		return NULL;
+
+	header->size = size;
+	header->size_class = size_class;
+	header->tag = (uint8_t)tag;
+
+	account(cache, header->tag, (int64_t)size, 1);
+	return (uint8_t *)header + HEADER_SIZE;
+}
+
+static inline struct bmem_header *get_header(void *ptr)
+{
+	return (struct bmem_header *)((uint8_t *)ptr - HEADER_SIZE);
+}
+
+static void arena_free(void *ptr)
+{
+	struct thread_cache *cache = get_thread_cache();
+	struct bmem_header *header = get_header(ptr);
+
+	account(cache, header->tag, -(int64_t)header->size, -1);
+
+	if (header->size_class == LARGE_CLASS)
+		a_free(header);
+	else
+		free_block(cache, header->size_class, header);
+}
+
+static void *arena_realloc(void *ptr, size_t size)
+{
+	struct bmem_header *header;
+	size_t total = size + HEADER_SIZE;
+	int64_t delta;
+	void *new_ptr;
+
+	if (!ptr)
+		return arena_malloc(size, thread_tag);
+	if (total < size)
+		return NULL;
+
+	header = get_header(ptr);
+	delta = (int64_t)size - (int64_t)header->size;
+
+	if (header->size_class == LARGE_CLASS) {
+		header = a_realloc(header, total);
+		if (!header)
+			return NULL;
+
+		header->size = size;
+		account(get_thread_cache(), header->tag, delta, 0);
+		return (uint8_t *)header + HEADER_SIZE;
+	}
+
+	if (total <= class_size(header->size_class)) {
+		header->size = size;
+		account(get_thread_cache(), header->tag, delta, 0);
+		return ptr;
+	}
+
+	new_ptr = arena_malloc(size, header->tag);
+	if (!new_ptr)
+		return NULL;
+
+	memcpy(new_ptr, ptr, header->size < size ? header->size : size);
+	arena_free(ptr);
+	return new_ptr;
+}
+
+#define b_malloc(size, tag) arena_malloc(size, tag)
+#define b_realloc(ptr, size) arena_realloc(ptr, size)
+#define b_free(ptr) arena_free(ptr)
+
+#else
+
 static long num_allocs = 0;
 
-void *bmalloc(size_t size)
+#define b_malloc(size, tag) a_malloc(size)
+#define b_realloc(ptr, size) a_realloc(ptr, size)
+#define b_free(ptr) a_free(ptr)
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+void *bmalloc_tagged(size_t size, enum bmem_tag tag)
 {
 	if (!size) {
 		os_breakpoint();
 		bcrash("bmalloc: Allocating 0 bytes is broken behavior, please fix your code!");
 	}
 
-	void *ptr = a_malloc(size);
+	void *ptr = b_malloc(size, tag);
 
 	if (!ptr) {
 		os_breakpoint();
 		bcrash("Out of memory while trying to allocate %lu bytes", (unsigned long)size);
 	}
 
+#ifndef BMEM_ARENA
 	os_atomic_inc_long(&num_allocs);
+	UNUSED_PARAMETER(tag);
+#endif
 	return ptr;
 }
 
+void *bmalloc(size_t size)
+{
+	return bmalloc_tagged(size, thread_tag);
+}
+
 void *brealloc(void *ptr, size_t size)
 {
+#ifndef BMEM_ARENA
 	if (!ptr)
 		os_atomic_inc_long(&num_allocs);
+#endif
 
 	if (!size) {
 		os_breakpoint();
 		bcrash("brealloc: Allocating 0 bytes is broken behavior, please fix your code!");
 	}
 
-	ptr = a_realloc(ptr, size);
+	ptr = b_realloc(ptr, size);
 
 	if (!ptr) {
 		os_breakpoint();
@@ -139,16 +573,74 @@ void *brealloc(void *ptr, size_t size)
 void bfree(void *ptr)
 {
 	if (ptr) {
+#ifndef BMEM_ARENA
 		os_atomic_dec_long(&num_allocs);
-		a_free(ptr);
+#endif
+		b_free(ptr);
 	}
 }
 
+#ifdef BMEM_ARENA
+
+long bnum_allocs(void)
+{
+	int64_t allocs = 0;
+
+	pthread_mutex_lock(&arena_mutex);
+	for (int i = 0; i < BMEM_TAG_COUNT; i++) {
+		struct bmem_tag_stats stats;
+		get_stats_locked((enum bmem_tag)i, &stats);
+		allocs += stats.live_allocs;
+	}
+	pthread_mutex_unlock(&arena_mutex);
+
+	return (long)allocs;
+}
+
+bool bmem_get_tag_stats(enum bmem_tag tag, struct bmem_tag_stats *stats)
+{
+	if ((unsigned)tag >= BMEM_TAG_COUNT || !stats)
+		return false;
+
+	pthread_mutex_lock(&arena_mutex);
+	get_stats_locked(tag, stats);
+	pthread_mutex_unlock(&arena_mutex);
+
+	return true;
+}
+
+void bmem_log_leaks(void)
+{
+	for (int i = 0; i < BMEM_TAG_COUNT; i++) {
+		struct bmem_tag_stats stats;
+
+		if (!bmem_get_tag_stats((enum bmem_tag)i, &stats) || !stats.live_allocs)
+			continue;
+
+		blog(LOG_INFO, "Memory leaks (%s): %lld allocations, %lld bytes (peak usage %lld bytes)",
+		     tag_names[i], (long long)stats.live_allocs, (long long)stats.live_bytes,
+		     (long long)stats.peak_bytes);
+	}
+}
+
+#else
+
 long bnum_allocs(void)
 {
 	return num_allocs;
 }
 
+bool bmem_get_tag_stats(enum bmem_tag tag, struct bmem_tag_stats *stats)
+{
+	UNUSED_PARAMETER(tag);
+	UNUSED_PARAMETER(stats);
+	return false;
+}
+
+void bmem_log_leaks(void) {}
+
+#endif
+
 int base_get_alignment(void)
 {
 	return ALIGNMENT;
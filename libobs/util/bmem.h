@@ -31,7 +31,30 @@ struct base_allocator {
 	void (*free)(void *);
 };
 
+/*
+ *   Allocation tags attribute memory to a subsystem.  bmalloc uses the
+ * calling thread's current tag, and brealloc keeps the tag of the original
+ * allocation.  Tags are only tracked when libobs is built with the arena
+ * allocator (ENABLE_BMEM_ARENA); otherwise the stats functions return false.
+ */
+
+enum bmem_tag {
+	BMEM_TAG_NONE,
+	BMEM_TAG_SOURCE,
+	BMEM_TAG_ENCODER,
+	BMEM_TAG_OUTPUT,
+	BMEM_TAG_DATA,
+	BMEM_TAG_COUNT,
+};
+
+struct bmem_tag_stats {
+	int64_t live_bytes;
+	int64_t peak_bytes;
+	int64_t live_allocs;
+};
+
 EXPORT void *bmalloc(size_t size);
+EXPORT void *bmalloc_tagged(size_t size, enum bmem_tag tag);
 EXPORT void *brealloc(void *ptr, size_t size);
 EXPORT void bfree(void *ptr);
 
@@ -39,6 +62,11 @@ EXPORT int base_get_alignment(void);
 
 EXPORT long bnum_allocs(void);
 
+EXPORT enum bmem_tag bmem_set_thread_tag(enum bmem_tag tag);
+EXPORT const char *bmem_tag_name(enum bmem_tag tag);
+EXPORT bool bmem_get_tag_stats(enum bmem_tag tag, struct bmem_tag_stats *stats);
+EXPORT void bmem_log_leaks(void);
+
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
 static inline void *bzalloc(size_t size)
@@ -49,6 +77,14 @@ static inline void *bzalloc(size_t size)
 	return mem;
 }
 
+static inline void *bzalloc_tagged(size_t size, enum bmem_tag tag)
+{
+	void *mem = bmalloc_tagged(size, tag);
+	if (mem)
+		memset(mem, 0, size);
+	return mem;
+}
+
 static inline char *bstrdup_n(const char *str, size_t n)
 {
 	char *dup;
@@ -248,13 +248,98 @@ static void merge_call(profile_entry *entry, profile_call *call, profile_call *p
 #endif
 }
 
-static bool enabled = false;
+/* ------------------------------------------------------------------------- */
+/* Event mode
+ *
+ * In event mode profile_start/profile_end only append a fixed-size event to a
+ * single-producer/single-consumer ring owned by the calling thread.  The
+ * aggregator thread drains the rings, rebuilds the call trees and merges them
+ * into the same root entries the default mode uses, so snapshots look the
+ * same either way.  Completed events are optionally retained for the trace
+ * exporter. */
+
+#define EVENT_RING_SIZE 8192
+#define EVENT_RING_MASK (EVENT_RING_SIZE - 1)
+#define AGGREGATOR_INTERVAL_MS 10
+
+enum profile_event_type {
+	PROFILE_EVENT_BEGIN,
+	PROFILE_EVENT_END,
+};
+
+typedef struct profile_event profile_event;
+struct profile_event {
+	const char *name;
+	uint64_t time;
+	enum profile_event_type type;
+};
+
+typedef struct profile_trace_event profile_trace_event;
+struct profile_trace_event {
+	const char *name;
+	uint64_t time;
+	long tid;
+	enum profile_event_type type;
+};
+
+typedef struct profile_event_ring profile_event_ring;
+struct profile_event_ring {
+	/* written by the owning thread only */
+	volatile long head;
+	/* written by the aggregator only */
+	volatile long tail;
+	volatile long dropped;
+
+	/* set when the owning thread exits, the aggregator frees the ring
+	 * once it has drained it */
+	volatile bool exited;
+
+	long tid;
+	const char *thread_name;
+	profile_call *context;
+	profile_event events[EVENT_RING_SIZE];
+};
+
+typedef struct profile_trace_thread profile_trace_thread;
+struct profile_trace_thread {
+	long tid;
+	const char *name;
+};
+
+static volatile bool enabled = false;
 static pthread_mutex_t root_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DARRAY(profile_root_entry) root_entries;
 
 static THREAD_LOCAL profile_call *thread_context = NULL;
 static THREAD_LOCAL bool thread_enabled = true;
 
+static volatile bool event_mode = false;
+static volatile long event_generation = 0;
+/* threads currently writing to their ring, see enter_event_mode */
+static volatile long event_producers = 0;
+static pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(profile_event_ring *) event_rings;
+static long next_ring_tid = 0;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static DARRAY(profile_trace_event) trace_events;
+static DARRAY(profile_trace_thread) trace_threads;
+static size_t trace_capacity = 0;
+/* oldest retained event once trace_events is full */
+static size_t trace_oldest = 0;
+static uint64_t trace_start_time = 0;
+static pthread_t aggregator_thread;
+static os_event_t *aggregator_stop_event = NULL;
+static bool aggregator_active = false;
+
+static THREAD_LOCAL profile_event_ring *thread_ring = NULL;
+static THREAD_LOCAL long thread_ring_generation = 0;
+static THREAD_LOCAL long thread_depth = 0;
+static THREAD_LOCAL long thread_drop_depth = 0;
+
+static void stop_aggregator(void);
+static void *aggregator_thread_func(void *unused);
+
 void profiler_start(void)
 {
 	pthread_mutex_lock(&root_mutex);
@@ -262,8 +347,45 @@ void profiler_start(void)
 	pthread_mutex_unlock(&root_mutex);
 }
 
+void profiler_start_event_mode(size_t max_trace_events)
+{
+	pthread_mutex_lock(&event_mutex);
+	if (!aggregator_active) {
+		trace_capacity = max_trace_events;
+		trace_start_time = os_gettime_ns();
+
+		if (os_event_init(&aggregator_stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+			pthread_mutex_unlock(&event_mutex);
+			blog(LOG_WARNING, "Failed to create profiler aggregator event, "
+					  "falling back to default profiler mode");
+			profiler_start();
+			return;
+		}
+
+		if (pthread_create(&aggregator_thread, NULL, aggregator_thread_func, NULL) != 0) {
+			os_event_destroy(aggregator_stop_event);
+			aggregator_stop_event = NULL;
+			pthread_mutex_unlock(&event_mutex);
+			blog(LOG_WARNING, "Failed to create profiler aggregator thread, "
+					  "falling back to default profiler mode");
+			profiler_start();
+			return;
+		}
+
+		aggregator_active = true;
+		os_atomic_store_bool(&event_mode, true);
+	}
+	pthread_mutex_unlock(&event_mutex);
+
+	profiler_start();
+}
+
 void profiler_stop(void)
 {
+	/* let the aggregator merge whatever is still queued before disabling
+	 * the root entries */
+	stop_aggregator();
+
 	pthread_mutex_lock(&root_mutex);
 	enabled = false;
 	pthread_mutex_unlock(&root_mutex);
@@ -355,17 +477,14 @@ static void merge_context(profile_call *context)
 	free_call_context(prev_call);
 }
 
-void profile_start(const char *name)
+static profile_call *begin_call(profile_call *parent, const char *name)
 {
-	if (!thread_enabled)
-		return;
-
 	profile_call new_call = {
 		.name = name,
 #ifdef TRACK_OVERHEAD
 		.overhead_start = os_gettime_ns(),
 #endif
-		.parent = thread_context,
+		.parent = parent,
 	};
 
 	profile_call *call = NULL;
@@ -378,20 +497,16 @@ void profile_start(const char *name)
 		memcpy(call, &new_call, sizeof(profile_call));
 	}
 
-	thread_context = call;
-	call->start_time = os_gettime_ns();
+	return call;
 }
 
-void profile_end(const char *name)
+/* returns the root call once it has been completed */
+static profile_call *end_call(profile_call **context, const char *name, uint64_t end)
 {
-	uint64_t end = os_gettime_ns();
-	if (!thread_enabled)
-		return;
-
-	profile_call *call = thread_context;
+	profile_call *call = *context;
 	if (!call) {
 		blog(LOG_ERROR, "Called profile end with no active profile");
-		return;
+		return NULL;
 	}
 
 	if (!call->name)
@@ -408,25 +523,327 @@ void profile_end(const char *name)
 			parent = parent->parent;
 
 		if (!parent || parent->name != name)
-			return;
+			return NULL;
 
 		while (call->name != name) {
-			profile_end(call->name);
+			end_call(context, call->name, end);
 			call = call->parent;
 		}
 	}
 
-	thread_context = call->parent;
+	*context = call->parent;
 
 	call->end_time = end;
 #ifdef TRACK_OVERHEAD
 	call->overhead_end = os_gettime_ns();
 #endif
 
-	if (call->parent)
+	return call->parent ? NULL : call;
+}
+
+/* Producers count themselves in event_producers while they use their ring.
+ * free_event_rings turns event mode off and then waits for the count to drop
+ * to zero before freeing the rings, so a producer either sees event mode off
+ * or holds the rings alive until it's done. */
+static inline bool enter_event_mode(void)
+{
+	os_atomic_inc_long(&event_producers);
+	if (os_atomic_load_bool(&event_mode))
+		return true;
+
+	os_atomic_dec_long(&event_producers);
+	return false;
+}
+
+static inline void leave_event_mode(void)
+{
+	os_atomic_dec_long(&event_producers);
+}
+
+static void thread_ring_exit(void *data)
+{
+	profile_event_ring *ring = data;
+
+	if (!enter_event_mode())
+		return;
+
+	if (thread_ring == ring && thread_ring_generation == os_atomic_load_long(&event_generation))
+		os_atomic_store_bool(&ring->exited, true);
+
+	leave_event_mode();
+}
+
+static void create_ring_key(void)
+{
+	pthread_key_create(&ring_key, thread_ring_exit);
+}
+
+static profile_event_ring *register_thread_ring(void)
+{
+	profile_event_ring *ring = bzalloc(sizeof(profile_event_ring));
+
+	pthread_once(&ring_key_once, create_ring_key);
+	pthread_setspecific(ring_key, ring);
+
+	pthread_mutex_lock(&event_mutex);
+	ring->tid = ++next_ring_tid;
+	da_push_back(event_rings, &ring);
+	pthread_mutex_unlock(&event_mutex);
+
+	thread_ring_generation = os_atomic_load_long(&event_generation);
+	thread_depth = 0;
+	thread_drop_depth = 0;
+	return ring;
+}
+
+static inline long ring_free_slots(profile_event_ring *ring)
+{
+	long head = ring->head;
+	long tail = os_atomic_load_long(&ring->tail);
+	return EVENT_RING_SIZE - 1 - ((head - tail) & EVENT_RING_MASK);
+}
+
+static inline void ring_push(profile_event_ring *ring, const char *name, uint64_t time, enum profile_event_type type)
+{
+	long head = ring->head;
+	profile_event *event = &ring->events[head];
+	event->name = name;
+	event->time = time;
+	event->type = type;
+	os_atomic_store_long(&ring->head, (head + 1) & EVENT_RING_MASK);
+}
+
+static void record_begin(const char *name)
+{
+	if (!thread_depth && !os_atomic_load_bool(&enabled)) {
+		thread_enabled = false;
+		return;
+	}
+
+	if (!thread_ring || thread_ring_generation != os_atomic_load_long(&event_generation))
+		thread_ring = register_thread_ring();
+
+	profile_event_ring *ring = thread_ring;
+	long depth = ++thread_depth;
+
+	/* always leave room for the end events of every open scope, so a begin
+	 * that made it into the ring can never lose its matching end */
+	if (thread_drop_depth || ring_free_slots(ring) <= depth) {
+		if (!thread_drop_depth)
+			thread_drop_depth = depth;
+		os_atomic_inc_long(&ring->dropped);
+		return;
+	}
+
+	ring_push(ring, name, os_gettime_ns(), PROFILE_EVENT_BEGIN);
+}
+
+static void record_end(const char *name, uint64_t end)
+{
+	profile_event_ring *ring = thread_ring;
+	long depth = thread_depth--;
+
+	/* the ring the scope began in has been freed since */
+	if (!ring || thread_ring_generation != os_atomic_load_long(&event_generation))
+		return;
+
+	if (thread_drop_depth) {
+		if (thread_drop_depth == depth)
+			thread_drop_depth = 0;
+		os_atomic_inc_long(&ring->dropped);
+		return;
+	}
+
+	ring_push(ring, name, end, PROFILE_EVENT_END);
+}
+
+void profile_start(const char *name)
+{
+	if (!thread_enabled)
+		return;
+
+	/* scopes nested in event mode scopes stay in event mode, even if it
+	 * has been turned off since */
+	if (thread_depth || os_atomic_load_bool(&event_mode)) {
+		if (enter_event_mode()) {
+			record_begin(name);
+			leave_event_mode();
+			return;
+		}
+		if (thread_depth) {
+			thread_depth++;
+			return;
+		}
+	}
+
+	thread_context = begin_call(thread_context, name);
+	thread_context->start_time = os_gettime_ns();
+}
+
+void profile_end(const char *name)
+{
+	uint64_t end = os_gettime_ns();
+	if (!thread_enabled)
 		return;
 
-	merge_context(call);
+	if (thread_depth) {
+		if (enter_event_mode()) {
+			record_end(name, end);
+			leave_event_mode();
+		} else {
+			thread_depth--;
+		}
+		return;
+	}
+
+	profile_call *root = end_call(&thread_context, name, end);
+	if (root)
+		merge_context(root);
+}
+
+/* trace_events is a ring of trace_capacity events, once it's full the oldest
+ * one is overwritten, so the trace always covers the latest events */
+static void retain_trace_event(profile_event_ring *ring, profile_event *event)
+{
+	profile_trace_event *trace;
+
+	if (!trace_capacity)
+		return;
+
+	if (trace_events.num < trace_capacity) {
+		trace = da_push_back_new(trace_events);
+	} else {
+		trace = &trace_events.array[trace_oldest];
+		if (++trace_oldest == trace_capacity)
+			trace_oldest = 0;
+	}
+
+	trace->name = event->name;
+	trace->time = event->time;
+	trace->tid = ring->tid;
+	trace->type = event->type;
+}
+
+static void drain_ring(profile_event_ring *ring)
+{
+	long tail = ring->tail;
+	long head = os_atomic_load_long(&ring->head);
+
+	while (tail != head) {
+		profile_event *event = &ring->events[tail];
+
+		if (event->type == PROFILE_EVENT_BEGIN) {
+			if (!ring->context && !ring->thread_name) {
+				ring->thread_name = event->name;
+				if (trace_capacity) {
+					profile_trace_thread thread = {ring->tid, ring->thread_name};
+					da_push_back(trace_threads, &thread);
+				}
+			}
+
+			ring->context = begin_call(ring->context, event->name);
+			ring->context->start_time = event->time;
+		} else {
+			profile_call *root = end_call(&ring->context, event->name, event->time);
+			if (root)
+				merge_context(root);
+		}
+
+		retain_trace_event(ring, event);
+		tail = (tail + 1) & EVENT_RING_MASK;
+	}
+
+	os_atomic_store_long(&ring->tail, tail);
+}
+
+static void free_ring(profile_event_ring *ring)
+{
+	long dropped = os_atomic_load_long(&ring->dropped);
+	if (dropped)
+		blog(LOG_INFO, "Profiler dropped %ld events on thread %ld (%s)", dropped, ring->tid,
+		     ring->thread_name ? ring->thread_name : "unnamed");
+
+	while (ring->context && ring->context->parent)
+		ring->context = ring->context->parent;
+	free_call_context(ring->context);
+	bfree(ring);
+}
+
+/* event_mutex must be held, it makes the caller the single consumer */
+static void drain_event_rings(void)
+{
+	for (size_t i = 0; i < event_rings.num; i++) {
+		profile_event_ring *ring = event_rings.array[i];
+
+		/* checked before draining, so everything the thread pushed
+		 * before it exited is merged */
+		bool exited = os_atomic_load_bool(&ring->exited);
+		drain_ring(ring);
+
+		if (exited) {
+			free_ring(ring);
+			da_erase(event_rings, i--);
+		}
+	}
+}
+
+static void *aggregator_thread_func(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	os_set_thread_name("profiler: aggregator");
+
+	while (os_event_timedwait(aggregator_stop_event, AGGREGATOR_INTERVAL_MS) == ETIMEDOUT) {
+		pthread_mutex_lock(&event_mutex);
+		drain_event_rings();
+		pthread_mutex_unlock(&event_mutex);
+	}
+
+	pthread_mutex_lock(&event_mutex);
+	drain_event_rings();
+	pthread_mutex_unlock(&event_mutex);
+	return NULL;
+}
+
+static void stop_aggregator(void)
+{
+	pthread_mutex_lock(&event_mutex);
+	bool active = aggregator_active;
+	aggregator_active = false;
+	pthread_mutex_unlock(&event_mutex);
+
+	if (!active)
+		return;
+
+	os_event_signal(aggregator_stop_event);
+	pthread_join(aggregator_thread, NULL);
+	os_event_destroy(aggregator_stop_event);
+	aggregator_stop_event = NULL;
+
+	/* producers keep recording into their rings until they observe the
+	 * profiler as disabled, those leftovers are discarded in profiler_free */
+}
+
+static void free_event_rings(void)
+{
+	os_atomic_store_bool(&event_mode, false);
+	os_atomic_inc_long(&event_generation);
+
+	/* producers that saw event mode on may still be writing to their
+	 * rings.  Not done under event_mutex, registering a ring takes it */
+	while (os_atomic_load_long(&event_producers))
+		os_sleep_ms(0);
+
+	pthread_mutex_lock(&event_mutex);
+	for (size_t i = 0; i < event_rings.num; i++)
+		free_ring(event_rings.array[i]);
+
+	da_free(event_rings);
+	da_free(trace_events);
+	da_free(trace_threads);
+	trace_capacity = 0;
+	trace_oldest = 0;
+	pthread_mutex_unlock(&event_mutex);
 }
 
 static int profiler_time_entry_compare(const void *first, const void *second)
@@ -768,6 +1185,9 @@ void profiler_free(void)
 {
 	DARRAY(profile_root_entry) old_root_entries = {0};
 
+	stop_aggregator();
+	free_event_rings();
+
 	pthread_mutex_lock(&root_mutex);
 	enabled = false;
 	da_move(old_root_entries, root_entries);
@@ -887,6 +1307,12 @@ profiler_snapshot_t *profile_snapshot_create(void)
 {
 	profiler_snapshot_t *snap = bzalloc(sizeof(profiler_snapshot_t));
 
+	if (os_atomic_load_bool(&event_mode)) {
+		pthread_mutex_lock(&event_mutex);
+		drain_event_rings();
+		pthread_mutex_unlock(&event_mutex);
+	}
+
 	pthread_mutex_lock(&root_mutex);
 	da_reserve(snap->roots, root_entries.num);
 	for (size_t i = 0; i < root_entries.num; i++) {
@@ -1016,6 +1442,88 @@ bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap, const char *
 	return true;
 }
 
+static void json_escape(struct dstr *dst, const char *str)
+{
+	for (const char *c = str; *c; c++) {
+		switch (*c) {
+		case '"':
+			dstr_cat(dst, "\\\"");
+			break;
+		case '\\':
+			dstr_cat(dst, "\\\\");
+			break;
+		default:
+			if ((unsigned char)*c < 0x20)
+				dstr_catf(dst, "\\u%04x", (unsigned char)*c);
+			else
+				dstr_cat_ch(dst, *c);
+		}
+	}
+}
+
+bool profiler_trace_dump_json(const char *filename)
+{
+	FILE *f = os_fopen(filename, "wb");
+	if (!f)
+		return false;
+
+	struct dstr buffer = {0};
+
+	pthread_mutex_lock(&event_mutex);
+	drain_event_rings();
+
+	dstr_copy(&buffer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fwrite(buffer.array, 1, buffer.len, f);
+
+	bool first = true;
+	for (size_t i = 0; i < trace_threads.num; i++) {
+		profile_trace_thread *thread = &trace_threads.array[i];
+
+		dstr_printf(&buffer,
+			    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+			    "\"tid\":%ld,\"args\":{\"name\":\"",
+			    first ? "" : ",\n", thread->tid);
+		json_escape(&buffer, thread->name);
+		dstr_cat(&buffer, "\"}}");
+		fwrite(buffer.array, 1, buffer.len, f);
+		first = false;
+	}
+
+	/* tids start at 1 */
+	long *depths = bzalloc(sizeof(long) * (next_ring_tid + 1));
+
+	for (size_t i = 0; i < trace_events.num; i++) {
+		profile_trace_event *event = &trace_events.array[(trace_oldest + i) % trace_events.num];
+		uint64_t ns = event->time > trace_start_time ? event->time - trace_start_time : 0;
+
+		/* skip the ends of scopes that began before the oldest event */
+		if (event->type == PROFILE_EVENT_BEGIN)
+			depths[event->tid]++;
+		else if (depths[event->tid])
+			depths[event->tid]--;
+		else
+			continue;
+
+		dstr_printf(&buffer, "%s{\"name\":\"", first ? "" : ",\n");
+		json_escape(&buffer, event->name);
+		dstr_catf(&buffer, "\",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,\"pid\":0,\"tid\":%ld}",
+			  event->type == PROFILE_EVENT_BEGIN ? 'B' : 'E', ns / 1000, (unsigned)(ns % 1000),
+			  event->tid);
+		fwrite(buffer.array, 1, buffer.len, f);
+		first = false;
+	}
+
+	pthread_mutex_unlock(&event_mutex);
+	bfree(depths);
+
+	dstr_copy(&buffer, "\n]}\n");
+	fwrite(buffer.array, 1, buffer.len, f);
+	dstr_free(&buffer);
+
+	fclose(f);
+	return true;
+}
+
 size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap)
 {
 	return snap ? snap->roots.num : 0;
@@ -27,6 +27,11 @@ EXPORT void profile_reenable_thread(void);
 EXPORT void profiler_start(void);
 EXPORT void profiler_stop(void);
 
+/* Low-overhead mode: scopes are recorded as fixed-size events in per-thread
+ * lock-free ring buffers and merged by a background aggregator thread.  The
+ * latest max_trace_events events are retained for profiler_trace_dump_json. */
+EXPORT void profiler_start_event_mode(size_t max_trace_events);
+
 EXPORT void profiler_print(profiler_snapshot_t *snap);
 EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
@@ -69,6 +74,9 @@ EXPORT void profile_snapshot_free(profiler_snapshot_t *snap);
 EXPORT bool profiler_snapshot_dump_csv(const profiler_snapshot_t *snap, const char *filename);
 EXPORT bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap, const char *filename);
 
+/* Chrome Trace Event / Perfetto compatible JSON, event mode only */
+EXPORT bool profiler_trace_dump_json(const char *filename);
+
 EXPORT size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap);
 EXPORT void profiler_snapshot_enumerate_roots(profiler_snapshot_t *snap, profiler_entry_enum_func func, void *context);
 
@@ -88,6 +88,12 @@ static const size_t render_times_reservation = 2;
 
 pthread_rwlock_t hm_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
+/* Time spent in parallel tick callbacks per tick pool worker (0 being the
+ * graphics thread itself), summed per frame for the last N frames */
+#define MAX_TICK_WORKERS 8
+static uint64_t worker_tick_frame[MAX_TICK_WORKERS] = {0};
+static struct ucirclebuf worker_ticks[MAX_TICK_WORKERS] = {0};
+
 static bool enabled = false;
 static bool gpu_enabled = false;
 /* These can be set from other threads, mark them volatile */
@@ -215,6 +221,10 @@ static void profiler_shutdown(void)
 		HASH_DEL(hm_entries, ent);
 		entry_destroy(ent);
 	}
+	for (size_t i = 0; i < MAX_TICK_WORKERS; i++) {
+		ucirclebuf_free(&worker_ticks[i]);
+		worker_tick_frame[i] = 0;
+	}
 	pthread_rwlock_unlock(&hm_rwlock);
 
 	reset_gpu_timers();
@@ -307,6 +317,14 @@ void source_profiler_frame_collect(void)
 
 	pthread_rwlock_wrlock(&hm_rwlock);
 
+	for (size_t i = 0; i < MAX_TICK_WORKERS; i++) {
+		if (!worker_ticks[i].array)
+			ucirclebuf_init(&worker_ticks[i], profiler_samples);
+		if (worker_ticks[i].array)
+			ucirclebuf_push(&worker_ticks[i], worker_tick_frame[i]);
+		worker_tick_frame[i] = 0;
+	}
+
 	struct source_samples *smps = hm_samples;
 	while (smps) {
 		/* processing is delayed by FRAME_BUFFER_SIZE - 1 frames */
@@ -441,6 +459,43 @@ void source_profiler_source_tick_end(obs_source_t *source, uint64_t start)
 	smp->frames[smp->frame_idx]->tick = delta;
 }
 
+void source_profiler_source_tick_add(obs_source_t *source, uint64_t time, size_t worker)
+{
+	if (!enabled)
+		return;
+
+	worker_tick_frame[worker < MAX_TICK_WORKERS ? worker : MAX_TICK_WORKERS - 1] += time;
+
+	struct source_samples *smp = NULL;
+	HASH_FIND_PTR(hm_samples, &source, smp);
+	if (smp)
+		smp->frames[smp->frame_idx]->tick += time;
+}
+
+bool source_profiler_get_tick_worker_stats(size_t worker, uint64_t *avg, uint64_t *max)
+{
+	if (worker >= MAX_TICK_WORKERS)
+		return false;
+
+	uint64_t sum = 0, max_ = 0;
+	size_t num;
+
+	pthread_rwlock_rdlock(&hm_rwlock);
+	struct ucirclebuf *buf = &worker_ticks[worker];
+	for (num = 0; num < buf->num; num++) {
+		sum += buf->array[num];
+		if (buf->array[num] > max_)
+			max_ = buf->array[num];
+	}
+	pthread_rwlock_unlock(&hm_rwlock);
+
+	if (avg)
+		*avg = num ? sum / num : 0;
+	if (max)
+		*max = max_;
+	return num != 0;
+}
+
 uint64_t source_profiler_source_render_begin(gs_timer_t **timer)
 {
 	if (!enabled)
@@ -60,6 +60,9 @@ EXPORT void source_profiler_gpu_enable(bool enable);
 EXPORT profiler_result_t *source_profiler_get_result(obs_source_t *source);
 /* Update existing profiler results object for source */
 EXPORT bool source_profiler_fill_result(obs_source_t *source, profiler_result_t *result);
+/* Per-frame average and max time spent in parallel tick callbacks on tick
+ * worker 'worker' in ns, with 0 being the graphics thread */
+EXPORT bool source_profiler_get_tick_worker_stats(size_t worker, uint64_t *avg, uint64_t *max);
 
 #ifdef __cplusplus
 }
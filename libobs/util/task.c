@@ -162,3 +162,185 @@ static void *tiny_tubular_task_thread(void *param)
 
 	return NULL;
 }
+
+/* ------------------------------------------------------------------------- */
+
+struct os_task_pool {
+	char *name;
+	pthread_t *threads;
+	size_t num_threads;
+
+	os_sem_t *start_sem;
+	os_event_t *done_event;
+	pthread_mutex_t run_mutex;
+
+	os_task_range_t task;
+	void *param;
+	long count;
+	long workers;
+	volatile long next;
+	volatile long finished;
+	volatile bool stop;
+};
+
+static THREAD_LOCAL size_t worker_index = 0;
+
+struct pool_thread_info {
+	os_task_pool_t *pool;
+	size_t index;
+};
+
+static void run_pool_items(os_task_pool_t *pool)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&pool->next) - 1;
+		if (idx >= pool->count)
+			break;
+
+		pool->task(pool->param, (size_t)idx);
+	}
+}
+
+static void *pool_thread(void *param)
+{
+	struct pool_thread_info info = *(struct pool_thread_info *)param;
+	os_task_pool_t *pool = info.pool;
+	bfree(param);
+
+	worker_index = info.index;
+	os_set_thread_name(pool->name);
+
+	while (os_sem_wait(pool->start_sem) == 0) {
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		run_pool_items(pool);
+
+		if (os_atomic_inc_long(&pool->finished) == pool->workers)
+			os_event_signal(pool->done_event);
+	}
+
+	return NULL;
+}
+
+os_task_pool_t *os_task_pool_create(const char *name, size_t threads)
+{
+	struct os_task_pool *pool = bzalloc(sizeof(*pool));
+	pool->name = bstrdup(name ? name : "task pool");
+
+	if (pthread_mutex_init(&pool->run_mutex, NULL) != 0)
+		goto fail1;
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		goto fail2;
+	if (os_event_init(&pool->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail3;
+
+	pool->threads = bzalloc(sizeof(pthread_t) * (threads ? threads : 1));
+
+	for (size_t i = 0; i < threads; i++) {
+		struct pool_thread_info *info = bmalloc(sizeof(*info));
+		info->pool = pool;
+		info->index = i + 1;
+
+		if (pthread_create(&pool->threads[i], NULL, pool_thread, info) != 0) {
+			bfree(info);
+			break;
+		}
+
+		pool->num_threads++;
+	}
+
+	return pool;
+
+fail3:
+	os_sem_destroy(pool->start_sem);
+fail2:
+	pthread_mutex_destroy(&pool->run_mutex);
+fail1:
+	bfree(pool->name);
+	bfree(pool);
+	return NULL;
+}
+
+void os_task_pool_destroy(os_task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	os_atomic_store_bool(&pool->stop, true);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_event_destroy(pool->done_event);
+	os_sem_destroy(pool->start_sem);
+	pthread_mutex_destroy(&pool->run_mutex);
+	bfree(pool->threads);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t os_task_pool_threads(const os_task_pool_t *pool)
+{
+	return pool ? pool->num_threads : 0;
+}
+
+static inline bool run_on_caller(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count)
+{
+	if (pool && pool->num_threads && count >= 2)
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+		task(param, i);
+	return true;
+}
+
+/* called with run_mutex held */
+static void run_on_pool(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count)
+{
+	/* the calling thread takes part, so only wake as many workers as
+	 * there are remaining items */
+	size_t workers = count - 1 < pool->num_threads ? count - 1 : pool->num_threads;
+
+	pool->task = task;
+	pool->param = param;
+	pool->count = (long)count;
+	pool->workers = (long)workers;
+	os_atomic_store_long(&pool->next, 0);
+	os_atomic_store_long(&pool->finished, 0);
+
+	for (size_t i = 0; i < workers; i++)
+		os_sem_post(pool->start_sem);
+
+	run_pool_items(pool);
+	os_event_wait(pool->done_event);
+}
+
+void os_task_pool_run(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count)
+{
+	if (run_on_caller(pool, task, param, count))
+		return;
+
+	pthread_mutex_lock(&pool->run_mutex);
+	run_on_pool(pool, task, param, count);
+	pthread_mutex_unlock(&pool->run_mutex);
+}
+
+bool os_task_pool_try_run(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count)
+{
+	if (run_on_caller(pool, task, param, count))
+		return true;
+
+	if (pthread_mutex_trylock(&pool->run_mutex) != 0)
+		return false;
+
+	run_on_pool(pool, task, param, count);
+	pthread_mutex_unlock(&pool->run_mutex);
+	return true;
+}
+
+size_t os_task_pool_worker_index(void)
+{
+	return worker_index;
+}
@@ -17,6 +17,37 @@ EXPORT void os_task_queue_destroy(os_task_queue_t *tt);
 EXPORT bool os_task_queue_wait(os_task_queue_t *tt);
 EXPORT bool os_task_queue_inside(os_task_queue_t *tt);
 
+/* A fixed set of worker threads that run a batch of independent items in
+ * parallel.  Idle workers claim the next unprocessed item, so uneven item
+ * costs are balanced across threads automatically. */
+struct os_task_pool;
+typedef struct os_task_pool os_task_pool_t;
+
+typedef void (*os_task_range_t)(void *param, size_t idx);
+
+EXPORT os_task_pool_t *os_task_pool_create(const char *name, size_t threads);
+EXPORT void os_task_pool_destroy(os_task_pool_t *pool);
+EXPORT size_t os_task_pool_threads(const os_task_pool_t *pool);
+
+/* Calls task(param, idx) for every idx in [0, count) on the pool threads and
+ * the calling thread, returns once all items have completed.  Without a pool
+ * the items are run on the calling thread.
+ *
+ * Must not be called for a pool from one of its own items: only one batch
+ * runs at a time and the lock guarding that is not recursive, so the nested
+ * call deadlocks.  Code that may run inside a pool item should use
+ * os_task_pool_try_run instead. */
+EXPORT void os_task_pool_run(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count);
+
+/* Same as os_task_pool_run, except that while the pool is running the items
+ * of another thread nothing is run and false is returned, so that the caller
+ * can do the work itself instead of waiting for the pool */
+EXPORT bool os_task_pool_try_run(os_task_pool_t *pool, os_task_range_t task, void *param, size_t count);
+
+/* 1-based index of the pool worker running the current item, or 0 if called
+ * on a thread that is not a pool worker (e.g. the os_task_pool_run caller) */
+EXPORT size_t os_task_pool_worker_index(void);
+
 #ifdef __cplusplus
 }
 #endif
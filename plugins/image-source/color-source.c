@@ -3,6 +3,7 @@
 struct color_source {
 	struct vec4 color;
 	struct vec4 color_srgb;
+	uint8_t color_rgba[4];
 
 	uint32_t width;
 	uint32_t height;
@@ -25,6 +26,10 @@ static void color_source_update(void *data, obs_data_t *settings)
 
 	vec4_from_rgba(&context->color, color);
 	vec4_from_rgba_srgb(&context->color_srgb, color);
+	context->color_rgba[0] = (uint8_t)(color & 0xFF);
+	context->color_rgba[1] = (uint8_t)((color >> 8) & 0xFF);
+	context->color_rgba[2] = (uint8_t)((color >> 16) & 0xFF);
+	context->color_rgba[3] = (uint8_t)(color >> 24);
 	context->width = width;
 	context->height = height;
 }
@@ -96,6 +101,16 @@ static void color_source_render(void *data, gs_effect_t *effect)
 	gs_enable_framebuffer_srgb(previous);
 }
 
+static void color_source_render_cpu(void *data, struct obs_cpu_image *image)
+{
+	struct color_source *context = data;
+
+	for (uint32_t x = 0; x < image->width; x++)
+		memcpy(image->data + x * 4, context->color_rgba, 4);
+	for (uint32_t y = 1; y < image->height; y++)
+		memcpy(image->data + y * image->linesize, image->data, image->width * 4);
+}
+
 static uint32_t color_source_getwidth(void *data)
 {
 	struct color_source *context = data;
@@ -141,6 +156,7 @@ struct obs_source_info color_source_info_v1 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.video_render_cpu = color_source_render_cpu,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
@@ -158,6 +174,7 @@ struct obs_source_info color_source_info_v2 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.video_render_cpu = color_source_render_cpu,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
@@ -175,6 +192,7 @@ struct obs_source_info color_source_info_v3 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.video_render_cpu = color_source_render_cpu,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
@@ -24,6 +24,12 @@ struct image_source {
 	uint64_t last_time;
 	bool active;
 	bool restart_gif;
+
+	/* left by the tick for the render, the tick may run on a worker
+	 * thread that can't enter graphics */
+	bool reload;
+	bool texture_dirty;
+
 	volatile bool file_decoded;
 	volatile bool texture_loaded;
 
@@ -151,10 +157,7 @@ static void restart_gif(void *data)
 		context->if4.image3.image2.image.cur_loop = 0;
 		context->if4.image3.image2.image.cur_time = 0;
 
-		obs_enter_graphics();
-		gs_image_file4_update_texture(&context->if4);
-		obs_leave_graphics();
-
+		context->texture_dirty = true;
 		context->restart_gif = false;
 	}
 }
@@ -200,8 +203,22 @@ static uint32_t image_source_getheight(void *data)
 static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
-	if (!os_atomic_load_bool(&context->texture_loaded))
-		return;
+
+	if (context->reload) {
+		context->reload = false;
+		image_source_load(context);
+	}
+
+	if (!os_atomic_load_bool(&context->texture_loaded)) {
+		if (!os_atomic_load_bool(&context->file_decoded))
+			return;
+		image_source_load_texture(context);
+	}
+
+	if (context->texture_dirty) {
+		gs_image_file4_update_texture(&context->if4);
+		context->texture_dirty = false;
+	}
 
 	struct gs_image_file *const image = &context->if4.image3.image2.image;
 	gs_texture_t *const texture = image->texture;
@@ -227,12 +244,8 @@ static void image_source_render(void *data, gs_effect_t *effect)
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
-	if (!os_atomic_load_bool(&context->texture_loaded)) {
-		if (os_atomic_load_bool(&context->file_decoded))
-			image_source_load_texture(context);
-		else
-			return;
-	}
+	if (!os_atomic_load_bool(&context->texture_loaded))
+		return;
 
 	uint64_t frame_time = obs_get_video_frame_time();
 
@@ -244,7 +257,7 @@ static void image_source_tick(void *data, float seconds)
 			context->update_time_elapsed = 0.0f;
 
 			if (context->file_timestamp != t) {
-				image_source_load(context);
+				context->reload = true;
 			}
 		}
 	}
@@ -270,13 +283,8 @@ static void image_source_tick(void *data, float seconds)
 
 	if (context->last_time && context->if4.image3.image2.image.is_animated_gif) {
 		uint64_t elapsed = frame_time - context->last_time;
-		bool updated = gs_image_file4_tick(&context->if4, elapsed);
-
-		if (updated) {
-			obs_enter_graphics();
-			gs_image_file4_update_texture(&context->if4);
-			obs_leave_graphics();
-		}
+		if (gs_image_file4_tick(&context->if4, elapsed))
+			context->texture_dirty = true;
 	}
 
 	context->last_time = frame_time;
@@ -357,13 +365,13 @@ static enum gs_color_space image_source_get_color_space(void *data, size_t count
 
 	struct image_source *const s = data;
 	gs_image_file4_t *const if4 = &s->if4;
-	return if4->image3.image2.image.texture ? if4->space : GS_CS_SRGB;
+	return os_atomic_load_bool(&s->file_decoded) ? if4->space : GS_CS_SRGB;
 }
 
 static struct obs_source_info image_source_info = {
 	.id = "image_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB | OBS_SOURCE_PARALLEL_TICK,
 	.get_name = image_source_get_name,
 	.create = image_source_create,
 	.destroy = image_source_destroy,
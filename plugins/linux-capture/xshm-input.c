@@ -18,6 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <glad/glad.h>
+#include <xcb/damage.h>
 #include <xcb/randr.h>
 #include <xcb/shm.h>
 #include <xcb/xfixes.h>
@@ -25,6 +27,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <obs-module.h>
 #include <util/dstr.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
 #include "xcursor-xcb.h"
 #include "xhelpers.h"
 
@@ -34,6 +39,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define INVALID_DISPLAY (-1)
 
+/* Damage rectangles beyond this count are merged into their bounding box */
+#define XSHM_MAX_DAMAGE_RECTS 32
+
 struct xshm_data {
 	obs_source_t *source;
 
@@ -65,6 +73,25 @@ struct xshm_data {
 	bool use_xinerama;
 	bool use_randr;
 	bool advanced;
+
+	xcb_damage_damage_t damage;
+	xcb_xfixes_region_t damage_region;
+	uint8_t damage_event;
+
+	pthread_t thread;
+	os_event_t *event;
+
+	/* owned by the capture thread */
+	DARRAY(xcb_rectangle_t) fetch_rects;
+	bool fetch_full;
+	uint64_t captures;
+	uint64_t fetched_pixels;
+
+	/* frame handed from the capture thread to the graphics thread */
+	pthread_mutex_t frame_mutex;
+	uint8_t *frame;
+	DARRAY(xcb_rectangle_t) frame_rects;
+	bool frame_full;
 };
 
 /**
@@ -179,11 +206,298 @@ static const char *xshm_getname(void *unused)
 	return obs_module_text("X11SharedMemoryDisplayInput");
 }
 
+/**
+ * Set up damage tracking on the root window
+ *
+ * Without the damage extension every frame is captured in full.
+ */
+static void xshm_damage_init(struct xshm_data *data)
+{
+	const xcb_query_extension_reply_t *ext = xcb_get_extension_data(data->xcb, &xcb_damage_id);
+	xcb_damage_query_version_cookie_t ver_c;
+	xcb_damage_query_version_reply_t *ver_r;
+
+	if (!ext || !ext->present) {
+		blog(LOG_INFO, "Missing Damage extension, capturing full frames");
+		return;
+	}
+
+	ver_c = xcb_damage_query_version_unchecked(data->xcb, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+	ver_r = xcb_damage_query_version_reply(data->xcb, ver_c, NULL);
+	if (!ver_r)
+		return;
+	free(ver_r);
+
+	data->damage_event = ext->first_event;
+	data->damage = xcb_generate_id(data->xcb);
+	data->damage_region = xcb_generate_id(data->xcb);
+
+	xcb_damage_create(data->xcb, data->damage, data->xcb_screen->root, XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+	xcb_xfixes_create_region(data->xcb, data->damage_region, 0, NULL);
+}
+
+/**
+ * Drain pending events
+ *
+ * The damage object only reports the transition from empty to non-empty, so
+ * there is at most one notify event between two calls to xshm_get_damage.
+ *
+ * @return true if the root window was damaged
+ */
+static bool xshm_poll_damage(struct xshm_data *data)
+{
+	xcb_generic_event_t *event;
+	bool damaged = false;
+
+	while ((event = xcb_poll_for_event(data->xcb))) {
+		if ((event->response_type & ~0x80) == data->damage_event + XCB_DAMAGE_NOTIFY)
+			damaged = true;
+		free(event);
+	}
+
+	return damaged;
+}
+
+/**
+ * Add a rectangle in root window coordinates, clipped to the capture area
+ */
+static void xshm_add_fetch_rect(struct xshm_data *data, int_fast32_t x, int_fast32_t y, int_fast32_t w,
+				int_fast32_t h)
+{
+	int_fast32_t x0 = x - data->adj_x_org;
+	int_fast32_t y0 = y - data->adj_y_org;
+	int_fast32_t x1 = x0 + w;
+	int_fast32_t y1 = y0 + h;
+
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 > data->adj_width)
+		x1 = data->adj_width;
+	if (y1 > data->adj_height)
+		y1 = data->adj_height;
+
+	if (x1 <= x0 || y1 <= y0)
+		return;
+
+	xcb_rectangle_t *rect = da_push_back_new(data->fetch_rects);
+	rect->x = (int16_t)x0;
+	rect->y = (int16_t)y0;
+	rect->width = (uint16_t)(x1 - x0);
+	rect->height = (uint16_t)(y1 - y0);
+}
+
+/**
+ * Merge all fetch rectangles into their bounding box
+ */
+static void xshm_merge_fetch_rects(struct xshm_data *data)
+{
+	int_fast32_t x0 = data->adj_width, y0 = data->adj_height;
+	int_fast32_t x1 = 0, y1 = 0;
+
+	for (size_t i = 0; i < data->fetch_rects.num; i++) {
+		const xcb_rectangle_t *rect = &data->fetch_rects.array[i];
+
+		if (rect->x < x0)
+			x0 = rect->x;
+		if (rect->y < y0)
+			y0 = rect->y;
+		if (rect->x + rect->width > x1)
+			x1 = rect->x + rect->width;
+		if (rect->y + rect->height > y1)
+			y1 = rect->y + rect->height;
+	}
+
+	da_clear(data->fetch_rects);
+	xshm_add_fetch_rect(data, data->adj_x_org + x0, data->adj_y_org + y0, x1 - x0, y1 - y0);
+}
+
+/**
+ * Collect the damaged part of the capture area and reset the damage
+ *
+ * @return false if the damage could not be retrieved
+ */
+static bool xshm_get_damage(struct xshm_data *data)
+{
+	xcb_xfixes_fetch_region_cookie_t region_c;
+	xcb_xfixes_fetch_region_reply_t *region_r;
+
+	xcb_damage_subtract(data->xcb, data->damage, XCB_NONE, data->damage_region);
+	region_c = xcb_xfixes_fetch_region_unchecked(data->xcb, data->damage_region);
+	region_r = xcb_xfixes_fetch_region_reply(data->xcb, region_c, NULL);
+	if (!region_r)
+		return false;
+
+	xcb_rectangle_t *rects = xcb_xfixes_fetch_region_rectangles(region_r);
+	int count = xcb_xfixes_fetch_region_rectangles_length(region_r);
+
+	for (int i = 0; i < count; i++)
+		xshm_add_fetch_rect(data, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+
+	free(region_r);
+
+	if (data->fetch_rects.num > XSHM_MAX_DAMAGE_RECTS)
+		xshm_merge_fetch_rects(data);
+	return true;
+}
+
+/**
+ * Fetch the changed parts of the screen and hand them to the graphics thread
+ *
+ * All image requests are issued before waiting for the first reply, so the
+ * server answers them in a single round trip. Damage regions never overlap,
+ * so they always fit into the shm segment back to back.
+ */
+static void xshm_capture_frame(struct xshm_data *data)
+{
+	xcb_shm_get_image_cookie_t img_c[XSHM_MAX_DAMAGE_RECTS];
+	const size_t linesize = data->adj_width * 4;
+	bool damaged = xshm_poll_damage(data);
+	bool full = !data->damage || data->fetch_full;
+	bool success = true;
+	size_t offset = 0;
+
+	da_clear(data->fetch_rects);
+
+	/* the damage has to be subtracted on full captures too, the server
+	 * sends no more notify events until it is */
+	if (data->damage && damaged && !xshm_get_damage(data))
+		full = true;
+	if (full) {
+		da_clear(data->fetch_rects);
+		xshm_add_fetch_rect(data, data->adj_x_org, data->adj_y_org, data->adj_width, data->adj_height);
+	}
+	if (!data->fetch_rects.num)
+		return;
+
+	for (size_t i = 0; i < data->fetch_rects.num; i++) {
+		const xcb_rectangle_t *rect = &data->fetch_rects.array[i];
+
+		img_c[i] = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root, data->adj_x_org + rect->x,
+						       data->adj_y_org + rect->y, rect->width, rect->height, ~0,
+						       XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg, offset);
+		offset += (size_t)rect->width * rect->height * 4;
+	}
+
+	for (size_t i = 0; i < data->fetch_rects.num; i++) {
+		xcb_shm_get_image_reply_t *img_r = xcb_shm_get_image_reply(data->xcb, img_c[i], NULL);
+		if (!img_r)
+			success = false;
+		free(img_r);
+	}
+
+	data->fetch_full = !success;
+	if (!success)
+		return;
+
+	pthread_mutex_lock(&data->frame_mutex);
+
+	offset = 0;
+	for (size_t i = 0; i < data->fetch_rects.num; i++) {
+		const xcb_rectangle_t *rect = &data->fetch_rects.array[i];
+		const size_t row = (size_t)rect->width * 4;
+		const uint8_t *src = (const uint8_t *)data->xshm->data + offset;
+		uint8_t *dst = data->frame + rect->y * linesize + rect->x * 4;
+
+		if (row == linesize) {
+			memcpy(dst, src, row * rect->height);
+		} else {
+			for (uint16_t y = 0; y < rect->height; y++)
+				memcpy(dst + y * linesize, src + y * row, row);
+		}
+
+		offset += row * rect->height;
+	}
+
+	if (full || data->frame_rects.num + data->fetch_rects.num > XSHM_MAX_DAMAGE_RECTS) {
+		data->frame_full = true;
+		da_clear(data->frame_rects);
+	} else if (!data->frame_full) {
+		da_push_back_da(data->frame_rects, data->fetch_rects);
+	}
+
+	pthread_mutex_unlock(&data->frame_mutex);
+
+	data->captures++;
+	data->fetched_pixels += offset / 4;
+}
+
+/**
+ * Capture thread, paced at the output frame rate
+ */
+static void *xshm_thread(void *vptr)
+{
+	XSHM_DATA(vptr);
+	const uint64_t interval = obs_get_frame_interval_ns();
+	uint64_t next = os_gettime_ns();
+
+	os_set_thread_name("xshm: capture");
+
+	while (os_event_try(data->event) == EAGAIN) {
+		if (obs_source_showing(data->source))
+			xshm_capture_frame(data);
+
+		next += interval;
+		if (!os_sleepto_ns(next))
+			next = os_gettime_ns();
+	}
+
+	return NULL;
+}
+
+/**
+ * Upload the parts of the frame that changed since the last upload
+ *
+ * @note requires to be called within the obs graphics context with the frame
+ *       mutex held
+ */
+static void xshm_upload_frame(struct xshm_data *data)
+{
+	if (data->frame_full) {
+		gs_texture_set_image(data->texture, data->frame, data->adj_width * 4, false);
+	} else if (data->frame_rects.num) {
+		const size_t linesize = data->adj_width * 4;
+
+		glBindTexture(GL_TEXTURE_2D, *(GLuint *)gs_texture_get_obj(data->texture));
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, data->adj_width);
+
+		for (size_t i = 0; i < data->frame_rects.num; i++) {
+			const xcb_rectangle_t *rect = &data->frame_rects.array[i];
+			const uint8_t *start = data->frame + rect->y * linesize + rect->x * 4;
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect->x, rect->y, rect->width, rect->height, GL_BGRA,
+					GL_UNSIGNED_BYTE, start);
+		}
+
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	data->frame_full = false;
+	da_clear(data->frame_rects);
+}
+
 /**
  * Stop the capture
  */
 static void xshm_capture_stop(struct xshm_data *data)
 {
+	if (data->thread) {
+		os_event_signal(data->event);
+		pthread_join(data->thread, NULL);
+		os_event_destroy(data->event);
+		data->thread = 0;
+
+		blog(LOG_INFO,
+		     "Captured %" PRIu64 " frames, fetched %" PRIu64 "%% of the "
+		     "pixels a full capture would have",
+		     data->captures,
+		     data->captures ? data->fetched_pixels * 100 /
+					      (data->captures * (uint64_t)data->adj_width * data->adj_height)
+				    : 0);
+	}
+
 	obs_enter_graphics();
 
 	if (data->texture) {
@@ -207,6 +521,17 @@ static void xshm_capture_stop(struct xshm_data *data)
 		data->xcb = NULL;
 	}
 
+	data->damage = 0;
+	data->damage_region = 0;
+
+	bfree(data->frame);
+	data->frame = NULL;
+	da_free(data->frame_rects);
+	da_free(data->fetch_rects);
+	data->frame_full = false;
+	data->captures = 0;
+	data->fetched_pixels = 0;
+
 	if (data->server) {
 		bfree(data->server);
 		data->server = NULL;
@@ -256,12 +581,27 @@ static void xshm_capture_start(struct xshm_data *data)
 	data->cursor = xcb_xcursor_init(data->xcb);
 	xcb_xcursor_offset(data->cursor, data->adj_x_org, data->adj_y_org);
 
+	xshm_damage_init(data);
+
 	obs_enter_graphics();
 
 	xshm_resize_texture(data);
 
 	obs_leave_graphics();
 
+	if (!data->texture)
+		goto fail;
+
+	data->frame = bzalloc((size_t)data->adj_width * data->adj_height * 4);
+	data->fetch_full = true;
+
+	if (os_event_init(&data->event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (pthread_create(&data->thread, NULL, xshm_thread, data) != 0) {
+		os_event_destroy(data->event);
+		goto fail;
+	}
+
 	return;
 fail:
 	xshm_capture_stop(data);
@@ -465,6 +805,7 @@ static void xshm_destroy(void *vptr)
 
 	xshm_capture_stop(data);
 
+	pthread_mutex_destroy(&data->frame_mutex);
 	bfree(data);
 }
 
@@ -476,6 +817,11 @@ static void *xshm_create(obs_data_t *settings, obs_source_t *source)
 	struct xshm_data *data = bzalloc(sizeof(struct xshm_data));
 	data->source = source;
 
+	if (pthread_mutex_init(&data->frame_mutex, NULL) != 0) {
+		bfree(data);
+		return NULL;
+	}
+
 	xshm_update(data, settings);
 
 	return data;
@@ -494,27 +840,18 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t img_c;
-	xcb_shm_get_image_reply_t *img_r;
-
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root, data->adj_x_org, data->adj_y_org,
-					    data->adj_width, data->adj_height, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					    data->xshm->seg, 0);
-
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
-
-	if (!img_r)
-		goto exit;
-
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *)data->xshm->data, data->adj_width * 4, false);
+	/* never wait for the capture thread; a frame that is still being
+	 * copied is picked up on the next tick */
+	if (pthread_mutex_trylock(&data->frame_mutex) == 0) {
+		xshm_upload_frame(data);
+		pthread_mutex_unlock(&data->frame_mutex);
+	}
+
 	xcb_xcursor_update(data->xcb, data->cursor);
 
 	obs_leave_graphics();
-
-exit:
-	free(img_r);
 }
 
 /**
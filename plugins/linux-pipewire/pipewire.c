@@ -64,6 +64,12 @@ struct spa_meta_videotransform {
 #define CURSOR_META_SIZE(width, height) \
 	(sizeof(struct spa_meta_cursor) + sizeof(struct spa_meta_bitmap) + width * height * 4)
 
+#define DAMAGE_META_SIZE(n_regions) (sizeof(struct spa_meta_region) * n_regions)
+
+/* memory buffers are uploaded into alternating textures, so the upload never
+ * has to wait on the previous frame's transfer out of the same PBO */
+#define SHM_TEXTURE_COUNT 2
+
 struct obs_pw_version {
 	int major;
 	int minor;
@@ -100,6 +106,21 @@ struct _obs_pipewire_stream {
 
 	gs_texture_t *texture;
 
+	struct {
+		gs_texture_t *textures[SHM_TEXTURE_COUNT];
+		bool full_upload[SHM_TEXTURE_COUNT];
+		size_t current;
+
+		uint32_t width, height;
+		enum gs_color_format format;
+
+		/* damage of the previous frame, the texture that gets uploaded
+		 * next is still missing it */
+		DARRAY(struct spa_region) prev_damage;
+		bool prev_damage_valid;
+		DARRAY(struct spa_region) damage;
+	} shm;
+
 	struct pw_stream *stream;
 	struct spa_hook stream_listener;
 	struct spa_source *reneg;
@@ -294,6 +315,199 @@ static void swap_texture_red_blue(gs_texture_t *texture)
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+static bool gs_format_to_gl(enum gs_color_format format, GLenum *gl_format, GLenum *gl_type)
+{
+	switch (format) {
+	case GS_BGRA:
+	case GS_BGRX:
+		*gl_format = GL_BGRA;
+		*gl_type = GL_UNSIGNED_BYTE;
+		return true;
+	case GS_RGBA:
+		*gl_format = GL_RGBA;
+		*gl_type = GL_UNSIGNED_BYTE;
+		return true;
+	case GS_R10G10B10A2:
+		*gl_format = GL_RGBA;
+		*gl_type = GL_UNSIGNED_INT_2_10_10_10_REV;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool is_shm_texture(obs_pipewire_stream *obs_pw_stream, gs_texture_t *texture)
+{
+	for (size_t i = 0; i < SHM_TEXTURE_COUNT; i++) {
+		if (obs_pw_stream->shm.textures[i] == texture)
+			return true;
+	}
+	return false;
+}
+
+static void clear_texture(obs_pipewire_stream *obs_pw_stream)
+{
+	if (obs_pw_stream->texture && is_shm_texture(obs_pw_stream, obs_pw_stream->texture))
+		obs_pw_stream->texture = NULL;
+	else
+		g_clear_pointer(&obs_pw_stream->texture, gs_texture_destroy);
+}
+
+static void destroy_shm_textures(obs_pipewire_stream *obs_pw_stream)
+{
+	if (obs_pw_stream->texture && is_shm_texture(obs_pw_stream, obs_pw_stream->texture))
+		obs_pw_stream->texture = NULL;
+
+	for (size_t i = 0; i < SHM_TEXTURE_COUNT; i++)
+		g_clear_pointer(&obs_pw_stream->shm.textures[i], gs_texture_destroy);
+
+	da_free(obs_pw_stream->shm.prev_damage);
+	da_free(obs_pw_stream->shm.damage);
+	obs_pw_stream->shm.prev_damage_valid = false;
+}
+
+static bool ensure_shm_textures(obs_pipewire_stream *obs_pw_stream, uint32_t width, uint32_t height,
+				enum gs_color_format format, bool swap_red_blue)
+{
+	if (obs_pw_stream->shm.textures[0] && obs_pw_stream->shm.width == width &&
+	    obs_pw_stream->shm.height == height && obs_pw_stream->shm.format == format)
+		return true;
+
+	clear_texture(obs_pw_stream);
+	destroy_shm_textures(obs_pw_stream);
+
+	for (size_t i = 0; i < SHM_TEXTURE_COUNT; i++) {
+		obs_pw_stream->shm.textures[i] = gs_texture_create(width, height, format, 1, NULL, GS_DYNAMIC);
+		if (!obs_pw_stream->shm.textures[i]) {
+			destroy_shm_textures(obs_pw_stream);
+			return false;
+		}
+
+		if (swap_red_blue)
+			swap_texture_red_blue(obs_pw_stream->shm.textures[i]);
+
+		obs_pw_stream->shm.full_upload[i] = true;
+	}
+
+	obs_pw_stream->shm.width = width;
+	obs_pw_stream->shm.height = height;
+	obs_pw_stream->shm.format = format;
+	obs_pw_stream->shm.current = 0;
+
+	blog(LOG_DEBUG, "[pipewire] Created %d memory textures (%ux%u)", SHM_TEXTURE_COUNT, width, height);
+	return true;
+}
+
+/* Collects the damaged regions of the buffer clamped to the frame, returns
+ * false if the whole frame has to be considered damaged */
+static bool read_damage(obs_pipewire_stream *obs_pw_stream, struct spa_buffer *buffer, uint32_t width,
+			uint32_t height)
+{
+	struct spa_meta_region *region;
+	struct spa_meta *meta;
+	uint64_t area = 0;
+
+	da_clear(obs_pw_stream->shm.damage);
+
+	meta = spa_buffer_find_meta(buffer, SPA_META_VideoDamage);
+	if (!meta)
+		return false;
+
+	spa_meta_for_each(region, meta)
+	{
+		struct spa_region r = region->region;
+
+		if (!spa_meta_region_is_valid(region))
+			break;
+		if (r.position.x < 0 || r.position.y < 0 || (uint32_t)r.position.x >= width ||
+		    (uint32_t)r.position.y >= height)
+			continue;
+
+		r.size.width = MIN(r.size.width, width - r.position.x);
+		r.size.height = MIN(r.size.height, height - r.position.y);
+		area += (uint64_t)r.size.width * r.size.height;
+		da_push_back(obs_pw_stream->shm.damage, &r);
+	}
+
+	/* an empty list is treated as unknown rather than "unchanged", and
+	 * once most of the frame changed one full upload is cheaper */
+	return obs_pw_stream->shm.damage.num && area * 2 <= (uint64_t)width * height;
+}
+
+static void upload_damage(gs_texture_t *texture, const struct spa_region *regions, size_t count, const uint8_t *data,
+			  uint32_t stride, uint32_t bpp, GLenum gl_format, GLenum gl_type)
+{
+	GLuint gl_texture = *(GLuint *)gs_texture_get_obj(texture);
+
+	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / bpp);
+
+	for (size_t i = 0; i < count; i++) {
+		const struct spa_region *r = &regions[i];
+		const uint8_t *start = data + (size_t)r->position.y * stride + (size_t)r->position.x * bpp;
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r->position.x, r->position.y, r->size.width, r->size.height,
+				gl_format, gl_type, start);
+	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/* Uploads a memory buffer into the next texture of the ring.  Only regions
+ * damaged since that texture was last written are uploaded when the producer
+ * provides damage metadata. */
+static bool upload_shm_buffer(obs_pipewire_stream *obs_pw_stream, struct spa_buffer *buffer,
+			      const struct obs_pw_video_format *obs_pw_video_format, bool skipped_buffers)
+{
+	uint32_t width = obs_pw_stream->format.info.raw.size.width;
+	uint32_t height = obs_pw_stream->format.info.raw.size.height;
+	enum gs_color_format format = obs_pw_video_format->gs_format;
+	uint32_t bpp = gs_get_format_bpp(format) / 8;
+	uint32_t stride = buffer->datas[0].chunk->stride;
+	const uint8_t *data = buffer->datas[0].data;
+	struct darray prev_damage;
+	bool damage_valid;
+	GLenum gl_format, gl_type;
+	size_t next;
+
+	if (!ensure_shm_textures(obs_pw_stream, width, height, format, obs_pw_video_format->swap_red_blue))
+		return false;
+
+	if (!bpp)
+		return false;
+	if ((int32_t)stride <= 0)
+		stride = width * bpp;
+
+	data += buffer->datas[0].chunk->offset;
+
+	damage_valid = read_damage(obs_pw_stream, buffer, width, height) && !skipped_buffers &&
+		       gs_format_to_gl(format, &gl_format, &gl_type) && stride % bpp == 0;
+
+	next = (obs_pw_stream->shm.current + 1) % SHM_TEXTURE_COUNT;
+
+	if (damage_valid && obs_pw_stream->shm.prev_damage_valid && !obs_pw_stream->shm.full_upload[next]) {
+		gs_texture_t *texture = obs_pw_stream->shm.textures[next];
+
+		upload_damage(texture, obs_pw_stream->shm.prev_damage.array, obs_pw_stream->shm.prev_damage.num, data,
+			      stride, bpp, gl_format, gl_type);
+		upload_damage(texture, obs_pw_stream->shm.damage.array, obs_pw_stream->shm.damage.num, data, stride,
+			      bpp, gl_format, gl_type);
+	} else {
+		gs_texture_set_image(obs_pw_stream->shm.textures[next], data, stride, false);
+		obs_pw_stream->shm.full_upload[next] = false;
+	}
+
+	prev_damage = obs_pw_stream->shm.prev_damage.da;
+	obs_pw_stream->shm.prev_damage.da = obs_pw_stream->shm.damage.da;
+	obs_pw_stream->shm.damage.da = prev_damage;
+	obs_pw_stream->shm.prev_damage_valid = damage_valid;
+
+	obs_pw_stream->shm.current = next;
+	obs_pw_stream->texture = obs_pw_stream->shm.textures[next];
+	return true;
+}
+
 static inline struct spa_pod *build_format(obs_pipewire_stream *obs_pw_stream, struct spa_pod_builder *b,
 					   uint32_t format, uint64_t *modifiers, size_t modifier_count)
 {
@@ -567,7 +781,7 @@ static void return_unused_pw_buffer(struct pw_stream *stream, struct pw_buffer *
 	pw_stream_queue_buffer(stream, b);
 }
 
-static inline struct pw_buffer *find_latest_buffer(struct pw_stream *stream)
+static inline struct pw_buffer *find_latest_buffer(struct pw_stream *stream, bool *skipped)
 {
 	struct pw_buffer *b;
 
@@ -577,8 +791,11 @@ static inline struct pw_buffer *find_latest_buffer(struct pw_stream *stream)
 		struct pw_buffer *aux = pw_stream_dequeue_buffer(stream);
 		if (!aux)
 			break;
-		if (b)
+		if (b) {
 			return_unused_pw_buffer(stream, b);
+			if (skipped)
+				*skipped = true;
+		}
 		b = aux;
 	}
 
@@ -651,7 +868,7 @@ static void process_video_async(obs_pipewire_stream *obs_pw_stream)
 	struct pw_buffer *b;
 	bool has_buffer;
 
-	b = find_latest_buffer(obs_pw_stream->stream);
+	b = find_latest_buffer(obs_pw_stream->stream, NULL);
 	if (!b) {
 		blog(LOG_DEBUG, "[pipewire] Out of buffers!");
 		return;
@@ -706,8 +923,9 @@ static void process_video_sync(obs_pipewire_stream *obs_pw_stream)
 	struct spa_buffer *buffer;
 	struct pw_buffer *b;
 	bool has_buffer = true;
+	bool skipped_buffers = false;
 
-	b = find_latest_buffer(obs_pw_stream->stream);
+	b = find_latest_buffer(obs_pw_stream->stream, &skipped_buffers);
 	if (!b) {
 		blog(LOG_DEBUG, "[pipewire] Out of buffers!");
 		return;
@@ -788,7 +1006,8 @@ static void process_video_sync(obs_pipewire_stream *obs_pw_stream)
 			goto read_metadata;
 		}
 
-		g_clear_pointer(&obs_pw_stream->texture, gs_texture_destroy);
+		clear_texture(obs_pw_stream);
+		destroy_shm_textures(obs_pw_stream);
 
 		use_modifiers = obs_pw_stream->format.info.raw.modifier != DRM_FORMAT_MOD_INVALID;
 		obs_pw_stream->texture = gs_texture_create_from_dmabuf(obs_pw_stream->format.info.raw.size.width,
@@ -803,6 +1022,9 @@ static void process_video_sync(obs_pipewire_stream *obs_pw_stream)
 			pw_loop_signal_event(pw_thread_loop_get_loop(obs_pw->thread_loop), obs_pw_stream->reneg);
 			goto read_metadata;
 		}
+
+		if (obs_pw_video_format.swap_red_blue)
+			swap_texture_red_blue(obs_pw_stream->texture);
 	} else {
 		blog(LOG_DEBUG, "[pipewire] Buffer has memory texture");
 
@@ -823,16 +1045,10 @@ static void process_video_sync(obs_pipewire_stream *obs_pw_stream)
 			goto read_metadata;
 		}
 
-		g_clear_pointer(&obs_pw_stream->texture, gs_texture_destroy);
-		obs_pw_stream->texture = gs_texture_create(obs_pw_stream->format.info.raw.size.width,
-							   obs_pw_stream->format.info.raw.size.height,
-							   obs_pw_video_format.gs_format, 1,
-							   (const uint8_t **)&buffer->datas[0].data, GS_DYNAMIC);
+		if (!upload_shm_buffer(obs_pw_stream, buffer, &obs_pw_video_format, skipped_buffers))
+			goto read_metadata;
 	}
 
-	if (obs_pw_video_format.swap_red_blue)
-		swap_texture_red_blue(obs_pw_stream->texture);
-
 	/* Video Crop */
 	region = spa_buffer_find_meta_data(buffer, SPA_META_VideoCrop, sizeof(*region));
 	if (region && spa_meta_region_is_valid(region)) {
@@ -920,7 +1136,7 @@ static void on_param_changed_cb(void *user_data, uint32_t id, const struct spa_p
 	obs_pipewire_stream *obs_pw_stream = user_data;
 	obs_pipewire *obs_pw = obs_pw_stream->obs_pw;
 	struct spa_pod_builder pod_builder;
-	const struct spa_pod *params[7];
+	const struct spa_pod *params[8];
 	const char *format_name;
 	uint32_t n_params = 0;
 	uint32_t buffer_types;
@@ -988,6 +1204,13 @@ static void on_param_changed_cb(void *user_data, uint32_t id, const struct spa_p
 					   SPA_POD_CHOICE_RANGE_Int(CURSOR_META_SIZE(64, 64), CURSOR_META_SIZE(1, 1),
 								    CURSOR_META_SIZE(1024, 1024)));
 
+	/* Damage, only used for memory buffers */
+	params[n_params++] = spa_pod_builder_add_object(&pod_builder, SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+							SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+							SPA_PARAM_META_size,
+							SPA_POD_CHOICE_RANGE_Int(DAMAGE_META_SIZE(16), DAMAGE_META_SIZE(1),
+										 DAMAGE_META_SIZE(16)));
+
 	/* Buffer options */
 #if PW_CHECK_VERSION(1, 2, 0)
 	if (supports_explicit_sync) {
@@ -1381,7 +1604,8 @@ void obs_pipewire_stream_destroy(obs_pipewire_stream *obs_pw_stream)
 
 	obs_enter_graphics();
 	g_clear_pointer(&obs_pw_stream->cursor.texture, gs_texture_destroy);
-	g_clear_pointer(&obs_pw_stream->texture, gs_texture_destroy);
+	clear_texture(obs_pw_stream);
+	destroy_shm_textures(obs_pw_stream);
 	obs_leave_graphics();
 
 	pw_thread_loop_lock(obs_pw_stream->obs_pw->thread_loop);
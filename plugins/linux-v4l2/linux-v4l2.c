@@ -27,13 +27,19 @@ MODULE_EXPORT const char *obs_module_description(void)
 extern struct obs_source_info v4l2_input;
 extern struct obs_output_info virtualcam_info;
 extern bool loopback_module_available();
+extern bool shared_memory_queue_requested();
 
 bool obs_module_load(void)
 {
 	obs_register_source(&v4l2_input);
 
+	bool shared_memory = shared_memory_queue_requested();
+
 	if (loopback_module_available()) {
 		obs_register_output(&virtualcam_info);
+	} else if (shared_memory) {
+		blog(LOG_INFO, "v4l2loopback not installed, virtual camera uses the shared memory queue");
+		obs_register_output(&virtualcam_info);
 	} else {
 		blog(LOG_WARNING, "v4l2loopback not installed, virtual camera not registered");
 	}
@@ -15,15 +15,144 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <inttypes.h>
+
 #include <obs-module.h>
+#include <util/platform.h>
 #include <linux/videodev2.h>
 
 #include "v4l2-decoder.h"
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: decoder: " msg, ##__VA_ARGS__)
 
+/* frame threading delays output by (threads - 1) frames, so keep the pool
+ * small, a few threads are enough for 4K30 / 1080p60 h264 */
+#define MAX_DECODE_THREADS 4
+
+static int decode_threads(void)
+{
+	int cores = os_get_logical_cores();
+	return cores < MAX_DECODE_THREADS ? cores : MAX_DECODE_THREADS;
+}
+
+static AVCodecContext *open_context(const AVCodec *codec, int thread_count)
+{
+	AVCodecContext *context = avcodec_alloc_context3(codec);
+	if (!context) {
+		return NULL;
+	}
+
+	context->flags2 |= AV_CODEC_FLAG2_FAST;
+	if (thread_count > 1) {
+		context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	}
+	context->thread_count = thread_count;
+
+	if (avcodec_open2(context, codec, NULL) < 0) {
+		blog(LOG_ERROR, "failed to open codec");
+		avcodec_free_context(&context);
+		return NULL;
+	}
+
+	return context;
+}
+
+static void close_context(AVCodecContext **context)
+{
+	if (*context) {
+#if LIBAVCODEC_VERSION_MAJOR < 61
+		avcodec_close(*context);
+#endif
+		avcodec_free_context(context);
+	}
+}
+
+/* mjpeg packets decode to exactly one frame, without delay */
+static int decode_frame(AVCodecContext *context, AVPacket *packet, AVFrame *frame)
+{
+	int ret = avcodec_send_packet(context, packet);
+	av_packet_unref(packet);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return avcodec_receive_frame(context, frame);
+}
+
+static void *decode_thread(void *param)
+{
+	struct v4l2_decode_worker *worker = param;
+
+	os_set_thread_name("v4l2: decode");
+
+	while (os_sem_wait(worker->work) == 0 && !os_atomic_load_bool(&worker->stop)) {
+		worker->ret = decode_frame(worker->context, worker->packet, worker->frame);
+		os_event_signal(worker->done);
+	}
+
+	return NULL;
+}
+
+static int init_worker(struct v4l2_decoder *decoder, struct v4l2_decode_worker *worker)
+{
+	worker->context = open_context(decoder->codec, 1);
+	if (!worker->context) {
+		return -1;
+	}
+
+	worker->packet = av_packet_alloc();
+	if (!worker->packet) {
+		return -1;
+	}
+
+	worker->frame = av_frame_alloc();
+	if (!worker->frame) {
+		return -1;
+	}
+
+	if (os_sem_init(&worker->work, 0) != 0) {
+		return -1;
+	}
+
+	if (os_event_init(&worker->done, OS_EVENT_TYPE_AUTO) != 0) {
+		return -1;
+	}
+
+	if (pthread_create(&worker->thread, NULL, decode_thread, worker) != 0) {
+		blog(LOG_ERROR, "failed to create decode thread");
+		return -1;
+	}
+
+	worker->thread_created = true;
+	return 0;
+}
+
+static void destroy_worker(struct v4l2_decode_worker *worker)
+{
+	if (worker->thread_created) {
+		os_atomic_set_bool(&worker->stop, true);
+		os_sem_post(worker->work);
+		pthread_join(worker->thread, NULL);
+	}
+
+	os_event_destroy(worker->done);
+	os_sem_destroy(worker->work);
+
+	if (worker->frame) {
+		av_frame_free(&worker->frame);
+	}
+
+	if (worker->packet) {
+		av_packet_free(&worker->packet);
+	}
+
+	close_context(&worker->context);
+}
+
 int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 {
+	memset(decoder, 0, sizeof(*decoder));
+
 	if (pixfmt == V4L2_PIX_FMT_MJPEG) {
 		decoder->codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
 	} else if (pixfmt == V4L2_PIX_FMT_H264) {
@@ -38,7 +167,29 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 		return -1;
 	}
 
-	decoder->context = avcodec_alloc_context3(decoder->codec);
+	/* the mjpeg decoder has neither frame nor slice threading, so it gets
+	 * one context per worker instead; at least two so that decoding
+	 * overlaps with the capture */
+	if (pixfmt == V4L2_PIX_FMT_MJPEG) {
+		int num_workers = decode_threads();
+		if (num_workers < 2) {
+			num_workers = 2;
+		}
+
+		for (int i = 0; i < num_workers; i++) {
+			/* counted first, so that destroying the decoder also
+			 * cleans up a worker that failed halfway */
+			decoder->num_workers++;
+			if (init_worker(decoder, &decoder->workers[i]) < 0) {
+				return -1;
+			}
+		}
+
+		blog(LOG_DEBUG, "initialized avcodec with %zu decode workers", decoder->num_workers);
+		return 0;
+	}
+
+	decoder->context = open_context(decoder->codec, decode_threads());
 	if (!decoder->context) {
 		return -1;
 	}
@@ -53,14 +204,7 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 		return -1;
 	}
 
-	decoder->context->flags2 |= AV_CODEC_FLAG2_FAST;
-
-	if (avcodec_open2(decoder->context, decoder->codec, NULL) < 0) {
-		blog(LOG_ERROR, "failed to open codec");
-		return -1;
-	}
-
-	blog(LOG_DEBUG, "initialized avcodec");
+	blog(LOG_DEBUG, "initialized avcodec with %d threads", decoder->context->thread_count);
 
 	return 0;
 }
@@ -68,6 +212,22 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt)
 void v4l2_destroy_decoder(struct v4l2_decoder *decoder)
 {
 	blog(LOG_DEBUG, "destroying avcodec");
+
+	if (decoder->frames) {
+		blog(LOG_INFO,
+		     "decoded %" PRIu64 "/%" PRIu64 " frames, avg copy: %.2f ms, "
+		     "avg send: %.2f ms, avg latency: %.2f ms, max latency: %.2f ms",
+		     decoder->frames, decoder->packets, (double)decoder->copy_ns / decoder->packets / 1000000.0,
+		     (double)decoder->send_ns / decoder->packets / 1000000.0,
+		     (double)decoder->latency_ns / decoder->frames / 1000000.0,
+		     (double)decoder->latency_max_ns / 1000000.0);
+	}
+
+	for (size_t i = 0; i < decoder->num_workers; i++) {
+		destroy_worker(&decoder->workers[i]);
+	}
+	decoder->num_workers = 0;
+
 	if (decoder->frame) {
 		av_frame_free(&decoder->frame);
 	}
@@ -76,34 +236,44 @@ void v4l2_destroy_decoder(struct v4l2_decoder *decoder)
 		av_packet_free(&decoder->packet);
 	}
 
-	if (decoder->context) {
-#if LIBAVCODEC_VERSION_MAJOR < 61
-		avcodec_close(decoder->context);
-#endif
-		avcodec_free_context(&decoder->context);
-	}
+	close_context(&decoder->context);
 }
 
-int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length, struct v4l2_decoder *decoder)
+/* the worker that decodes the next packet is always free when no packet is
+ * being sent, v4l2_decode_packet waits for it */
+static inline struct v4l2_decode_worker *next_worker(struct v4l2_decoder *decoder)
 {
-	decoder->packet->data = data;
-	decoder->packet->size = length;
-	if (avcodec_send_packet(decoder->context, decoder->packet) < 0) {
-		blog(LOG_ERROR, "failed to send frame to codec");
-		return -1;
-	}
+	return &decoder->workers[decoder->submitted % decoder->num_workers];
+}
+
+int v4l2_copy_packet(struct v4l2_decoder *decoder, uint8_t *data, size_t length, uint64_t timestamp)
+{
+	uint64_t start = os_gettime_ns();
+	AVPacket *packet = decoder->num_workers ? next_worker(decoder)->packet : decoder->packet;
 
-	if (avcodec_receive_frame(decoder->context, decoder->frame) < 0) {
-		blog(LOG_ERROR, "failed to receive frame from codec");
+	/* a refcounted copy, the codec's frame threads keep a reference to it
+	 * instead of copying it again */
+	av_packet_unref(packet);
+	if (av_new_packet(packet, (int)length) < 0) {
+		blog(LOG_ERROR, "failed to allocate packet");
 		return -1;
 	}
 
+	memcpy(packet->data, data, length);
+	packet->pts = (int64_t)timestamp;
+
+	decoder->copy_ns += os_gettime_ns() - start;
+	return 0;
+}
+
+static void set_frame_format(struct obs_source_frame *out, const AVFrame *frame)
+{
 	for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i) {
-		out->data[i] = decoder->frame->data[i];
-		out->linesize[i] = decoder->frame->linesize[i];
+		out->data[i] = frame->data[i];
+		out->linesize[i] = frame->linesize[i];
 	}
 
-	switch (decoder->context->pix_fmt) {
+	switch (frame->format) {
 	case AV_PIX_FMT_GRAY8:
 		out->format = VIDEO_FORMAT_Y800;
 		break;
@@ -122,6 +292,129 @@ int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length
 	default:
 		break;
 	}
+}
 
-	return 0;
+static void update_latency(struct v4l2_decoder *decoder, int64_t pts, uint64_t now)
+{
+	for (size_t i = 0; i < V4L2_DECODER_TS_RING; i++) {
+		if (decoder->ts_ring[i].pts == pts && decoder->ts_ring[i].submit_ts) {
+			uint64_t latency = now - decoder->ts_ring[i].submit_ts;
+			decoder->latency_ns += latency;
+			if (latency > decoder->latency_max_ns)
+				decoder->latency_max_ns = latency;
+			decoder->ts_ring[i].submit_ts = 0;
+			break;
+		}
+	}
+}
+
+static void output_frame(struct v4l2_decoder *decoder, const AVFrame *frame, obs_source_t *source,
+			 struct obs_source_frame *out)
+{
+	update_latency(decoder, frame->pts, os_gettime_ns());
+	decoder->frames++;
+
+	set_frame_format(out, frame);
+	out->timestamp = (uint64_t)frame->pts;
+	obs_source_output_video(source, out);
+}
+
+/* outputs the frames of the workers in the order their packets were sent,
+ * stopping at the first one that isn't done unless all of the workers are
+ * busy or the decoder is flushed */
+static int output_worker_frames(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out,
+				bool flush)
+{
+	int ret = 0;
+
+	while (decoder->delivered < decoder->submitted) {
+		struct v4l2_decode_worker *worker = &decoder->workers[decoder->delivered % decoder->num_workers];
+
+		if (flush) {
+			os_event_wait(worker->done);
+		} else if (decoder->submitted - decoder->delivered == decoder->num_workers) {
+			uint64_t start = os_gettime_ns();
+			os_event_wait(worker->done);
+			decoder->send_ns += os_gettime_ns() - start;
+		} else if (os_event_try(worker->done) != 0) {
+			break;
+		}
+
+		decoder->delivered++;
+
+		if (worker->ret < 0) {
+			blog(LOG_ERROR, "failed to decode frame");
+			ret = -1;
+			continue;
+		}
+
+		output_frame(decoder, worker->frame, source, out);
+	}
+
+	return ret;
+}
+
+static int receive_frames(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out)
+{
+	for (;;) {
+		int ret = avcodec_receive_frame(decoder->context, decoder->frame);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+			return 0;
+		if (ret < 0) {
+			blog(LOG_ERROR, "failed to receive frame from codec");
+			return -1;
+		}
+
+		output_frame(decoder, decoder->frame, source, out);
+	}
+}
+
+int v4l2_decode_packet(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out)
+{
+	uint64_t start = os_gettime_ns();
+	size_t pos = decoder->ts_ring_pos++ % V4L2_DECODER_TS_RING;
+	int ret;
+
+	decoder->packets++;
+
+	if (decoder->num_workers) {
+		struct v4l2_decode_worker *worker = next_worker(decoder);
+
+		decoder->ts_ring[pos].pts = worker->packet->pts;
+		decoder->ts_ring[pos].submit_ts = start;
+
+		decoder->submitted++;
+		os_sem_post(worker->work);
+
+		/* the next packet goes to the oldest worker, so this also
+		 * waits for it if all of them are busy */
+		return output_worker_frames(decoder, source, out, false);
+	}
+
+	decoder->ts_ring[pos].pts = decoder->packet->pts;
+	decoder->ts_ring[pos].submit_ts = start;
+
+	ret = avcodec_send_packet(decoder->context, decoder->packet);
+	av_packet_unref(decoder->packet);
+	if (ret < 0) {
+		blog(LOG_ERROR, "failed to send frame to codec");
+		return -1;
+	}
+
+	decoder->send_ns += os_gettime_ns() - start;
+
+	return receive_frames(decoder, source, out);
+}
+
+int v4l2_flush_decoder(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out)
+{
+	if (decoder->num_workers) {
+		return output_worker_frames(decoder, source, out, true);
+	}
+
+	if (avcodec_send_packet(decoder->context, NULL) < 0) {
+		return -1;
+	}
+
+	return receive_frames(decoder, source, out);
 }
@@ -24,6 +24,26 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/pixfmt.h>
+#include <util/threading.h>
+
+#define V4L2_DECODER_TS_RING 32
+#define V4L2_DECODER_MAX_WORKERS 4
+
+/**
+ * A decode thread with its own single threaded codec context
+ */
+struct v4l2_decode_worker {
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	int ret;
+
+	pthread_t thread;
+	bool thread_created;
+	volatile bool stop;
+	os_sem_t *work;
+	os_event_t *done;
+};
 
 /**
  * Data structure for decoder
@@ -33,6 +53,29 @@ struct v4l2_decoder {
 	AVCodecContext *context;
 	AVPacket *packet;
 	AVFrame *frame;
+
+	/* mjpeg frames don't depend on each other, so instead of one context
+	 * they are decoded by a pool of workers, taking turns, and output in
+	 * the order they were captured */
+	struct v4l2_decode_worker workers[V4L2_DECODER_MAX_WORKERS];
+	size_t num_workers;
+	uint64_t submitted;
+	uint64_t delivered;
+
+	/* submit time of recent packets by pts, for the latency counters */
+	struct {
+		int64_t pts;
+		uint64_t submit_ts;
+	} ts_ring[V4L2_DECODER_TS_RING];
+	size_t ts_ring_pos;
+
+	/* per-stage counters, logged when the decoder is destroyed */
+	uint64_t packets;
+	uint64_t frames;
+	uint64_t copy_ns;
+	uint64_t send_ns;
+	uint64_t latency_ns;
+	uint64_t latency_max_ns;
 };
 
 /**
@@ -53,15 +96,41 @@ int v4l2_init_decoder(struct v4l2_decoder *decoder, int pixfmt);
 void v4l2_destroy_decoder(struct v4l2_decoder *decoder);
 
 /**
- * Decode a jpeg or h264 frame into an obs frame
+ * Copy a jpeg or h264 frame into the decoder's packet.
+ * This is the only step that needs the capture buffer, it can be requeued
+ * right after.
  *
- * @param out the obs frame to decode into
+ * @param decoder the decoder as initialized by v4l2_init_decoder
  * @param data the codec data
  * @param length length of the data
+ * @param timestamp the timestamp of the frame
+ * @return non-zero on failure
+ */
+int v4l2_copy_packet(struct v4l2_decoder *decoder, uint8_t *data, size_t length, uint64_t timestamp);
+
+/**
+ * Send the copied packet to the decoder and output all frames that have
+ * finished decoding.
+ * Decoding happens on worker threads, so frames come out in order but may
+ * lag a few packets behind.
+ *
+ * @param decoder the decoder as initialized by v4l2_init_decoder
+ * @param source the source to output the decoded frames to
+ * @param out the prepared obs frame, data and format are filled per frame
+ * @return non-zero on failure
+ */
+int v4l2_decode_packet(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out);
+
+/**
+ * Wait for the packets that are still being decoded and output their frames.
+ * Used when the capture stops, no packets can be sent afterwards.
+ *
  * @param decoder the decoder as initialized by v4l2_init_decoder
+ * @param source the source to output the decoded frames to
+ * @param out the prepared obs frame, data and format are filled per frame
  * @return non-zero on failure
  */
-int v4l2_decode_frame(struct obs_source_frame *out, uint8_t *data, size_t length, struct v4l2_decoder *decoder);
+int v4l2_flush_decoder(struct v4l2_decoder *decoder, obs_source_t *source, struct obs_source_frame *out);
 
 #ifdef __cplusplus
 }
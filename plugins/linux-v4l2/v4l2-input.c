@@ -254,14 +254,27 @@ static void *v4l2_thread(void *vptr)
 		start = (uint8_t *)data->buffers.info[buf.index].start;
 
 		if (data->pixfmt == V4L2_PIX_FMT_MJPEG || data->pixfmt == V4L2_PIX_FMT_H264) {
-			if (v4l2_decode_frame(&out, start, buf.bytesused, &data->decoder) < 0) {
+			/* only hold the capture buffer for the copy, decoding
+			 * happens after it has been requeued */
+			if (v4l2_copy_packet(&data->decoder, start, buf.bytesused, out.timestamp) < 0)
+				break;
+
+			if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
+				blog(LOG_ERROR, "%s: failed to enqueue buffer", data->device_id);
+				break;
+			}
+
+			if (v4l2_decode_packet(&data->decoder, data->source, &out) < 0) {
 				blog(LOG_ERROR, "failed to unpack jpeg or h264");
 				break;
 			}
-		} else {
-			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
-				out.data[i] = start + plane_offsets[i];
+
+			frames++;
+			continue;
 		}
+
+		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
+			out.data[i] = start + plane_offsets[i];
 		obs_source_output_video(data->source, &out);
 
 		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
@@ -272,6 +285,9 @@ static void *v4l2_thread(void *vptr)
 		frames++;
 	}
 
+	if (data->pixfmt == V4L2_PIX_FMT_MJPEG || data->pixfmt == V4L2_PIX_FMT_H264)
+		v4l2_flush_decoder(&data->decoder, data->source, &out);
+
 	blog(LOG_INFO, "%s: Stopped capture after %" PRIu64 " frames", data->device_id, frames);
 
 exit:
@@ -3,18 +3,73 @@
 #include <obs-module.h>
 #include <util/dstr.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include "shared-memory-queue.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <errno.h>
 #include <string.h>
 
+#define VCAM_BUFFER_COUNT 4
+
+enum vcam_buffer_state {
+	VCAM_BUFFER_FREE,
+	VCAM_BUFFER_FILLING,
+	VCAM_BUFFER_READY,
+	VCAM_BUFFER_QUEUED,
+};
+
+struct vcam_buffer {
+	uint8_t *data;
+	size_t length;
+	uint64_t timestamp;
+	enum vcam_buffer_state state;
+};
+
 struct virtualcam_data {
 	obs_output_t *output;
+
+	/* deliver frames through the shared memory video queue instead of
+	 * v4l2loopback */
+	bool use_queue;
+	video_queue_t *vq;
+
 	int device;
 	uint32_t frame_size;
+	uint32_t height;
+	uint32_t row_size;
+	uint32_t linesize;
+
+	/* MMAP streaming I/O, or write() when the device does not support it */
+	bool mmap_io;
+	struct vcam_buffer buffers[VCAM_BUFFER_COUNT];
+	uint32_t buffer_count;
+	uint32_t queued;
+
+	/* buffers filled by the video thread, oldest first */
+	pthread_mutex_t mutex;
+	uint32_t ready[VCAM_BUFFER_COUNT];
+	uint32_t ready_head;
+	uint32_t ready_count;
+
+	os_sem_t *ready_sem;
+	pthread_t thread;
+	bool thread_active;
+	volatile bool stopping;
+
+	volatile long total_frames;
+	volatile long dropped_frames;
+
+	/* held by virtual_video while it writes a frame.  Raw video is only
+	 * disconnected some time after obs_output_end_data_capture, so stop
+	 * clears video_active under it before tearing anything down */
+	pthread_mutex_t video_mutex;
+	bool video_active;
 };
 
 static const char *virtualcam_name(void *unused)
@@ -27,6 +82,8 @@ static void virtualcam_destroy(void *data)
 {
 	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
 	close(vcam->device);
+	pthread_mutex_destroy(&vcam->video_mutex);
+	pthread_mutex_destroy(&vcam->mutex);
 	bfree(data);
 }
 
@@ -95,6 +152,28 @@ bool loopback_module_available()
 	return false;
 }
 
+/* The shared memory queue is only read by local consumers that know about
+ * it, so it has to be asked for explicitly and is never a stand-in for a
+ * missing v4l2loopback. */
+static bool shared_memory_requested = false;
+
+bool shared_memory_queue_requested()
+{
+	const char *env = getenv("OBS_VIRTUALCAM_SHARED_MEMORY");
+
+	if (!env || !*env || strcmp(env, "0") == 0)
+		return false;
+
+	/* shm_open objects live in /dev/shm */
+	if (access("/dev/shm", R_OK | W_OK) != 0) {
+		blog(LOG_WARNING, "OBS_VIRTUALCAM_SHARED_MEMORY is set, but /dev/shm is not usable");
+		return false;
+	}
+
+	shared_memory_requested = true;
+	return true;
+}
+
 static int loopback_module_load()
 {
 	return run_command(
@@ -106,10 +185,288 @@ static void *virtualcam_create(obs_data_t *settings, obs_output_t *output)
 	struct virtualcam_data *vcam = (struct virtualcam_data *)bzalloc(sizeof(*vcam));
 	vcam->output = output;
 
-	UNUSED_PARAMETER(settings);
+	if (pthread_mutex_init(&vcam->mutex, NULL) != 0) {
+		bfree(vcam);
+		return NULL;
+	}
+	if (pthread_mutex_init(&vcam->video_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&vcam->mutex);
+		bfree(vcam);
+		return NULL;
+	}
+
+	vcam->use_queue = shared_memory_requested || obs_data_get_bool(settings, "shared_memory");
 	return vcam;
 }
 
+static void virtualcam_update(void *data, obs_data_t *settings)
+{
+	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
+	vcam->use_queue = shared_memory_requested || obs_data_get_bool(settings, "shared_memory");
+}
+
+static void virtualcam_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_bool(settings, "shared_memory", false);
+}
+
+static void set_video_active(struct virtualcam_data *vcam, bool active)
+{
+	pthread_mutex_lock(&vcam->video_mutex);
+	vcam->video_active = active;
+	pthread_mutex_unlock(&vcam->video_mutex);
+}
+
+static bool start_queue(struct virtualcam_data *vcam)
+{
+	uint32_t width = obs_output_get_width(vcam->output);
+	uint32_t height = obs_output_get_height(vcam->output);
+
+	struct obs_video_info ovi;
+	obs_get_video_info(&ovi);
+
+	/* 100ns units, as on Windows */
+	uint64_t interval = ovi.fps_den * 10000000ULL / ovi.fps_num;
+
+	vcam->vq = video_queue_create(width, height, interval);
+	if (!vcam->vq) {
+		blog(LOG_WARNING, "Failed to create the virtual camera video queue (%s)", strerror(errno));
+		return false;
+	}
+
+	struct video_scale_info vsi = {0};
+	vsi.format = VIDEO_FORMAT_NV12;
+	vsi.width = width;
+	vsi.height = height;
+	obs_output_set_video_conversion(vcam->output, &vsi);
+
+	blog(LOG_INFO, "Virtual camera started (shared memory queue)");
+	set_video_active(vcam, true);
+	obs_output_begin_data_capture(vcam->output, 0);
+	return true;
+}
+
+static void free_buffers(struct virtualcam_data *vcam)
+{
+	for (uint32_t i = 0; i < vcam->buffer_count; i++) {
+		struct vcam_buffer *buffer = &vcam->buffers[i];
+
+		if (vcam->mmap_io)
+			munmap(buffer->data, buffer->length);
+		else
+			bfree(buffer->data);
+	}
+
+	if (vcam->mmap_io) {
+		struct v4l2_requestbuffers req = {0};
+		req.count = 0;
+		req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		req.memory = V4L2_MEMORY_MMAP;
+		ioctl(vcam->device, VIDIOC_REQBUFS, &req);
+	}
+
+	memset(vcam->buffers, 0, sizeof(vcam->buffers));
+	vcam->buffer_count = 0;
+	vcam->mmap_io = false;
+}
+
+static bool map_buffers(struct virtualcam_data *vcam)
+{
+	struct v4l2_requestbuffers req = {0};
+	req.count = VCAM_BUFFER_COUNT;
+	req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	req.memory = V4L2_MEMORY_MMAP;
+
+	if (ioctl(vcam->device, VIDIOC_REQBUFS, &req) < 0)
+		return false;
+
+	vcam->mmap_io = true;
+
+	if (req.count < 2)
+		goto fail;
+
+	for (uint32_t i = 0; i < req.count && i < VCAM_BUFFER_COUNT; i++) {
+		struct v4l2_buffer buf = {0};
+		buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index = i;
+
+		if (ioctl(vcam->device, VIDIOC_QUERYBUF, &buf) < 0 || buf.length < vcam->frame_size)
+			goto fail;
+
+		void *data = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, vcam->device, buf.m.offset);
+		if (data == MAP_FAILED)
+			goto fail;
+
+		vcam->buffers[i].data = data;
+		vcam->buffers[i].length = buf.length;
+		vcam->buffer_count++;
+	}
+
+	return true;
+
+fail:
+	free_buffers(vcam);
+	return false;
+}
+
+static void alloc_buffers(struct virtualcam_data *vcam)
+{
+	for (uint32_t i = 0; i < VCAM_BUFFER_COUNT; i++) {
+		vcam->buffers[i].data = bmalloc(vcam->frame_size);
+		vcam->buffers[i].length = vcam->frame_size;
+	}
+
+	vcam->buffer_count = VCAM_BUFFER_COUNT;
+	vcam->mmap_io = false;
+}
+
+static void write_buffer(struct virtualcam_data *vcam, struct vcam_buffer *buffer)
+{
+	const uint8_t *data = buffer->data;
+	uint32_t frame_size = vcam->frame_size;
+
+	while (frame_size > 0) {
+		ssize_t written = write(vcam->device, data, frame_size);
+		if (written == -1)
+			break;
+		data += written;
+		frame_size -= written;
+	}
+
+	pthread_mutex_lock(&vcam->mutex);
+	buffer->state = VCAM_BUFFER_FREE;
+	pthread_mutex_unlock(&vcam->mutex);
+}
+
+/* Reclaims buffers the device has finished with.  Blocks while every buffer
+ * is queued, since the video thread has nothing left to fill. */
+static void dequeue_buffers(struct virtualcam_data *vcam)
+{
+	while (vcam->queued && !os_atomic_load_bool(&vcam->stopping)) {
+		struct pollfd pfd = {.fd = vcam->device, .events = POLLOUT};
+		int timeout = vcam->queued == vcam->buffer_count ? 100 : 0;
+		int ret = poll(&pfd, 1, timeout);
+
+		if (ret < 0 && errno != EINTR)
+			break;
+		if (ret == 0) {
+			if (timeout == 0)
+				break;
+			continue;
+		}
+		if (ret < 0)
+			continue;
+
+		struct v4l2_buffer buf = {0};
+		buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buf.memory = V4L2_MEMORY_MMAP;
+
+		if (ioctl(vcam->device, VIDIOC_DQBUF, &buf) < 0 || buf.index >= vcam->buffer_count)
+			break;
+
+		pthread_mutex_lock(&vcam->mutex);
+		vcam->buffers[buf.index].state = VCAM_BUFFER_FREE;
+		pthread_mutex_unlock(&vcam->mutex);
+		vcam->queued--;
+	}
+}
+
+static void queue_buffer(struct virtualcam_data *vcam, uint32_t idx)
+{
+	struct vcam_buffer *buffer = &vcam->buffers[idx];
+	struct v4l2_buffer buf = {0};
+
+	buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = idx;
+	buf.bytesused = vcam->frame_size;
+	buf.field = V4L2_FIELD_NONE;
+	buf.flags = V4L2_BUF_FLAG_TIMESTAMP_COPY;
+	buf.timestamp.tv_sec = buffer->timestamp / 1000000000;
+	buf.timestamp.tv_usec = (buffer->timestamp % 1000000000) / 1000;
+
+	if (ioctl(vcam->device, VIDIOC_QBUF, &buf) < 0) {
+		blog(LOG_DEBUG, "v4l2-output: Failed to queue buffer (%s)", strerror(errno));
+		os_atomic_inc_long(&vcam->dropped_frames);
+
+		pthread_mutex_lock(&vcam->mutex);
+		buffer->state = VCAM_BUFFER_FREE;
+		pthread_mutex_unlock(&vcam->mutex);
+	} else {
+		vcam->queued++;
+	}
+
+	dequeue_buffers(vcam);
+}
+
+static void *virtualcam_thread(void *data)
+{
+	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
+
+	os_set_thread_name("v4l2-output: I/O");
+
+	while (os_sem_wait(vcam->ready_sem) == 0) {
+		uint32_t idx;
+
+		if (os_atomic_load_bool(&vcam->stopping))
+			break;
+
+		pthread_mutex_lock(&vcam->mutex);
+		if (!vcam->ready_count) {
+			pthread_mutex_unlock(&vcam->mutex);
+			continue;
+		}
+		idx = vcam->ready[vcam->ready_head];
+		vcam->ready_head = (vcam->ready_head + 1) % VCAM_BUFFER_COUNT;
+		vcam->ready_count--;
+		vcam->buffers[idx].state = VCAM_BUFFER_QUEUED;
+		pthread_mutex_unlock(&vcam->mutex);
+
+		if (vcam->mmap_io)
+			queue_buffer(vcam, idx);
+		else
+			write_buffer(vcam, &vcam->buffers[idx]);
+	}
+
+	return NULL;
+}
+
+static bool start_io_thread(struct virtualcam_data *vcam)
+{
+	vcam->ready_head = 0;
+	vcam->ready_count = 0;
+	vcam->queued = 0;
+	os_atomic_set_bool(&vcam->stopping, false);
+	os_atomic_set_long(&vcam->total_frames, 0);
+	os_atomic_set_long(&vcam->dropped_frames, 0);
+
+	if (os_sem_init(&vcam->ready_sem, 0) != 0)
+		return false;
+
+	if (pthread_create(&vcam->thread, NULL, virtualcam_thread, vcam) != 0) {
+		os_sem_destroy(vcam->ready_sem);
+		vcam->ready_sem = NULL;
+		return false;
+	}
+
+	vcam->thread_active = true;
+	return true;
+}
+
+static void stop_io_thread(struct virtualcam_data *vcam)
+{
+	if (!vcam->thread_active)
+		return;
+
+	os_atomic_set_bool(&vcam->stopping, true);
+	os_sem_post(vcam->ready_sem);
+	pthread_join(vcam->thread, NULL);
+	os_sem_destroy(vcam->ready_sem);
+	vcam->ready_sem = NULL;
+	vcam->thread_active = false;
+}
+
 static bool try_connect(void *data, const char *device)
 {
 	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
@@ -120,6 +477,9 @@ static bool try_connect(void *data, const char *device)
 	uint32_t width = obs_output_get_width(vcam->output);
 	uint32_t height = obs_output_get_height(vcam->output);
 
+	vcam->height = height;
+	vcam->row_size = width * 2;
+	vcam->linesize = vcam->row_size;
 	vcam->frame_size = width * height * 2;
 
 	vcam->device = open(device, O_RDWR);
@@ -156,6 +516,16 @@ static bool try_connect(void *data, const char *device)
 	if (ioctl(vcam->device, VIDIOC_S_FMT, &format) < 0)
 		goto fail_close_device;
 
+	if (format.fmt.pix.bytesperline > vcam->row_size) {
+		vcam->linesize = format.fmt.pix.bytesperline;
+		vcam->frame_size = vcam->linesize * height;
+	}
+
+	if (!(capability.capabilities & V4L2_CAP_STREAMING) || !map_buffers(vcam)) {
+		blog(LOG_INFO, "v4l2-output: Streaming I/O unavailable, using write()");
+		alloc_buffers(vcam);
+	}
+
 	struct video_scale_info vsi = {0};
 	vsi.format = VIDEO_FORMAT_YUY2;
 	vsi.width = width;
@@ -167,14 +537,24 @@ static bool try_connect(void *data, const char *device)
 
 	if (ioctl(vcam->device, VIDIOC_STREAMON, &parm) < 0) {
 		blog(LOG_ERROR, "Failed to start streaming on '%s' (%s)", device, strerror(errno));
-		goto fail_close_device;
+		goto fail_free_buffers;
+	}
+
+	if (!start_io_thread(vcam)) {
+		blog(LOG_ERROR, "Failed to start virtual camera I/O thread");
+		ioctl(vcam->device, VIDIOC_STREAMOFF, &parm);
+		goto fail_free_buffers;
 	}
 
-	blog(LOG_INFO, "Virtual camera started");
+	blog(LOG_INFO, "Virtual camera started (%s I/O, %u buffers)", vcam->mmap_io ? "mmap" : "write",
+	     vcam->buffer_count);
+	set_video_active(vcam, true);
 	obs_output_begin_data_capture(vcam->output, 0);
 
 	return true;
 
+fail_free_buffers:
+	free_buffers(vcam);
 fail_close_device:
 	close(vcam->device);
 	return false;
@@ -192,6 +572,9 @@ static bool virtualcam_start(void *data)
 	bool success = false;
 	int n;
 
+	if (vcam->use_queue)
+		return start_queue(vcam);
+
 	if (!loopback_module_loaded()) {
 		if (loopback_module_load() != 0)
 			return false;
@@ -237,6 +620,16 @@ static void virtualcam_stop(void *data, uint64_t ts)
 {
 	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
 	obs_output_end_data_capture(vcam->output);
+	set_video_active(vcam, false);
+
+	if (vcam->vq) {
+		video_queue_close(vcam->vq);
+		vcam->vq = NULL;
+		blog(LOG_INFO, "Virtual camera stopped");
+		return;
+	}
+
+	stop_io_thread(vcam);
 
 	struct v4l2_streamparm parm = {0};
 	parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
@@ -245,22 +638,91 @@ static void virtualcam_stop(void *data, uint64_t ts)
 		blog(LOG_WARNING, "Failed to stop streaming on video device %d (%s)", vcam->device, strerror(errno));
 	}
 
+	free_buffers(vcam);
 	close(vcam->device);
-	blog(LOG_INFO, "Virtual camera stopped");
+	blog(LOG_INFO, "Virtual camera stopped, %ld of %ld frames dropped", os_atomic_load_long(&vcam->dropped_frames),
+	     os_atomic_load_long(&vcam->total_frames));
 
 	UNUSED_PARAMETER(ts);
 }
 
+/* Returns a buffer to fill, reusing the oldest frame not yet handed to the
+ * device when none are free.  Must be called with the mutex held. */
+static struct vcam_buffer *acquire_buffer(struct virtualcam_data *vcam, bool *dropped)
+{
+	for (uint32_t i = 0; i < vcam->buffer_count; i++) {
+		if (vcam->buffers[i].state == VCAM_BUFFER_FREE)
+			return &vcam->buffers[i];
+	}
+
+	if (vcam->ready_count) {
+		uint32_t idx = vcam->ready[vcam->ready_head];
+		vcam->ready_head = (vcam->ready_head + 1) % VCAM_BUFFER_COUNT;
+		vcam->ready_count--;
+		*dropped = true;
+		return &vcam->buffers[idx];
+	}
+
+	*dropped = true;
+	return NULL;
+}
+
 static void virtual_video(void *param, struct video_data *frame)
 {
 	struct virtualcam_data *vcam = (struct virtualcam_data *)param;
-	uint32_t frame_size = vcam->frame_size;
-	while (frame_size > 0) {
-		ssize_t written = write(vcam->device, frame->data[0], vcam->frame_size);
-		if (written == -1)
-			break;
-		frame_size -= written;
+	struct vcam_buffer *buffer;
+	bool dropped = false;
+
+	pthread_mutex_lock(&vcam->video_mutex);
+	if (!vcam->video_active) {
+		pthread_mutex_unlock(&vcam->video_mutex);
+		return;
+	}
+
+	if (vcam->vq) {
+		video_queue_write(vcam->vq, frame->data, frame->linesize, frame->timestamp);
+		pthread_mutex_unlock(&vcam->video_mutex);
+		return;
 	}
+
+	os_atomic_inc_long(&vcam->total_frames);
+
+	pthread_mutex_lock(&vcam->mutex);
+	buffer = acquire_buffer(vcam, &dropped);
+	if (buffer)
+		buffer->state = VCAM_BUFFER_FILLING;
+	pthread_mutex_unlock(&vcam->mutex);
+
+	if (dropped)
+		os_atomic_inc_long(&vcam->dropped_frames);
+	if (!buffer) {
+		pthread_mutex_unlock(&vcam->video_mutex);
+		return;
+	}
+
+	if (frame->linesize[0] == vcam->linesize) {
+		memcpy(buffer->data, frame->data[0], vcam->frame_size);
+	} else {
+		for (uint32_t y = 0; y < vcam->height; y++)
+			memcpy(buffer->data + y * vcam->linesize, frame->data[0] + y * frame->linesize[0],
+			       vcam->row_size);
+	}
+	buffer->timestamp = frame->timestamp;
+
+	pthread_mutex_lock(&vcam->mutex);
+	buffer->state = VCAM_BUFFER_READY;
+	vcam->ready[(vcam->ready_head + vcam->ready_count) % VCAM_BUFFER_COUNT] = (uint32_t)(buffer - vcam->buffers);
+	vcam->ready_count++;
+	pthread_mutex_unlock(&vcam->mutex);
+
+	os_sem_post(vcam->ready_sem);
+	pthread_mutex_unlock(&vcam->video_mutex);
+}
+
+static int virtualcam_dropped_frames(void *data)
+{
+	struct virtualcam_data *vcam = (struct virtualcam_data *)data;
+	return (int)os_atomic_load_long(&vcam->dropped_frames);
 }
 
 struct obs_output_info virtualcam_info = {
@@ -271,5 +733,8 @@ struct obs_output_info virtualcam_info = {
 	.destroy = virtualcam_destroy,
 	.start = virtualcam_start,
 	.stop = virtualcam_stop,
+	.update = virtualcam_update,
+	.get_defaults = virtualcam_defaults,
 	.raw_video = virtual_video,
+	.get_dropped_frames = virtualcam_dropped_frames,
 };
@@ -451,19 +451,24 @@ static void *color_correction_filter_create_v1(obs_data_t *settings, obs_source_
 	matrix4_identity(&filter->bright_matrix);
 	matrix4_identity(&filter->color_matrix);
 
-	/* Here we enter the GPU drawing/shader portion of our code. */
-	obs_enter_graphics();
+	/*
+	 * Here we enter the GPU drawing/shader portion of our code, unless
+	 * there is no GPU and the filter is applied on the CPU instead.
+	 */
+	if (!obs_cpu_compositing_active()) {
+		obs_enter_graphics();
 
-	/* Load the shader on the GPU. */
-	filter->effect = gs_effect_create_from_file(effect_path, NULL);
+		/* Load the shader on the GPU. */
+		filter->effect = gs_effect_create_from_file(effect_path, NULL);
 
-	/* If the filter is active pass the parameters to the filter. */
-	if (filter->effect) {
-		filter->gamma_param = gs_effect_get_param_by_name(filter->effect, SETTING_GAMMA);
-		filter->final_matrix_param = gs_effect_get_param_by_name(filter->effect, "color_matrix");
-	}
+		/* If the filter is active pass the parameters to the filter. */
+		if (filter->effect) {
+			filter->gamma_param = gs_effect_get_param_by_name(filter->effect, SETTING_GAMMA);
+			filter->final_matrix_param = gs_effect_get_param_by_name(filter->effect, "color_matrix");
+		}
 
-	obs_leave_graphics();
+		obs_leave_graphics();
+	}
 
 	bfree(effect_path);
 
@@ -472,7 +477,7 @@ static void *color_correction_filter_create_v1(obs_data_t *settings, obs_source_
 	 * and exit out so we don't crash OBS by telling it to update
 	 * values that don't exist anymore.
 	 */
-	if (!filter->effect) {
+	if (!filter->effect && !obs_cpu_compositing_active()) {
 		color_correction_filter_destroy_v1(filter);
 		return NULL;
 	}
@@ -509,19 +514,24 @@ static void *color_correction_filter_create_v2(obs_data_t *settings, obs_source_
 	matrix4_identity(&filter->bright_matrix);
 	matrix4_identity(&filter->color_matrix);
 
-	/* Here we enter the GPU drawing/shader portion of our code. */
-	obs_enter_graphics();
+	/*
+	 * Here we enter the GPU drawing/shader portion of our code, unless
+	 * there is no GPU and the filter is applied on the CPU instead.
+	 */
+	if (!obs_cpu_compositing_active()) {
+		obs_enter_graphics();
 
-	/* Load the shader on the GPU. */
-	filter->effect = gs_effect_create_from_file(effect_path, NULL);
+		/* Load the shader on the GPU. */
+		filter->effect = gs_effect_create_from_file(effect_path, NULL);
 
-	/* If the filter is active pass the parameters to the filter. */
-	if (filter->effect) {
-		filter->gamma_param = gs_effect_get_param_by_name(filter->effect, SETTING_GAMMA);
-		filter->final_matrix_param = gs_effect_get_param_by_name(filter->effect, "color_matrix");
-	}
+		/* If the filter is active pass the parameters to the filter. */
+		if (filter->effect) {
+			filter->gamma_param = gs_effect_get_param_by_name(filter->effect, SETTING_GAMMA);
+			filter->final_matrix_param = gs_effect_get_param_by_name(filter->effect, "color_matrix");
+		}
 
-	obs_leave_graphics();
+		obs_leave_graphics();
+	}
 
 	bfree(effect_path);
 
@@ -530,7 +540,7 @@ static void *color_correction_filter_create_v2(obs_data_t *settings, obs_source_
 	 * and exit out so we don't crash OBS by telling it to update
 	 * values that don't exist anymore.
 	 */
-	if (!filter->effect) {
+	if (!filter->effect && !obs_cpu_compositing_active()) {
 		color_correction_filter_destroy_v2(filter);
 		return NULL;
 	}
@@ -600,6 +610,57 @@ static void color_correction_filter_render_v2(void *data, gs_effect_t *effect)
 	}
 }
 
+/*
+ * Without a GPU, the same math as the shader is done on the CPU: the colors
+ * are unpremultiplied (the image already has straight alpha), gamma is applied
+ * and the pixel is multiplied by the final matrix.
+ */
+static void color_correction_filter_apply_cpu(float gamma, const struct matrix4 *matrix,
+					      const struct obs_cpu_image *input, struct obs_cpu_image *output)
+{
+	const struct vec4 *rows[4] = {&matrix->x, &matrix->y, &matrix->z, &matrix->t};
+	float gamma_table[256];
+
+	for (int i = 0; i < 256; i++)
+		gamma_table[i] = powf((float)i / 255.0f, gamma);
+
+	for (uint32_t y = 0; y < output->height; y++) {
+		const uint8_t *src = input->data + (size_t)y * input->linesize;
+		uint8_t *dst = output->data + (size_t)y * output->linesize;
+
+		for (uint32_t x = 0; x < output->width; x++, src += 4, dst += 4) {
+			float pixel[4] = {0.0f, 0.0f, 0.0f, (float)src[3] / 255.0f};
+
+			if (src[3]) {
+				pixel[0] = gamma_table[src[0]];
+				pixel[1] = gamma_table[src[1]];
+				pixel[2] = gamma_table[src[2]];
+			}
+
+			for (int c = 0; c < 4; c++) {
+				float val = pixel[0] * rows[0]->ptr[c] + pixel[1] * rows[1]->ptr[c] +
+					    pixel[2] * rows[2]->ptr[c] + pixel[3] * rows[3]->ptr[c];
+				val = val < 0.0f ? 0.0f : (val > 1.0f ? 1.0f : val);
+				dst[c] = (uint8_t)(val * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+static void color_correction_filter_render_cpu_v1(void *data, const struct obs_cpu_image *input,
+						  struct obs_cpu_image *output)
+{
+	struct color_correction_filter_data *filter = data;
+	color_correction_filter_apply_cpu(filter->gamma, &filter->final_matrix, input, output);
+}
+
+static void color_correction_filter_render_cpu_v2(void *data, const struct obs_cpu_image *input,
+						  struct obs_cpu_image *output)
+{
+	struct color_correction_filter_data_v2 *filter = data;
+	color_correction_filter_apply_cpu(filter->gamma, &filter->final_matrix, input, output);
+}
+
 /*
  * This function sets the interface. the types (add_*_Slider), the type of
  * data collected (int), the internal name, user-facing name, minimum,
@@ -712,6 +773,7 @@ struct obs_source_info color_filter = {
 	.create = color_correction_filter_create_v1,
 	.destroy = color_correction_filter_destroy_v1,
 	.video_render = color_correction_filter_render_v1,
+	.filter_video_cpu = color_correction_filter_render_cpu_v1,
 	.update = color_correction_filter_update_v1,
 	.get_properties = color_correction_filter_properties_v1,
 	.get_defaults = color_correction_filter_defaults_v1,
@@ -726,6 +788,7 @@ struct obs_source_info color_filter_v2 = {
 	.create = color_correction_filter_create_v2,
 	.destroy = color_correction_filter_destroy_v2,
 	.video_render = color_correction_filter_render_v2,
+	.filter_video_cpu = color_correction_filter_render_cpu_v2,
 	.update = color_correction_filter_update_v2,
 	.get_properties = color_correction_filter_properties_v2,
 	.get_defaults = color_correction_filter_defaults_v2,
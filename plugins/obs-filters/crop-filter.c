@@ -36,20 +36,24 @@ static void *crop_filter_create(obs_data_t *settings, obs_source_t *context)
 
 	filter->context = context;
 
-	obs_enter_graphics();
-	filter->effect = gs_effect_create_from_file(effect_path, NULL);
-	obs_leave_graphics();
-
-	bfree(effect_path);
+	/* without a graphics subsystem the filter crops on the CPU */
+	if (!obs_cpu_compositing_active()) {
+		obs_enter_graphics();
+		filter->effect = gs_effect_create_from_file(effect_path, NULL);
+		obs_leave_graphics();
+
+		if (!filter->effect) {
+			bfree(effect_path);
+			bfree(filter);
+			return NULL;
+		}
 
-	if (!filter->effect) {
-		bfree(filter);
-		return NULL;
+		filter->param_mul = gs_effect_get_param_by_name(filter->effect, "mul_val");
+		filter->param_add = gs_effect_get_param_by_name(filter->effect, "add_val");
+		filter->param_multiplier = gs_effect_get_param_by_name(filter->effect, "multiplier");
 	}
 
-	filter->param_mul = gs_effect_get_param_by_name(filter->effect, "mul_val");
-	filter->param_add = gs_effect_get_param_by_name(filter->effect, "add_val");
-	filter->param_multiplier = gs_effect_get_param_by_name(filter->effect, "multiplier");
+	bfree(effect_path);
 
 	obs_source_update(context, settings);
 	return filter;
@@ -59,9 +63,11 @@ static void crop_filter_destroy(void *data)
 {
 	struct crop_filter_data *filter = data;
 
-	obs_enter_graphics();
-	gs_effect_destroy(filter->effect);
-	obs_leave_graphics();
+	if (filter->effect) {
+		obs_enter_graphics();
+		gs_effect_destroy(filter->effect);
+		obs_leave_graphics();
+	}
 
 	bfree(filter);
 }
@@ -247,6 +253,40 @@ static void crop_filter_render(void *data, gs_effect_t *effect)
 	}
 }
 
+static void crop_filter_render_cpu(void *data, const struct obs_cpu_image *input, struct obs_cpu_image *output)
+{
+	struct crop_filter_data *filter = data;
+
+	/* the output pixel x, y is the input pixel left + x, top + y, anything
+	 * outside of the input is transparent */
+	int64_t x0 = -(int64_t)filter->left;
+	int64_t x1 = x0 + input->width;
+	if (x0 < 0)
+		x0 = 0;
+	if (x0 > output->width)
+		x0 = output->width;
+	if (x1 > output->width)
+		x1 = output->width;
+	if (x1 < x0)
+		x1 = x0;
+
+	for (uint32_t y = 0; y < output->height; y++) {
+		uint8_t *dst = output->data + (size_t)y * output->linesize;
+		int64_t src_y = (int64_t)y + filter->top;
+
+		if (src_y < 0 || src_y >= input->height) {
+			memset(dst, 0, (size_t)output->width * 4);
+			continue;
+		}
+
+		const uint8_t *src = input->data + (size_t)src_y * input->linesize;
+
+		memset(dst, 0, (size_t)x0 * 4);
+		memcpy(dst + x0 * 4, src + (x0 + filter->left) * 4, (size_t)(x1 - x0) * 4);
+		memset(dst + x1 * 4, 0, (size_t)(output->width - x1) * 4);
+	}
+}
+
 static uint32_t crop_filter_width(void *data)
 {
 	struct crop_filter_data *crop = data;
@@ -294,6 +334,7 @@ struct obs_source_info crop_filter = {
 	.get_defaults = crop_filter_defaults,
 	.video_tick = crop_filter_tick,
 	.video_render = crop_filter_render,
+	.filter_video_cpu = crop_filter_render_cpu,
 	.get_width = crop_filter_width,
 	.get_height = crop_filter_height,
 	.video_get_color_space = crop_filter_get_color_space,
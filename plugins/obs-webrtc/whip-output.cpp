@@ -3,6 +3,8 @@
 
 #include <obs.hpp>
 
+#include <algorithm>
+
 /*
  * Sets the maximum size for a video fragment. Effective range is
  * 576-1470, with a lower value equating to more packets created,
@@ -26,6 +28,9 @@ const uint8_t video_payload_type = 96;
 // ~3 seconds of 8.5 Megabit video
 const int video_nack_buffer_size = 4000;
 
+// Queued video beyond this is dropped up to the next keyframe
+const int64_t max_queued_video_usec = 2000000;
+
 WHIPOutput::WHIPOutput(obs_data_t *, obs_output_t *output)
 	: output(output),
 	  endpoint_url(),
@@ -38,8 +43,20 @@ WHIPOutput::WHIPOutput(obs_data_t *, obs_output_t *output)
 	  peer_connection(nullptr),
 	  audio_track(nullptr),
 	  video_track(nullptr),
+	  send_mutex(),
+	  send_cv(),
+	  send_thread(),
+	  send_queue(),
+	  send_batch(),
+	  send_thread_active(false),
+	  drop_video_until_keyframe(false),
+	  max_queued_packets(0),
+	  total_batches(0),
+	  total_packets(0),
 	  total_bytes_sent(0),
 	  connect_time_ms(0),
+	  dropped_frames(0),
+	  congestion(0.0f),
 	  start_time_ns(0),
 	  last_audio_timestamp(0),
 	  last_video_timestamp(0)
@@ -88,17 +105,148 @@ void WHIPOutput::Data(struct encoder_packet *packet)
 		return;
 	}
 
-	if (audio_track && packet->type == OBS_ENCODER_AUDIO) {
+	if ((audio_track && packet->type == OBS_ENCODER_AUDIO) || (video_track && packet->type == OBS_ENCODER_VIDEO))
+		QueuePacket(packet);
+}
+
+int64_t WHIPOutput::QueuedVideoDuration(const struct encoder_packet *packet)
+{
+	for (auto &queued : send_queue) {
+		if (queued.type == OBS_ENCODER_VIDEO)
+			return packet->dts_usec - queued.dts_usec;
+	}
+
+	return 0;
+}
+
+void WHIPOutput::DropQueuedVideo()
+{
+	auto it = send_queue.begin();
+	while (it != send_queue.end()) {
+		if (it->type == OBS_ENCODER_VIDEO) {
+			obs_encoder_packet_release(&*it);
+			it = send_queue.erase(it);
+			dropped_frames++;
+		} else {
+			++it;
+		}
+	}
+}
+
+/**
+ * @brief Reference a packet into the send queue and wake the send thread.
+ *
+ * When the send thread falls behind by more than max_queued_video_usec, the
+ * queued video is dropped and sending resumes at the next keyframe.
+ */
+void WHIPOutput::QueuePacket(struct encoder_packet *packet)
+{
+	std::lock_guard<std::mutex> l(send_mutex);
+	if (!send_thread_active)
+		return;
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t queued_usec = QueuedVideoDuration(packet);
+		congestion = std::min(1.0f, (float)queued_usec / (float)max_queued_video_usec);
+
+		if (queued_usec > max_queued_video_usec) {
+			do_log(LOG_WARNING, "Send queue is %lldms behind, dropping video until the next keyframe",
+			       (long long)(queued_usec / 1000));
+			DropQueuedVideo();
+			drop_video_until_keyframe = true;
+		}
+
+		if (drop_video_until_keyframe) {
+			if (!packet->keyframe) {
+				dropped_frames++;
+				return;
+			}
+			drop_video_until_keyframe = false;
+		}
+	}
+
+	send_queue.emplace_back();
+	obs_encoder_packet_ref(&send_queue.back(), packet);
+
+	if (send_queue.size() > max_queued_packets)
+		max_queued_packets = send_queue.size();
+
+	send_cv.notify_one();
+}
+
+void WHIPOutput::SendPacket(struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_AUDIO) {
 		int64_t duration = packet->dts_usec - last_audio_timestamp;
 		Send(packet->data, packet->size, duration, audio_track, audio_sr_reporter);
 		last_audio_timestamp = packet->dts_usec;
-	} else if (video_track && packet->type == OBS_ENCODER_VIDEO) {
+	} else {
 		int64_t duration = packet->dts_usec - last_video_timestamp;
 		Send(packet->data, packet->size, duration, video_track, video_sr_reporter);
 		last_video_timestamp = packet->dts_usec;
 	}
 }
 
+void WHIPOutput::SendThread()
+{
+	os_set_thread_name("whip-output: send");
+
+	std::unique_lock<std::mutex> l(send_mutex);
+
+	for (;;) {
+		send_cv.wait(l, [this] { return !send_queue.empty() || !send_thread_active; });
+		if (!send_thread_active)
+			break;
+
+		send_batch.swap(send_queue);
+		l.unlock();
+
+		for (auto &packet : send_batch) {
+			SendPacket(&packet);
+			obs_encoder_packet_release(&packet);
+		}
+
+		total_batches++;
+		total_packets += send_batch.size();
+		send_batch.clear();
+
+		l.lock();
+	}
+}
+
+void WHIPOutput::StartSendThread()
+{
+	std::lock_guard<std::mutex> l(send_mutex);
+
+	send_thread_active = true;
+	drop_video_until_keyframe = false;
+	max_queued_packets = 0;
+	total_batches = 0;
+	total_packets = 0;
+	send_thread = std::thread(&WHIPOutput::SendThread, this);
+}
+
+void WHIPOutput::StopSendThread()
+{
+	{
+		std::lock_guard<std::mutex> l(send_mutex);
+		if (!send_thread_active)
+			return;
+
+		send_thread_active = false;
+		send_cv.notify_one();
+	}
+
+	send_thread.join();
+
+	for (auto &packet : send_queue)
+		obs_encoder_packet_release(&packet);
+	send_queue.clear();
+
+	do_log(LOG_INFO, "Sent %zu packets in %zu batches, max queue depth: %zu, dropped video frames: %d",
+	       total_packets, total_batches, max_queued_packets, dropped_frames.load());
+}
+
 void WHIPOutput::ConfigureAudioTrack(std::string media_stream_id, std::string cname)
 {
 	if (!obs_output_get_audio_encoder(output, 0)) {
@@ -524,6 +672,7 @@ void WHIPOutput::StartThread()
 		return;
 	}
 
+	StartSendThread();
 	obs_output_begin_data_capture(output, 0);
 	running = true;
 }
@@ -581,6 +730,8 @@ void WHIPOutput::SendDelete()
 
 void WHIPOutput::StopThread(bool signal)
 {
+	StopSendThread();
+
 	if (peer_connection != nullptr) {
 		peer_connection->close();
 		peer_connection = nullptr;
@@ -605,6 +756,8 @@ void WHIPOutput::StopThread(bool signal)
 
 	total_bytes_sent = 0;
 	connect_time_ms = 0;
+	dropped_frames = 0;
+	congestion = 0.0f;
 	start_time_ns = 0;
 	last_audio_timestamp = 0;
 	last_video_timestamp = 0;
@@ -616,8 +769,6 @@ void WHIPOutput::Send(void *data, uintptr_t size, uint64_t duration, std::shared
 	if (track == nullptr || !track->isOpen())
 		return;
 
-	std::vector<rtc::byte> sample{(rtc::byte *)data, (rtc::byte *)data + size};
-
 	auto rtp_config = rtcp_sr_reporter->rtpConfig;
 
 	// Sample time is in microseconds, we need to convert it to seconds
@@ -637,8 +788,8 @@ void WHIPOutput::Send(void *data, uintptr_t size, uint64_t duration, std::shared
 		rtcp_sr_reporter->setNeedsToReport();
 
 	try {
-		track->send(sample);
-		total_bytes_sent += sample.size();
+		track->send((const rtc::byte *)data, size);
+		total_bytes_sent += size;
 	} catch (const std::exception &e) {
 		do_log(LOG_ERROR, "error: %s ", e.what());
 	}
@@ -687,6 +838,12 @@ void register_whip_output()
 	info.get_connect_time_ms = [](void *priv_data) -> int {
 		return static_cast<WHIPOutput *>(priv_data)->GetConnectTime();
 	};
+	info.get_dropped_frames = [](void *priv_data) -> int {
+		return static_cast<WHIPOutput *>(priv_data)->GetDroppedFrames();
+	};
+	info.get_congestion = [](void *priv_data) -> float {
+		return static_cast<WHIPOutput *>(priv_data)->GetCongestion();
+	};
 	info.encoded_video_codecs = video_codecs;
 	info.encoded_audio_codecs = audio_codecs;
 	info.protocols = "WHIP";
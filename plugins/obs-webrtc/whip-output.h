@@ -3,13 +3,16 @@
 #include <obs-module.h>
 #include <util/curl/curl-helper.h>
 #include <util/platform.h>
+#include <util/threading.h>
 #include <util/base.h>
 #include <util/dstr.h>
 
 #include <string>
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 #include <rtc/rtc.hpp>
 
@@ -26,6 +29,10 @@ public:
 
 	inline int GetConnectTime() { return connect_time_ms; }
 
+	inline int GetDroppedFrames() { return dropped_frames; }
+
+	inline float GetCongestion() { return congestion; }
+
 private:
 	void ConfigureAudioTrack(std::string media_stream_id, std::string cname);
 	void ConfigureVideoTrack(std::string media_stream_id, std::string cname);
@@ -37,6 +44,14 @@ private:
 	void StopThread(bool signal);
 	void ParseLinkHeader(std::string linkHeader, std::vector<rtc::IceServer> &iceServers);
 
+	void StartSendThread();
+	void StopSendThread();
+	void SendThread();
+	void QueuePacket(struct encoder_packet *packet);
+	int64_t QueuedVideoDuration(const struct encoder_packet *packet);
+	void DropQueuedVideo();
+	void SendPacket(struct encoder_packet *packet);
+
 	void Send(void *data, uintptr_t size, uint64_t duration, std::shared_ptr<rtc::Track> track,
 		  std::shared_ptr<rtc::RtcpSrReporter> rtcp_sr_reporter);
 
@@ -58,8 +73,24 @@ private:
 	std::shared_ptr<rtc::RtcpSrReporter> audio_sr_reporter;
 	std::shared_ptr<rtc::RtcpSrReporter> video_sr_reporter;
 
+	/* Packets are referenced into send_queue by the output data callback
+	 * and sent in batches from send_thread.  The two vectors are swapped
+	 * on every wakeup so their storage is reused. */
+	std::mutex send_mutex;
+	std::condition_variable send_cv;
+	std::thread send_thread;
+	std::vector<struct encoder_packet> send_queue;
+	std::vector<struct encoder_packet> send_batch;
+	bool send_thread_active;
+	bool drop_video_until_keyframe;
+	size_t max_queued_packets;
+	size_t total_batches;
+	size_t total_packets;
+
 	std::atomic<size_t> total_bytes_sent;
 	std::atomic<int> connect_time_ms;
+	std::atomic<int> dropped_frames;
+	std::atomic<float> congestion;
 	int64_t start_time_ns;
 	int64_t last_audio_timestamp;
 	int64_t last_video_timestamp;
@@ -680,15 +680,34 @@ static void parse_packet(struct obs_x264 *obsx264, struct encoder_packet *packet
 	if (!nal_count)
 		return;
 
-	da_resize(obsx264->packet_data, 0);
+	/* x264 outputs the NAL payloads of a frame sequentially in its own
+	 * buffer (valid until the next encode call), so they can usually be
+	 * sent as they are instead of being concatenated */
+	size_t size = 0;
+	bool contiguous = true;
 
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals + i;
-		da_push_back_array(obsx264->packet_data, nal->p_payload, nal->i_payload);
+		if (nals[0].p_payload + size != nal->p_payload)
+			contiguous = false;
+		size += nal->i_payload;
+	}
+
+	if (contiguous) {
+		packet->data = nals[0].p_payload;
+		packet->size = size;
+	} else {
+		da_resize(obsx264->packet_data, 0);
+
+		for (int i = 0; i < nal_count; i++) {
+			x264_nal_t *nal = nals + i;
+			da_push_back_array(obsx264->packet_data, nal->p_payload, nal->i_payload);
+		}
+
+		packet->data = obsx264->packet_data.array;
+		packet->size = obsx264->packet_data.num;
 	}
 
-	packet->data = obsx264->packet_data.array;
-	packet->size = obsx264->packet_data.num;
 	packet->type = OBS_ENCODER_VIDEO;
 	packet->pts = pic_out->i_pts;
 	packet->dts = pic_out->i_dts;
@@ -196,6 +196,9 @@ void VCamFilter::Thread()
 		sleepto_100ns(cur_time += obs_interval);
 		filter_time += obs_interval;
 	}
+
+	nv12_scale_free(&scaler);
+	nv12_scale_free(&placeholder.scaler);
 }
 
 void VCamFilter::Frame(uint64_t ts)
@@ -253,6 +256,7 @@ void VCamFilter::Frame(uint64_t ts)
 		}
 
 		/* Re-initialize the main scaler to use the new resolution */
+		nv12_scale_free(&scaler);
 		nv12_scale_init(&scaler, scaler.format, new_filter_cx, new_filter_cy, new_obs_cx, new_obs_cy);
 
 		obs_cx = new_obs_cx;
@@ -268,6 +272,7 @@ void VCamFilter::Frame(uint64_t ts)
 		filter_cy = new_filter_cy;
 
 		/* Re-initialize the main scaler to use the new resolution */
+		nv12_scale_free(&scaler);
 		nv12_scale_init(&scaler, scaler.format, new_filter_cx, new_filter_cy, new_obs_cx, new_obs_cy);
 
 		UpdatePlaceholder();
@@ -337,6 +342,7 @@ void VCamFilter::UpdatePlaceholder(void)
 		/* No scaling necessary if it matches exactly */
 		memcpy(placeholder.scaled_data, placeholder.source_data, GetOutputBufferSize());
 	} else {
+		nv12_scale_free(&placeholder.scaler);
 		nv12_scale_init(&placeholder.scaler, placeholder.scaler.format, GetCX(), GetCY(), placeholder.cx,
 				placeholder.cy);
 		nv12_do_scale(&placeholder.scaler, placeholder.scaled_data, placeholder.source_data);
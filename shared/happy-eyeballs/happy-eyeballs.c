@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 #include "happy-eyeballs.h"
+#include "util/bmem.h"
 #include "util/darray.h"
 #include "util/dstr.h"
 #include "util/platform.h"
@@ -35,24 +36,37 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #define GetSockError() WSAGetLastError()
+#define E_INPROGRESS WSAEWOULDBLOCK
+#define E_TIMEDOUT WSAETIMEDOUT
+#define closesocket_nb(s) closesocket(s)
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #endif
 #else /* !_WIN32 */
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #define GetSockError() errno
+#define E_INPROGRESS EINPROGRESS
+#define E_TIMEDOUT ETIMEDOUT
+#define closesocket_nb(s) close(s)
 #endif
 
 /* ------------------------------------------------------------------------- */
 /* happy eyeballs coefficients                                               */
 
-/* this is the same default as libcurl */
+/* this is the same default as libcurl (RFC 8305 recommends 250 ms, with a
+ * minimum of 100 ms) */
 #define HAPPY_EYEBALLS_DELAY_MS 200
 #define HAPPY_EYEBALLS_MAX_ATTEMPTS 6
 /* Total time to wait for sockets or to finish trying; whichever is shorter */
 #define HAPPY_EYEBALLS_CONNECTION_TIMEOUT_MS 25000
+/* How long happy_eyeballs_connect waits for the race before returning */
+#define HAPPY_EYEBALLS_CONNECT_WAIT_MS (HAPPY_EYEBALLS_DELAY_MS * HAPPY_EYEBALLS_MAX_ATTEMPTS)
+/* Upper bound on a single wait, so a destroyed context is noticed quickly */
+#define HAPPY_EYEBALLS_POLL_MS 100
 
 /* ------------------------------------------------------------------------- */
 
@@ -64,13 +78,21 @@
 #define STATUS_FAILURE -1
 #define STATUS_INVALID_ARGUMENT -EINVAL
 
+#define RACE_RUNNING 0
+#define RACE_COMPLETED 1
+#define RACE_ABANDONED 2
+
 struct happy_eyeballs_candidate {
 	SOCKET sockfd;
-	os_event_t *socket_completed_event;
-	pthread_t thread;
+	struct addrinfo *address;
 	int error;
+	bool done;
 };
 
+/* Name resolution and all connection attempts run on a single worker thread
+ * per context, using nonblocking sockets.  The context is shared between the
+ * caller and the worker and freed by whichever releases it last; the caller
+ * only reads the results after race_completed_event has been signalled. */
 struct happy_eyeballs_ctx {
 	/**
 	 * socket_fd will be non-zero upon successful connection to the host
@@ -111,20 +133,15 @@ struct happy_eyeballs_ctx {
 	struct sockaddr_storage bind_addr;
 
 	/**
-	 * List of in-flight connection attempts.
+	 * Host and port to connect to, owned by the worker once started.
 	 */
-	DARRAY(struct happy_eyeballs_candidate) candidates;
+	char *hostname;
+	int port;
 
 	/**
-	 * Protects against multiple simultaneous winners writing socket_fd,
-	 * winner_addr, and winner_addr_len
+	 * Connection attempts, only accessed by the worker thread.
 	 */
-	pthread_mutex_t winner_mutex;
-
-	/**
-	 * Protects against mutating while iterating the candidate list
-	 */
-	pthread_mutex_t candidate_mutex;
+	DARRAY(struct happy_eyeballs_candidate) candidates;
 
 	/**
 	 * Event that signals completion of the race, either via winner or
@@ -151,17 +168,13 @@ struct happy_eyeballs_ctx {
 	uint64_t connection_time_end;
 
 	/**
-	 * Indicates whether we are in the initial phase of dispatching
-	 * connections, or if we are waiting for things to connect or time out.
+	 * RACE_RUNNING until either the worker completes the race, or the
+	 * caller destroys the context first (the worker then gives up and
+	 * closes every socket, including a winner nobody will pick up).
 	 */
-	volatile bool is_starting;
-};
+	volatile long state;
 
-struct happy_connect_worker_args {
-	SOCKET sockfd;
-	struct happy_eyeballs_ctx *context;
-	struct happy_eyeballs_candidate *candidate;
-	struct addrinfo *address;
+	volatile long refs;
 };
 
 static int check_comodo(struct happy_eyeballs_ctx *context)
@@ -209,7 +222,14 @@ static int build_addr_list(const char *hostname, int port, struct happy_eyeballs
 	dstr_free(&port_str);
 	if (err) {
 		context->error = GetSockError();
-		context->error_message = strerror(GetSockError());
+#ifdef _WIN32
+		context->error_message = strerror(context->error);
+#else
+		context->error_message = gai_strerror(err);
+#endif
+		/* getaddrinfo doesn't always set errno */
+		if (!context->error)
+			context->error = err;
 		return STATUS_FAILURE;
 	}
 
@@ -251,27 +271,16 @@ static int build_addr_list(const char *hostname, int port, struct happy_eyeballs
 
 static void signal_end(struct happy_eyeballs_ctx *context)
 {
-	if (os_event_try(context->race_completed_event) != EAGAIN)
-		return;
-
 	context->connection_time_end = os_gettime_ns();
 	os_event_signal(context->race_completed_event);
 }
 
 /**
- * Takes the errors that may have been generated by workers, finds the most
- * common one, and sets that to be the overall context error.
+ * Takes the errors of the failed attempts, finds the most common one, and sets
+ * that to be the overall context error.
  */
-static int coalesce_errors(struct happy_eyeballs_ctx *context)
+static void coalesce_errors(struct happy_eyeballs_ctx *context)
 {
-	/* Don't coalesce errors while starting */
-	if (os_atomic_load_bool(&context->is_starting))
-		return STATUS_FAILURE;
-
-	/* Don't coalesce errors if we've already completed */
-	if (os_event_try(context->race_completed_event) != EAGAIN)
-		return STATUS_FAILURE;
-
 	/* We'll use the mode of the errors for now. */
 	struct mode {
 		int error;
@@ -281,7 +290,6 @@ static int coalesce_errors(struct happy_eyeballs_ctx *context)
 	da_init(modes);
 
 	/* Gather all the errors into counts for each error */
-	pthread_mutex_lock(&context->candidate_mutex);
 	for (size_t i = 0; i < context->candidates.num; i++) {
 		int err = context->candidates.array[i].error;
 		struct mode *mode = NULL;
@@ -306,10 +314,9 @@ static int coalesce_errors(struct happy_eyeballs_ctx *context)
 		mode->error = err;
 		mode->count++;
 	}
-	pthread_mutex_unlock(&context->candidate_mutex);
 
 	int max_count = 0;
-	int max_value = 0;
+	int max_value = E_TIMEDOUT;
 
 	/* Find the error with the most occurrences. */
 	for (size_t i = 0; i < modes.num; i++) {
@@ -323,142 +330,285 @@ static int coalesce_errors(struct happy_eyeballs_ctx *context)
 	/* Set the error */
 	context->error = max_value;
 	context->error_message = strerror(context->error);
-
-	return STATUS_SUCCESS;
 }
 
-static void *happy_connect_worker(void *arg)
+static bool set_nonblocking(SOCKET fd, bool nonblocking)
 {
-	struct happy_connect_worker_args *args = (struct happy_connect_worker_args *)arg;
-	struct happy_eyeballs_ctx *context = args->context;
+#ifdef _WIN32
+	u_long mode = nonblocking;
+	return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1)
+		return false;
+
+	flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
 
-	if (args->sockfd == INVALID_SOCKET) {
-		goto success;
+static void candidate_failed(struct happy_eyeballs_candidate *candidate, int error)
+{
+	if (candidate->sockfd != INVALID_SOCKET) {
+		closesocket_nb(candidate->sockfd);
+		candidate->sockfd = INVALID_SOCKET;
 	}
-	if (os_event_try(args->context->race_completed_event) == 0) {
-		/* Already lost, don't bother */
-		goto success;
+
+	candidate->error = error;
+	candidate->done = true;
+}
+
+static void set_winner(struct happy_eyeballs_ctx *context, struct happy_eyeballs_candidate *candidate)
+{
+	struct addrinfo *addr = candidate->address;
+
+	/* the caller expects a regular blocking socket */
+	set_nonblocking(candidate->sockfd, false);
+
+	context->socket_fd = candidate->sockfd;
+	memcpy(&context->winner_addr, addr->ai_addr, addr->ai_addrlen);
+	context->winner_addr_len = (socklen_t)addr->ai_addrlen;
+	candidate->done = true;
+}
+
+/* Starts a nonblocking connection attempt.  Returns true if it connected
+ * immediately, which can happen with local addresses. */
+static bool start_attempt(struct happy_eyeballs_ctx *context, struct addrinfo *addr)
+{
+	struct happy_eyeballs_candidate *candidate = da_push_back_new(context->candidates);
+
+	candidate->address = addr;
+#ifdef _WIN32
+	candidate->sockfd = WSASocket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+#else
+	candidate->sockfd = socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP);
+#endif
+	if (candidate->sockfd == INVALID_SOCKET) {
+		candidate_failed(candidate, GetSockError());
+		return false;
 	}
 
 #if !defined(_WIN32) && defined(SO_NOSIGPIPE)
-	setsockopt(args->sockfd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+	setsockopt(candidate->sockfd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
 #endif
 	if (context->bind_addr.ss_family != 0 &&
-	    bind(args->sockfd, (const struct sockaddr *)&context->bind_addr, context->bind_addr_len) < 0) {
-		goto failure;
+	    bind(candidate->sockfd, (const struct sockaddr *)&context->bind_addr, context->bind_addr_len) < 0) {
+		candidate_failed(candidate, GetSockError());
+		return false;
 	}
 
-	if (connect(args->sockfd, args->address->ai_addr, (int)args->address->ai_addrlen) == 0) {
+	if (!set_nonblocking(candidate->sockfd, true)) {
+		candidate_failed(candidate, GetSockError());
+		return false;
+	}
 
-		/* success, check if we're the winner. */
-		pthread_mutex_lock(&context->winner_mutex);
-		os_event_signal(args->candidate->socket_completed_event);
+	if (connect(candidate->sockfd, addr->ai_addr, (int)addr->ai_addrlen) == 0) {
+		set_winner(context, candidate);
+		return true;
+	}
 
-		if (os_event_try(context->race_completed_event) == EAGAIN) {
-			/* We are the winner. */
-			context->socket_fd = args->sockfd;
-			memcpy(&context->winner_addr, args->address->ai_addr, args->address->ai_addrlen);
-			context->winner_addr_len = (socklen_t)args->address->ai_addrlen;
-			signal_end(context);
-		}
+	int err = GetSockError();
+	if (err != E_INPROGRESS)
+		candidate_failed(candidate, err);
+	return false;
+}
+
+/* Checks a socket that became writable (or errored) for the outcome of its
+ * connection attempt */
+static bool check_attempt(struct happy_eyeballs_ctx *context, struct happy_eyeballs_candidate *candidate)
+{
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (getsockopt(candidate->sockfd, SOL_SOCKET, SO_ERROR, (char *)&err, &len) != 0)
+		err = GetSockError();
+
+	if (err == 0) {
+		set_winner(context, candidate);
+		return true;
+	}
+
+	candidate_failed(candidate, err);
+	return false;
+}
+
+/* Waits up to timeout_ms for any pending attempt to finish.  Returns true if
+ * one of them connected. */
+static bool wait_attempts(struct happy_eyeballs_ctx *context, int timeout_ms)
+{
+	struct happy_eyeballs_candidate *pending[HAPPY_EYEBALLS_MAX_ATTEMPTS];
+	size_t num = 0;
+
+	for (size_t i = 0; i < context->candidates.num; i++) {
+		if (!context->candidates.array[i].done)
+			pending[num++] = &context->candidates.array[i];
+	}
 
-		pthread_mutex_unlock(&context->winner_mutex);
-		goto success;
+	if (!num) {
+		os_sleep_ms(timeout_ms);
+		return false;
 	}
 
-failure:
-	/* failure, note down the error */
-	args->candidate->error = GetSockError();
-	pthread_mutex_lock(&context->winner_mutex);
-	os_event_signal(args->candidate->socket_completed_event);
-
-	/* connection candidates may still be getting dispatched, treat as if
-	 * there's an active candidate */
-	bool active = os_atomic_load_bool(&context->is_starting);
-
-	/* check if we are the last worker running. If so, we'll set the error
-	 * status and signal the completion event. */
-	pthread_mutex_lock(&context->candidate_mutex);
-	for (size_t i = 0; i < context->candidates.num && !active; i++) {
-		active = os_event_try(context->candidates.array[i].socket_completed_event) == EAGAIN;
+#ifdef _WIN32
+	/* WSAPoll doesn't report failed connection attempts on older versions
+	 * of Windows, select does (through the exception set) */
+	fd_set write_set;
+	fd_set except_set;
+	struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+
+	FD_ZERO(&write_set);
+	FD_ZERO(&except_set);
+	for (size_t i = 0; i < num; i++) {
+		FD_SET(pending[i]->sockfd, &write_set);
+		FD_SET(pending[i]->sockfd, &except_set);
 	}
 
-	pthread_mutex_unlock(&context->candidate_mutex);
-	pthread_mutex_unlock(&context->winner_mutex);
+	if (select(0, NULL, &write_set, &except_set, &tv) <= 0)
+		return false;
 
-	if (active || context->error != 0) {
-		/* we're not last or there is already an error on the context,
-		 * let's exit. */
-		goto success;
+	for (size_t i = 0; i < num; i++) {
+		SOCKET fd = pending[i]->sockfd;
+		if ((FD_ISSET(fd, &write_set) || FD_ISSET(fd, &except_set)) && check_attempt(context, pending[i]))
+			return true;
 	}
+#else
+	struct pollfd fds[HAPPY_EYEBALLS_MAX_ATTEMPTS];
 
-	/* Ok, we are last. Coalesce errors and signal completion. */
-	if (coalesce_errors(context) == STATUS_SUCCESS)
-		signal_end(context);
+	for (size_t i = 0; i < num; i++) {
+		fds[i].fd = pending[i]->sockfd;
+		fds[i].events = POLLOUT;
+		fds[i].revents = 0;
+	}
 
-success:
-	free(args);
-	return NULL;
+	if (poll(fds, (nfds_t)num, timeout_ms) <= 0)
+		return false;
+
+	for (size_t i = 0; i < num; i++) {
+		if (fds[i].revents && check_attempt(context, pending[i]))
+			return true;
+	}
+#endif
+
+	return false;
 }
 
-static int launch_worker(struct happy_eyeballs_ctx *context, struct addrinfo *addr)
+static size_t pending_attempts(struct happy_eyeballs_ctx *context)
 {
-#ifdef _WIN32
-	SOCKET fd = WSASocket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
-#else
-	SOCKET fd = socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP);
-#endif
-	if (fd == INVALID_SOCKET) {
-		context->error = GetSockError();
-		return STATUS_FAILURE;
-	}
+	size_t count = 0;
 
-	pthread_mutex_lock(&context->candidate_mutex);
+	for (size_t i = 0; i < context->candidates.num; i++)
+		count += !context->candidates.array[i].done;
+	return count;
+}
 
-	struct happy_eyeballs_candidate *candidate = da_push_back_new(context->candidates);
-	candidate->sockfd = fd;
-	struct happy_connect_worker_args *args =
-		(struct happy_connect_worker_args *)malloc(sizeof(struct happy_connect_worker_args));
-	if (args == NULL) {
-		context->error = ENOMEM;
-		context->error_message = "happy-eyeballs: Failed to allocate "
-					 "memory for worker context";
-		pthread_mutex_unlock(&context->candidate_mutex);
-		return STATUS_FAILURE;
+/**
+ * Staggered connection attempts as described by RFC 8305: a new attempt
+ * (alternating address families) is started every HAPPY_EYEBALLS_DELAY_MS,
+ * or right away once all previous attempts have failed, and the first
+ * socket to connect wins.
+ */
+static void race(struct happy_eyeballs_ctx *context)
+{
+	struct addrinfo *next = context->addresses;
+	uint64_t now = os_gettime_ns();
+	uint64_t deadline = now + HAPPY_EYEBALLS_CONNECTION_TIMEOUT_MS * 1000000ULL;
+	uint64_t next_attempt = now;
+
+	context->connection_time_start = now;
+
+	while (os_atomic_load_long(&context->state) == RACE_RUNNING) {
+		size_t pending = pending_attempts(context);
+		bool can_start = next && context->candidates.num < HAPPY_EYEBALLS_MAX_ATTEMPTS;
+
+		now = os_gettime_ns();
+
+		if (can_start && (now >= next_attempt || !pending)) {
+			struct addrinfo *addr = next;
+
+			next = next->ai_next;
+			next_attempt = now + HAPPY_EYEBALLS_DELAY_MS * 1000000ULL;
+
+			if (start_attempt(context, addr))
+				return;
+			continue;
+		}
+
+		if (!pending) {
+			coalesce_errors(context);
+			return;
+		}
+
+		if (now >= deadline) {
+			context->error = E_TIMEDOUT;
+			context->error_message = strerror(E_TIMEDOUT);
+			return;
+		}
+
+		uint64_t wait_until = can_start && next_attempt < deadline ? next_attempt : deadline;
+		uint64_t wait_ms = (wait_until - now + 999999) / 1000000;
+		if (wait_ms > HAPPY_EYEBALLS_POLL_MS)
+			wait_ms = HAPPY_EYEBALLS_POLL_MS;
+
+		if (wait_attempts(context, (int)wait_ms))
+			return;
 	}
+}
 
-	int result = os_event_init(&candidate->socket_completed_event, OS_EVENT_TYPE_MANUAL);
-	if (result != 0) {
-		/* failure to create the socket completed event */
-		context->error = result;
-		context->error_message = "happy-eyeballs: Failed to initialize "
-					 "socket completed event";
-		free(args);
-		pthread_mutex_unlock(&context->candidate_mutex);
-		return STATUS_FAILURE;
+static void context_free(struct happy_eyeballs_ctx *context)
+{
+	for (size_t i = 0; i < context->candidates.num; i++) {
+		struct happy_eyeballs_candidate *candidate = &context->candidates.array[i];
+
+		if (candidate->sockfd != INVALID_SOCKET && candidate->sockfd != context->socket_fd)
+			closesocket_nb(candidate->sockfd);
 	}
 
-	args->sockfd = fd;
-	args->address = addr;
-	args->context = context;
-	args->candidate = candidate;
-	pthread_mutex_unlock(&context->candidate_mutex);
+	os_event_destroy(context->race_completed_event);
+	if (context->addresses != NULL)
+		freeaddrinfo(context->addresses);
 
-	/* Launch worker thread; `args` ownership is passed to this thread */
-	result = pthread_create(&candidate->thread, NULL, happy_connect_worker, args);
-	if (result != 0) {
-		/* failure to start the worker thread */
-		context->error = result;
-		context->error_message = strerror(result);
-		os_event_destroy(candidate->socket_completed_event);
-		free(args);
-		pthread_mutex_lock(&context->candidate_mutex);
-		da_erase_item(context->candidates, candidate);
-		pthread_mutex_unlock(&context->candidate_mutex);
-		return STATUS_FAILURE;
+	bfree(context->hostname);
+	da_free(context->candidates);
+	free(context);
+}
+
+static void context_release(struct happy_eyeballs_ctx *context)
+{
+	if (os_atomic_dec_long(&context->refs) == 0)
+		context_free(context);
+}
+
+static void *happy_eyeballs_thread(void *param)
+{
+	struct happy_eyeballs_ctx *context = param;
+
+	os_set_thread_name("happy-eyeballs");
+
+	if (check_comodo(context) == STATUS_SUCCESS && build_addr_list(context->hostname, context->port, context) ==
+								     STATUS_SUCCESS)
+		race(context);
+
+	if (!os_atomic_compare_swap_long(&context->state, RACE_RUNNING, RACE_COMPLETED)) {
+		/* nobody is going to pick up the winner anymore */
+		if (context->socket_fd != INVALID_SOCKET) {
+			closesocket_nb(context->socket_fd);
+			context->socket_fd = INVALID_SOCKET;
+		}
+	} else {
+		/* close the losing sockets right away instead of on destroy */
+		for (size_t i = 0; i < context->candidates.num; i++) {
+			struct happy_eyeballs_candidate *candidate = &context->candidates.array[i];
+
+			if (candidate->sockfd != INVALID_SOCKET && candidate->sockfd != context->socket_fd) {
+				closesocket_nb(candidate->sockfd);
+				candidate->sockfd = INVALID_SOCKET;
+			}
+		}
+		signal_end(context);
 	}
 
-	return STATUS_SUCCESS;
+	context_release(context);
+	return NULL;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -477,105 +627,57 @@ int happy_eyeballs_create(struct happy_eyeballs_ctx **context)
 	memset(ctx, 0, sizeof(struct happy_eyeballs_ctx));
 
 	ctx->socket_fd = INVALID_SOCKET;
+	ctx->refs = 1;
 	da_init(ctx->candidates);
 	da_reserve(ctx->candidates, HAPPY_EYEBALLS_MAX_ATTEMPTS);
 
 	/* race_completed_event will be signalled when there is a winner or all
 	 * attempts have failed */
 	int result = os_event_init(&ctx->race_completed_event, OS_EVENT_TYPE_MANUAL);
-
-	/* this mutex is used to avoid the situation where we may have two
-	 * simultaneous winners and inconsistent values set to the context. */
-	if (result == 0)
-		result = pthread_mutex_init(&ctx->winner_mutex, NULL);
-	bool have_winner_mutex = result == 0;
-
-	/* this mutex is used to avoid the situation where we may be mutating
-	 * the candidate array while iterating it. */
-	if (result == 0)
-		result = pthread_mutex_init(&ctx->candidate_mutex, NULL);
-	bool have_candidate_mutex = result == 0;
-
 	if (result == 0) {
 		*context = ctx;
 		return STATUS_SUCCESS;
 	}
 
 	/* Failure, cleanup */
-	if (ctx->race_completed_event)
-		os_event_destroy((*context)->race_completed_event);
-
-	if (have_winner_mutex)
-		pthread_mutex_destroy(&(*context)->winner_mutex);
-
-	if (have_candidate_mutex)
-		pthread_mutex_destroy(&(*context)->candidate_mutex);
-
+	da_free(ctx->candidates);
 	free(ctx);
 	*context = NULL;
 
-	/* Error codes from pthread_mutex_init are positive, os_event_init is
-	 * negative. We have promised to return negative error codes, so we are
-	 * making them all negative here. */
+	/* We have promised to return negative error codes */
 	return -abs(result);
 }
 
 int happy_eyeballs_connect(struct happy_eyeballs_ctx *context, const char *hostname, int port)
 {
-	if (hostname == NULL || context == NULL || port == 0)
+	if (hostname == NULL || context == NULL || port == 0 || context->hostname)
 		return STATUS_INVALID_ARGUMENT;
 
-	int result = check_comodo(context);
-	if (result == STATUS_SUCCESS)
-		result = build_addr_list(hostname, port, context);
-	if (result != STATUS_SUCCESS)
-		return result;
+	context->hostname = bstrdup(hostname);
+	context->port = port;
 
-	context->connection_time_start = os_gettime_ns();
-	int prev_family = 0;
-	struct addrinfo *next = context->addresses;
-	os_atomic_store_bool(&context->is_starting, true);
-
-	/* Exit the loop under the following conditions:
-	 *   1. We have reached the maximum allowed number of attempts
-	 *   2. There are no more candidates in the linked list (ie. `next` is
-	 *      null)
-	 *   3. We have seen two candidates of the same family in a row, stop
-	 *      happy eyeballs and let the previous attempt go it alone. */
-	for (int i = 0; i < HAPPY_EYEBALLS_MAX_ATTEMPTS && next && next->ai_family != prev_family; i++) {
-		/* Launch a worker thread for this address */
-		int result = launch_worker(context, next);
-		if (result != STATUS_SUCCESS)
-			return result;
-
-		/* Wait until the delay between attempts times out or we get
-		 * signalled... */
-		result = os_event_timedwait(context->race_completed_event, HAPPY_EYEBALLS_DELAY_MS);
-		if (result == 0) {
-			/* signalled. Break out of the loop. */
-			break;
-		} else if (result == EINVAL) {
-			/* we ran into an error. */
-			context->error = result;
-			context->error_message = "happy-eyeballs: Encountered "
-						 "error waiting for "
-						 "race_completed_event";
-			return STATUS_FAILURE;
-		}
+	/* The worker holds its own reference, so that destroying the context
+	 * never has to wait for name resolution or a connection attempt */
+	pthread_t thread;
+	os_atomic_inc_long(&context->refs);
 
-		/* timer timed out, move to the next candidate... */
-		prev_family = next->ai_family;
-		next = next->ai_next;
+	int result = pthread_create(&thread, NULL, happy_eyeballs_thread, context);
+	if (result != 0) {
+		os_atomic_dec_long(&context->refs);
+		context->error = result;
+		context->error_message = strerror(result);
+		return STATUS_FAILURE;
 	}
+	pthread_detach(thread);
 
-	os_atomic_store_bool(&context->is_starting, false);
-
-	if (happy_eyeballs_try(context) == EAGAIN) {
-		int active_count = 0;
-		for (size_t i = 0; i < context->candidates.num; i++)
-			active_count += (os_event_try(context->candidates.array[i].socket_completed_event) == EAGAIN);
-		if (active_count == 0 && coalesce_errors(context) == STATUS_SUCCESS)
-			signal_end(context);
+	/* Give the race a chance to finish, like a blocking connect would */
+	result = os_event_timedwait(context->race_completed_event, HAPPY_EYEBALLS_CONNECT_WAIT_MS);
+	if (result == EINVAL) {
+		context->error = result;
+		context->error_message = "happy-eyeballs: Encountered "
+					 "error waiting for "
+					 "race_completed_event";
+		return STATUS_FAILURE;
 	}
 
 	return happy_eyeballs_try(context);
@@ -585,10 +687,13 @@ int happy_eyeballs_try(struct happy_eyeballs_ctx *context)
 {
 	int status = os_event_try(context->race_completed_event);
 
+	if (status == EAGAIN)
+		return status;
+
 	if (context->error != 0)
 		return STATUS_FAILURE;
 
-	if (status != 0 && status != EAGAIN) {
+	if (status != 0) {
 		context->error = status;
 		context->error_message = strerror(status);
 		return STATUS_FAILURE;
@@ -608,76 +713,29 @@ int happy_eyeballs_timedwait(struct happy_eyeballs_ctx *context, unsigned long t
 
 	int status = os_event_timedwait(context->race_completed_event, time_in_millis);
 
+	if (status == ETIMEDOUT)
+		return status;
+
 	if (context->error != 0)
 		return STATUS_FAILURE;
 
-	if (status != 0 && status != ETIMEDOUT) {
+	if (status != 0) {
 		context->error = status;
 		return STATUS_FAILURE;
 	}
 	return status;
 }
 
-static void *destroy_thread(void *param)
-{
-	struct happy_eyeballs_ctx *context = param;
-
-	os_set_thread_name("happy-eyeballs destroy thread");
-#ifdef _WIN32
-#define SHUT_RDWR SD_BOTH
-#else
-#define closesocket(s) close(s)
-#endif
-	/* We do not need to lock context->candidate_mutex here because the
-	 * candidate array is _only_ mutated in happy_eyeballs_connect. Using
-	 * this function at the same time as connect is a programmer error.
-	 * Locking it here will cause a deadlock with join.
-	 *
-	 * Shutdown non-winning sockets (but keep the socket alive so that
-	 * things error out in threads) */
-	for (size_t i = 0; i < context->candidates.num; i++) {
-		if (context->candidates.array[i].sockfd != INVALID_SOCKET &&
-		    context->candidates.array[i].sockfd != context->socket_fd) {
-			shutdown(context->candidates.array[i].sockfd, SHUT_RDWR);
-		}
-	}
-
-	/* Join threads */
-	for (size_t i = 0; i < context->candidates.num; i++) {
-		pthread_join(context->candidates.array[i].thread, NULL);
-		os_event_destroy(context->candidates.array[i].socket_completed_event);
-	}
-
-	/* Close sockets */
-	for (size_t i = 0; i < context->candidates.num; i++) {
-		if (context->candidates.array[i].sockfd != INVALID_SOCKET &&
-		    context->candidates.array[i].sockfd != context->socket_fd) {
-			closesocket(context->candidates.array[i].sockfd);
-		}
-	}
-
-	pthread_mutex_destroy(&context->winner_mutex);
-	pthread_mutex_destroy(&context->candidate_mutex);
-	os_event_destroy(context->race_completed_event);
-	if (context->addresses != NULL)
-		freeaddrinfo(context->addresses);
-
-	da_free(context->candidates);
-	free(context);
-
-	return NULL;
-}
-
 int happy_eyeballs_destroy(struct happy_eyeballs_ctx *context)
 {
 	if (context == NULL)
 		return STATUS_INVALID_ARGUMENT;
 
-	/* The destroy happens asynchronously in another thread due to the
-	 * connect() call blocking on Windows. */
-	pthread_t thread;
-	pthread_create(&thread, NULL, destroy_thread, context);
-	pthread_detach(thread);
+	/* If the race is still running, the worker notices this within
+	 * HAPPY_EYEBALLS_POLL_MS (or after name resolution), closes its
+	 * sockets and frees the context. */
+	os_atomic_compare_swap_long(&context->state, RACE_RUNNING, RACE_ABANDONED);
+	context_release(context);
 
 	return STATUS_SUCCESS;
 }
@@ -1,6 +1,9 @@
 /**
- * An implementation of RFC 6555 (Happy Eyeballs) to connect to IPv6 hosts with
- * IPv4 fast fallback. This implementation currently only works for TCP.
+ * An implementation of RFC 8305 (Happy Eyeballs v2) to connect to IPv6 hosts
+ * with IPv4 fast fallback. This implementation currently only works for TCP.
+ *
+ * Name resolution and the staggered connection attempts all run on a single
+ * background thread per session, using nonblocking sockets.
  *
  * More precisely this algorithm will attempt the configured preferred protocol
  * family, followed by the other. So if the user has configured their operating
@@ -71,7 +74,8 @@ int happy_eyeballs_create(struct happy_eyeballs_ctx **context);
  * Connect to a provided hostname and port. This function will block for up to
  * 1.2 seconds. After this function returns with a success result (0), you need
  * to check happy_eyeballs_try or happy_eyeballs_timedwait to determine if a
- * connection has been established.
+ * connection has been established. This function may only be called once per
+ * context.
  *
  * Upon successfully starting the connection process and waiting for the
  * initial delay timers, this function will return 0 if the connection has been
@@ -172,7 +176,8 @@ int happy_eyeballs_timedwait_default(struct happy_eyeballs_ctx *context);
 
 /**
  * Releases any resources claimed. Accessing context after calling this
- * function will be a use-after-free error.
+ * function will be a use-after-free error. This function does not block; if
+ * the connection process is still ongoing it is cancelled in the background.
  *
  * This function will not close the socket specified in context->socket_fd. You
  * must close that yourself!
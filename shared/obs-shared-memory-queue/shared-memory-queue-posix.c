@@ -0,0 +1,375 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "shared-memory-queue.h"
+#include "tiny-nv12-scale.h"
+
+#define VIDEO_NAME "/obs-virtualcam-video"
+
+enum queue_type {
+	SHARED_QUEUE_TYPE_VIDEO,
+};
+
+/* same layout as the Windows queue; read_idx doubles as the futex word
+ * readers wait on */
+struct queue_header {
+	volatile uint32_t write_idx;
+	volatile uint32_t read_idx;
+	volatile uint32_t state;
+
+	uint32_t offsets[3];
+
+	uint32_t type;
+
+	uint32_t cx;
+	uint32_t cy;
+	uint64_t interval;
+
+	uint32_t writer_pid;
+	uint32_t reserved[7];
+};
+
+struct video_queue {
+	size_t size;
+	bool ready_to_read;
+	struct queue_header *header;
+	uint64_t *ts[3];
+	uint8_t *frame[3];
+	uint32_t last_inc;
+	int dup_counter;
+	bool is_writer;
+};
+
+#define ALIGN_SIZE(size, align) size = (((size) + (align - 1)) & (~(align - 1)))
+#define FRAME_HEADER_SIZE 32
+
+static void queue_wake(volatile uint32_t *addr)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)addr;
+#endif
+}
+
+static void queue_wait(volatile uint32_t *addr, uint32_t val, uint32_t timeout_ms)
+{
+#ifdef __linux__
+	struct timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+#else
+	/* no cross-process wait primitive, poll once a millisecond */
+	struct timespec interval = {0, 1000000};
+	for (uint32_t i = 0; i < timeout_ms && *addr == val; i++)
+		nanosleep(&interval, NULL);
+#endif
+}
+
+static void map_frames(struct video_queue *vq)
+{
+	for (size_t i = 0; i < 3; i++) {
+		uint32_t off = vq->header->offsets[i];
+		vq->ts[i] = (uint64_t *)(((uint8_t *)vq->header) + off);
+		vq->frame[i] = ((uint8_t *)vq->header) + off + FRAME_HEADER_SIZE;
+	}
+}
+
+/* a queue left behind by a writer that exited without closing it */
+static bool queue_is_stale(void)
+{
+	struct queue_header *header;
+	struct stat st;
+	bool stale = false;
+	int fd;
+
+	fd = shm_open(VIDEO_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+		close(fd);
+		return true;
+	}
+
+	header = mmap(NULL, sizeof(*header), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED)
+		return false;
+
+	if (header->state == SHARED_QUEUE_STATE_STOPPING || !header->writer_pid ||
+	    (kill((pid_t)header->writer_pid, 0) != 0 && errno == ESRCH))
+		stale = true;
+
+	munmap(header, sizeof(*header));
+	return stale;
+}
+
+video_queue_t *video_queue_create(uint32_t cx, uint32_t cy, uint64_t interval)
+{
+	struct video_queue vq = {0};
+	struct video_queue *pvq;
+	size_t frame_size = (size_t)cx * cy * 3 / 2;
+	uint32_t offset_frame[3];
+	size_t size;
+	int fd;
+
+	size = sizeof(struct queue_header);
+
+	ALIGN_SIZE(size, 32);
+
+	offset_frame[0] = (uint32_t)size;
+	size += frame_size + FRAME_HEADER_SIZE;
+	ALIGN_SIZE(size, 32);
+
+	offset_frame[1] = (uint32_t)size;
+	size += frame_size + FRAME_HEADER_SIZE;
+	ALIGN_SIZE(size, 32);
+
+	offset_frame[2] = (uint32_t)size;
+	size += frame_size + FRAME_HEADER_SIZE;
+	ALIGN_SIZE(size, 32);
+
+	struct queue_header header = {0};
+
+	header.state = SHARED_QUEUE_STATE_STARTING;
+	header.cx = cx;
+	header.cy = cy;
+	header.interval = interval;
+	header.writer_pid = (uint32_t)getpid();
+	vq.is_writer = true;
+	vq.size = size;
+
+	for (size_t i = 0; i < 3; i++) {
+		uint32_t off = offset_frame[i];
+		header.offsets[i] = off;
+	}
+
+	/* fail if already in use */
+	fd = shm_open(VIDEO_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST && queue_is_stale()) {
+		shm_unlink(VIDEO_NAME);
+		fd = shm_open(VIDEO_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+	}
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		shm_unlink(VIDEO_NAME);
+		return NULL;
+	}
+
+	vq.header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (vq.header == MAP_FAILED) {
+		shm_unlink(VIDEO_NAME);
+		return NULL;
+	}
+	memcpy(vq.header, &header, sizeof(header));
+	map_frames(&vq);
+
+	pvq = malloc(sizeof(vq));
+	if (!pvq) {
+		munmap(vq.header, size);
+		shm_unlink(VIDEO_NAME);
+		return NULL;
+	}
+	memcpy(pvq, &vq, sizeof(vq));
+	return pvq;
+}
+
+video_queue_t *video_queue_open()
+{
+	struct video_queue vq = {0};
+	struct stat st;
+	int fd;
+
+	fd = shm_open(VIDEO_NAME, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct queue_header)) {
+		close(fd);
+		return NULL;
+	}
+
+	vq.size = (size_t)st.st_size;
+	vq.header = mmap(NULL, vq.size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (vq.header == MAP_FAILED) {
+		return NULL;
+	}
+
+	struct video_queue *pvq = malloc(sizeof(vq));
+	if (!pvq) {
+		munmap(vq.header, vq.size);
+		return NULL;
+	}
+	memcpy(pvq, &vq, sizeof(vq));
+	return pvq;
+}
+
+void video_queue_close(video_queue_t *vq)
+{
+	if (!vq) {
+		return;
+	}
+	if (vq->is_writer) {
+		vq->header->state = SHARED_QUEUE_STATE_STOPPING;
+		queue_wake(&vq->header->read_idx);
+		shm_unlink(VIDEO_NAME);
+	}
+
+	munmap(vq->header, vq->size);
+	free(vq);
+}
+
+void video_queue_get_info(video_queue_t *vq, uint32_t *cx, uint32_t *cy, uint64_t *interval)
+{
+	struct queue_header *qh = vq->header;
+	*cx = qh->cx;
+	*cy = qh->cy;
+	*interval = qh->interval;
+}
+
+#define get_idx(inc) ((unsigned long)inc % 3)
+
+static void copy_plane(uint8_t *dst, const uint8_t *src, uint32_t src_linesize, uint32_t width, uint32_t height)
+{
+	if (src_linesize == width) {
+		memcpy(dst, src, (size_t)width * height);
+		return;
+	}
+
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(dst + (size_t)y * width, src + (size_t)y * src_linesize, width);
+}
+
+void video_queue_write(video_queue_t *vq, uint8_t **data, uint32_t *linesize, uint64_t timestamp)
+{
+	struct queue_header *qh = vq->header;
+	uint32_t inc = qh->write_idx + 1;
+
+	/* readers check write_idx after copying a frame, so it has to be
+	 * visible before the slot is overwritten */
+	__atomic_store_n(&qh->write_idx, inc, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	unsigned long idx = get_idx(inc);
+	size_t size = (size_t)qh->cx * qh->cy;
+
+	*vq->ts[idx] = timestamp;
+	copy_plane(vq->frame[idx], data[0], linesize[0], qh->cx, qh->cy);
+	copy_plane(vq->frame[idx] + size, data[1], linesize[1], qh->cx, qh->cy / 2);
+
+	__atomic_store_n(&qh->read_idx, inc, __ATOMIC_RELEASE);
+	qh->state = SHARED_QUEUE_STATE_READY;
+	queue_wake(&qh->read_idx);
+}
+
+enum queue_state video_queue_state(video_queue_t *vq)
+{
+	if (!vq) {
+		return SHARED_QUEUE_STATE_INVALID;
+	}
+
+	enum queue_state state = (enum queue_state)vq->header->state;
+	if (!vq->ready_to_read && state == SHARED_QUEUE_STATE_READY) {
+		size_t frame_size = (size_t)vq->header->cx * vq->header->cy * 3 / 2;
+
+		for (size_t i = 0; i < 3; i++) {
+			if ((size_t)vq->header->offsets[i] + FRAME_HEADER_SIZE + frame_size > vq->size)
+				return SHARED_QUEUE_STATE_INVALID;
+		}
+
+		map_frames(vq);
+		vq->ready_to_read = true;
+	}
+
+	return state;
+}
+
+bool video_queue_wait(video_queue_t *vq, uint32_t timeout_ms)
+{
+	struct queue_header *qh = vq->header;
+	uint32_t inc = __atomic_load_n(&qh->read_idx, __ATOMIC_ACQUIRE);
+
+	if (inc != vq->last_inc)
+		return true;
+	if (qh->state == SHARED_QUEUE_STATE_STOPPING)
+		return false;
+
+	queue_wait(&qh->read_idx, inc, timeout_ms);
+	return __atomic_load_n(&qh->read_idx, __ATOMIC_ACQUIRE) != inc;
+}
+
+const uint8_t *video_queue_peek(video_queue_t *vq, uint64_t *ts, uint32_t *seq)
+{
+	struct queue_header *qh = vq->header;
+	uint32_t inc = __atomic_load_n(&qh->read_idx, __ATOMIC_ACQUIRE);
+
+	if (!vq->ready_to_read || qh->state == SHARED_QUEUE_STATE_STOPPING) {
+		return NULL;
+	}
+
+	unsigned long idx = get_idx(inc);
+
+	vq->last_inc = inc;
+	*ts = *vq->ts[idx];
+	*seq = inc;
+	return vq->frame[idx];
+}
+
+bool video_queue_frame_valid(video_queue_t *vq, uint32_t seq)
+{
+	/* the slot is reused three frames later, and write_idx is bumped
+	 * before the writer starts copying into it */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&vq->header->write_idx, __ATOMIC_RELAXED) - seq < 3;
+}
+
+bool video_queue_read(video_queue_t *vq, nv12_scale_t *scale, void *dst, uint64_t *ts)
+{
+	struct queue_header *qh = vq->header;
+	uint32_t inc = __atomic_load_n(&qh->read_idx, __ATOMIC_ACQUIRE);
+
+	if (qh->state == SHARED_QUEUE_STATE_STOPPING) {
+		return false;
+	}
+
+	if (inc == vq->last_inc) {
+		if (++vq->dup_counter == 10) {
+			return false;
+		}
+	} else {
+		vq->dup_counter = 0;
+	}
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		uint32_t seq;
+		const uint8_t *frame = video_queue_peek(vq, ts, &seq);
+		if (!frame) {
+			return false;
+		}
+
+		nv12_do_scale(scale, dst, frame);
+		if (video_queue_frame_valid(vq, seq)) {
+			return true;
+		}
+	}
+
+	return false;
+}
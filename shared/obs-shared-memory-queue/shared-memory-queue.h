@@ -28,6 +28,20 @@ extern void video_queue_write(video_queue_t *vq, uint8_t **data, uint32_t *lines
 extern enum queue_state video_queue_state(video_queue_t *vq);
 extern bool video_queue_read(video_queue_t *vq, nv12_scale_t *scale, void *dst, uint64_t *ts);
 
+#ifndef _WIN32
+/* Blocks until a frame newer than the last one read is published, the
+ * writer stops, or the timeout expires.  Returns true if a new frame is
+ * available. */
+extern bool video_queue_wait(video_queue_t *vq, uint32_t timeout_ms);
+
+/* Zero-copy access to the newest NV12 frame (cx by cy luma followed by the
+ * interleaved chroma plane).  The pointer stays readable, but the writer
+ * reuses the slot three frames later; check video_queue_frame_valid after
+ * consuming the frame and discard the result if it returns false. */
+extern const uint8_t *video_queue_peek(video_queue_t *vq, uint64_t *ts, uint32_t *seq);
+extern bool video_queue_frame_valid(video_queue_t *vq, uint32_t seq);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
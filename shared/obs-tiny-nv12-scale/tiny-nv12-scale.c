@@ -1,22 +1,293 @@
+#include <stdlib.h>
 #include <string.h>
 #include "tiny-nv12-scale.h"
 
-/* TODO: optimize this stuff later, or replace with something better.  it's
- * kind of garbage.  although normally it shouldn't be called that often.  plus
- * it's nearest neighbor so not really a huge deal.  at the very least it
- * should be sse2 at some point. */
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NV12_SCALE_SSE2
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define NV12_SCALE_NEON
+#include <arm_neon.h>
+#endif
+
+/* Scaling walks per-column tables built once by nv12_scale_init, so the inner
+ * loops do no divides.  Bilinear scaling blends the two source rows around each
+ * destination row with SIMD first, then interpolates horizontally from that
+ * row using the tables.  Weights are 7 bit so the blend stays in 16 bit
+ * lanes; every kernel produces the same output as the C version. */
+
+/* ------------------------------------------------------------------------- */
+/* row blending kernels: dst = a + (b - a) * f / 128, f in [0, 128]          */
+
+typedef void (*blend_rows_t)(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n, int f);
+
+static void blend_rows_c(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n, int f)
+{
+	for (int i = 0; i < n; i++)
+		dst[i] = (uint8_t)(a[i] + ((((int)b[i] - (int)a[i]) * f + 64) >> 7));
+}
+
+#ifdef NV12_SCALE_SSE2
+static void blend_rows_sse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n, int f)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight = _mm_set1_epi16((short)f);
+	const __m128i round = _mm_set1_epi16(64);
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i a_lo = _mm_unpacklo_epi8(va, zero);
+		__m128i a_hi = _mm_unpackhi_epi8(va, zero);
+		__m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(vb, zero), a_lo);
+		__m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(vb, zero), a_hi);
+
+		d_lo = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(d_lo, weight), round), 7);
+		d_hi = _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(d_hi, weight), round), 7);
+
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packus_epi16(_mm_add_epi16(a_lo, d_lo), _mm_add_epi16(a_hi, d_hi)));
+	}
+
+	blend_rows_c(dst + i, a + i, b + i, n - i, f);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+static void blend_rows_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n, int f)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i weight = _mm256_set1_epi16((short)f);
+	const __m256i round = _mm256_set1_epi16(64);
+	int i = 0;
+
+	/* unpack and pack both work per 128 bit lane, so byte order is kept */
+	for (; i + 32 <= n; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i a_lo = _mm256_unpacklo_epi8(va, zero);
+		__m256i a_hi = _mm256_unpackhi_epi8(va, zero);
+		__m256i d_lo = _mm256_sub_epi16(_mm256_unpacklo_epi8(vb, zero), a_lo);
+		__m256i d_hi = _mm256_sub_epi16(_mm256_unpackhi_epi8(vb, zero), a_hi);
+
+		d_lo = _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d_lo, weight), round), 7);
+		d_hi = _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d_hi, weight), round), 7);
+
+		_mm256_storeu_si256((__m256i *)(dst + i),
+				    _mm256_packus_epi16(_mm256_add_epi16(a_lo, d_lo), _mm256_add_epi16(a_hi, d_hi)));
+	}
+
+	blend_rows_sse2(dst + i, a + i, b + i, n - i, f);
+}
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return 0;
+
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+		return 0;
+	if ((_xgetbv(0) & 6) != 6)
+		return 0;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#ifdef NV12_SCALE_NEON
+static void blend_rows_neon(uint8_t *dst, const uint8_t *a, const uint8_t *b, int n, int f)
+{
+	const int16x8_t weight = vdupq_n_s16((int16_t)f);
+	int i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t va = vld1q_u8(a + i);
+		uint8x16_t vb = vld1q_u8(b + i);
+		int16x8_t d_lo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(vb), vget_low_u8(va)));
+		int16x8_t d_hi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(vb), vget_high_u8(va)));
+
+		/* rounding shift: (x + 64) >> 7 */
+		d_lo = vrshrq_n_s16(vmulq_s16(d_lo, weight), 7);
+		d_hi = vrshrq_n_s16(vmulq_s16(d_hi, weight), 7);
+
+		int16x8_t r_lo = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(va))), d_lo);
+		int16x8_t r_hi = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(va))), d_hi);
+
+		vst1q_u8(dst + i, vcombine_u8(vqmovun_s16(r_lo), vqmovun_s16(r_hi)));
+	}
+
+	blend_rows_c(dst + i, a + i, b + i, n - i, f);
+}
+#endif
+
+static blend_rows_t get_blend_rows(void)
+{
+	static blend_rows_t blend_rows = NULL;
+
+	/* racing initializations all store the same pointer */
+	if (!blend_rows) {
+#if defined(NV12_SCALE_SSE2)
+		blend_rows = cpu_has_avx2() ? blend_rows_avx2 : blend_rows_sse2;
+#elif defined(NV12_SCALE_NEON)
+		blend_rows = blend_rows_neon;
+#else
+		blend_rows = blend_rows_c;
+#endif
+	}
+
+	return blend_rows;
+}
 
-void nv12_scale_init(nv12_scale_t *s, enum target_format format, int dst_cx, int dst_cy, int src_cx, int src_cy)
+/* ------------------------------------------------------------------------- */
+/* coordinate tables                                                         */
+
+struct nv12_scale_tables {
+	int *x;        /* luma source column */
+	int *uv_x;     /* byte offset of the source u/v pair */
+	int *y;        /* luma source row (bilinear only) */
+	int *uv_y;     /* chroma source row (bilinear only) */
+	uint8_t *fx;   /* horizontal luma weights (bilinear only) */
+	uint8_t *uv_fx;
+	uint8_t *fy;
+	uint8_t *uv_fy;
+	uint8_t *row;  /* vertically blended source row (bilinear only) */
+};
+
+/* Maps pixel centers, then clamps so that pos + 1 is always in range */
+static void build_bilinear_table(int *pos, uint8_t *frac, int src, int dst, int step)
+{
+	for (int i = 0; i < dst; i++) {
+		long long sp = (long long)(2 * i + 1) * src * 65536 / (2 * (long long)dst) - 32768;
+		int p, f;
+
+		if (sp < 0)
+			sp = 0;
+
+		p = (int)(sp >> 16);
+		f = (int)(((sp & 0xFFFF) + 256) >> 9);
+
+		if (p >= src - 1) {
+			p = src - 2;
+			f = 128;
+		}
+
+		pos[i] = p * step;
+		frac[i] = (uint8_t)f;
+	}
+}
+
+/* one allocation, the arrays follow the struct */
+static struct nv12_scale_tables *scale_tables_create(const nv12_scale_t *s, bool bilinear)
+{
+	const int dst_cx_d2 = s->dst_cx / 2;
+	const int dst_cy_d2 = s->dst_cy / 2;
+	size_t size = sizeof(struct nv12_scale_tables) + sizeof(int) * (s->dst_cx + dst_cx_d2);
+	struct nv12_scale_tables *t;
+
+	if (bilinear) {
+		size += sizeof(int) * (s->dst_cy + dst_cy_d2);
+		size += s->dst_cx + dst_cx_d2 + s->dst_cy + dst_cy_d2 + s->src_cx;
+	}
+
+	t = calloc(1, size);
+	if (!t)
+		return NULL;
+
+	t->x = (int *)(t + 1);
+	t->uv_x = t->x + s->dst_cx;
+
+	if (!bilinear) {
+		for (int x = 0; x < s->dst_cx; x++)
+			t->x[x] = x * s->src_cx / s->dst_cx;
+		for (int x = 0; x < dst_cx_d2; x++)
+			t->uv_x[x] = x * s->src_cx / s->dst_cx * 2;
+		return t;
+	}
+
+	t->y = t->uv_x + dst_cx_d2;
+	t->uv_y = t->y + s->dst_cy;
+	t->fx = (uint8_t *)(t->uv_y + dst_cy_d2);
+	t->uv_fx = t->fx + s->dst_cx;
+	t->fy = t->uv_fx + dst_cx_d2;
+	t->uv_fy = t->fy + s->dst_cy;
+	t->row = t->uv_fy + dst_cy_d2;
+
+	build_bilinear_table(t->x, t->fx, s->src_cx, s->dst_cx, 1);
+	build_bilinear_table(t->uv_x, t->uv_fx, s->src_cx / 2, dst_cx_d2, 2);
+	build_bilinear_table(t->y, t->fy, s->src_cy, s->dst_cy, 1);
+	build_bilinear_table(t->uv_y, t->uv_fy, s->src_cy / 2, dst_cy_d2, 1);
+	return t;
+}
+
+static bool can_scale_bilinear(const nv12_scale_t *s)
+{
+	/* needs two source samples in each direction on both planes */
+	return s->filter == SCALE_FILTER_BILINEAR && s->src_cx >= 4 && s->src_cy >= 4 && s->dst_cx >= 2 &&
+	       s->dst_cy >= 2;
+}
+
+static inline bool needs_scaling(const nv12_scale_t *s)
+{
+	return s->src_cx != s->dst_cx || s->src_cy != s->dst_cy;
+}
+
+bool nv12_scale_init(nv12_scale_t *s, enum target_format format, int dst_cx, int dst_cy, int src_cx, int src_cy)
+{
+	return nv12_scale_init_filter(s, format, SCALE_FILTER_NEAREST, dst_cx, dst_cy, src_cx, src_cy);
+}
+
+bool nv12_scale_init_filter(nv12_scale_t *s, enum target_format format, enum scale_filter filter, int dst_cx,
+			    int dst_cy, int src_cx, int src_cy)
 {
 	s->format = format;
+	s->filter = filter;
 
 	s->src_cx = src_cx;
 	s->src_cy = src_cy;
 
 	s->dst_cx = dst_cx;
 	s->dst_cy = dst_cy;
+
+	/* YUY2 output doesn't use the tables, but they're built anyway as
+	 * the format can be changed without initializing the scaler again */
+	s->tables = NULL;
+	if (!needs_scaling(s))
+		return true;
+
+	s->tables = scale_tables_create(s, can_scale_bilinear(s));
+	return s->tables != NULL;
+}
+
+void nv12_scale_free(nv12_scale_t *s)
+{
+	free(s->tables);
+	s->tables = NULL;
 }
 
+static inline uint8_t lerp(int a, int b, int f)
+{
+	return (uint8_t)(a + (((b - a) * f + 64) >> 7));
+}
+
+/* ------------------------------------------------------------------------- */
+/* nearest neighbor                                                          */
+
 static void nv12_scale_nearest(nv12_scale_t *s, uint8_t *dst_start, const uint8_t *src)
 {
 	register uint8_t *dst = dst_start;
@@ -24,16 +295,14 @@ static void nv12_scale_nearest(nv12_scale_t *s, uint8_t *dst_start, const uint8_
 	const int src_cy = s->src_cy;
 	const int dst_cx = s->dst_cx;
 	const int dst_cy = s->dst_cy;
+	const struct nv12_scale_tables *t = s->tables;
 
 	/* lum */
 	for (int y = 0; y < dst_cy; y++) {
-		const int src_line = y * src_cy / dst_cy * s->src_cx;
-
-		for (int x = 0; x < dst_cx; x++) {
-			const int src_x = x * src_cx / dst_cx;
+		const uint8_t *line = src + y * src_cy / dst_cy * s->src_cx;
 
-			*(dst++) = src[src_line + src_x];
-		}
+		for (int x = 0; x < dst_cx; x++)
+			*(dst++) = line[t->x[x]];
 	}
 
 	src += src_cx * src_cy;
@@ -43,14 +312,13 @@ static void nv12_scale_nearest(nv12_scale_t *s, uint8_t *dst_start, const uint8_
 	const int dst_cy_d2 = dst_cy / 2;
 
 	for (int y = 0; y < dst_cy_d2; y++) {
-		const int src_line = y * src_cy / dst_cy * src_cx;
+		const uint8_t *line = src + y * src_cy / dst_cy * src_cx;
 
 		for (int x = 0; x < dst_cx_d2; x++) {
-			const int src_x = x * src_cx / dst_cx * 2;
-			const int pos = src_line + src_x;
+			const uint8_t *pos = line + t->uv_x[x];
 
-			*(dst++) = src[pos];
-			*(dst++) = src[pos + 1];
+			*(dst++) = pos[0];
+			*(dst++) = pos[1];
 		}
 	}
 }
@@ -63,16 +331,14 @@ static void nv12_scale_nearest_to_i420(nv12_scale_t *s, uint8_t *dst_start, cons
 	const int dst_cx = s->dst_cx;
 	const int dst_cy = s->dst_cy;
 	const int size = src_cx * src_cy;
+	const struct nv12_scale_tables *t = s->tables;
 
 	/* lum */
 	for (int y = 0; y < dst_cy; y++) {
-		const int src_line = y * src_cy / dst_cy * s->src_cx;
-
-		for (int x = 0; x < dst_cx; x++) {
-			const int src_x = x * src_cx / dst_cx;
+		const uint8_t *line = src + y * src_cy / dst_cy * s->src_cx;
 
-			*(dst++) = src[src_line + src_x];
-		}
+		for (int x = 0; x < dst_cx; x++)
+			*(dst++) = line[t->x[x]];
 	}
 
 	src += size;
@@ -84,14 +350,76 @@ static void nv12_scale_nearest_to_i420(nv12_scale_t *s, uint8_t *dst_start, cons
 	register uint8_t *dst2 = dst + dst_cx * dst_cy / 4;
 
 	for (int y = 0; y < dst_cy_d2; y++) {
-		const int src_line = y * src_cy / dst_cy * src_cx;
+		const uint8_t *line = src + y * src_cy / dst_cy * src_cx;
 
 		for (int x = 0; x < dst_cx_d2; x++) {
-			const int src_x = x * src_cx / dst_cx * 2;
-			const int pos = src_line + src_x;
+			const uint8_t *pos = line + t->uv_x[x];
 
-			*(dst++) = src[pos];
-			*(dst2++) = src[pos + 1];
+			*(dst++) = pos[0];
+			*(dst2++) = pos[1];
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* bilinear                                                                  */
+
+static const uint8_t *blend_source_rows(struct nv12_scale_tables *t, blend_rows_t blend_rows, const uint8_t *plane,
+					int linesize, int row, int f)
+{
+	const uint8_t *a = plane + row * linesize;
+
+	if (f == 0)
+		return a;
+	if (f == 128)
+		return a + linesize;
+
+	blend_rows(t->row, a, a + linesize, linesize, f);
+	return t->row;
+}
+
+static void nv12_scale_bilinear(nv12_scale_t *s, uint8_t *dst_start, const uint8_t *src, bool i420)
+{
+	const blend_rows_t blend_rows = get_blend_rows();
+	const int src_cx = s->src_cx;
+	const int src_cy = s->src_cy;
+	const int dst_cx = s->dst_cx;
+	const int dst_cy = s->dst_cy;
+	const int dst_cx_d2 = dst_cx / 2;
+	const int dst_cy_d2 = dst_cy / 2;
+	uint8_t *dst = dst_start;
+	struct nv12_scale_tables *t = s->tables;
+
+	/* lum */
+	for (int y = 0; y < dst_cy; y++) {
+		const uint8_t *line = blend_source_rows(t, blend_rows, src, src_cx, t->y[y], t->fy[y]);
+
+		for (int x = 0; x < dst_cx; x++) {
+			const uint8_t *pos = line + t->x[x];
+			*(dst++) = lerp(pos[0], pos[1], t->fx[x]);
+		}
+	}
+
+	src += src_cx * src_cy;
+
+	/* uv */
+	uint8_t *dst_u = dst;
+	uint8_t *dst_v = dst + dst_cx_d2 * dst_cy_d2;
+
+	for (int y = 0; y < dst_cy_d2; y++) {
+		const uint8_t *line = blend_source_rows(t, blend_rows, src, src_cx, t->uv_y[y], t->uv_fy[y]);
+
+		for (int x = 0; x < dst_cx_d2; x++) {
+			const uint8_t *pos = line + t->uv_x[x];
+			const int f = t->uv_fx[x];
+
+			if (i420) {
+				*(dst_u++) = lerp(pos[0], pos[2], f);
+				*(dst_v++) = lerp(pos[1], pos[3], f);
+			} else {
+				*(dst++) = lerp(pos[0], pos[2], f);
+				*(dst++) = lerp(pos[1], pos[3], f);
+			}
 		}
 	}
 }
@@ -182,19 +510,23 @@ static void nv12_convert_to_yuy2(nv12_scale_t *s, uint8_t *dst_start, const uint
 
 void nv12_do_scale(nv12_scale_t *s, uint8_t *dst, const uint8_t *src)
 {
-	if (s->src_cx == s->dst_cx && s->src_cy == s->dst_cy) {
+	if (!needs_scaling(s)) {
 		if (s->format == TARGET_FORMAT_I420)
 			nv12_convert_to_i420(s, dst, src);
 		else if (s->format == TARGET_FORMAT_YUY2)
 			nv12_convert_to_yuy2(s, dst, src);
 		else
 			memcpy(dst, src, s->src_cx * s->src_cy * 3 / 2);
+	} else if (s->format == TARGET_FORMAT_YUY2) {
+		nv12_scale_nearest_to_yuy2(s, dst, src);
+	} else if (!s->tables) {
+		/* nv12_scale_init failed */
+		return;
+	} else if (can_scale_bilinear(s)) {
+		nv12_scale_bilinear(s, dst, src, s->format == TARGET_FORMAT_I420);
+	} else if (s->format == TARGET_FORMAT_I420) {
+		nv12_scale_nearest_to_i420(s, dst, src);
 	} else {
-		if (s->format == TARGET_FORMAT_I420)
-			nv12_scale_nearest_to_i420(s, dst, src);
-		else if (s->format == TARGET_FORMAT_YUY2)
-			nv12_scale_nearest_to_yuy2(s, dst, src);
-		else
-			nv12_scale_nearest(s, dst, src);
+		nv12_scale_nearest(s, dst, src);
 	}
 }
@@ -13,19 +13,39 @@ enum target_format {
 	TARGET_FORMAT_YUY2,
 };
 
+enum scale_filter {
+	SCALE_FILTER_NEAREST,
+	SCALE_FILTER_BILINEAR,
+};
+
+struct nv12_scale_tables;
+
 struct nv12_scale {
 	enum target_format format;
+	enum scale_filter filter;
 
 	int src_cx;
 	int src_cy;
 
 	int dst_cx;
 	int dst_cy;
+
+	/* coordinate tables and scratch row, built by nv12_scale_init */
+	struct nv12_scale_tables *tables;
 };
 
 typedef struct nv12_scale nv12_scale_t;
 
-extern void nv12_scale_init(nv12_scale_t *s, enum target_format format, int dst_cx, int dst_cy, int src_cx, int src_cy);
+/* Both return false if the scaling tables can't be allocated.  A scaler is
+ * used by one thread at a time and has to be freed with nv12_scale_free
+ * before it's initialized again. */
+extern bool nv12_scale_init(nv12_scale_t *s, enum target_format format, int dst_cx, int dst_cy, int src_cx, int src_cy);
+
+/* Bilinear filtering applies to NV12 and I420 output; YUY2 output is always
+ * scaled with nearest neighbor. */
+extern bool nv12_scale_init_filter(nv12_scale_t *s, enum target_format format, enum scale_filter filter, int dst_cx,
+				   int dst_cy, int src_cx, int src_cy);
+extern void nv12_scale_free(nv12_scale_t *s);
 extern void nv12_do_scale(nv12_scale_t *s, uint8_t *dst, const uint8_t *src);
 
 #ifdef __cplusplus
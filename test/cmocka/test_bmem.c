@@ -0,0 +1,176 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define NUM_BLOCKS 100
+#define BLOCK_SIZE 48
+
+struct holder {
+	void *blocks[NUM_BLOCKS];
+	os_event_t *allocated;
+	os_event_t *release;
+};
+
+static void *hold_blocks_thread(void *param)
+{
+	struct holder *holder = param;
+
+	bmem_set_thread_tag(BMEM_TAG_SOURCE);
+	for (size_t i = 0; i < NUM_BLOCKS; i++)
+		holder->blocks[i] = bmalloc(BLOCK_SIZE);
+
+	os_event_signal(holder->allocated);
+	os_event_wait(holder->release);
+
+	for (size_t i = 0; i < NUM_BLOCKS; i++)
+		bfree(holder->blocks[i]);
+	return NULL;
+}
+
+/* allocations of other threads are counted while those threads are still
+ * running, not only once they exit */
+static void count_other_threads_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct holder holder = {0};
+	struct bmem_tag_stats before, during;
+	pthread_t thread;
+
+	assert_int_equal(os_event_init(&holder.allocated, OS_EVENT_TYPE_MANUAL), 0);
+	assert_int_equal(os_event_init(&holder.release, OS_EVENT_TYPE_MANUAL), 0);
+
+	long base = bnum_allocs();
+	bool tagged = bmem_get_tag_stats(BMEM_TAG_SOURCE, &before);
+
+	assert_int_equal(pthread_create(&thread, NULL, hold_blocks_thread, &holder), 0);
+
+	os_event_wait(holder.allocated);
+	assert_int_equal(bnum_allocs(), base + NUM_BLOCKS);
+
+	if (tagged) {
+		assert_true(bmem_get_tag_stats(BMEM_TAG_SOURCE, &during));
+		assert_int_equal(during.live_allocs, before.live_allocs + NUM_BLOCKS);
+		assert_int_equal(during.live_bytes, before.live_bytes + NUM_BLOCKS * BLOCK_SIZE);
+		assert_true(during.peak_bytes >= during.live_bytes);
+	}
+
+	os_event_signal(holder.release);
+	pthread_join(thread, NULL);
+	assert_int_equal(bnum_allocs(), base);
+
+	os_event_destroy(holder.allocated);
+	os_event_destroy(holder.release);
+}
+
+struct late_free {
+	pthread_key_t key;
+	void *block;
+	int passes;
+};
+
+/* runs again on the next round of thread exit destructors, so the second
+ * pass comes after the destructor of the allocator's thread cache */
+static void late_free_destructor(void *param)
+{
+	struct late_free *late = param;
+
+	if (late->passes++ == 0) {
+		pthread_setspecific(late->key, late);
+		return;
+	}
+
+	bfree(late->block);
+	bfree(bmalloc(BLOCK_SIZE));
+	bfree(brealloc(bmalloc(BLOCK_SIZE), BLOCK_SIZE * 1000));
+}
+
+static void *late_free_thread(void *param)
+{
+	struct late_free *late = param;
+
+	late->block = bmalloc(BLOCK_SIZE);
+	pthread_setspecific(late->key, late);
+	return NULL;
+}
+
+/* memory freed from thread exit destructors after the thread's allocator
+ * state is gone is still released and counted */
+static void destructor_reentry_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct late_free late = {0};
+	long base = bnum_allocs();
+	pthread_t thread;
+
+	assert_int_equal(pthread_key_create(&late.key, late_free_destructor), 0);
+	assert_int_equal(pthread_create(&thread, NULL, late_free_thread, &late), 0);
+	pthread_join(thread, NULL);
+
+	assert_int_equal(late.passes, 2);
+	assert_int_equal(bnum_allocs(), base);
+
+	pthread_key_delete(late.key);
+}
+
+#define BENCH_ITERATIONS 200000
+#define BENCH_LIVE 64
+
+static void *bench_thread(void *param)
+{
+	void *live[BENCH_LIVE] = {0};
+	uint32_t seed = (uint32_t)(uintptr_t)param;
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		size_t slot = (size_t)i % BENCH_LIVE;
+
+		seed = seed * 1664525 + 1013904223;
+		bfree(live[slot]);
+		live[slot] = bmalloc(16 + (seed >> 20) % 2048);
+	}
+
+	for (size_t i = 0; i < BENCH_LIVE; i++)
+		bfree(live[i]);
+	return NULL;
+}
+
+static void alloc_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	for (int threads = 1; threads <= 8; threads *= 2) {
+		pthread_t ids[8];
+		uint64_t start = os_gettime_ns();
+
+		for (int i = 0; i < threads; i++)
+			pthread_create(&ids[i], NULL, bench_thread, (void *)(uintptr_t)(i + 1));
+		for (int i = 0; i < threads; i++)
+			pthread_join(ids[i], NULL);
+
+		double ms = (double)(os_gettime_ns() - start) / 1000000.0;
+		print_message("%d thread(s): %.1f ms, %.1f ns per bmalloc/bfree pair\n", threads, ms,
+			      ms * 1000000.0 / BENCH_ITERATIONS / threads);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(count_other_threads_test),
+		cmocka_unit_test(destructor_reentry_test),
+		cmocka_unit_test(alloc_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,337 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/video-deinterlace.h>
+
+static const struct {
+	const char *name;
+	enum video_format format;
+	uint32_t planes;
+	bool half_height_chroma;
+} formats[] = {
+	{"I420", VIDEO_FORMAT_I420, 3, true},  {"NV12", VIDEO_FORMAT_NV12, 2, true},
+	{"I422", VIDEO_FORMAT_I422, 3, false}, {"I444", VIDEO_FORMAT_I444, 3, false},
+	{"YUY2", VIDEO_FORMAT_YUY2, 1, false}, {"BGRA", VIDEO_FORMAT_BGRA, 1, false},
+};
+
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static const enum video_deinterlace_filter filters[] = {
+	VIDEO_DEINTERLACE_DISCARD,
+	VIDEO_DEINTERLACE_LINEAR,
+	VIDEO_DEINTERLACE_BLEND,
+	VIDEO_DEINTERLACE_YADIF,
+};
+
+#define NUM_FILTERS (sizeof(filters) / sizeof(filters[0]))
+
+static void get_plane_heights(uint32_t heights[MAX_AV_PLANES], enum video_format format, uint32_t cy)
+{
+	memset(heights, 0, sizeof(uint32_t) * MAX_AV_PLANES);
+
+	for (size_t f = 0; f < NUM_FORMATS; f++) {
+		if (formats[f].format != format)
+			continue;
+
+		for (uint32_t i = 0; i < formats[f].planes; i++)
+			heights[i] = i && formats[f].half_height_chroma ? (cy + 1) / 2 : cy;
+	}
+}
+
+static void fill_noise(struct video_frame *frame, enum video_format format, uint32_t cy)
+{
+	uint32_t heights[MAX_AV_PLANES];
+
+	get_plane_heights(heights, format, cy);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++) {
+		for (size_t j = 0; j < (size_t)frame->linesize[i] * heights[i]; j++)
+			frame->data[i][j] = (uint8_t)rand();
+	}
+}
+
+static void assert_frames_equal(const struct video_frame *a, const struct video_frame *b, enum video_format format,
+				uint32_t cy)
+{
+	uint32_t heights[MAX_AV_PLANES];
+
+	get_plane_heights(heights, format, cy);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (heights[i])
+			assert_memory_equal(a->data[i], b->data[i], (size_t)a->linesize[i] * heights[i]);
+	}
+}
+
+/* the SIMD paths against the C paths on noise, for every filter and field,
+ * on sizes that leave odd edges and tails */
+static void simd_exact_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const uint32_t sizes[][2] = {{2, 2}, {7, 5}, {67, 33}, {720, 480}};
+
+	srand(1);
+
+	for (size_t f = 0; f < NUM_FORMATS; f++) {
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			const enum video_format format = formats[f].format;
+			const uint32_t cx = sizes[s][0], cy = sizes[s][1];
+			struct video_frame prev, cur, next, expected, actual;
+
+			video_frame_init(&prev, format, cx, cy);
+			video_frame_init(&cur, format, cx, cy);
+			video_frame_init(&next, format, cx, cy);
+			video_frame_init(&expected, format, cx, cy);
+			video_frame_init(&actual, format, cx, cy);
+			fill_noise(&prev, format, cy);
+			fill_noise(&cur, format, cy);
+			fill_noise(&next, format, cy);
+
+			for (size_t i = 0; i < NUM_FILTERS * 4; i++) {
+				struct video_deinterlace_info info = {
+					.format = format,
+					.width = cx,
+					.height = cy,
+					.filter = filters[i / 4],
+					.top_field_first = (i & 1) != 0,
+					.second_field = (i & 2) != 0,
+				};
+
+				video_deinterlace_set_simd(false);
+				video_deinterlace(&expected, &prev, &cur, &next, &info, NULL);
+				video_deinterlace_set_simd(true);
+				video_deinterlace(&actual, &prev, &cur, &next, &info, NULL);
+				assert_frames_equal(&actual, &expected, format, cy);
+			}
+
+			video_frame_free(&prev);
+			video_frame_free(&cur);
+			video_frame_free(&next);
+			video_frame_free(&expected);
+			video_frame_free(&actual);
+		}
+	}
+}
+
+/* Y800 frames of a scene sampled at a field time: the texture rises from
+ * top to bottom, and a bright bar moves right by speed pixels per field */
+#define BAR_X 100
+#define BAR_WIDTH 24
+
+static uint8_t scene_pixel(uint32_t x, uint32_t y, int field_time, int speed)
+{
+	const int bar_x = BAR_X + field_time * speed;
+
+	if ((int)x >= bar_x && (int)x < bar_x + BAR_WIDTH)
+		return 235;
+	return (uint8_t)(16 + (x * 37) % 64 + y / 4);
+}
+
+/* weaves the top field at field_time and the bottom one at field_time + 1 */
+static void weave_frame(struct video_frame *frame, uint32_t cx, uint32_t cy, int field_time, int speed)
+{
+	for (uint32_t y = 0; y < cy; y++) {
+		for (uint32_t x = 0; x < cx; x++)
+			frame->data[0][y * frame->linesize[0] + x] =
+				scene_pixel(x, y, field_time + (int)(y & 1), speed);
+	}
+}
+
+/* how much the rows of a frame zigzag, the artifact of weaving fields */
+static uint64_t combing(const struct video_frame *frame, uint32_t cx, uint32_t cy)
+{
+	uint64_t total = 0;
+
+	for (uint32_t y = 1; y + 1 < cy; y++) {
+		const uint8_t *row = frame->data[0] + y * frame->linesize[0];
+		const uint8_t *row_above = row - frame->linesize[0];
+		const uint8_t *row_below = row + frame->linesize[0];
+
+		for (uint32_t x = 0; x < cx; x++) {
+			int above = row_above[x];
+			int below = row_below[x];
+			int v = row[x];
+
+			if ((v > above && v > below) || (v < above && v < below))
+				total += abs(2 * v - above - below);
+		}
+	}
+
+	return total;
+}
+
+static void static_scene_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 320, cy = 240;
+	struct video_frame frame, out;
+
+	video_frame_init(&frame, VIDEO_FORMAT_Y800, cx, cy);
+	video_frame_init(&out, VIDEO_FORMAT_Y800, cx, cy);
+	weave_frame(&frame, cx, cy, 0, 0);
+
+	/* with nothing moving the frames around it give back the missing
+	 * rows exactly */
+	for (int i = 0; i < 4; i++) {
+		struct video_deinterlace_info info = {
+			.format = VIDEO_FORMAT_Y800,
+			.width = cx,
+			.height = cy,
+			.filter = VIDEO_DEINTERLACE_YADIF,
+			.top_field_first = (i & 1) != 0,
+			.second_field = (i & 2) != 0,
+		};
+
+		video_deinterlace(&out, &frame, &frame, &frame, &info, NULL);
+		assert_memory_equal(out.data[0], frame.data[0], cx * cy);
+	}
+
+	video_frame_free(&frame);
+	video_frame_free(&out);
+}
+
+static void moving_scene_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 320, cy = 240;
+	const int speed = 6;
+	struct video_frame prev, cur, next, out;
+	struct video_deinterlace_info info = {
+		.format = VIDEO_FORMAT_Y800,
+		.width = cx,
+		.height = cy,
+		.top_field_first = true,
+	};
+
+	video_frame_init(&prev, VIDEO_FORMAT_Y800, cx, cy);
+	video_frame_init(&cur, VIDEO_FORMAT_Y800, cx, cy);
+	video_frame_init(&next, VIDEO_FORMAT_Y800, cx, cy);
+	video_frame_init(&out, VIDEO_FORMAT_Y800, cx, cy);
+	weave_frame(&prev, cx, cy, -2, speed);
+	weave_frame(&cur, cx, cy, 0, speed);
+	weave_frame(&next, cx, cy, 2, speed);
+
+	const uint64_t woven = combing(&cur, cx, cy);
+	assert_true(woven > 0);
+
+	for (size_t i = 0; i < NUM_FILTERS * 2; i++) {
+		const int field = (int)(i & 1);
+
+		info.filter = filters[i / 2];
+		info.second_field = field != 0;
+		video_deinterlace(&out, &prev, &cur, &next, &info, NULL);
+
+		const uint64_t combed = combing(&out, cx, cy);
+		print_message("filter %d field %d: combing %llu (woven frame %llu)\n", (int)info.filter, field,
+			      (unsigned long long)combed, (unsigned long long)woven);
+
+		/* the rows of the kept field are untouched */
+		if (info.filter != VIDEO_DEINTERLACE_BLEND) {
+			for (uint32_t y = (uint32_t)field; y < cy; y += 2)
+				assert_memory_equal(out.data[0] + y * out.linesize[0],
+						    cur.data[0] + y * cur.linesize[0], cx);
+		}
+
+		/* line doubling and yadif rebuild the bar where the kept
+		 * field has it */
+		if (info.filter == VIDEO_DEINTERLACE_DISCARD || info.filter == VIDEO_DEINTERLACE_YADIF) {
+			assert_true(combed < woven / 20);
+
+			for (uint32_t y = 1 - (uint32_t)field; y < cy; y += 2) {
+				const uint8_t *row = out.data[0] + y * out.linesize[0];
+
+				for (uint32_t x = 0; x < cx; x++) {
+					const bool in_bar = scene_pixel(x, 0, field, speed) == 235;
+					assert_true(in_bar ? row[x] == 235 : row[x] < 235);
+				}
+			}
+		}
+	}
+
+	video_frame_free(&prev);
+	video_frame_free(&cur);
+	video_frame_free(&next);
+	video_frame_free(&out);
+}
+
+#define BENCH_CX 1920
+#define BENCH_CY 1080
+#define BENCH_FIELDS 60
+
+static double bench_fields(struct video_frame *frames, struct video_frame *dst, enum video_deinterlace_filter filter,
+			   os_task_pool_t *pool)
+{
+	struct video_deinterlace_info info = {
+		.format = VIDEO_FORMAT_NV12,
+		.width = BENCH_CX,
+		.height = BENCH_CY,
+		.filter = filter,
+		.top_field_first = true,
+	};
+	uint64_t start = os_gettime_ns();
+
+	/* one second of 1080i60, two fields per frame */
+	for (int i = 0; i < BENCH_FIELDS; i++) {
+		info.second_field = (i & 1) != 0;
+		video_deinterlace(dst, &frames[0], &frames[1], &frames[2], &info, pool);
+	}
+
+	return (double)(os_gettime_ns() - start) / BENCH_FIELDS / 1000000.0;
+}
+
+static void deinterlace_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	static const char *names[] = {"discard", "linear", "blend", "yadif"};
+	os_task_pool_t *pool = os_task_pool_create("deinterlace benchmark", 3);
+	struct video_frame frames[3], dst;
+
+	for (int i = 0; i < 3; i++) {
+		video_frame_init(&frames[i], VIDEO_FORMAT_NV12, BENCH_CX, BENCH_CY);
+		fill_noise(&frames[i], VIDEO_FORMAT_NV12, BENCH_CY);
+	}
+	video_frame_init(&dst, VIDEO_FORMAT_NV12, BENCH_CX, BENCH_CY);
+
+	for (size_t f = 0; f < NUM_FILTERS; f++) {
+		video_deinterlace_set_simd(false);
+		double c = bench_fields(frames, &dst, filters[f], NULL);
+		video_deinterlace_set_simd(true);
+		double simd = bench_fields(frames, &dst, filters[f], NULL);
+		double threaded = bench_fields(frames, &dst, filters[f], pool);
+
+		print_message("1080i60 NV12 %-7s: C %.2f ms/field, SIMD %.2f ms/field, SIMD 4 threads %.2f ms/field "
+			      "(%.0f fields/s, 60 needed)\n",
+			      names[f], c, simd, threaded, 1000.0 / threaded);
+	}
+
+	for (int i = 0; i < 3; i++)
+		video_frame_free(&frames[i]);
+	video_frame_free(&dst);
+	os_task_pool_destroy(pool);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(simd_exact_test),
+		cmocka_unit_test(static_scene_test),
+		cmocka_unit_test(moving_scene_test),
+		cmocka_unit_test(deinterlace_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
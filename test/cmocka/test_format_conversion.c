@@ -0,0 +1,345 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+
+/* widths that exercise the 8 pixel AVX2 loop, the 4 pixel SSE2 loop and the
+ * scalar tails */
+static const uint32_t widths[] = {1920, 1926, 1929, 37, 12, 8, 3};
+
+#define TEST_CY 6
+
+static uint8_t *random_data(size_t size)
+{
+	uint8_t *data = bmalloc(size);
+
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)rand();
+	return data;
+}
+
+/* ------------------------------------------------------------------------- */
+/* scalar versions of what the SSE2 code computes */
+
+static void reference_compress(const uint8_t *input, uint32_t in_linesize, uint32_t cx, uint32_t cy,
+			       uint8_t *output[], const uint32_t out_linesize[], bool nv12)
+{
+	for (uint32_t y = 0; y < cy; y += 2) {
+		for (uint32_t x = 0; x < cx; x += 2) {
+			const uint8_t *px0 = input + y * in_linesize + x * 4;
+			const uint8_t *px1 = px0 + in_linesize;
+			bool pair = x + 1 < cx;
+			uint8_t u, v;
+
+			output[0][y * out_linesize[0] + x] = px0[1];
+			output[0][(y + 1) * out_linesize[0] + x] = px1[1];
+
+			if (pair) {
+				output[0][y * out_linesize[0] + x + 1] = px0[5];
+				output[0][(y + 1) * out_linesize[0] + x + 1] = px1[5];
+				u = (uint8_t)((px0[0] + px0[4] + px1[0] + px1[4]) >> 2);
+				v = (uint8_t)((px0[2] + px0[6] + px1[2] + px1[6]) >> 2);
+			} else {
+				u = (uint8_t)((px0[0] + px1[0]) >> 1);
+				v = (uint8_t)((px0[2] + px1[2]) >> 1);
+			}
+
+			if (nv12) {
+				output[1][y / 2 * out_linesize[1] + x] = u;
+				output[1][y / 2 * out_linesize[1] + x + 1] = v;
+			} else {
+				output[1][y / 2 * out_linesize[1] + x / 2] = u;
+				output[2][y / 2 * out_linesize[2] + x / 2] = v;
+			}
+		}
+	}
+}
+
+static void reference_i444(const uint8_t *input, uint32_t in_linesize, uint32_t cx, uint32_t cy, uint8_t *output[],
+			   const uint32_t out_linesize[])
+{
+	for (uint32_t y = 0; y < cy; y++) {
+		for (uint32_t x = 0; x < cx; x++) {
+			const uint8_t *px = input + y * in_linesize + x * 4;
+
+			output[0][y * out_linesize[0] + x] = px[1];
+			output[1][y * out_linesize[1] + x] = px[0];
+			output[2][y * out_linesize[2] + x] = px[2];
+		}
+	}
+}
+
+static void reference_decompress(const uint8_t *const input[], const uint32_t in_linesize[], uint32_t cx,
+				 uint32_t cy, uint8_t *output, uint32_t out_linesize, bool nv12)
+{
+	for (uint32_t y = 0; y < cy; y++) {
+		uint32_t *out = (uint32_t *)(output + y * out_linesize);
+
+		for (uint32_t x = 0; x < cx; x++) {
+			uint32_t lum = input[0][y * in_linesize[0] + x];
+
+			if (nv12) {
+				const uint8_t *uv = input[1] + y / 2 * in_linesize[1] + x / 2 * 2;
+				out[x] = lum | (uv[0] << 8) | (uv[1] << 16);
+			} else {
+				uint32_t u = input[1][y / 2 * in_linesize[1] + x / 2];
+				uint32_t v = input[2][y / 2 * in_linesize[2] + x / 2];
+				out[x] = (lum << 16) | (u << 8) | v;
+			}
+		}
+	}
+}
+
+static void reference_422(const uint8_t *input, uint32_t in_linesize, uint32_t cx, uint32_t cy, uint8_t *output,
+			  uint32_t out_linesize, bool leading_lum)
+{
+	for (uint32_t y = 0; y < cy; y++) {
+		for (uint32_t x = 0; x < cx / 2; x++) {
+			const uint8_t *in = input + y * in_linesize + x * 4;
+			uint8_t *out = output + y * out_linesize + x * 8;
+
+			memcpy(out, in, 4);
+			memcpy(out + 4, in, 4);
+			if (leading_lum)
+				out[4] = in[2];
+			else
+				out[5] = in[3];
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void compress_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int avx2 = 0; avx2 < 2; avx2++) {
+		format_conversion_set_avx2(avx2 != 0);
+
+		for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+			const uint32_t cx = widths[i];
+			/* an odd start address and odd output linesizes leave
+			 * the rows unaligned */
+			const uint32_t in_linesize = cx * 4;
+			const uint32_t out_linesize[3] = {cx + 3, cx + 5, cx + 1};
+			uint8_t *input = random_data(in_linesize * TEST_CY + 1);
+			uint8_t *expected[3], *actual[3];
+
+			for (int p = 0; p < 3; p++) {
+				expected[p] = bzalloc(out_linesize[p] * TEST_CY);
+				actual[p] = bzalloc(out_linesize[p] * TEST_CY);
+			}
+
+			reference_compress(input + 1, in_linesize, cx, TEST_CY, expected, out_linesize, true);
+			compress_uyvx_to_nv12(input + 1, in_linesize, 0, TEST_CY, actual, out_linesize);
+			assert_memory_equal(actual[0], expected[0], out_linesize[0] * TEST_CY);
+			assert_memory_equal(actual[1], expected[1], out_linesize[1] * TEST_CY / 2);
+
+			reference_compress(input + 1, in_linesize, cx, TEST_CY, expected, out_linesize, false);
+			compress_uyvx_to_i420(input + 1, in_linesize, 0, TEST_CY, actual, out_linesize);
+			assert_memory_equal(actual[0], expected[0], out_linesize[0] * TEST_CY);
+			assert_memory_equal(actual[1], expected[1], out_linesize[1] * TEST_CY / 2);
+			assert_memory_equal(actual[2], expected[2], out_linesize[2] * TEST_CY / 2);
+
+			reference_i444(input + 1, in_linesize, cx, TEST_CY, expected, out_linesize);
+			convert_uyvx_to_i444(input + 1, in_linesize, 0, TEST_CY, actual, out_linesize);
+			for (int p = 0; p < 3; p++)
+				assert_memory_equal(actual[p], expected[p], out_linesize[p] * TEST_CY);
+
+			bfree(input);
+			for (int p = 0; p < 3; p++) {
+				bfree(expected[p]);
+				bfree(actual[p]);
+			}
+		}
+	}
+
+	format_conversion_set_avx2(true);
+}
+
+static void decompress_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int avx2 = 0; avx2 < 2; avx2++) {
+		format_conversion_set_avx2(avx2 != 0);
+
+		for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+			/* 4:2:0 and 4:2:2 conversions work in pixel pairs */
+			const uint32_t cx = widths[i] & ~1U;
+			const uint32_t in_linesize[3] = {cx, cx + 2, cx / 2};
+			const uint32_t out_linesize = cx * 4 + 12;
+			const size_t out_size = out_linesize * TEST_CY;
+			const uint8_t *input[3];
+			uint8_t *planes[3];
+			uint8_t *expected = bzalloc(out_size);
+			uint8_t *actual = bzalloc(out_size);
+
+			for (int p = 0; p < 3; p++)
+				input[p] = planes[p] = random_data(in_linesize[p] * TEST_CY + 1);
+
+			reference_decompress(input, in_linesize, cx, TEST_CY, expected, out_linesize, true);
+			decompress_nv12(input, in_linesize, 0, TEST_CY, actual, out_linesize);
+			assert_memory_equal(actual, expected, out_size);
+
+			reference_decompress(input, in_linesize, cx, TEST_CY, expected, out_linesize, false);
+			decompress_420(input, in_linesize, 0, TEST_CY, actual, out_linesize);
+			assert_memory_equal(actual, expected, out_size);
+
+			/* packed 4:2:2 input */
+			const uint32_t packed_linesize = cx * 2;
+			uint8_t *packed = random_data(packed_linesize * TEST_CY);
+
+			for (int leading_lum = 0; leading_lum < 2; leading_lum++) {
+				reference_422(packed, packed_linesize, cx, TEST_CY, expected, out_linesize,
+					      leading_lum);
+				decompress_422(packed, packed_linesize, 0, TEST_CY, actual, out_linesize,
+					       leading_lum);
+				assert_memory_equal(actual, expected, out_size);
+			}
+
+			bfree(packed);
+			for (int p = 0; p < 3; p++)
+				bfree(planes[p]);
+			bfree(expected);
+			bfree(actual);
+		}
+	}
+
+	format_conversion_set_avx2(true);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct uyvx_conversion {
+	const uint8_t *input;
+	uint32_t in_linesize;
+	uint8_t **output;
+	const uint32_t *out_linesize;
+};
+
+static void compress_nv12_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct uyvx_conversion *conv = param;
+	compress_uyvx_to_nv12(conv->input, conv->in_linesize, start_y, end_y, conv->output, conv->out_linesize);
+}
+
+static void bands_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 1280, cy = 722;
+	const uint32_t out_linesize[2] = {cx, cx};
+	uint8_t *input = random_data(cx * 4 * cy);
+	uint8_t *expected[2] = {bzalloc(cx * cy), bzalloc(cx * cy / 2)};
+	uint8_t *actual[2] = {bzalloc(cx * cy), bzalloc(cx * cy / 2)};
+	struct uyvx_conversion conv = {input, cx * 4, actual, out_linesize};
+	os_task_pool_t *pool = os_task_pool_create("format conversion test", 3);
+
+	compress_uyvx_to_nv12(input, cx * 4, 0, cy, expected, out_linesize);
+
+	format_conversion_run_bands(pool, compress_nv12_band, &conv, 0, cy);
+	assert_memory_equal(actual[0], expected[0], cx * cy);
+	assert_memory_equal(actual[1], expected[1], cx * cy / 2);
+
+	/* partial ranges only touch their own rows */
+	memset(actual[0], 0, cx * cy);
+	format_conversion_run_bands(pool, compress_nv12_band, &conv, 100, 400);
+	assert_memory_equal(actual[0] + cx * 100, expected[0] + cx * 100, cx * 300);
+	assert_int_equal(actual[0][cx * 100 - 1], 0);
+	assert_int_equal(actual[0][cx * 400], 0);
+
+	memset(actual[0], 0, cx * cy);
+	format_conversion_run_bands(NULL, compress_nv12_band, &conv, 0, cy);
+	assert_memory_equal(actual[0], expected[0], cx * cy);
+
+	os_task_pool_destroy(pool);
+	bfree(input);
+	for (int p = 0; p < 2; p++) {
+		bfree(expected[p]);
+		bfree(actual[p]);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define BENCH_CX 3840
+#define BENCH_CY 2160
+#define BENCH_ITERATIONS 20
+
+struct nv12_decompression {
+	const uint8_t *const *input;
+	const uint32_t *in_linesize;
+	uint8_t *output;
+	uint32_t out_linesize;
+};
+
+static void decompress_nv12_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct nv12_decompression *conv = param;
+	decompress_nv12(conv->input, conv->in_linesize, start_y, end_y, conv->output, conv->out_linesize);
+}
+
+static void benchmark(const char *name, os_task_pool_t *pool, format_conversion_band_t convert, void *param)
+{
+	format_conversion_run_bands(pool, convert, param, 0, BENCH_CY);
+
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		format_conversion_run_bands(pool, convert, param, 0, BENCH_CY);
+	uint64_t elapsed = os_gettime_ns() - start;
+
+	print_message("%-36s %dx%d: %.3f ms/frame\n", name, BENCH_CX, BENCH_CY,
+		      (double)elapsed / BENCH_ITERATIONS / 1000000.0);
+}
+
+static void conversion_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	const uint32_t out_linesize[2] = {BENCH_CX, BENCH_CX};
+	uint8_t *uyvx = random_data(BENCH_CX * 4 * BENCH_CY);
+	uint8_t *planes[2] = {random_data(BENCH_CX * BENCH_CY), random_data(BENCH_CX * BENCH_CY / 2)};
+	const uint8_t *const input[2] = {planes[0], planes[1]};
+	struct uyvx_conversion compress = {uyvx, BENCH_CX * 4, planes, out_linesize};
+	struct nv12_decompression decompress = {input, out_linesize, uyvx, BENCH_CX * 4};
+	os_task_pool_t *pool = os_task_pool_create("format conversion benchmark", 3);
+
+	format_conversion_set_avx2(false);
+	benchmark("compress_uyvx_to_nv12 SSE2", NULL, compress_nv12_band, &compress);
+	benchmark("decompress_nv12 scalar", NULL, decompress_nv12_band, &decompress);
+
+	format_conversion_set_avx2(true);
+	benchmark("compress_uyvx_to_nv12", NULL, compress_nv12_band, &compress);
+	benchmark("compress_uyvx_to_nv12, 4 threads", pool, compress_nv12_band, &compress);
+	benchmark("decompress_nv12", NULL, decompress_nv12_band, &decompress);
+	benchmark("decompress_nv12, 4 threads", pool, decompress_nv12_band, &decompress);
+
+	os_task_pool_destroy(pool);
+	bfree(uyvx);
+	bfree(planes[0]);
+	bfree(planes[1]);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(compress_test),
+		cmocka_unit_test(decompress_test),
+		cmocka_unit_test(bands_test),
+		cmocka_unit_test(conversion_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
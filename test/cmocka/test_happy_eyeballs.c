@@ -0,0 +1,250 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <util/platform.h>
+#include <happy-eyeballs.h>
+
+/* HAPPY_EYEBALLS_DELAY_MS in happy-eyeballs.c */
+#define DELAY_MS 200
+#define WAIT_MS 5000
+
+struct listener {
+	int fd;
+	int filler;
+};
+
+static socklen_t loopback_addr(int family, int port, struct sockaddr_storage *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+
+	if (family == AF_INET6) {
+		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+		in6->sin6_family = AF_INET6;
+		in6->sin6_port = htons((uint16_t)port);
+		in6->sin6_addr = in6addr_loopback;
+		return sizeof(*in6);
+	}
+
+	struct sockaddr_in *in = (struct sockaddr_in *)addr;
+	in->sin_family = AF_INET;
+	in->sin_port = htons((uint16_t)port);
+	in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return sizeof(*in);
+}
+
+static int get_port(int fd)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+
+	if (getsockname(fd, (struct sockaddr *)&addr, &len) != 0)
+		return 0;
+	if (addr.ss_family == AF_INET6)
+		return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+	return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+}
+
+/* A stalled listener has its accept queue filled by a connection that is
+ * never accepted, so the SYNs of further connection attempts are dropped and
+ * those attempts stay pending instead of completing or being refused. */
+static bool listener_open(struct listener *l, int family, int port, bool stalled)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = loopback_addr(family, port, &addr);
+
+	l->filler = -1;
+	l->fd = socket(family, SOCK_STREAM, IPPROTO_TCP);
+	if (l->fd < 0)
+		return false;
+
+	if (family == AF_INET6)
+		setsockopt(l->fd, IPPROTO_IPV6, IPV6_V6ONLY, &(int){1}, sizeof(int));
+
+	if (bind(l->fd, (struct sockaddr *)&addr, len) != 0 || listen(l->fd, stalled ? 0 : 8) != 0) {
+		close(l->fd);
+		return false;
+	}
+
+	if (stalled) {
+		len = loopback_addr(family, get_port(l->fd), &addr);
+		l->filler = socket(family, SOCK_STREAM, IPPROTO_TCP);
+		assert_int_equal(connect(l->filler, (struct sockaddr *)&addr, len), 0);
+	}
+
+	return true;
+}
+
+static void listener_close(struct listener *l)
+{
+	if (l->filler >= 0)
+		close(l->filler);
+	close(l->fd);
+}
+
+/* "localhost" has to resolve to both loopback addresses, with IPv6 first,
+ * for the IPv6 attempt to be the one that fails or stalls */
+static bool localhost_prefers_ipv6(void)
+{
+	struct addrinfo hints = {0};
+	struct addrinfo *addrs = NULL;
+	bool has_v4 = false;
+	bool v6_first;
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	hints.ai_flags = AI_ADDRCONFIG;
+
+	if (getaddrinfo("localhost", "80", &hints, &addrs) != 0)
+		return false;
+
+	v6_first = addrs->ai_family == AF_INET6;
+	for (struct addrinfo *addr = addrs; addr; addr = addr->ai_next)
+		has_v4 |= addr->ai_family == AF_INET;
+
+	freeaddrinfo(addrs);
+	return v6_first && has_v4;
+}
+
+static int connect_and_wait(struct happy_eyeballs_ctx *ctx, const char *host, int port)
+{
+	int ret = happy_eyeballs_connect(ctx, host, port);
+	if (ret == EAGAIN)
+		ret = happy_eyeballs_timedwait(ctx, WAIT_MS);
+	return ret;
+}
+
+static void check_ipv4_winner(struct happy_eyeballs_ctx *ctx)
+{
+	struct sockaddr_storage addr;
+	int fd = happy_eyeballs_get_socket_fd(ctx);
+
+	assert_true(fd >= 0);
+	assert_int_equal(happy_eyeballs_get_remote_addr(ctx, &addr), sizeof(struct sockaddr_in));
+	assert_int_equal(addr.ss_family, AF_INET);
+	close(fd);
+}
+
+/* a refused IPv6 attempt starts the IPv4 one right away, without waiting for
+ * the connection attempt delay */
+static void refused_ipv6_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct happy_eyeballs_ctx *ctx;
+	struct listener v4;
+
+	if (!localhost_prefers_ipv6())
+		skip();
+
+	/* nothing listens on ::1 for the port of the IPv4 listener */
+	assert_true(listener_open(&v4, AF_INET, 0, false));
+
+	assert_int_equal(happy_eyeballs_create(&ctx), 0);
+	assert_int_equal(connect_and_wait(ctx, "localhost", get_port(v4.fd)), 0);
+	check_ipv4_winner(ctx);
+
+	uint64_t ms = happy_eyeballs_get_connection_time_ns(ctx) / 1000000;
+	print_message("connected over IPv4 after a refused IPv6 attempt in %llu ms\n", (unsigned long long)ms);
+	assert_true(ms < DELAY_MS);
+
+	happy_eyeballs_destroy(ctx);
+	listener_close(&v4);
+}
+
+/* an IPv6 attempt that never completes doesn't hold up the IPv4 attempt for
+ * longer than the connection attempt delay */
+static void stalled_ipv6_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct happy_eyeballs_ctx *ctx;
+	struct listener v4, v6;
+
+	if (!localhost_prefers_ipv6())
+		skip();
+
+	assert_true(listener_open(&v4, AF_INET, 0, false));
+	if (!listener_open(&v6, AF_INET6, get_port(v4.fd), true)) {
+		listener_close(&v4);
+		skip();
+	}
+
+	assert_int_equal(happy_eyeballs_create(&ctx), 0);
+	assert_int_equal(connect_and_wait(ctx, "localhost", get_port(v4.fd)), 0);
+	check_ipv4_winner(ctx);
+
+	uint64_t ms = happy_eyeballs_get_connection_time_ns(ctx) / 1000000;
+	print_message("connected over IPv4 after a stalled IPv6 attempt in %llu ms\n", (unsigned long long)ms);
+	assert_true(ms >= DELAY_MS - 10);
+	assert_true(ms < DELAY_MS * 3);
+
+	happy_eyeballs_destroy(ctx);
+	listener_close(&v6);
+	listener_close(&v4);
+}
+
+static int count_fds(void)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	struct dirent *ent;
+	int count = 0;
+
+	if (!dir)
+		return -1;
+
+	while ((ent = readdir(dir)) != NULL)
+		count += ent->d_name[0] != '.';
+
+	closedir(dir);
+	return count;
+}
+
+/* destroying the context while its attempt is still pending returns right
+ * away, and the worker closes the socket of the attempt once it notices */
+static void destroy_while_pending_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct happy_eyeballs_ctx *ctx;
+	struct listener v4;
+
+	assert_true(listener_open(&v4, AF_INET, 0, true));
+	int fds = count_fds();
+
+	assert_int_equal(happy_eyeballs_create(&ctx), 0);
+	assert_int_equal(happy_eyeballs_connect(ctx, "127.0.0.1", get_port(v4.fd)), EAGAIN);
+	assert_int_equal(happy_eyeballs_try(ctx), EAGAIN);
+	assert_true(count_fds() > fds);
+
+	uint64_t start = os_gettime_ns();
+	happy_eyeballs_destroy(ctx);
+	assert_true(os_gettime_ns() - start < DELAY_MS * 1000000ULL);
+
+	for (int i = 0; i < WAIT_MS / 10 && count_fds() > fds; i++)
+		os_sleep_ms(10);
+	assert_int_equal(count_fds(), fds);
+
+	listener_close(&v4);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(refused_ipv6_test),
+		cmocka_unit_test(stalled_ipv6_test),
+		cmocka_unit_test(destroy_while_pending_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
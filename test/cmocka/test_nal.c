@@ -0,0 +1,304 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <obs-nal.h>
+#include <util/bmem.h>
+
+#define MAX_OFFSET 32
+#define BOUNDARY_LEN 80
+
+/* ------------------------------------------------------------------------- */
+/* scalar reference, the FFmpeg-derived search and serializer that the SIMD
+ * search and single-copy conversion replaced */
+
+static const uint8_t *ref_find_startcode_internal(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+
+	for (end -= 3; p < a && p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		uint32_t x;
+		memcpy(&x, p, sizeof(x));
+
+		if ((x - 0x01010101) & (~x) & 0x80808080) {
+			if (p[1] == 0) {
+				if (p[0] == 0 && p[2] == 1)
+					return p;
+				if (p[2] == 0 && p[3] == 1)
+					return p + 1;
+			}
+
+			if (p[3] == 0) {
+				if (p[2] == 0 && p[4] == 1)
+					return p + 2;
+				if (p[4] == 0 && p[5] == 1)
+					return p + 3;
+			}
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end + 3;
+}
+
+static const uint8_t *ref_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *out = ref_find_startcode_internal(p, end);
+	if (p < out && out < end && !out[-1])
+		out--;
+	return out;
+}
+
+static size_t ref_parse_avc(uint8_t *out, const uint8_t *data, size_t size, bool *keyframe, int *priority)
+{
+	const uint8_t *const end = data + size;
+	const uint8_t *nal_start = ref_find_startcode(data, end);
+	size_t out_size = 0;
+
+	while (true) {
+		while (nal_start < end && !*(nal_start++))
+			;
+
+		if (nal_start == end)
+			break;
+
+		if ((nal_start[0] & 0x1F) == OBS_NAL_SLICE_IDR)
+			*keyframe = true;
+		if (*priority < nal_start[0] >> 5)
+			*priority = nal_start[0] >> 5;
+
+		const uint8_t *const nal_end = ref_find_startcode(nal_start, end);
+		const size_t nal_size = nal_end - nal_start;
+
+		out[out_size++] = (uint8_t)(nal_size >> 24);
+		out[out_size++] = (uint8_t)(nal_size >> 16);
+		out[out_size++] = (uint8_t)(nal_size >> 8);
+		out[out_size++] = (uint8_t)nal_size;
+		memcpy(out + out_size, nal_start, nal_size);
+		out_size += nal_size;
+		nal_start = nal_end;
+	}
+
+	return out_size;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static uint32_t rand_next(uint32_t *seed)
+{
+	*seed = *seed * 1664525 + 1013904223;
+	return *seed >> 8;
+}
+
+static void assert_same_startcodes(const uint8_t *p, const uint8_t *end)
+{
+	while (true) {
+		const uint8_t *expected = ref_find_startcode(p, end);
+
+		assert_ptr_equal(obs_nal_find_startcode(p, end), expected);
+		assert_ptr_equal(obs_avc_find_startcode(p, end), expected);
+
+		if (expected >= end - 3)
+			break;
+		p = expected + 3;
+	}
+}
+
+/* a single 3 or 4 byte start code at every position of buffers of every
+ * length and alignment, which covers codes straddling the 16 and 32 byte
+ * steps of the search as well as the end of the buffer */
+static void startcode_boundary_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	uint8_t *mem = bmalloc(BOUNDARY_LEN + MAX_OFFSET);
+
+	for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+		uint8_t *buf = mem + offset;
+
+		for (size_t len = 0; len <= BOUNDARY_LEN; len++) {
+			for (size_t code_len = 3; code_len <= 4; code_len++) {
+				for (size_t pos = 0; pos + code_len <= len; pos++) {
+					memset(buf, 0xAB, len);
+					memset(buf + pos, 0, code_len - 1);
+					buf[pos + code_len - 1] = 1;
+
+					assert_same_startcodes(buf, buf + len);
+				}
+			}
+
+			/* zeros only and no code at all */
+			memset(buf, 0, len);
+			assert_same_startcodes(buf, buf + len);
+			memset(buf, 0xAB, len);
+			assert_same_startcodes(buf, buf + len);
+		}
+	}
+
+	bfree(mem);
+}
+
+/* random data made of mostly 0, 1 and 3 bytes, so that start codes, zero
+ * runs and emulation prevention sequences follow each other closely */
+static void startcode_random_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const uint8_t bytes[] = {0, 0, 0, 0, 1, 1, 3, 0x65};
+	uint8_t *mem = bmalloc(4096 + MAX_OFFSET);
+	uint32_t seed = 1;
+
+	for (int i = 0; i < 2000; i++) {
+		size_t offset = rand_next(&seed) % MAX_OFFSET;
+		size_t len = rand_next(&seed) % 4096;
+		uint8_t *buf = mem + offset;
+
+		for (size_t j = 0; j < len; j++)
+			buf[j] = bytes[rand_next(&seed) % sizeof(bytes)];
+
+		assert_same_startcodes(buf, buf + len);
+	}
+
+	bfree(mem);
+}
+
+/* writes an escaped NAL unit payload the way an encoder does: no 00 00 0x
+ * with x <= 3 inside, an emulation prevention byte is inserted instead */
+static size_t write_payload(uint8_t *out, size_t size, uint32_t *seed)
+{
+	size_t pos = 0;
+	int zeros = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t b = (rand_next(seed) & 1) ? 0 : (uint8_t)rand_next(seed);
+
+		if (zeros >= 2 && b <= 3) {
+			out[pos++] = 3;
+			zeros = 0;
+		}
+
+		out[pos++] = b;
+		zeros = b ? 0 : zeros + 1;
+	}
+
+	/* rbsp stop bit, so the payload never ends in zeros */
+	out[pos++] = 0x80;
+	return pos;
+}
+
+static size_t make_packet(uint8_t *out, int num_nals, size_t max_payload, uint32_t *seed)
+{
+	static const uint8_t types[] = {OBS_NAL_SLICE, OBS_NAL_SLICE_IDR, OBS_NAL_SEI, OBS_NAL_SPS, OBS_NAL_PPS};
+	size_t pos = 0;
+
+	for (int i = 0; i < num_nals; i++) {
+		if (rand_next(seed) & 1)
+			out[pos++] = 0;
+		out[pos++] = 0;
+		out[pos++] = 0;
+		out[pos++] = 1;
+
+		out[pos++] = (uint8_t)((rand_next(seed) % 4) << 5 | types[rand_next(seed) % sizeof(types)]);
+		pos += write_payload(out + pos, rand_next(seed) % max_payload, seed);
+	}
+
+	return pos;
+}
+
+static void assert_same_conversion(const uint8_t *data, size_t size)
+{
+	struct encoder_packet src = {.data = (uint8_t *)data, .size = size, .type = OBS_ENCODER_VIDEO};
+	struct encoder_packet dst;
+	uint8_t *expected = bmalloc(size * 2 + 4);
+	bool keyframe = false;
+	int priority = 0;
+	size_t expected_size = ref_parse_avc(expected, data, size, &keyframe, &priority);
+
+	obs_parse_avc_packet(&dst, &src);
+
+	assert_int_equal(dst.size, expected_size);
+	assert_memory_equal(dst.data, expected, expected_size);
+	assert_int_equal(dst.keyframe, keyframe);
+	assert_int_equal(dst.priority, priority);
+	assert_int_equal(dst.drop_priority, priority);
+
+	obs_encoder_packet_release(&dst);
+	bfree(expected);
+}
+
+/* escaped payloads keep their emulation prevention bytes, and 00 00 03 is
+ * never taken for a start code */
+static void emulation_prevention_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const uint8_t packet[] = {
+		0, 0, 0, 1, 0x65, 0x88, 0, 0, 3, 0, 0, 0, 3, 1, 0, 0, 3, 2, 0, 0, 3, 3, 0x80,
+		0, 0, 1, 0x41, 0, 0, 3, 1, 0, 0, 3, 0, 0, 3, 0, 0, 3, 1, 0x80,
+	};
+	struct encoder_packet src = {.data = (uint8_t *)packet, .size = sizeof(packet), .type = OBS_ENCODER_VIDEO};
+	struct encoder_packet dst;
+
+	obs_parse_avc_packet(&dst, &src);
+
+	/* two units, copied unchanged behind their lengths */
+	assert_int_equal(dst.size, 4 + 19 + 4 + 16);
+	assert_int_equal(dst.data[3], 19);
+	assert_memory_equal(dst.data + 4, packet + 4, 19);
+	assert_int_equal(dst.data[4 + 19 + 3], 16);
+	assert_memory_equal(dst.data + 4 + 19 + 4, packet + 26, 16);
+	assert_true(dst.keyframe);
+	obs_encoder_packet_release(&dst);
+
+	assert_same_conversion(packet, sizeof(packet));
+}
+
+/* generated packets at every alignment, including ones with more units
+ * than the conversion caches in its first pass */
+static void convert_random_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	uint8_t *packet = bmalloc(256 * 1024);
+	uint8_t *mem = bmalloc(256 * 1024 + MAX_OFFSET);
+	uint32_t seed = 7;
+
+	for (int i = 0; i < 500; i++) {
+		int num_nals = 1 + (int)(rand_next(&seed) % (i % 50 == 0 ? 100 : 8));
+		size_t max_payload = i % 3 == 0 ? 2000 : 40;
+		size_t size = make_packet(packet, num_nals, max_payload, &seed);
+		size_t offset = rand_next(&seed) % MAX_OFFSET;
+
+		memcpy(mem + offset, packet, size);
+		assert_same_conversion(mem + offset, size);
+	}
+
+	bfree(mem);
+	bfree(packet);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(startcode_boundary_test),
+		cmocka_unit_test(startcode_random_test),
+		cmocka_unit_test(emulation_prevention_test),
+		cmocka_unit_test(convert_random_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
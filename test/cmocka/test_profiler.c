@@ -0,0 +1,254 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <string.h>
+
+#include <util/profiler.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define BENCH_SCOPES 200000
+#define CHECK_SCOPES 1000
+
+static const char *default_root = "default_root";
+static const char *event_root = "event_root";
+static const char *child_name = "child";
+
+static uint64_t scope_ns(const char *root, size_t count)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		profile_start(root);
+		profile_start(child_name);
+		profile_end(child_name);
+		profile_end(root);
+	}
+
+	return (os_gettime_ns() - start) / (count * 2);
+}
+
+struct find_data {
+	const char *name;
+	profiler_snapshot_entry_t *entry;
+};
+
+static bool find_root(void *context, profiler_snapshot_entry_t *entry)
+{
+	struct find_data *data = context;
+	if (profiler_snapshot_entry_name(entry) != data->name)
+		return true;
+
+	data->entry = entry;
+	return false;
+}
+
+static bool first_child(void *context, profiler_snapshot_entry_t *entry)
+{
+	*(profiler_snapshot_entry_t **)context = entry;
+	return false;
+}
+
+static uint64_t root_count(const char *root)
+{
+	profiler_snapshot_t *snap = profile_snapshot_create();
+	struct find_data data = {root, NULL};
+	uint64_t count = 0;
+
+	profiler_snapshot_enumerate_roots(snap, find_root, &data);
+	if (data.entry)
+		count = profiler_snapshot_entry_overall_count(data.entry);
+
+	profile_snapshot_free(snap);
+	return count;
+}
+
+/* every test starts the profiler and frees it, so they don't depend on the
+ * order they run in */
+static void default_mode_overhead_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	profiler_start();
+	profile_reenable_thread();
+	uint64_t ns = scope_ns(default_root, BENCH_SCOPES);
+	profiler_stop();
+
+	print_message("default mode: %llu ns per scope\n", (unsigned long long)ns);
+	profiler_free();
+}
+
+static void event_mode_aggregate_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	profiler_start_event_mode(CHECK_SCOPES * 4);
+	profile_reenable_thread();
+
+	/* stays well below the ring size, so nothing may be dropped */
+	scope_ns(event_root, CHECK_SCOPES);
+
+	profiler_snapshot_t *snap = profile_snapshot_create();
+	struct find_data data = {event_root, NULL};
+	profiler_snapshot_enumerate_roots(snap, find_root, &data);
+
+	assert_non_null(data.entry);
+	assert_int_equal(profiler_snapshot_entry_overall_count(data.entry), CHECK_SCOPES);
+	assert_int_equal(profiler_snapshot_num_children(data.entry), 1);
+
+	profiler_snapshot_entry_t *child = NULL;
+	profiler_snapshot_enumerate_children(data.entry, first_child, &child);
+	assert_string_equal(profiler_snapshot_entry_name(child), child_name);
+	assert_int_equal(profiler_snapshot_entry_overall_count(child), CHECK_SCOPES);
+
+	profile_snapshot_free(snap);
+
+	char *path = os_generate_formatted_filename("json", true, "profiler-trace-%CCYY%MM%DD%hh%mm%ss");
+	assert_true(profiler_trace_dump_json(path));
+	assert_true(os_get_file_size(path) > 0);
+	os_unlink(path);
+	bfree(path);
+
+	profiler_stop();
+	profiler_free();
+}
+
+static size_t count_str(const char *str, const char *find)
+{
+	size_t count = 0;
+
+	while ((str = strstr(str, find)) != NULL) {
+		count++;
+		str += strlen(find);
+	}
+
+	return count;
+}
+
+/* the retained events are a ring, so the trace keeps the latest scopes and
+ * drops the ends of the ones whose beginning was overwritten */
+static void event_mode_trace_ring_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const char *first_root = "first_root";
+	static const char *last_root = "last_root";
+
+	profiler_start_event_mode(CHECK_SCOPES / 2 + 1);
+	profile_reenable_thread();
+
+	scope_ns(first_root, 1);
+	scope_ns(event_root, CHECK_SCOPES);
+	scope_ns(last_root, 1);
+
+	char *path = os_generate_formatted_filename("json", true, "profiler-trace-%CCYY%MM%DD%hh%mm%ss");
+	assert_true(profiler_trace_dump_json(path));
+
+	char *json = os_quick_read_utf8_file(path);
+	assert_non_null(json);
+	assert_null(strstr(json, "\"first_root\",\"ph\""));
+	assert_non_null(strstr(json, "\"last_root\",\"ph\""));
+	assert_int_equal(count_str(json, "\"ph\":\"B\""), count_str(json, "\"ph\":\"E\""));
+
+	bfree(json);
+	os_unlink(path);
+	bfree(path);
+
+	profiler_stop();
+	profiler_free();
+}
+
+static void event_mode_overhead_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	profiler_start_event_mode(0);
+	profile_reenable_thread();
+	uint64_t ns = scope_ns(event_root, BENCH_SCOPES);
+	profiler_stop();
+
+	print_message("event mode: %llu ns per scope\n", (unsigned long long)ns);
+	profiler_free();
+}
+
+static void *scope_thread(void *data)
+{
+	scope_ns(event_root, (size_t)(uintptr_t)data);
+	return NULL;
+}
+
+/* the ring of a thread that exited is merged and freed by the aggregator */
+static void event_mode_thread_exit_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	profiler_start_event_mode(0);
+
+	for (int i = 0; i < 4; i++) {
+		pthread_t thread;
+		assert_int_equal(pthread_create(&thread, NULL, scope_thread, (void *)(uintptr_t)CHECK_SCOPES), 0);
+		pthread_join(thread, NULL);
+	}
+
+	assert_int_equal(root_count(event_root), CHECK_SCOPES * 4);
+
+	profiler_stop();
+	profiler_free();
+}
+
+static volatile bool producing = false;
+
+static void *producer_thread(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	profile_reenable_thread();
+	while (os_atomic_load_bool(&producing)) {
+		profile_start(event_root);
+		profile_start(child_name);
+		profile_end(child_name);
+		profile_end(event_root);
+	}
+	return NULL;
+}
+
+/* freeing the profiler while other threads are inside profile_start and
+ * profile_end must not free rings under them, which the sanitizers catch */
+static void event_mode_free_while_producing_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	pthread_t threads[4];
+
+	for (int round = 0; round < 20; round++) {
+		profiler_start_event_mode(0);
+		os_atomic_store_bool(&producing, true);
+
+		for (size_t i = 0; i < 4; i++)
+			assert_int_equal(pthread_create(&threads[i], NULL, producer_thread, NULL), 0);
+
+		os_sleep_ms(2);
+		profiler_stop();
+		profiler_free();
+
+		os_atomic_store_bool(&producing, false);
+		for (size_t i = 0; i < 4; i++)
+			pthread_join(threads[i], NULL);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(default_mode_overhead_test),
+		cmocka_unit_test(event_mode_aggregate_test),
+		cmocka_unit_test(event_mode_trace_ring_test),
+		cmocka_unit_test(event_mode_overhead_test),
+		cmocka_unit_test(event_mode_thread_exit_test),
+		cmocka_unit_test(event_mode_free_while_producing_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
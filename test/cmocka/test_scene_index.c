@@ -0,0 +1,132 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+
+#define NUM_ITEMS 4
+
+static const char *get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "index test";
+}
+
+static void *create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_source_info test_source = {
+	.id = "scene_index_test_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.get_name = get_name,
+	.create = create,
+	.destroy = destroy,
+};
+
+struct fixture {
+	obs_scene_t *scene;
+	obs_source_t *sources[NUM_ITEMS];
+	obs_sceneitem_t *items[NUM_ITEMS];
+	int64_t ids[NUM_ITEMS];
+};
+
+static void create_fixture(struct fixture *f)
+{
+	char name[32];
+
+	f->scene = obs_scene_create_private("index test scene");
+
+	for (int i = 0; i < NUM_ITEMS; i++) {
+		snprintf(name, sizeof(name), "index source %d", i);
+		f->sources[i] = obs_source_create_private(test_source.id, name, NULL);
+		f->items[i] = obs_scene_add(f->scene, f->sources[i]);
+		f->ids[i] = obs_sceneitem_get_id(f->items[i]);
+	}
+}
+
+static void destroy_fixture(struct fixture *f)
+{
+	obs_scene_release(f->scene);
+	for (int i = 0; i < NUM_ITEMS; i++)
+		obs_source_release(f->sources[i]);
+}
+
+/* checks the item lookups all agree, with NULL for items that are gone */
+static void check_lookups(struct fixture *f, int i, obs_sceneitem_t *expected)
+{
+	const char *name = obs_source_get_name(f->sources[i]);
+	obs_sceneitem_t *item;
+
+	assert_ptr_equal(obs_scene_find_source(f->scene, name), expected);
+	assert_ptr_equal(obs_scene_find_sceneitem_by_id(f->scene, f->ids[i]), expected);
+
+	PRAGMA_WARN_PUSH
+	PRAGMA_WARN_DEPRECATION
+	item = obs_scene_sceneitem_from_source(f->scene, f->sources[i]);
+	PRAGMA_WARN_POP
+	assert_ptr_equal(item, expected);
+	obs_sceneitem_release(item);
+}
+
+/* the first item heads the lookup indexes, so removing it is the case that
+ * used to leave them pointing at freed memory */
+static void remove_first_item_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+	struct fixture f;
+
+	create_fixture(&f);
+
+	for (int i = 0; i < NUM_ITEMS; i++)
+		check_lookups(&f, i, f.items[i]);
+
+	obs_sceneitem_remove(f.items[0]);
+
+	check_lookups(&f, 0, NULL);
+	for (int i = 1; i < NUM_ITEMS; i++)
+		check_lookups(&f, i, f.items[i]);
+
+	obs_sceneitem_remove(f.items[NUM_ITEMS - 1]);
+
+	check_lookups(&f, NUM_ITEMS - 1, NULL);
+	for (int i = 1; i < NUM_ITEMS - 1; i++)
+		check_lookups(&f, i, f.items[i]);
+
+	destroy_fixture(&f);
+}
+
+static int setup_core(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_register_source(&test_source);
+	return 0;
+}
+
+static int teardown_core(void **state)
+{
+	UNUSED_PARAMETER(state);
+	obs_shutdown();
+	return 0;
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(remove_first_item_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup_core, teardown_core);
+}
@@ -0,0 +1,206 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "shared-memory-queue.h"
+#include "tiny-nv12-scale.h"
+
+static void fill_frame(uint8_t *planes[2], uint32_t linesize[2], uint32_t cx, uint32_t cy, uint8_t value)
+{
+	memset(planes[0], value, (size_t)linesize[0] * cy);
+	memset(planes[1], value + 1, (size_t)linesize[1] * cy / 2);
+	(void)cx;
+}
+
+static video_queue_t *create_queue(uint32_t cx, uint32_t cy)
+{
+	video_queue_t *vq = video_queue_create(cx, cy, 166666);
+	if (!vq) {
+		print_message("virtual camera queue already in use, skipping\n");
+		skip();
+	}
+	return vq;
+}
+
+static void queue_roundtrip_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 64, cy = 32;
+	uint32_t linesize[2] = {cx + 16, cx + 16};
+	uint8_t *planes[2] = {bmalloc(linesize[0] * cy), bmalloc(linesize[1] * cy / 2)};
+	uint8_t *dst = bmalloc(cx * cy * 3 / 2);
+	uint32_t info_cx, info_cy;
+	uint64_t interval, ts;
+	nv12_scale_t scale;
+
+	video_queue_t *writer = create_queue(cx, cy);
+	assert_null(video_queue_create(cx, cy, 166666));
+
+	video_queue_t *reader = video_queue_open();
+	assert_non_null(reader);
+	assert_int_equal(video_queue_state(reader), SHARED_QUEUE_STATE_STARTING);
+
+	video_queue_get_info(reader, &info_cx, &info_cy, &interval);
+	assert_int_equal(info_cx, cx);
+	assert_int_equal(info_cy, cy);
+	assert_int_equal(interval, 166666);
+
+	fill_frame(planes, linesize, cx, cy, 0x40);
+	video_queue_write(writer, planes, linesize, 1234);
+	assert_int_equal(video_queue_state(reader), SHARED_QUEUE_STATE_READY);
+
+	assert_true(nv12_scale_init(&scale, TARGET_FORMAT_NV12, cx, cy, cx, cy));
+	assert_true(video_queue_read(reader, &scale, dst, &ts));
+	assert_int_equal(ts, 1234);
+	for (size_t i = 0; i < cx * cy; i++)
+		assert_int_equal(dst[i], 0x40);
+	for (size_t i = cx * cy; i < cx * cy * 3 / 2; i++)
+		assert_int_equal(dst[i], 0x41);
+
+	video_queue_close(writer);
+	assert_int_equal(video_queue_state(reader), SHARED_QUEUE_STATE_STOPPING);
+	assert_false(video_queue_read(reader, &scale, dst, &ts));
+	video_queue_close(reader);
+	nv12_scale_free(&scale);
+
+	bfree(planes[0]);
+	bfree(planes[1]);
+	bfree(dst);
+}
+
+static void queue_zero_copy_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 32, cy = 16;
+	uint32_t linesize[2] = {cx, cx};
+	uint8_t *planes[2] = {bmalloc(cx * cy), bmalloc(cx * cy / 2)};
+	const uint8_t *frame;
+	uint32_t seq;
+	uint64_t ts;
+
+	video_queue_t *writer = create_queue(cx, cy);
+	video_queue_t *reader = video_queue_open();
+	assert_non_null(reader);
+
+	fill_frame(planes, linesize, cx, cy, 1);
+	video_queue_write(writer, planes, linesize, 1);
+	assert_int_equal(video_queue_state(reader), SHARED_QUEUE_STATE_READY);
+	assert_true(video_queue_wait(reader, 0));
+
+	frame = video_queue_peek(reader, &ts, &seq);
+	assert_non_null(frame);
+	assert_int_equal(ts, 1);
+	assert_int_equal(frame[0], 1);
+	assert_false(video_queue_wait(reader, 0));
+
+	/* the slot survives two more frames, the third one reuses it */
+	for (uint8_t i = 2; i <= 3; i++)
+		video_queue_write(writer, planes, linesize, i);
+	assert_true(video_queue_frame_valid(reader, seq));
+	video_queue_write(writer, planes, linesize, 4);
+	assert_false(video_queue_frame_valid(reader, seq));
+
+	video_queue_close(writer);
+	video_queue_close(reader);
+	bfree(planes[0]);
+	bfree(planes[1]);
+}
+
+#define BENCH_CX 1920
+#define BENCH_CY 1080
+#define BENCH_FRAMES 120
+
+struct bench_writer {
+	video_queue_t *vq;
+	uint64_t interval_ns;
+};
+
+static void *bench_write_thread(void *data)
+{
+	struct bench_writer *bw = data;
+	uint32_t linesize[2] = {BENCH_CX, BENCH_CX};
+	uint8_t *planes[2] = {bmalloc(BENCH_CX * BENCH_CY), bmalloc(BENCH_CX * BENCH_CY / 2)};
+	uint64_t next = os_gettime_ns();
+
+	for (int i = 0; i < BENCH_FRAMES; i++) {
+		fill_frame(planes, linesize, BENCH_CX, BENCH_CY, (uint8_t)i);
+		video_queue_write(bw->vq, planes, linesize, os_gettime_ns());
+
+		next += bw->interval_ns;
+		os_sleepto_ns(next);
+	}
+
+	bfree(planes[0]);
+	bfree(planes[1]);
+	return NULL;
+}
+
+/* 1080p60 writer with a waiting reader that copies every frame out;
+ * reports publish-to-copied latency */
+static void queue_reader_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	struct bench_writer bw = {create_queue(BENCH_CX, BENCH_CY), 1000000000ULL / 60};
+	uint8_t *dst = bmalloc(BENCH_CX * BENCH_CY * 3 / 2);
+	uint64_t latency_total = 0, latency_max = 0;
+	int frames = 0;
+	pthread_t thread;
+
+	video_queue_t *reader = video_queue_open();
+	assert_non_null(reader);
+	assert_int_equal(pthread_create(&thread, NULL, bench_write_thread, &bw), 0);
+
+	while (frames < BENCH_FRAMES && video_queue_wait(reader, 100)) {
+		const uint8_t *frame;
+		uint32_t seq;
+		uint64_t ts;
+
+		if (video_queue_state(reader) != SHARED_QUEUE_STATE_READY)
+			continue;
+
+		frame = video_queue_peek(reader, &ts, &seq);
+		assert_non_null(frame);
+		memcpy(dst, frame, BENCH_CX * BENCH_CY * 3 / 2);
+		if (!video_queue_frame_valid(reader, seq))
+			continue;
+
+		uint64_t latency = os_gettime_ns() - ts;
+		latency_total += latency;
+		if (latency > latency_max)
+			latency_max = latency;
+		frames++;
+	}
+
+	pthread_join(thread, NULL);
+	video_queue_close(bw.vq);
+	video_queue_close(reader);
+	bfree(dst);
+
+	assert_true(frames > 0);
+	print_message("1080p60: read %d/%d frames, latency avg %.3f ms, max %.3f ms\n", frames, BENCH_FRAMES,
+		      (double)latency_total / frames / 1000000.0, (double)latency_max / 1000000.0);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(queue_roundtrip_test),
+		cmocka_unit_test(queue_zero_copy_test),
+		cmocka_unit_test(queue_reader_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
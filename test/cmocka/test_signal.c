@@ -0,0 +1,117 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <callback/signal.h>
+#include <util/platform.h>
+
+#define BENCH_EMITS 200000
+#define NUM_CALLBACKS 10
+
+static const char *signal_decls[] = {
+	"void first(ptr source)",
+	"void second(ptr source)",
+	"void third(ptr source)",
+	"void fourth(ptr source)",
+	"void fifth(ptr source)",
+	"void volume(in out ptr source, in out float volume)",
+	NULL,
+};
+
+static void count_cb(void *data, calldata_t *cd)
+{
+	long *count = data;
+	(*count)++;
+	UNUSED_PARAMETER(cd);
+}
+
+static uint64_t emit_ns(signal_handler_t *handler, signal_handle_t *handle, size_t count)
+{
+	uint8_t stack[128];
+	calldata_t cd;
+	uint64_t start;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_ptr(&cd, "source", NULL);
+	calldata_set_float(&cd, "volume", 1.0);
+
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < count; i++) {
+		if (handle)
+			signal_handle_emit(handle, &cd);
+		else
+			signal_handler_signal(handler, "volume", &cd);
+	}
+
+	return (os_gettime_ns() - start) / count;
+}
+
+static void signal_emit_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	long counts[NUM_CALLBACKS] = {0};
+	signal_handle_t *handle;
+	uint64_t by_name, by_handle;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(signal_handler_add_array(handler, signal_decls));
+	assert_null(signal_handler_get_handle(handler, "missing"));
+
+	handle = signal_handler_get_handle(handler, "volume");
+	assert_non_null(handle);
+
+	for (size_t i = 0; i < NUM_CALLBACKS; i++)
+		signal_handler_connect(handler, "volume", count_cb, &counts[i]);
+
+	by_name = emit_ns(handler, NULL, BENCH_EMITS);
+	by_handle = emit_ns(handler, handle, BENCH_EMITS);
+
+	for (size_t i = 0; i < NUM_CALLBACKS; i++)
+		assert_int_equal(counts[i], BENCH_EMITS * 2);
+
+	print_message("%d callbacks: %llu ns per emit by name, %llu ns by handle\n", NUM_CALLBACKS,
+		      (unsigned long long)by_name, (unsigned long long)by_handle);
+
+	for (size_t i = 0; i < NUM_CALLBACKS; i++)
+		signal_handler_disconnect(handler, "volume", count_cb, &counts[i]);
+
+	signal_handle_emit(handle, NULL);
+	assert_int_equal(counts[0], BENCH_EMITS * 2);
+
+	signal_handler_destroy(handler);
+}
+
+static void calldata_pool_test(void **state)
+{
+	calldata_t *cd;
+	uint8_t *stack;
+
+	UNUSED_PARAMETER(state);
+
+	cd = calldata_acquire();
+	calldata_set_string(cd, "name", "first");
+	stack = cd->stack;
+	calldata_release(cd);
+
+	cd = calldata_acquire();
+	assert_ptr_equal(cd->stack, stack);
+	assert_null(calldata_string(cd, "name"));
+	calldata_set_string(cd, "name", "second");
+	assert_string_equal(calldata_string(cd, "name"), "second");
+	calldata_release(cd);
+
+	calldata_pool_free();
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(signal_emit_test),
+		cmocka_unit_test(calldata_pool_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
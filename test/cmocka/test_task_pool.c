@@ -0,0 +1,232 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/task.h>
+#include <util/threading.h>
+
+#define NUM_THREADS 3
+#define NUM_ITEMS 1000
+#define NUM_CALLERS 4
+#define CALLER_ROUNDS 50
+
+struct run_data {
+	volatile long runs[NUM_ITEMS];
+	volatile long bad_worker;
+	volatile long order;
+	volatile long out_of_order;
+};
+
+static void run_data_reset(struct run_data *data)
+{
+	for (size_t i = 0; i < NUM_ITEMS; i++)
+		data->runs[i] = 0;
+	data->bad_worker = 0;
+	data->order = 0;
+	data->out_of_order = 0;
+}
+
+static void assert_ran_once(struct run_data *data, size_t count)
+{
+	for (size_t i = 0; i < NUM_ITEMS; i++)
+		assert_int_equal(data->runs[i], i < count ? 1 : 0);
+	assert_int_equal(data->bad_worker, 0);
+}
+
+static void count_item(void *param, size_t idx)
+{
+	struct run_data *data = param;
+
+	os_atomic_inc_long(&data->runs[idx]);
+	if (os_task_pool_worker_index() > NUM_THREADS)
+		os_atomic_inc_long(&data->bad_worker);
+}
+
+static void count_item_on_caller(void *param, size_t idx)
+{
+	struct run_data *data = param;
+
+	data->runs[idx]++;
+	if (os_task_pool_worker_index() != 0)
+		data->bad_worker++;
+	if (data->order++ != (long)idx)
+		data->out_of_order++;
+}
+
+/* every item runs exactly once per run, on a worker or on the caller */
+static void pool_run_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	os_task_pool_t *pool = os_task_pool_create("task pool test", NUM_THREADS);
+	struct run_data *data = bzalloc(sizeof(*data));
+
+	assert_non_null(pool);
+	assert_int_equal(os_task_pool_threads(pool), NUM_THREADS);
+	assert_int_equal(os_task_pool_worker_index(), 0);
+
+	for (int i = 0; i < 20; i++) {
+		run_data_reset(data);
+		os_task_pool_run(pool, count_item, data, NUM_ITEMS);
+		assert_ran_once(data, NUM_ITEMS);
+	}
+
+	/* fewer items than threads */
+	run_data_reset(data);
+	os_task_pool_run(pool, count_item, data, 2);
+	assert_ran_once(data, 2);
+
+	/* nothing to hand out, runs on the caller */
+	run_data_reset(data);
+	os_task_pool_run(pool, count_item_on_caller, data, 1);
+	assert_ran_once(data, 1);
+
+	run_data_reset(data);
+	os_task_pool_run(pool, count_item_on_caller, data, 0);
+	assert_ran_once(data, 0);
+
+	bfree(data);
+	os_task_pool_destroy(pool);
+}
+
+/* without a pool the items run in order on the calling thread */
+static void no_pool_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct run_data *data = bzalloc(sizeof(*data));
+
+	assert_int_equal(os_task_pool_threads(NULL), 0);
+
+	os_task_pool_run(NULL, count_item_on_caller, data, NUM_ITEMS);
+	assert_ran_once(data, NUM_ITEMS);
+	assert_int_equal(data->out_of_order, 0);
+
+	bfree(data);
+	os_task_pool_destroy(NULL);
+}
+
+struct caller {
+	os_task_pool_t *pool;
+	struct run_data data;
+	bool failed;
+};
+
+static void *caller_thread(void *param)
+{
+	struct caller *caller = param;
+
+	for (int i = 0; i < CALLER_ROUNDS && !caller->failed; i++) {
+		size_t count = (size_t)(i * 37 % NUM_ITEMS) + 1;
+
+		run_data_reset(&caller->data);
+		os_task_pool_run(caller->pool, count_item, &caller->data, count);
+
+		for (size_t j = 0; j < NUM_ITEMS; j++) {
+			if (caller->data.runs[j] != (j < count ? 1 : 0))
+				caller->failed = true;
+		}
+	}
+
+	return NULL;
+}
+
+/* runs from several threads at once share the pool without losing or
+ * repeating items */
+static void concurrent_callers_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	os_task_pool_t *pool = os_task_pool_create("task pool test", NUM_THREADS);
+	struct caller *callers = bzalloc(sizeof(*callers) * NUM_CALLERS);
+	pthread_t threads[NUM_CALLERS];
+
+	for (int i = 0; i < NUM_CALLERS; i++) {
+		callers[i].pool = pool;
+		assert_int_equal(pthread_create(&threads[i], NULL, caller_thread, &callers[i]), 0);
+	}
+
+	for (int i = 0; i < NUM_CALLERS; i++) {
+		pthread_join(threads[i], NULL);
+		assert_false(callers[i].failed);
+	}
+
+	bfree(callers);
+	os_task_pool_destroy(pool);
+}
+
+struct blocking_run {
+	os_task_pool_t *pool;
+	os_event_t *started;
+	os_event_t *release;
+};
+
+static void blocking_item(void *param, size_t idx)
+{
+	struct blocking_run *run = param;
+
+	if (idx == 0) {
+		os_event_signal(run->started);
+		os_event_wait(run->release);
+	}
+}
+
+static void *blocking_thread(void *param)
+{
+	struct blocking_run *run = param;
+	os_task_pool_run(run->pool, blocking_item, run, 2);
+	return NULL;
+}
+
+/* try_run gives up instead of waiting while the pool is busy */
+static void try_run_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct blocking_run run = {os_task_pool_create("task pool test", NUM_THREADS)};
+	struct run_data *data = bzalloc(sizeof(*data));
+	pthread_t thread;
+
+	assert_int_equal(os_event_init(&run.started, OS_EVENT_TYPE_MANUAL), 0);
+	assert_int_equal(os_event_init(&run.release, OS_EVENT_TYPE_MANUAL), 0);
+
+	assert_true(os_task_pool_try_run(run.pool, count_item, data, NUM_ITEMS));
+	assert_ran_once(data, NUM_ITEMS);
+
+	assert_int_equal(pthread_create(&thread, NULL, blocking_thread, &run), 0);
+	os_event_wait(run.started);
+
+	run_data_reset(data);
+	assert_false(os_task_pool_try_run(run.pool, count_item, data, NUM_ITEMS));
+	assert_ran_once(data, 0);
+
+	/* single items never need the pool */
+	assert_true(os_task_pool_try_run(run.pool, count_item_on_caller, data, 1));
+	assert_ran_once(data, 1);
+
+	os_event_signal(run.release);
+	pthread_join(thread, NULL);
+
+	run_data_reset(data);
+	assert_true(os_task_pool_try_run(run.pool, count_item, data, NUM_ITEMS));
+	assert_ran_once(data, NUM_ITEMS);
+
+	os_event_destroy(run.started);
+	os_event_destroy(run.release);
+	bfree(data);
+	os_task_pool_destroy(run.pool);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(pool_run_test),
+		cmocka_unit_test(no_pool_test),
+		cmocka_unit_test(concurrent_callers_test),
+		cmocka_unit_test(try_run_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
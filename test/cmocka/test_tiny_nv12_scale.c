@@ -0,0 +1,268 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+
+#include "tiny-nv12-scale.h"
+
+static uint8_t *create_image(int cx, int cy)
+{
+	uint8_t *image = bmalloc(cx * cy * 3 / 2);
+	uint8_t *uv = image + cx * cy;
+
+	srand(1);
+
+	for (int y = 0; y < cy; y++) {
+		for (int x = 0; x < cx; x++) {
+			double v = 128.0 + 60.0 * sin(x * 0.05) * cos(y * 0.03) + 40.0 * x / cx;
+			image[y * cx + x] = (uint8_t)(v + rand() % 9 - 4);
+		}
+	}
+
+	for (int y = 0; y < cy / 2; y++) {
+		for (int x = 0; x < cx / 2; x++) {
+			uv[y * cx + x * 2] = (uint8_t)(128.0 + 50.0 * sin(x * 0.07));
+			uv[y * cx + x * 2 + 1] = (uint8_t)(128.0 + 50.0 * cos(y * 0.05));
+		}
+	}
+
+	return image;
+}
+
+/* the original divide-per-pixel nearest neighbor implementation */
+static void reference_nearest(uint8_t *dst, const uint8_t *src, int src_cx, int src_cy, int dst_cx, int dst_cy,
+			      bool i420)
+{
+	uint8_t *dst2;
+
+	for (int y = 0; y < dst_cy; y++) {
+		const int src_line = y * src_cy / dst_cy * src_cx;
+
+		for (int x = 0; x < dst_cx; x++)
+			*(dst++) = src[src_line + x * src_cx / dst_cx];
+	}
+
+	src += src_cx * src_cy;
+	dst2 = dst + dst_cx * dst_cy / 4;
+
+	for (int y = 0; y < dst_cy / 2; y++) {
+		const int src_line = y * src_cy / dst_cy * src_cx;
+
+		for (int x = 0; x < dst_cx / 2; x++) {
+			const int pos = src_line + x * src_cx / dst_cx * 2;
+
+			*(dst++) = src[pos];
+			if (i420) {
+				*(dst2++) = src[pos + 1];
+			} else {
+				*(dst++) = src[pos + 1];
+			}
+		}
+	}
+}
+
+static void reference_coord(int i, int src, int dst, int *p, double *f)
+{
+	double sp = (i + 0.5) * src / dst - 0.5;
+
+	if (sp < 0.0)
+		sp = 0.0;
+
+	*p = (int)sp;
+	*f = sp - *p;
+
+	if (*p >= src - 1) {
+		*p = src - 2;
+		*f = 1.0;
+	}
+}
+
+/* floating point bilinear filter of one plane with interleaved samples */
+static void reference_bilinear_plane(uint8_t *dst, int dst_step, const uint8_t *src, int linesize, int src_cx,
+				     int src_cy, int dst_cx, int dst_cy, int src_step)
+{
+	for (int y = 0; y < dst_cy; y++) {
+		int y0;
+		double fy;
+
+		reference_coord(y, src_cy, dst_cy, &y0, &fy);
+
+		for (int x = 0; x < dst_cx; x++) {
+			const uint8_t *row0 = src + y0 * linesize;
+			const uint8_t *row1 = row0 + linesize;
+			int x0;
+			double fx;
+
+			reference_coord(x, src_cx, dst_cx, &x0, &fx);
+			x0 *= src_step;
+
+			double top = row0[x0] + (row0[x0 + src_step] - row0[x0]) * fx;
+			double bot = row1[x0] + (row1[x0 + src_step] - row1[x0]) * fx;
+			double v = top + (bot - top) * fy;
+
+			dst[(y * dst_cx + x) * dst_step] = (uint8_t)(v + 0.5);
+		}
+	}
+}
+
+static double psnr(const uint8_t *a, const uint8_t *b, size_t size)
+{
+	double sum = 0.0;
+
+	for (size_t i = 0; i < size; i++) {
+		double d = (double)a[i] - (double)b[i];
+		sum += d * d;
+	}
+
+	if (sum == 0.0)
+		return INFINITY;
+	return 10.0 * log10(255.0 * 255.0 * size / sum);
+}
+
+static void nearest_compat_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int sizes[][4] = {
+		{1920, 1080, 1280, 720},
+		{640, 480, 1000, 700},
+		{1280, 720, 642, 362},
+	};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		const int src_cx = sizes[i][0], src_cy = sizes[i][1];
+		const int dst_cx = sizes[i][2], dst_cy = sizes[i][3];
+		const size_t dst_size = dst_cx * dst_cy * 3 / 2;
+		uint8_t *src = create_image(src_cx, src_cy);
+		uint8_t *expected = bmalloc(dst_size);
+		uint8_t *actual = bmalloc(dst_size);
+		nv12_scale_t scale;
+
+		for (int i420 = 0; i420 < 2; i420++) {
+			assert_true(nv12_scale_init(&scale, i420 ? TARGET_FORMAT_I420 : TARGET_FORMAT_NV12, dst_cx,
+						    dst_cy, src_cx, src_cy));
+			nv12_do_scale(&scale, actual, src);
+			nv12_scale_free(&scale);
+			reference_nearest(expected, src, src_cx, src_cy, dst_cx, dst_cy, i420);
+			assert_memory_equal(actual, expected, dst_size);
+		}
+
+		bfree(src);
+		bfree(expected);
+		bfree(actual);
+	}
+}
+
+static void bilinear_psnr_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const int sizes[][4] = {
+		{3840, 2160, 1920, 1080},
+		{1920, 1080, 1280, 720},
+		{640, 360, 1280, 720},
+		{1000, 700, 999, 701},
+	};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		const int src_cx = sizes[i][0], src_cy = sizes[i][1];
+		const int dst_cx = sizes[i][2], dst_cy = sizes[i][3];
+		const int dst_luma = dst_cx * dst_cy;
+		const int dst_chroma = (dst_cx / 2) * (dst_cy / 2);
+		const size_t dst_size = dst_luma + dst_chroma * 2;
+		uint8_t *src = create_image(src_cx, src_cy);
+		uint8_t *expected = bzalloc(dst_size);
+		uint8_t *nv12 = bzalloc(dst_size);
+		uint8_t *i420 = bzalloc(dst_size);
+		nv12_scale_t scale;
+
+		reference_bilinear_plane(expected, 1, src, src_cx, src_cx, src_cy, dst_cx, dst_cy, 1);
+		for (int c = 0; c < 2; c++)
+			reference_bilinear_plane(expected + dst_luma + c, 2, src + src_cx * src_cy + c, src_cx,
+						 src_cx / 2, src_cy / 2, dst_cx / 2, dst_cy / 2, 2);
+
+		assert_true(nv12_scale_init_filter(&scale, TARGET_FORMAT_NV12, SCALE_FILTER_BILINEAR, dst_cx, dst_cy,
+						   src_cx, src_cy));
+		nv12_do_scale(&scale, nv12, src);
+		nv12_scale_free(&scale);
+
+		double luma = psnr(nv12, expected, dst_luma);
+		double chroma = psnr(nv12 + dst_luma, expected + dst_luma, dst_chroma * 2);
+
+		print_message("bilinear %dx%d -> %dx%d: PSNR luma %.2f dB, chroma %.2f dB\n", src_cx, src_cy, dst_cx,
+			      dst_cy, luma, chroma);
+		assert_true(luma > 45.0);
+		assert_true(chroma > 45.0);
+
+		/* I420 output carries the same samples, deinterleaved */
+		assert_true(nv12_scale_init_filter(&scale, TARGET_FORMAT_I420, SCALE_FILTER_BILINEAR, dst_cx, dst_cy,
+						   src_cx, src_cy));
+		nv12_do_scale(&scale, i420, src);
+		nv12_scale_free(&scale);
+
+		assert_memory_equal(i420, nv12, dst_luma);
+		for (int j = 0; j < dst_chroma; j++) {
+			assert_int_equal(i420[dst_luma + j], nv12[dst_luma + j * 2]);
+			assert_int_equal(i420[dst_luma + dst_chroma + j], nv12[dst_luma + j * 2 + 1]);
+		}
+
+		bfree(src);
+		bfree(expected);
+		bfree(nv12);
+		bfree(i420);
+	}
+}
+
+static void benchmark(const char *name, enum scale_filter filter, int src_cx, int src_cy, int dst_cx, int dst_cy)
+{
+	const int iterations = 20;
+	uint8_t *src = create_image(src_cx, src_cy);
+	uint8_t *dst = bmalloc(dst_cx * dst_cy * 3 / 2);
+	nv12_scale_t scale;
+
+	nv12_scale_init_filter(&scale, TARGET_FORMAT_NV12, filter, dst_cx, dst_cy, src_cx, src_cy);
+	nv12_do_scale(&scale, dst, src);
+
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < iterations; i++)
+		nv12_do_scale(&scale, dst, src);
+	uint64_t elapsed = os_gettime_ns() - start;
+
+	print_message("%s %dx%d -> %dx%d: %.3f ms/frame\n", name, src_cx, src_cy, dst_cx, dst_cy,
+		      (double)elapsed / iterations / 1000000.0);
+
+	nv12_scale_free(&scale);
+	bfree(src);
+	bfree(dst);
+}
+
+static void scale_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	benchmark("nearest ", SCALE_FILTER_NEAREST, 3840, 2160, 1920, 1080);
+	benchmark("bilinear", SCALE_FILTER_BILINEAR, 3840, 2160, 1920, 1080);
+	benchmark("nearest ", SCALE_FILTER_NEAREST, 1920, 1080, 1280, 720);
+	benchmark("bilinear", SCALE_FILTER_BILINEAR, 1920, 1080, 1280, 720);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(nearest_compat_test),
+		cmocka_unit_test(bilinear_psnr_test),
+		cmocka_unit_test(scale_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,274 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <linux/videodev2.h>
+
+#include "v4l2-decoder.h"
+
+#define WIDTH 640
+#define HEIGHT 360
+#define NUM_PACKETS 120
+#define FRAME_INTERVAL 8333333 /* 120 fps */
+
+/* an mjpeg stream as a webcam would send it, and the checksum of each frame
+ * as decoded by a plain codec context */
+static AVPacket *packets[NUM_PACKETS];
+static uint32_t expected_sums[NUM_PACKETS];
+
+static struct {
+	uint64_t timestamps[NUM_PACKETS];
+	uint32_t sums[NUM_PACKETS];
+	size_t count;
+	bool bad_format;
+} output;
+
+static uint32_t luma_sum(uint8_t *const data[], const int linesize[])
+{
+	uint32_t sum = 0;
+
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++)
+			sum = sum * 31 + data[0][y * linesize[0] + x];
+	}
+
+	return sum;
+}
+
+/* the decoder under test outputs here instead of to a source */
+void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame)
+{
+	UNUSED_PARAMETER(source);
+
+	if (output.count == NUM_PACKETS)
+		return;
+
+	if (frame->format != VIDEO_FORMAT_I420)
+		output.bad_format = true;
+
+	output.timestamps[output.count] = frame->timestamp;
+	output.sums[output.count] = luma_sum(frame->data, (const int *)frame->linesize);
+	output.count++;
+}
+
+static void fill_picture(AVFrame *frame, int idx)
+{
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++)
+			frame->data[0][y * frame->linesize[0] + x] = (uint8_t)(x + y * 2 + idx * 5);
+	}
+
+	for (int c = 1; c < 3; c++) {
+		for (int y = 0; y < HEIGHT / 2; y++)
+			memset(frame->data[c] + y * frame->linesize[c], 128 + (idx + c * 16) % 64, WIDTH / 2);
+	}
+}
+
+static int setup_stream(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+	const AVCodec *decoder = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+	AVCodecContext *enc = avcodec_alloc_context3(encoder);
+	AVCodecContext *dec = avcodec_alloc_context3(decoder);
+	AVFrame *frame = av_frame_alloc();
+	AVFrame *decoded = av_frame_alloc();
+	AVPacket *packet = av_packet_alloc();
+
+	enc->width = WIDTH;
+	enc->height = HEIGHT;
+	enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+	enc->time_base = (AVRational){1, 120};
+	if (avcodec_open2(enc, encoder, NULL) < 0 || avcodec_open2(dec, decoder, NULL) < 0)
+		return -1;
+
+	frame->width = WIDTH;
+	frame->height = HEIGHT;
+	frame->format = AV_PIX_FMT_YUVJ420P;
+	if (av_frame_get_buffer(frame, 0) < 0)
+		return -1;
+
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		if (av_frame_make_writable(frame) < 0)
+			return -1;
+
+		fill_picture(frame, i);
+		frame->pts = i;
+
+		if (avcodec_send_frame(enc, frame) < 0 || avcodec_receive_packet(enc, packet) < 0)
+			return -1;
+
+		packets[i] = av_packet_clone(packet);
+		av_packet_unref(packet);
+
+		if (avcodec_send_packet(dec, packets[i]) < 0 || avcodec_receive_frame(dec, decoded) < 0)
+			return -1;
+
+		expected_sums[i] = luma_sum(decoded->data, decoded->linesize);
+		av_frame_unref(decoded);
+	}
+
+	av_packet_free(&packet);
+	av_frame_free(&decoded);
+	av_frame_free(&frame);
+	avcodec_free_context(&dec);
+	avcodec_free_context(&enc);
+	return 0;
+}
+
+static int teardown_stream(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int i = 0; i < NUM_PACKETS; i++)
+		av_packet_free(&packets[i]);
+	return 0;
+}
+
+static void prep_frame(struct obs_source_frame *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->width = WIDTH;
+	out->height = HEIGHT;
+	memset(&output, 0, sizeof(output));
+}
+
+/* replays the stream like the capture thread does: the capture buffer is
+ * reused right after the copy, and every frame comes out once, in order */
+static void mjpeg_replay_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct v4l2_decoder decoder;
+	struct obs_source_frame out;
+	uint8_t *capture_buffer = malloc(WIDTH * HEIGHT * 3);
+
+	assert_int_equal(v4l2_init_decoder(&decoder, V4L2_PIX_FMT_MJPEG), 0);
+	assert_true(decoder.num_workers >= 2);
+	prep_frame(&out);
+
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		size_t size = (size_t)packets[i]->size;
+
+		memcpy(capture_buffer, packets[i]->data, size);
+		assert_int_equal(v4l2_copy_packet(&decoder, capture_buffer, size, (uint64_t)i * FRAME_INTERVAL), 0);
+		memset(capture_buffer, 0, size);
+
+		assert_int_equal(v4l2_decode_packet(&decoder, NULL, &out), 0);
+		assert_true(decoder.submitted - decoder.delivered < decoder.num_workers);
+		assert_int_equal(output.count, decoder.delivered);
+	}
+
+	assert_int_equal(v4l2_flush_decoder(&decoder, NULL, &out), 0);
+	assert_int_equal(output.count, NUM_PACKETS);
+	assert_false(output.bad_format);
+
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		assert_int_equal(output.timestamps[i], (uint64_t)i * FRAME_INTERVAL);
+		assert_int_equal(output.sums[i], expected_sums[i]);
+	}
+
+	v4l2_destroy_decoder(&decoder);
+	free(capture_buffer);
+}
+
+/* a corrupt packet is reported, but doesn't hold up or reorder the frames
+ * after it */
+static void mjpeg_corrupt_packet_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const uint8_t garbage[64] = {0};
+	struct v4l2_decoder decoder;
+	struct obs_source_frame out;
+	bool failed = false;
+
+	assert_int_equal(v4l2_init_decoder(&decoder, V4L2_PIX_FMT_MJPEG), 0);
+	prep_frame(&out);
+
+	for (int i = 0; i < 8; i++) {
+		uint8_t *data = i == 3 ? (uint8_t *)garbage : packets[i]->data;
+		size_t size = i == 3 ? sizeof(garbage) : (size_t)packets[i]->size;
+
+		assert_int_equal(v4l2_copy_packet(&decoder, data, size, (uint64_t)i * FRAME_INTERVAL), 0);
+		if (v4l2_decode_packet(&decoder, NULL, &out) < 0)
+			failed = true;
+	}
+
+	if (v4l2_flush_decoder(&decoder, NULL, &out) < 0)
+		failed = true;
+
+	assert_true(failed);
+	assert_int_equal(output.count, 7);
+	for (int i = 0, j = 0; i < 8; i++) {
+		if (i == 3)
+			continue;
+		assert_int_equal(output.timestamps[j], (uint64_t)i * FRAME_INTERVAL);
+		assert_int_equal(output.sums[j], expected_sums[i]);
+		j++;
+	}
+
+	v4l2_destroy_decoder(&decoder);
+}
+
+static void mjpeg_replay_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+	AVCodecContext *context = avcodec_alloc_context3(codec);
+	AVFrame *frame = av_frame_alloc();
+	struct v4l2_decoder decoder;
+	struct obs_source_frame out;
+	uint64_t start;
+
+	assert_int_equal(avcodec_open2(context, codec, NULL), 0);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		avcodec_send_packet(context, packets[i]);
+		avcodec_receive_frame(context, frame);
+	}
+	double single = (double)(os_gettime_ns() - start) / NUM_PACKETS / 1000000.0;
+
+	assert_int_equal(v4l2_init_decoder(&decoder, V4L2_PIX_FMT_MJPEG), 0);
+	prep_frame(&out);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_PACKETS; i++) {
+		v4l2_copy_packet(&decoder, packets[i]->data, packets[i]->size, (uint64_t)i * FRAME_INTERVAL);
+		v4l2_decode_packet(&decoder, NULL, &out);
+	}
+	v4l2_flush_decoder(&decoder, NULL, &out);
+	double pool = (double)(os_gettime_ns() - start) / NUM_PACKETS / 1000000.0;
+
+	print_message("mjpeg %dx%d: 1 context %.2f ms/frame, %zu workers %.2f ms/frame, "
+		      "avg latency %.2f ms\n",
+		      WIDTH, HEIGHT, single, decoder.num_workers, pool,
+		      (double)decoder.latency_ns / decoder.frames / 1000000.0);
+
+	v4l2_destroy_decoder(&decoder);
+	av_frame_free(&frame);
+	avcodec_free_context(&context);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(mjpeg_replay_test),
+		cmocka_unit_test(mjpeg_corrupt_packet_test),
+		cmocka_unit_test(mjpeg_replay_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, setup_stream, teardown_stream);
+}
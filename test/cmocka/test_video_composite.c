@@ -0,0 +1,564 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/video-composite.h>
+#include <media-io/video-frame.h>
+#include <obs-video-cpu.h>
+
+struct image {
+	uint8_t *data;
+	uint32_t linesize;
+	uint32_t width;
+	uint32_t height;
+};
+
+static void image_init(struct image *image, uint32_t width, uint32_t height)
+{
+	image->width = width;
+	image->height = height;
+	image->linesize = width * 4;
+	image->data = bzalloc((size_t)image->linesize * height);
+}
+
+static void image_free(struct image *image)
+{
+	bfree(image->data);
+}
+
+static inline uint8_t *pixel(const struct image *image, uint32_t x, uint32_t y)
+{
+	return image->data + (size_t)y * image->linesize + (size_t)x * 4;
+}
+
+static void fill_noise(struct image *image, bool opaque)
+{
+	for (size_t i = 0; i < (size_t)image->linesize * image->height; i++)
+		image->data[i] = (i & 3) == 3 && opaque ? 255 : (uint8_t)rand();
+}
+
+static void fill_color(struct image *image, uint32_t rgba)
+{
+	for (uint32_t y = 0; y < image->height; y++)
+		for (uint32_t x = 0; x < image->width; x++)
+			memcpy(pixel(image, x, y), &rgba, 4);
+}
+
+static struct video_composite_layer make_layer(const struct image *image, float x, float y, float cx, float cy)
+{
+	struct video_composite_layer layer = {
+		.data = image->data,
+		.linesize = image->linesize,
+		.width = image->width,
+		.height = image->height,
+		.src_cx = (float)image->width,
+		.src_cy = (float)image->height,
+		.dst_x = x,
+		.dst_y = y,
+		.dst_cx = cx,
+		.dst_cy = cy,
+		.filter = VIDEO_COMPOSITE_BILINEAR,
+	};
+	return layer;
+}
+
+static void assert_transparent(const struct image *canvas, uint32_t x, uint32_t y)
+{
+	static const uint8_t zero[4] = {0};
+	assert_memory_equal(pixel(canvas, x, y), zero, 4);
+}
+
+/* translation, cropping, flipping, point scaling and clipping move pixels
+ * without changing them */
+static void placement_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct image src, canvas;
+	struct video_composite_layer layer;
+
+	image_init(&src, 37, 23);
+	image_init(&canvas, 128, 96);
+	fill_noise(&src, true);
+
+	/* translated */
+	layer = make_layer(&src, 10.0f, 20.0f, 37.0f, 23.0f);
+	layer.opaque = true;
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+	for (uint32_t y = 0; y < src.height; y++)
+		assert_memory_equal(pixel(&canvas, 10, 20 + y), pixel(&src, 0, y), src.linesize);
+	assert_transparent(&canvas, 9, 20);
+	assert_transparent(&canvas, 47, 20);
+	assert_transparent(&canvas, 10, 19);
+	assert_transparent(&canvas, 10, 43);
+
+	/* cropped, and partly off the canvas */
+	layer = make_layer(&src, -2.0f, 90.0f, 30.0f, 20.0f);
+	layer.src_x = 5.0f;
+	layer.src_y = 1.0f;
+	layer.src_cx = 30.0f;
+	layer.src_cy = 20.0f;
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+	for (uint32_t y = 0; y < 6; y++)
+		assert_memory_equal(pixel(&canvas, 0, 90 + y), pixel(&src, 7, 1 + y), 28 * 4);
+	assert_transparent(&canvas, 28, 90);
+
+	/* flipped both ways */
+	layer = make_layer(&src, 50.0f, 40.0f, -37.0f, -23.0f);
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+	for (uint32_t y = 0; y < src.height; y++)
+		for (uint32_t x = 0; x < src.width; x++)
+			assert_memory_equal(pixel(&canvas, 13 + x, 17 + y), pixel(&src, src.width - 1 - x, src.height - 1 - y),
+					    4);
+
+	/* doubled with point sampling, then clipped */
+	layer = make_layer(&src, 0.0f, 0.0f, 74.0f, 46.0f);
+	layer.filter = VIDEO_COMPOSITE_POINT;
+	layer.clip = true;
+	layer.clip_x = 4;
+	layer.clip_y = 2;
+	layer.clip_cx = 60;
+	layer.clip_cy = 40;
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+	for (uint32_t y = 0; y < 46; y++) {
+		for (uint32_t x = 0; x < 74; x++) {
+			if (x < 4 || x >= 64 || y < 2 || y >= 42)
+				assert_transparent(&canvas, x, y);
+			else
+				assert_memory_equal(pixel(&canvas, x, y), pixel(&src, x / 2, y / 2), 4);
+		}
+	}
+
+	image_free(&src);
+	image_free(&canvas);
+}
+
+/* layers are blended in order with the default blend state */
+static void blend_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct image back, front, canvas;
+	struct video_composite_layer layers[2];
+
+	image_init(&back, 64, 64);
+	image_init(&front, 64, 64);
+	image_init(&canvas, 64, 64);
+
+	fill_color(&back, 0xFFFF0000);
+	layers[0] = make_layer(&back, 0.0f, 0.0f, 64.0f, 32.0f);
+	layers[0].opaque = true;
+	layers[1] = make_layer(&front, 0.0f, 0.0f, 64.0f, 64.0f);
+
+	for (uint32_t a = 0; a < 256; a += 5) {
+		fill_color(&front, (a << 24) | 0x000064C8);
+
+		for (int simd = 0; simd < 2; simd++) {
+			video_composite_set_simd(simd);
+			video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, layers, 2, NULL);
+
+			/* over the opaque layer */
+			const uint8_t *p = pixel(&canvas, 33, 10);
+			assert_int_equal(p[0], (200 * a + 127) / 255);
+			assert_int_equal(p[1], (100 * a + 127) / 255);
+			assert_int_equal(p[2], (255 * (255 - a) + 127) / 255);
+			assert_int_equal(p[3], 255);
+
+			/* over the cleared canvas */
+			p = pixel(&canvas, 33, 50);
+			assert_int_equal(p[0], (200 * a + 127) / 255);
+			assert_int_equal(p[3], a);
+		}
+	}
+
+	image_free(&back);
+	image_free(&front);
+	image_free(&canvas);
+}
+
+/* bilinear scaling interpolates between pixels and clamps at the edges */
+static void bilinear_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct image src, canvas;
+
+	image_init(&src, 2, 1);
+	image_init(&canvas, 8, 1);
+	fill_color(&src, 0xFF000000);
+	pixel(&src, 1, 0)[0] = 128;
+
+	struct video_composite_layer layer = make_layer(&src, 0.0f, 0.0f, 8.0f, 1.0f);
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+
+	static const uint8_t expected[8] = {0, 0, 16, 48, 80, 112, 128, 128};
+	for (uint32_t x = 0; x < 8; x++) {
+		assert_int_equal(pixel(&canvas, x, 0)[0], expected[x]);
+		assert_int_equal(pixel(&canvas, x, 0)[3], 255);
+	}
+
+	image_free(&src);
+	image_free(&canvas);
+}
+
+static float random_float(float min, float max)
+{
+	return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+/* randomly placed, scaled and cropped layers give the same canvas with and
+ * without SIMD, on one thread and on several */
+static void simd_exact_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct image sources[6], expected, actual;
+	struct video_composite_layer layers[12];
+	os_task_pool_t *pool = os_task_pool_create("video composite test", 3);
+
+	for (int i = 0; i < 6; i++) {
+		image_init(&sources[i], 17 + rand() % 300, 9 + rand() % 200);
+		fill_noise(&sources[i], i == 0);
+	}
+	image_init(&expected, 322, 181);
+	image_init(&actual, 322, 181);
+
+	for (int round = 0; round < 50; round++) {
+		for (int i = 0; i < 12; i++) {
+			const struct image *src = &sources[rand() % 6];
+			float cx = random_float(-400.0f, 400.0f);
+			float cy = random_float(-250.0f, 250.0f);
+
+			layers[i] = make_layer(src, random_float(-80.0f, 320.0f), random_float(-50.0f, 180.0f), cx, cy);
+			layers[i].src_x = random_float(0.0f, (float)src->width / 2);
+			layers[i].src_y = random_float(0.0f, (float)src->height / 2);
+			layers[i].src_cx = random_float(1.0f, (float)src->width - layers[i].src_x);
+			layers[i].src_cy = random_float(1.0f, (float)src->height - layers[i].src_y);
+			layers[i].filter = rand() % 4 ? VIDEO_COMPOSITE_BILINEAR : VIDEO_COMPOSITE_POINT;
+			layers[i].opaque = src == &sources[0];
+
+			if (rand() % 3 == 0) {
+				layers[i].clip = true;
+				layers[i].clip_x = rand() % 200 - 20;
+				layers[i].clip_y = rand() % 100 - 20;
+				layers[i].clip_cx = rand() % 200;
+				layers[i].clip_cy = rand() % 150;
+			}
+		}
+
+		video_composite_set_simd(false);
+		video_composite(expected.data, expected.linesize, expected.width, expected.height, layers, 12, NULL);
+		video_composite_set_simd(true);
+		video_composite(actual.data, actual.linesize, actual.width, actual.height, layers, 12, NULL);
+		assert_memory_equal(actual.data, expected.data, (size_t)expected.linesize * expected.height);
+
+		video_composite(actual.data, actual.linesize, actual.width, actual.height, layers, 12, pool);
+		assert_memory_equal(actual.data, expected.data, (size_t)expected.linesize * expected.height);
+	}
+
+	for (int i = 0; i < 6; i++)
+		image_free(&sources[i]);
+	image_free(&expected);
+	image_free(&actual);
+	os_task_pool_destroy(pool);
+}
+
+/* a flipped async frame, cropped and mirrored by its scene item, in a nested
+ * scene that's drawn at half size and clipped by its own item */
+static void flatten_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct obs_sceneitem_crop no_crop = {0, 0, 0, 0};
+	struct obs_sceneitem_crop crop = {2, 1, 0, 3};
+	struct cpu_draw draw = {
+		.transform = {1.0f, 1.0f, 0.0f, 0.0f},
+		.clip_right = 64,
+		.clip_bottom = 64,
+		.filter = VIDEO_COMPOSITE_POINT,
+	};
+	struct video_composite_layer layer;
+	struct image frame, canvas;
+	struct matrix4 m;
+
+	image_init(&frame, 16, 8);
+	image_init(&canvas, 64, 64);
+
+	for (uint32_t y = 0; y < frame.height; y++) {
+		for (uint32_t x = 0; x < frame.width; x++) {
+			uint8_t *p = pixel(&frame, x, y);
+			p[0] = (uint8_t)(x * 10);
+			p[1] = (uint8_t)(y * 10);
+			p[2] = 77;
+			p[3] = 255;
+		}
+	}
+
+	/* the 36x40 scene, at half size at 8, 4 */
+	matrix4_identity(&m);
+	m.x.x = 0.5f;
+	m.y.y = 0.5f;
+	m.t.x = 8.0f;
+	m.t.y = 4.0f;
+	cpu_enter_item(&draw, &m, &no_crop, &no_crop, 36, 40);
+
+	/* the frame, mirrored at twice its size with the right edge of its
+	 * cropped area at 38, 20 */
+	matrix4_identity(&m);
+	m.x.x = -2.0f;
+	m.y.y = 2.0f;
+	m.t.x = 38.0f;
+	m.t.y = 20.0f;
+	cpu_enter_item(&draw, &m, &crop, &no_crop, frame.width, frame.height);
+	assert_false(cpu_clip_empty(&draw));
+	assert_int_equal(draw.depth, 2);
+
+	struct obs_cpu_image image = {frame.data, frame.linesize, frame.width, frame.height};
+	assert_true(cpu_make_layer(&draw, &image, true, &layer));
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, &layer, 1, NULL);
+
+	/* the shown rows 1 to 4 are the data rows 6 to 3, the columns 2 to 15
+	 * are mirrored onto 27 to 13 and the scene clips column 26 */
+	for (uint32_t y = 0; y < canvas.height; y++) {
+		for (uint32_t x = 0; x < canvas.width; x++) {
+			if (x >= 13 && x < 26 && y >= 14 && y < 18) {
+				const uint8_t *p = pixel(&canvas, x, y);
+				assert_int_equal(p[0], (28 - x) * 10);
+				assert_int_equal(p[1], (20 - y) * 10);
+				assert_int_equal(p[2], 77);
+				assert_int_equal(p[3], 255);
+			} else {
+				assert_transparent(&canvas, x, y);
+			}
+		}
+	}
+
+	draw.crop.left = 16;
+	assert_false(cpu_make_layer(&draw, &image, true, &layer));
+
+	image_free(&frame);
+	image_free(&canvas);
+}
+
+/* BT.709 limited range, as given by video_format_get_parameters */
+static const float bt709_limited[16] = {
+	1.164384f, 0.000000f,  1.792741f,  -0.972945f, 1.164384f, -0.213249f, -0.532909f, 0.301483f,
+	1.164384f, 2.112402f,  0.000000f,  -1.133402f, 0.000000f, 0.000000f,  0.000000f,  1.000000f,
+};
+
+static const enum video_format convert_formats[] = {
+	VIDEO_FORMAT_I420, VIDEO_FORMAT_NV12, VIDEO_FORMAT_I422, VIDEO_FORMAT_I444, VIDEO_FORMAT_YVYU,
+	VIDEO_FORMAT_YUY2, VIDEO_FORMAT_UYVY, VIDEO_FORMAT_Y800, VIDEO_FORMAT_BGRA, VIDEO_FORMAT_BGRX,
+};
+
+#define NUM_CONVERT_FORMATS (sizeof(convert_formats) / sizeof(convert_formats[0]))
+
+static void fill_frame(struct video_frame *frame, enum video_format format, uint32_t height, int value)
+{
+	const bool half_height_chroma = format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12;
+
+	for (int i = 0; i < MAX_AV_PLANES; i++) {
+		if (!frame->data[i])
+			continue;
+
+		size_t size = (size_t)frame->linesize[i] * (i && half_height_chroma ? (height + 1) / 2 : height);
+		for (size_t j = 0; j < size; j++)
+			frame->data[i][j] = value < 0 ? (uint8_t)rand() : (uint8_t)value;
+	}
+}
+
+/* frames convert the same way with and without SIMD, and limited range
+ * black and white map to full range */
+static void convert_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t width = 99, height = 34;
+	os_task_pool_t *pool = os_task_pool_create("video composite test", 3);
+	struct image expected, actual;
+
+	image_init(&expected, width, height);
+	image_init(&actual, width, height);
+
+	for (size_t f = 0; f < NUM_CONVERT_FORMATS; f++) {
+		const enum video_format format = convert_formats[f];
+		struct video_frame frame;
+
+		assert_true(video_composite_format_supported(format));
+		video_frame_init(&frame, format, width, height);
+		fill_frame(&frame, format, height, -1);
+
+		video_composite_set_simd(false);
+		video_composite_convert(expected.data, expected.linesize, (const uint8_t *const *)frame.data,
+					frame.linesize, format, width, height, bt709_limited, NULL);
+		video_composite_set_simd(true);
+		video_composite_convert(actual.data, actual.linesize, (const uint8_t *const *)frame.data,
+					frame.linesize, format, width, height, bt709_limited, pool);
+		assert_memory_equal(actual.data, expected.data, (size_t)expected.linesize * height);
+
+		if (format_is_yuv(format)) {
+			static const struct {
+				uint8_t y;
+				uint8_t rgb;
+			} levels[] = {{16, 0}, {235, 255}};
+
+			for (int l = 0; l < 2; l++) {
+				fill_frame(&frame, format, height, 128);
+				if (format == VIDEO_FORMAT_UYVY || format == VIDEO_FORMAT_YUY2 ||
+				    format == VIDEO_FORMAT_YVYU) {
+					const size_t offset = format == VIDEO_FORMAT_UYVY ? 1 : 0;
+					for (size_t i = offset; i < (size_t)frame.linesize[0] * height; i += 2)
+						frame.data[0][i] = levels[l].y;
+				} else {
+					memset(frame.data[0], levels[l].y, (size_t)frame.linesize[0] * height);
+				}
+
+				video_composite_convert(actual.data, actual.linesize,
+							(const uint8_t *const *)frame.data, frame.linesize, format,
+							width, height, bt709_limited, pool);
+
+				const uint8_t *p = pixel(&actual, width - 1, height - 1);
+				for (int c = 0; c < 3; c++)
+					assert_int_equal(p[c], levels[l].rgb);
+				assert_int_equal(p[3], 255);
+			}
+		}
+
+		video_frame_free(&frame);
+	}
+
+	assert_false(video_composite_format_supported(VIDEO_FORMAT_P010));
+
+	image_free(&expected);
+	image_free(&actual);
+	os_task_pool_destroy(pool);
+}
+
+#define BENCH_CX 1920
+#define BENCH_CY 1080
+#define BENCH_ITERATIONS 30
+
+static double bench_composite(const struct image *canvas, const struct video_composite_layer *layers, size_t count,
+			      os_task_pool_t *pool)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		video_composite(canvas->data, canvas->linesize, canvas->width, canvas->height, layers, count, pool);
+
+	return (double)(os_gettime_ns() - start) / BENCH_ITERATIONS / 1000000.0;
+}
+
+/* a 1080p scene of ten items: a full screen background, four camera feeds
+ * scaled into a grid, a picture in picture, two cropped captures and two
+ * translucent overlays */
+static void composite_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	os_task_pool_t *pool = os_task_pool_create("video composite benchmark", 3);
+	struct image background, cameras[4], capture, overlay, logo, canvas;
+	struct video_composite_layer layers[10];
+
+	image_init(&background, BENCH_CX, BENCH_CY);
+	image_init(&capture, 2560, 1440);
+	image_init(&overlay, 1920, 200);
+	image_init(&logo, 300, 300);
+	image_init(&canvas, BENCH_CX, BENCH_CY);
+	fill_noise(&background, true);
+	fill_noise(&capture, true);
+	fill_noise(&overlay, false);
+	fill_noise(&logo, false);
+
+	layers[0] = make_layer(&background, 0.0f, 0.0f, BENCH_CX, BENCH_CY);
+	layers[0].opaque = true;
+
+	for (int i = 0; i < 4; i++) {
+		image_init(&cameras[i], 1280, 720);
+		fill_noise(&cameras[i], true);
+		layers[1 + i] = make_layer(&cameras[i], (float)(i % 2) * 640.0f, (float)(i / 2) * 360.0f, 640.0f,
+					   360.0f);
+		layers[1 + i].opaque = true;
+	}
+
+	layers[5] = make_layer(&cameras[0], 1300.0f, 60.0f, 560.0f, 315.0f);
+	layers[5].opaque = true;
+
+	layers[6] = make_layer(&capture, 1280.0f, 420.0f, 640.0f, 360.0f);
+	layers[6].src_x = 100.0f;
+	layers[6].src_cx = 2360.0f;
+	layers[6].opaque = true;
+
+	layers[7] = make_layer(&capture, 0.0f, 720.0f, 1280.0f, 260.0f);
+	layers[7].src_y = 900.0f;
+	layers[7].src_cx = 1280.0f;
+	layers[7].src_cy = 260.0f;
+	layers[7].opaque = true;
+
+	layers[8] = make_layer(&overlay, 0.0f, 880.0f, 1920.0f, 200.0f);
+	layers[9] = make_layer(&logo, 1720.0f, 20.0f, 150.0f, 150.0f);
+
+	/* warm up */
+	video_composite(canvas.data, canvas.linesize, canvas.width, canvas.height, layers, 10, NULL);
+
+	video_composite_set_simd(false);
+	double c = bench_composite(&canvas, layers, 10, NULL);
+	video_composite_set_simd(true);
+	double simd = bench_composite(&canvas, layers, 10, NULL);
+	double threaded = bench_composite(&canvas, layers, 10, pool);
+
+	print_message("1080p 10 items: C %.2f ms/frame, SIMD %.2f ms/frame, SIMD 4 threads %.2f ms/frame "
+		      "(%.0f fps, 60 needed)\n",
+		      c, simd, threaded, 1000.0 / threaded);
+
+	struct video_frame frame;
+	video_frame_init(&frame, VIDEO_FORMAT_NV12, BENCH_CX, BENCH_CY);
+	fill_frame(&frame, VIDEO_FORMAT_NV12, BENCH_CY, -1);
+
+	for (int simd_enabled = 0; simd_enabled < 2; simd_enabled++) {
+		video_composite_set_simd(simd_enabled);
+
+		uint64_t start = os_gettime_ns();
+		for (int i = 0; i < BENCH_ITERATIONS; i++)
+			video_composite_convert(canvas.data, canvas.linesize, (const uint8_t *const *)frame.data,
+						frame.linesize, VIDEO_FORMAT_NV12, BENCH_CX, BENCH_CY, bt709_limited,
+						NULL);
+		double ms = (double)(os_gettime_ns() - start) / BENCH_ITERATIONS / 1000000.0;
+
+		print_message("1080p NV12 to RGBA: %s %.2f ms/frame\n", simd_enabled ? "SIMD" : "C", ms);
+	}
+
+	video_frame_free(&frame);
+	image_free(&background);
+	for (int i = 0; i < 4; i++)
+		image_free(&cameras[i]);
+	image_free(&capture);
+	image_free(&overlay);
+	image_free(&logo);
+	image_free(&canvas);
+	os_task_pool_destroy(pool);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(placement_test),
+		cmocka_unit_test(blend_test),
+		cmocka_unit_test(bilinear_test),
+		cmocka_unit_test(simd_exact_test),
+		cmocka_unit_test(flatten_test),
+		cmocka_unit_test(convert_test),
+		cmocka_unit_test(composite_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
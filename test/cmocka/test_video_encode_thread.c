@@ -0,0 +1,174 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-io.h>
+#include <media-io/video-frame.h>
+
+#define CX 64
+#define CY 36
+#define FPS 60
+#define INTERVAL (1000000000ULL / FPS)
+
+/* frames a threaded input holds, including the one being processed, as
+ * MAX_QUEUED_FRAMES in video-io.c */
+#define QUEUED_FRAMES 3
+
+#define STALLED_FRAMES 10
+#define FREE_FRAMES 4
+#define NUM_FRAMES (STALLED_FRAMES + FREE_FRAMES)
+
+struct encoder {
+	uint64_t timestamps[NUM_FRAMES];
+	volatile long frames;
+	volatile long bad_frames;
+
+	/* posted for every frame received */
+	os_sem_t *received;
+
+	/* when set, every frame waits for a post before it's done */
+	os_sem_t *gate;
+};
+
+/* every frame carries its index in its first pixel, so an encoder that gets
+ * a cache slot that has already been reused sees a mismatch */
+static void encode(void *param, struct video_data *frame)
+{
+	struct encoder *enc = param;
+	long idx = os_atomic_load_long(&enc->frames);
+	uint64_t frame_idx = (frame->timestamp + INTERVAL / 2) / INTERVAL;
+
+	if (enc->gate)
+		os_sem_wait(enc->gate);
+
+	if (frame->data[0][0] != (uint8_t)frame_idx)
+		os_atomic_inc_long(&enc->bad_frames);
+	if (idx && frame->timestamp <= enc->timestamps[idx - 1])
+		os_atomic_inc_long(&enc->bad_frames);
+
+	if (idx < NUM_FRAMES)
+		enc->timestamps[idx] = frame->timestamp;
+	os_atomic_inc_long(&enc->frames);
+	os_sem_post(enc->received);
+}
+
+static void output_frame(video_t *video, struct encoder *fast, int i)
+{
+	struct video_frame frame;
+	uint64_t ts = (uint64_t)i * INTERVAL;
+
+	assert_true(video_output_lock_frame(video, &frame, 1, ts));
+	frame.data[0][0] = (uint8_t)i;
+	video_output_unlock_frame(video);
+
+	/* the fast encoder is the last input, so the video thread is done with
+	 * the frame once it got it */
+	os_sem_wait(fast->received);
+}
+
+/* a stalled encoder on its own thread drops the frames it can't keep up with,
+ * without holding up the encoders on the video thread, and the timestamps of
+ * the frames it does get show the gap */
+static void stalled_encoder_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct video_output_info info = {
+		.name = "encode thread test",
+		.format = VIDEO_FORMAT_NV12,
+		.fps_num = FPS,
+		.fps_den = 1,
+		.width = CX,
+		.height = CY,
+		.cache_size = 16,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	struct encoder fast = {0};
+	struct encoder slow = {0};
+	uint32_t total = 0, late = 0;
+	video_t *video;
+
+	assert_int_equal(os_sem_init(&fast.received, 0), 0);
+	assert_int_equal(os_sem_init(&slow.received, 0), 0);
+	assert_int_equal(os_sem_init(&slow.gate, 0), 0);
+
+	assert_int_equal(video_output_open(&video, &info), VIDEO_OUTPUT_SUCCESS);
+
+	/* inputs get frames in the order they connected, so the slow encoder's
+	 * frame is queued by the time the fast encoder has its own */
+	assert_true(video_output_connect_threaded(video, NULL, 1, encode, &slow));
+	assert_true(video_output_connect(video, NULL, encode, &fast));
+
+	assert_false(video_output_get_input_frames(video, encode, &fast, &total, &late));
+	assert_true(video_output_get_input_frames(video, encode, &slow, &total, &late));
+
+	/* the slow encoder is stuck on the first frame, so it holds that and
+	 * the queued ones, and the rest are dropped */
+	for (int i = 0; i < STALLED_FRAMES; i++)
+		output_frame(video, &fast, i);
+
+	assert_true(video_output_get_input_frames(video, encode, &slow, &total, &late));
+	assert_int_equal(total, STALLED_FRAMES);
+	assert_int_equal(late, STALLED_FRAMES - QUEUED_FRAMES);
+
+	for (int i = 0; i < QUEUED_FRAMES; i++) {
+		os_sem_post(slow.gate);
+		os_sem_wait(slow.received);
+	}
+
+	/* once it catches up, it gets every frame again */
+	for (int i = STALLED_FRAMES; i < NUM_FRAMES; i++) {
+		os_sem_post(slow.gate);
+		output_frame(video, &fast, i);
+		os_sem_wait(slow.received);
+	}
+
+	assert_true(video_output_get_input_frames(video, encode, &slow, &total, &late));
+	video_output_disconnect(video, encode, &fast);
+	video_output_disconnect(video, encode, &slow);
+
+	assert_int_equal(fast.frames, NUM_FRAMES);
+	assert_int_equal(fast.bad_frames, 0);
+
+	assert_int_equal(total, NUM_FRAMES);
+	assert_int_equal(late, STALLED_FRAMES - QUEUED_FRAMES);
+	assert_int_equal(slow.frames, QUEUED_FRAMES + FREE_FRAMES);
+	assert_int_equal(slow.bad_frames, 0);
+
+	assert_int_equal(slow.timestamps[QUEUED_FRAMES - 1], (QUEUED_FRAMES - 1) * INTERVAL);
+	assert_int_equal(slow.timestamps[QUEUED_FRAMES], STALLED_FRAMES * INTERVAL);
+
+	video_output_close(video);
+	os_sem_destroy(fast.received);
+	os_sem_destroy(slow.received);
+	os_sem_destroy(slow.gate);
+}
+
+/* the video thread names itself in the profiler of the core */
+static int setup_core(void **state)
+{
+	UNUSED_PARAMETER(state);
+	return obs_startup("en-US", NULL, NULL) ? 0 : -1;
+}
+
+static int teardown_core(void **state)
+{
+	UNUSED_PARAMETER(state);
+	obs_shutdown();
+	return 0;
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(stalled_encoder_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup_core, teardown_core);
+}
@@ -0,0 +1,273 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-frame.h>
+
+static const struct {
+	const char *name;
+	enum video_format format;
+	uint32_t planes;
+	bool half_height_chroma;
+} formats[] = {
+	{"NV12", VIDEO_FORMAT_NV12, 2, true},  {"P010", VIDEO_FORMAT_P010, 2, true},
+	{"I444", VIDEO_FORMAT_I444, 3, false}, {"P216", VIDEO_FORMAT_P216, 2, false},
+	{"P416", VIDEO_FORMAT_P416, 2, false}, {"BGRA", VIDEO_FORMAT_BGRA, 1, false},
+};
+
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static void get_plane_heights(uint32_t heights[MAX_AV_PLANES], enum video_format format, uint32_t cy)
+{
+	memset(heights, 0, sizeof(uint32_t) * MAX_AV_PLANES);
+
+	for (size_t f = 0; f < NUM_FORMATS; f++) {
+		if (formats[f].format != format)
+			continue;
+
+		for (uint32_t i = 0; i < formats[f].planes; i++)
+			heights[i] = i && formats[f].half_height_chroma ? (cy + 1) / 2 : cy;
+	}
+}
+
+static void fill_frame(struct video_frame *frame, enum video_format format, uint32_t cy)
+{
+	uint32_t heights[MAX_AV_PLANES];
+
+	get_plane_heights(heights, format, cy);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++) {
+		for (size_t j = 0; j < (size_t)frame->linesize[i] * heights[i]; j++)
+			frame->data[i][j] = (uint8_t)rand();
+	}
+}
+
+static void assert_frames_equal(const struct video_frame *a, const struct video_frame *b, enum video_format format,
+				uint32_t cy)
+{
+	uint32_t heights[MAX_AV_PLANES];
+
+	get_plane_heights(heights, format, cy);
+
+	for (uint32_t i = 0; i < MAX_AV_PLANES; i++) {
+		assert_int_equal(a->linesize[i], b->linesize[i]);
+		if (heights[i])
+			assert_memory_equal(a->data[i], b->data[i], (size_t)a->linesize[i] * heights[i]);
+	}
+}
+
+/* sizes below the threshold, on the threaded path and on the non-temporal
+ * path, against the plain single-threaded copy */
+static void copy_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	static const uint32_t sizes[][2] = {{64, 36}, {1922, 1082}, {3840, 2160}};
+	os_task_pool_t *pool = os_task_pool_create("video frame copy test", 3);
+
+	for (size_t f = 0; f < NUM_FORMATS; f++) {
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			const enum video_format format = formats[f].format;
+			const uint32_t cx = sizes[s][0], cy = sizes[s][1];
+			struct video_frame src, expected, actual;
+
+			video_frame_init(&src, format, cx, cy);
+			video_frame_init(&expected, format, cx, cy);
+			video_frame_init(&actual, format, cx, cy);
+			fill_frame(&src, format, cy);
+
+			video_frame_copy(&expected, &src, format, cy);
+			video_frame_copy_parallel(&actual, &src, format, cy, pool);
+			assert_frames_equal(&actual, &expected, format, cy);
+
+			memset(actual.data[0], 0, actual.linesize[0]);
+			video_frame_copy_parallel(&actual, &src, format, cy, NULL);
+			assert_frames_equal(&actual, &expected, format, cy);
+
+			video_frame_free(&src);
+			video_frame_free(&expected);
+			video_frame_free(&actual);
+		}
+	}
+
+	os_task_pool_destroy(pool);
+}
+
+/* a source frame with padded rows is copied row by row */
+static void copy_linesize_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	const uint32_t cx = 3840, cy = 2160, pad = 96;
+	os_task_pool_t *pool = os_task_pool_create("video frame copy test", 3);
+	struct video_frame src, dst;
+
+	video_frame_init(&dst, VIDEO_FORMAT_P010, cx, cy);
+
+	src.data[0] = bmalloc((size_t)(dst.linesize[0] + pad) * cy);
+	src.data[1] = bmalloc((size_t)(dst.linesize[1] + pad) * cy / 2);
+	src.linesize[0] = dst.linesize[0] + pad;
+	src.linesize[1] = dst.linesize[1] + pad;
+	for (int i = 2; i < MAX_AV_PLANES; i++) {
+		src.data[i] = NULL;
+		src.linesize[i] = 0;
+	}
+	fill_frame(&src, VIDEO_FORMAT_P010, cy);
+
+	video_frame_copy_parallel(&dst, &src, VIDEO_FORMAT_P010, cy, pool);
+
+	for (uint32_t y = 0; y < cy; y++)
+		assert_memory_equal(dst.data[0] + (size_t)y * dst.linesize[0], src.data[0] + (size_t)y * src.linesize[0],
+				    dst.linesize[0]);
+	for (uint32_t y = 0; y < cy / 2; y++)
+		assert_memory_equal(dst.data[1] + (size_t)y * dst.linesize[1], src.data[1] + (size_t)y * src.linesize[1],
+				    dst.linesize[1]);
+
+	bfree(src.data[0]);
+	bfree(src.data[1]);
+	video_frame_free(&dst);
+	os_task_pool_destroy(pool);
+}
+
+#define NUM_COPIERS 4
+#define COPIER_FRAMES 8
+
+struct copier {
+	os_task_pool_t *pool;
+	struct video_frame src;
+	struct video_frame dst;
+	bool failed;
+};
+
+static void *copier_thread(void *param)
+{
+	struct copier *copier = param;
+	uint32_t heights[MAX_AV_PLANES];
+
+	get_plane_heights(heights, VIDEO_FORMAT_NV12, 2160);
+
+	for (int i = 0; i < COPIER_FRAMES && !copier->failed; i++) {
+		memset(copier->dst.data[0], 0, (size_t)copier->dst.linesize[0] * heights[0]);
+		memset(copier->dst.data[1], 0, (size_t)copier->dst.linesize[1] * heights[1]);
+
+		video_frame_copy_parallel(&copier->dst, &copier->src, VIDEO_FORMAT_NV12, 2160, copier->pool);
+
+		for (int p = 0; p < 2; p++) {
+			if (memcmp(copier->dst.data[p], copier->src.data[p],
+				   (size_t)copier->src.linesize[p] * heights[p]) != 0)
+				copier->failed = true;
+		}
+	}
+
+	return NULL;
+}
+
+/* frames of several sources copied at once on one pool, some of them on
+ * their own thread while the pool is busy */
+static void copy_concurrent_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	os_task_pool_t *pool = os_task_pool_create("video frame copy test", 3);
+	struct copier *copiers = bzalloc(sizeof(*copiers) * NUM_COPIERS);
+	pthread_t threads[NUM_COPIERS];
+
+	for (int i = 0; i < NUM_COPIERS; i++) {
+		copiers[i].pool = pool;
+		video_frame_init(&copiers[i].src, VIDEO_FORMAT_NV12, 3840, 2160);
+		video_frame_init(&copiers[i].dst, VIDEO_FORMAT_NV12, 3840, 2160);
+		fill_frame(&copiers[i].src, VIDEO_FORMAT_NV12, 2160);
+		assert_int_equal(pthread_create(&threads[i], NULL, copier_thread, &copiers[i]), 0);
+	}
+
+	for (int i = 0; i < NUM_COPIERS; i++) {
+		pthread_join(threads[i], NULL);
+		assert_false(copiers[i].failed);
+		video_frame_free(&copiers[i].src);
+		video_frame_free(&copiers[i].dst);
+	}
+
+	bfree(copiers);
+	os_task_pool_destroy(pool);
+}
+
+#define BENCH_CX 3840
+#define BENCH_CY 2160
+#define BENCH_ITERATIONS 20
+
+static double bench_copy(struct video_frame *dst, const struct video_frame *src, enum video_format format,
+			 os_task_pool_t *pool, bool parallel)
+{
+	uint64_t start = os_gettime_ns();
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		if (parallel)
+			video_frame_copy_parallel(dst, src, format, BENCH_CY, pool);
+		else
+			video_frame_copy(dst, src, format, BENCH_CY);
+	}
+
+	return (double)(os_gettime_ns() - start) / BENCH_ITERATIONS / 1000000.0;
+}
+
+static void copy_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	if (!getenv("OBS_TEST_BENCHMARKS"))
+		skip();
+
+	os_task_pool_t *pool = os_task_pool_create("video frame copy benchmark", 3);
+
+	for (size_t f = 0; f < NUM_FORMATS; f++) {
+		const enum video_format format = formats[f].format;
+		uint32_t heights[MAX_AV_PLANES];
+		struct video_frame src, dst;
+		size_t size = 0;
+
+		video_frame_init(&src, format, BENCH_CX, BENCH_CY);
+		video_frame_init(&dst, format, BENCH_CX, BENCH_CY);
+		fill_frame(&src, format, BENCH_CY);
+
+		get_plane_heights(heights, format, BENCH_CY);
+		for (uint32_t i = 0; i < MAX_AV_PLANES; i++)
+			size += (size_t)src.linesize[i] * heights[i];
+
+		/* warm up both buffers */
+		video_frame_copy(&dst, &src, format, BENCH_CY);
+
+		double plain = bench_copy(&dst, &src, format, NULL, false);
+		double single = bench_copy(&dst, &src, format, NULL, true);
+		double threaded = bench_copy(&dst, &src, format, pool, true);
+		double mb = (double)size / (1024.0 * 1024.0);
+
+		print_message("%s %dx%d (%.1f MB): memcpy %.2f ms (%.1f GB/s), 1 thread %.2f ms (%.1f GB/s), "
+			      "4 threads %.2f ms (%.1f GB/s)\n",
+			      formats[f].name, BENCH_CX, BENCH_CY, mb, plain, mb / plain, single, mb / single, threaded,
+			      mb / threaded);
+
+		video_frame_free(&src);
+		video_frame_free(&dst);
+	}
+
+	os_task_pool_destroy(pool);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(copy_test),
+		cmocka_unit_test(copy_linesize_test),
+		cmocka_unit_test(copy_concurrent_test),
+		cmocka_unit_test(copy_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}